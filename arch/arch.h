@@ -34,6 +34,187 @@
 #  error "No architecuture detected. Check CFLAGS."
 #endif
 
+/* vector unit */
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE4_1__)
+#  include <smmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+
+/**
+ * @fn gref_arch_table32
+ * @brief dst[i] = table[src[i] & 0x1f] with the vector unit. returns the number
+ * of bytes converted (a multiple of the vector width), the remainder must be
+ * processed by the caller.
+ */
+static inline
+int64_t gref_arch_table32(
+	uint8_t *dst,
+	uint8_t const *src,
+	int64_t len,
+	uint8_t const *table)
+{
+	int64_t i = 0;
+
+#if defined(__AVX2__)
+	__m256i const tl = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)table));
+	__m256i const th = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)(table + 16)));
+	__m256i const lmask = _mm256_set1_epi8(0x0f);
+	__m256i const hmask = _mm256_set1_epi8(0x10);
+	for(; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i const *)&src[i]);
+		__m256i idx = _mm256_and_si256(v, lmask);
+		__m256i sel = _mm256_cmpeq_epi8(_mm256_and_si256(v, hmask), hmask);
+		__m256i r = _mm256_blendv_epi8(
+			_mm256_shuffle_epi8(tl, idx),
+			_mm256_shuffle_epi8(th, idx), sel);
+		_mm256_storeu_si256((__m256i *)&dst[i], r);
+	}
+#elif defined(__SSE4_1__)
+	__m128i const tl = _mm_loadu_si128((__m128i const *)table);
+	__m128i const th = _mm_loadu_si128((__m128i const *)(table + 16));
+	__m128i const lmask = _mm_set1_epi8(0x0f);
+	__m128i const hmask = _mm_set1_epi8(0x10);
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i const *)&src[i]);
+		__m128i idx = _mm_and_si128(v, lmask);
+		__m128i sel = _mm_cmpeq_epi8(_mm_and_si128(v, hmask), hmask);
+		__m128i r = _mm_blendv_epi8(
+			_mm_shuffle_epi8(tl, idx),
+			_mm_shuffle_epi8(th, idx), sel);
+		_mm_storeu_si128((__m128i *)&dst[i], r);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	uint8x16x2_t const t = { { vld1q_u8(table), vld1q_u8(table + 16) } };
+	uint8x16_t const mask = vdupq_n_u8(0x1f);
+	for(; i + 16 <= len; i += 16) {
+		uint8x16_t v = vandq_u8(vld1q_u8(&src[i]), mask);
+		vst1q_u8(&dst[i], vqtbl2q_u8(t, v));
+	}
+#endif
+	return(i);
+}
+
+/**
+ * @fn gref_arch_rev_table16
+ * @brief dst[i] = table[src[len - 1 - i] & 0x0f] (reverse and convert, e.g.
+ * reverse-complement of 4bit sequence). returns the number of bytes processed
+ * from the head of dst.
+ */
+static inline
+int64_t gref_arch_rev_table16(
+	uint8_t *dst,
+	uint8_t const *src,
+	int64_t len,
+	uint8_t const *table)
+{
+	int64_t i = 0;
+
+#if defined(__AVX2__)
+	__m256i const t = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)table));
+	__m256i const rv = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+	__m256i const mask = _mm256_set1_epi8(0x0f);
+	for(; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i const *)&src[len - i - 32]);
+		v = _mm256_permute2x128_si256(_mm256_shuffle_epi8(v, rv), v, 0x01);
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_shuffle_epi8(t, _mm256_and_si256(v, mask)));
+	}
+#elif defined(__SSE4_1__)
+	__m128i const t = _mm_loadu_si128((__m128i const *)table);
+	__m128i const rv = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i const mask = _mm_set1_epi8(0x0f);
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)&src[len - i - 16]), rv);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_shuffle_epi8(t, _mm_and_si128(v, mask)));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	uint8x16_t const t = vld1q_u8(table);
+	uint8x16_t const mask = vdupq_n_u8(0x0f);
+	for(; i + 16 <= len; i += 16) {
+		uint8x16_t v = vrev64q_u8(vld1q_u8(&src[len - i - 16]));
+		v = vextq_u8(v, v, 8);
+		vst1q_u8(&dst[i], vqtbl1q_u8(t, vandq_u8(v, mask)));
+	}
+#endif
+	return(i);
+}
+
+/**
+ * @fn gref_arch_ambiguous_run
+ * @brief length of the run of N (0x00 or 0x0f in the 4bit encoding) in p[0],
+ * p[incr], ..., p[(len - 1) * incr] (incr is 1 or -1).
+ */
+static inline
+int64_t gref_arch_ambiguous_run(
+	uint8_t const *p,
+	int64_t len,
+	int64_t incr)
+{
+	int64_t i = 0;
+
+#if defined(__AVX2__)
+	__m256i const n = _mm256_set1_epi8(0x0f), z = _mm256_setzero_si256();
+	for(; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i const *)((incr > 0) ? &p[i] : &p[-i - 31]));
+		uint32_t m = ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, n), _mm256_cmpeq_epi8(v, z)));
+		if(m != 0) {
+			return(i + ((incr > 0) ? __builtin_ctz(m) : __builtin_clz(m)));
+		}
+	}
+#elif defined(__SSE4_1__)
+	__m128i const n = _mm_set1_epi8(0x0f), z = _mm_setzero_si128();
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i const *)((incr > 0) ? &p[i] : &p[-i - 15]));
+		uint32_t m = 0xffff & ~(uint32_t)_mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, n), _mm_cmpeq_epi8(v, z)));
+		if(m != 0) {
+			return(i + ((incr > 0) ? __builtin_ctz(m) : __builtin_clz(m<<16)));
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	uint8x16_t const n = vdupq_n_u8(0x0f);
+	for(; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8((incr > 0) ? &p[i] : &p[-i - 15]);
+		if(vminvq_u8(vorrq_u8(vceqq_u8(v, n), vceqzq_u8(v))) == 0) { break; }	/* locate in the scalar loop */
+	}
+#endif
+
+	for(; i < len && (p[i * incr] == 0x00 || p[i * incr] == 0x0f); i++) {}
+	return(i);
+}
+
+/**
+ * @fn gref_arch_match16
+ * @brief bit i of the return value is set if p[i] == c, for 16 bytes from p.
+ */
+static inline
+uint32_t gref_arch_match16(
+	uint8_t const *p,
+	uint8_t c)
+{
+#if defined(__AVX2__) || defined(__SSE4_1__)
+	__m128i v = _mm_loadu_si128((__m128i const *)p);
+	return((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c))));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	static uint8_t const w[16] = {
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+	};
+	uint8x16_t b = vandq_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(c)), vld1q_u8(w));
+	return((uint32_t)vaddv_u8(vget_low_u8(b)) | ((uint32_t)vaddv_u8(vget_high_u8(b))<<8));
+#else
+	uint32_t m = 0;
+	for(int64_t i = 0; i < 16; i++) {
+		m |= (uint32_t)(p[i] == c)<<i;
+	}
+	return(m);
+#endif
+}
+
 
 #endif /* _ARCH_H_INCLUDED */
 /**
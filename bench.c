@@ -0,0 +1,455 @@
+
+/**
+ * @file bench.c
+ *
+ * @brief benchmark of the pool, archive, and index operations. each phase is
+ * reported in a tab-separated line:
+ *
+ *   workload  k  threads  phase  sec  count  count_per_sec  maxrss_kb
+ *
+ * count is bases (append, freeze), kmers (iterate, sort, build), or lookups
+ * (match, match_batch). maxrss_kb is the peak resident set size of the process
+ * after the phase. the workloads are generated from a fixed seed, thus the
+ * same command line gives the same inputs.
+ */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE				200112L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "psort/psort.h"
+#include "gref.h"
+
+/**
+ * @struct bench_params_s
+ */
+#define BENCH_MAX_SWEEP				( 16 )
+struct bench_params_s {
+	int64_t k[BENCH_MAX_SWEEP], k_cnt;
+	int64_t threads[BENCH_MAX_SWEEP], threads_cnt;
+	int64_t len;					/* total length of the generated workloads */
+	int64_t query_cnt;
+	uint64_t seed;
+	uint8_t build_mode;
+	uint8_t kmer_idx_type;			/* 0: the default of gref_init_pool */
+	uint32_t build_mem_kb;			/* GREF_BUILD_PARTITION */
+	uint8_t skip_sort;
+	uint8_t run_random;
+	uint8_t run_bubble;
+	char const *fasta;
+	char const *gfa;
+};
+
+/**
+ * @fn bench_rand
+ * @brief xorshift64, independent of the libc rand
+ */
+static
+uint64_t bench_rand(
+	uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x<<13; x ^= x>>7; x ^= x<<17;
+	return(*state = x);
+}
+
+/**
+ * @fn bench_generate_random_sequence
+ * @brief 4bit-encoded random sequence, as unittest_generate_random_sequence in gref.c
+ */
+static
+uint8_t *bench_generate_random_sequence(
+	uint64_t *state,
+	int64_t len)
+{
+	uint8_t *seq = (uint8_t *)malloc(len + 1);
+	if(seq == NULL) { return(NULL); }
+	for(int64_t i = 0; i < len; i++) {
+		seq[i] = 0x01<<(bench_rand(state) & 0x03);
+	}
+	return(seq);
+}
+
+/**
+ * @fn bench_now
+ */
+static
+double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/**
+ * @fn bench_report
+ */
+static
+void bench_report(
+	char const *workload,
+	int64_t k,
+	int64_t threads,
+	char const *phase,
+	double sec,
+	int64_t count)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%s\t%lld\t%lld\t%s\t%.6f\t%lld\t%.1f\t%ld\n",
+		workload, (long long)k, (long long)threads, phase,
+		sec, (long long)count, (sec > 0.0) ? count / sec : 0.0, ru.ru_maxrss);
+	fflush(stdout);
+	return;
+}
+
+/**
+ * @fn bench_append_random
+ * @brief a single segment
+ */
+static
+int64_t bench_append_random(
+	gref_pool_t *pool,
+	struct bench_params_s const *p)
+{
+	uint64_t state = p->seed;
+	uint8_t *seq = bench_generate_random_sequence(&state, p->len);
+	if(seq == NULL) { return(-1); }
+	gref_append_segment(pool, "random", 6, seq, p->len);
+	free(seq);
+	return(p->len);
+}
+
+/**
+ * @fn bench_append_bubble
+ * @brief chain of bubbles. each unit is a backbone segment followed by two short
+ * alleles (snv and indel), merging into the next backbone. one third of the units
+ * also have a deletion, a direct link between the backbones. some alleles are
+ * joined in the reverse orientation.
+ */
+#define BENCH_BUBBLE_BACKBONE_LEN	( 1000 )
+static
+int64_t bench_append_bubble(
+	gref_pool_t *pool,
+	struct bench_params_s const *p)
+{
+	uint64_t state = p->seed;
+	int64_t const unit_cnt = p->len / (BENCH_BUBBLE_BACKBONE_LEN + 16) + 1;
+	int64_t total = 0;
+
+	uint8_t *seq = bench_generate_random_sequence(&state, BENCH_BUBBLE_BACKBONE_LEN);
+	if(seq == NULL) { return(-1); }
+
+	/* the backbone and the two alleles */
+	char name[3][32];
+	int32_t len[3];
+	for(int64_t i = 0; i < unit_cnt; i++) {
+		/* backbone */
+		len[0] = sprintf(name[0], "b%lld", (long long)i);
+		for(int64_t j = 0; j < BENCH_BUBBLE_BACKBONE_LEN; j++) {
+			seq[j] = 0x01<<(bench_rand(&state) & 0x03);
+		}
+		if(gref_append_segment(pool, name[0], len[0], seq, BENCH_BUBBLE_BACKBONE_LEN) != 0) {
+			goto _bench_append_bubble_error_handler;
+		}
+		total += BENCH_BUBBLE_BACKBONE_LEN;
+		if(i + 1 == unit_cnt) { break; }
+
+		/* alleles */
+		uint32_t const del = (bench_rand(&state) % 3 == 0);
+		uint32_t const rv = (bench_rand(&state) % 8 == 0);
+		for(int64_t j = 1; j < 3; j++) {
+			len[j] = sprintf(name[j], "a%lld_%lld", (long long)i, (long long)j);
+			int64_t allele_len = 1 + bench_rand(&state) % 16;
+			for(int64_t l = 0; l < allele_len; l++) {
+				seq[l] = 0x01<<(bench_rand(&state) & 0x03);
+			}
+			if(gref_append_segment(pool, name[j], len[j], seq, allele_len) != 0) {
+				goto _bench_append_bubble_error_handler;
+			}
+			total += allele_len;
+		}
+
+		/* the next backbone */
+		char next[32];
+		int32_t next_len = sprintf(next, "b%lld", (long long)(i + 1));
+		for(int64_t j = 1; j < 3; j++) {
+			if(gref_append_link(pool, name[0], len[0], 0, name[j], len[j], rv && j == 1) != 0
+			|| gref_append_link(pool, name[j], len[j], rv && j == 1, next, next_len, 0) != 0) {
+				goto _bench_append_bubble_error_handler;
+			}
+		}
+		if(del && gref_append_link(pool, name[0], len[0], 0, next, next_len, 0) != 0) {
+			goto _bench_append_bubble_error_handler;
+		}
+	}
+	free(seq);
+	return(total);
+
+_bench_append_bubble_error_handler:;
+	free(seq);
+	return(-1);
+}
+
+/**
+ * @fn bench_run
+ * @brief all the phases on a workload
+ */
+static
+int bench_run(
+	char const *workload,
+	int64_t k,
+	int64_t threads,
+	struct bench_params_s const *p)
+{
+	int const external = (strcmp(workload, "fasta") == 0 || strcmp(workload, "gfa") == 0);
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = k,
+		.num_threads = threads,
+		.seq_format = external ? GREF_ASCII : GREF_4BIT,
+		.build_mode = p->build_mode,
+		.kmer_idx_type = p->kmer_idx_type,
+		.build_mem_kb = p->build_mem_kb));
+	if(pool == NULL) { return(-1); }
+
+	/* the pool, the archive, or the index, cleaned up on error */
+	gref_t *gref = (gref_t *)pool;
+	gref_iter_t *iter = NULL;
+	gref_kmer_tuple_t *arr = NULL;
+	uint64_t *query = NULL;
+	gref_match_res_t *res = NULL;
+
+	/* append */
+	double t = bench_now();
+	int64_t len = 0;
+	if(strcmp(workload, "random") == 0) {
+		len = bench_append_random(pool, p);
+	} else if(strcmp(workload, "bubble") == 0) {
+		len = bench_append_bubble(pool, p);
+	} else if(strcmp(workload, "fasta") == 0) {
+		len = (gref_load_fasta(pool, p->fasta) == 0) ? 0 : -1;
+	} else {
+		len = (gref_load_gfa(pool, p->gfa) == 0) ? 0 : -1;
+	}
+	if(len < 0) {
+		fprintf(stderr, "failed to load %s\n", workload);
+		goto _bench_run_error_handler;
+	}
+	double append_sec = bench_now() - t;
+
+	/* freeze */
+	t = bench_now();
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	double freeze_sec = bench_now() - t;
+	if((gref = (gref_t *)acv) == NULL) { goto _bench_run_error_handler; }
+	len = gref_get_total_len(acv);
+	bench_report(workload, k, threads, "append", append_sec, len);
+	bench_report(workload, k, threads, "freeze", freeze_sec, len);
+
+	/* iterate, the tuples are kept for the sort phase */
+	int64_t const batch = 4096;
+	int64_t kmer_cnt = 0, cnt = 0, cap = p->skip_sort ? batch : 1024 * 1024;
+	arr = (gref_kmer_tuple_t *)malloc(sizeof(gref_kmer_tuple_t) * cap);
+	iter = gref_iter_init(acv, NULL);
+	if(arr == NULL || iter == NULL) { goto _bench_run_error_handler; }
+
+	t = bench_now();
+	while(1) {
+		if(cnt + batch > cap) {
+			if(p->skip_sort) {
+				cnt = 0;
+			} else {
+				gref_kmer_tuple_t *narr = (gref_kmer_tuple_t *)realloc(arr, sizeof(gref_kmer_tuple_t) * (cap *= 2));
+				if(narr == NULL) { goto _bench_run_error_handler; }
+				arr = narr;
+			}
+		}
+		int64_t n = gref_iter_next_batch(iter, &arr[cnt], batch);
+		if(n == 0) { break; }
+		cnt += n;
+		kmer_cnt += n;
+	}
+	double iter_sec = bench_now() - t;
+	gref_iter_clean(iter); iter = NULL;
+	bench_report(workload, k, threads, "iterate", iter_sec, kmer_cnt);
+
+	/* sort, the same as the sort step of GREF_BUILD_SORT */
+	if(!p->skip_sort) {
+		t = bench_now();
+		psort_half(arr, cnt, sizeof(gref_kmer_tuple_t), threads);
+		bench_report(workload, k, threads, "sort", bench_now() - t, cnt);
+	}
+
+	/* build, enumeration, sort, and table construction */
+	t = bench_now();
+	gref_idx_t *idx = gref_build_index(acv);
+	double build_sec = bench_now() - t;
+	if((gref = (gref_t *)idx) == NULL) { goto _bench_run_error_handler; }
+	bench_report(workload, k, threads, "build", build_sec, kmer_cnt);
+
+	/* breakdown of freeze and build, available if libgref is built with GREF_STATS */
+	static char const *const phase[GREF_PHASE_CNT] = {
+		[GREF_PHASE_SEQ] = "freeze.seq",
+		[GREF_PHASE_LINK] = "freeze.link",
+		[GREF_PHASE_ENUMERATE] = "build.enumerate",
+		[GREF_PHASE_SORT] = "build.sort",
+		[GREF_PHASE_KMER_TABLE] = "build.kmer_table",
+		[GREF_PHASE_CAP] = "build.cap",
+		[GREF_PHASE_PACK] = "build.pack",
+		[GREF_PHASE_PLACE] = "build.place"
+	};
+	struct gref_stats_s stats;
+	gref_get_stats(idx, &stats);
+	for(int64_t i = 0; i < GREF_PHASE_CNT; i++) {
+		if(stats.phase_sec[i] == 0.0) { continue; }
+		bench_report(workload, k, threads, phase[i], stats.phase_sec[i],
+			(i < GREF_PHASE_ENUMERATE) ? len : kmer_cnt);
+	}
+
+	/* three fourths of the queries are sampled from the enumerated kmers (the last batch if -S) */
+	uint64_t state = p->seed ^ 0x5555;
+	uint64_t const mask = (k < 32) ? (0x01ULL<<(2 * k)) - 1 : ~0ULL;
+	query = (uint64_t *)malloc(sizeof(uint64_t) * p->query_cnt);
+	res = (gref_match_res_t *)malloc(sizeof(gref_match_res_t) * p->query_cnt);
+	if(query == NULL || res == NULL) { goto _bench_run_error_handler; }
+	for(int64_t i = 0; i < p->query_cnt; i++) {
+		query[i] = (cnt == 0 || bench_rand(&state) % 4 == 0)
+			? bench_rand(&state) & mask
+			: arr[bench_rand(&state) % cnt].kmer;
+	}
+	free(arr); arr = NULL;
+
+	/* match */
+	int64_t hits = 0;
+	t = bench_now();
+	for(int64_t i = 0; i < p->query_cnt; i++) {
+		hits += gref_match_2bitpacked(idx, query[i]).len;
+	}
+	bench_report(workload, k, threads, "match", bench_now() - t, p->query_cnt);
+
+	t = bench_now();
+	gref_match_batch(idx, query, p->query_cnt, res);
+	for(int64_t i = 0; i < p->query_cnt; i++) {
+		hits -= res[i].len;
+	}
+	bench_report(workload, k, threads, "match_batch", bench_now() - t, p->query_cnt);
+	if(hits != 0) {
+		fprintf(stderr, "match and match_batch disagree\n");
+	}
+
+	free(query);
+	free(res);
+	gref_clean(idx);
+	return(0);
+
+_bench_run_error_handler:;
+	if(iter != NULL) { gref_iter_clean(iter); }
+	free(arr);
+	free(query);
+	free(res);
+	if(gref != NULL) { gref_clean(gref); }
+	return(-1);
+}
+
+/**
+ * @fn bench_parse_list
+ */
+static
+int64_t bench_parse_list(
+	char const *str,
+	int64_t *v)
+{
+	int64_t cnt = 0;
+	while(*str != '\0' && cnt < BENCH_MAX_SWEEP) {
+		char *end;
+		v[cnt++] = strtoll(str, &end, 10);
+		if(end == str) { return(-1); }
+		str = (*end == ',') ? end + 1 : end;
+	}
+	return(cnt);
+}
+
+/**
+ * @fn main
+ */
+int main(int argc, char *argv[])
+{
+	struct bench_params_s p = {
+		.k = { 12, 14 }, .k_cnt = 2,
+		.threads = { 1, 4 }, .threads_cnt = 2,
+		.len = 4 * 1024 * 1024,
+		.query_cnt = 1024 * 1024,
+		.seed = 1,
+		.build_mode = GREF_BUILD_SORT,
+		.run_random = 1,
+		.run_bubble = 1
+	};
+
+	int c;
+	while((c = getopt(argc, argv, "k:t:l:q:s:b:m:i:w:f:g:Sh")) != -1) {
+		switch(c) {
+			case 'k': p.k_cnt = bench_parse_list(optarg, p.k); break;
+			case 't': p.threads_cnt = bench_parse_list(optarg, p.threads); break;
+			case 'l': p.len = strtoll(optarg, NULL, 10); break;
+			case 'q': p.query_cnt = strtoll(optarg, NULL, 10); break;
+			case 's': p.seed = strtoull(optarg, NULL, 10) | 0x01; break;
+			case 'b':
+				p.build_mode = (strcmp(optarg, "count") == 0) ? GREF_BUILD_COUNT
+					: (strcmp(optarg, "partition") == 0) ? GREF_BUILD_PARTITION : GREF_BUILD_SORT;
+				break;
+			case 'm': p.build_mem_kb = strtoll(optarg, NULL, 10) * 1024; break;
+			case 'i':
+				p.kmer_idx_type = (strcmp(optarg, "dense") == 0) ? GREF_KMER_IDX_DENSE
+					: (strcmp(optarg, "compact") == 0) ? GREF_KMER_IDX_COMPACT
+					: (strcmp(optarg, "inline") == 0) ? GREF_KMER_IDX_INLINE
+					: (strcmp(optarg, "hash") == 0) ? GREF_KMER_IDX_HASH : 0;
+				break;
+			case 'w':
+				p.run_random = (strstr(optarg, "random") != NULL);
+				p.run_bubble = (strstr(optarg, "bubble") != NULL);
+				break;
+			case 'f': p.fasta = optarg; break;
+			case 'g': p.gfa = optarg; break;
+			case 'S': p.skip_sort = 1; break;
+			default:
+				fprintf(stderr,
+					"usage: %s [-k 12,14] [-t 1,4] [-l len] [-q queries] [-s seed]\n"
+					"          [-b sort|count|partition] [-m budget_mb] [-i dense|compact|inline|hash]\n"
+					"          [-w random,bubble]\n"
+					"          [-f in.fa] [-g in.gfa] [-S]\n"
+					"  -S  skip the standalone sort phase (saves the tuple array)\n", argv[0]);
+				return((c == 'h') ? 0 : 1);
+		}
+	}
+	if(p.k_cnt <= 0 || p.threads_cnt <= 0 || p.len <= 0 || p.query_cnt <= 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return(1);
+	}
+
+	printf("workload\tk\tthreads\tphase\tsec\tcount\tcount_per_sec\tmaxrss_kb\n");
+	char const *workload[4] = {
+		p.run_random ? "random" : NULL,
+		p.run_bubble ? "bubble" : NULL,
+		p.fasta != NULL ? "fasta" : NULL,
+		p.gfa != NULL ? "gfa" : NULL
+	};
+	int ret = 0;
+	for(int64_t w = 0; w < 4; w++) {
+		if(workload[w] == NULL) { continue; }
+		for(int64_t i = 0; i < p.k_cnt; i++) {
+			for(int64_t j = 0; j < p.threads_cnt; j++) {
+				ret |= bench_run(workload[w], p.k[i], p.threads[j], &p);
+			}
+		}
+	}
+	return(ret ? 1 : 0);
+}
+
+/**
+ * end of bench.c
+ */
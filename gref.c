@@ -9,6 +9,10 @@
  * @license MIT
  */
 
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE				/* MAP_ANONYMOUS, MAP_HUGETLB, madvise, syscall, pread and mkstemp */
+#endif
+
 #define UNITTEST_UNIQUE_ID			50
 #define UNITTEST 					1
 
@@ -17,6 +21,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include "hmap/hmap.h"
 #include "psort/psort.h"
 #include "zf/zf.h"
@@ -34,6 +47,9 @@
 /* roundup */
 #define _roundup(x, base)			( (((x) + (base) - 1) / (base)) * (base) )
 
+/* prefetch for read */
+#define _prefetch(p)				__builtin_prefetch((void const *)(p), 0, 3)
+
 /* max, min */
 #define MAX2(x, y)					( (x) < (y) ? (y) : (x) )
 #define MAX3(x, y, z)				( MAX2(MAX2(x, y), z) )
@@ -46,6 +62,25 @@
 #define _decode_id(_x)				( (_x)>>1 )
 #define _decode_dir(_x)				( (_x) & 0x01 )
 
+/* build-phase instrumentation, compiled in with -DGREF_STATS */
+#ifdef GREF_STATS
+#include <time.h>
+static _force_inline
+double gref_stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+#  define _stats_init(_t)				double _t = gref_stats_now()
+#  define _stats_lap(_gref, _phase, _t)	{ double _n = gref_stats_now(); (_gref)->phase_sec[(_phase)] += _n - (_t); (_t) = _n; }
+#  define _stats_max(_x, _v)			{ if((_x) < (_v)) { (_x) = (_v); } }
+#else
+#  define _stats_init(_t)
+#  define _stats_lap(_gref, _phase, _t)
+#  define _stats_max(_x, _v)
+#endif
+
 
 /**
  * structs and typedefs
@@ -110,6 +145,37 @@ struct gref_section_half_s {
 };
 _static_assert(sizeof(struct gref_section_half_s) == 32);
 
+/**
+ * @struct gref_kmer_occ_s
+ * @brief kmer and its number of occurrences
+ */
+struct gref_kmer_occ_s {
+	uint64_t kmer;
+	int64_t occ;
+};
+
+/**
+ * @struct gref_kmer_run_s
+ * @brief head of a bucket in kmer_table. the buckets of the hash index are kept
+ * in an array of runs, sorted by kmer and terminated by the total count, during
+ * the build.
+ */
+struct gref_kmer_run_s {
+	uint64_t kmer;
+	int64_t base;
+};
+
+/**
+ * @struct gref_region_s
+ * @brief anonymous mapping that holds a kmer table
+ */
+#define GREF_REGION_CNT				( 8 )
+#define GREF_REGION_MIN_SIZE		( 1024 * 1024 )	/* smaller tables stay on the heap */
+struct gref_region_s {
+	void *ptr;
+	uint64_t size;
+};
+
 /**
  * @enum gref_type
  * @breif gref->type
@@ -130,15 +196,15 @@ struct gref_s {
 	/* name -> section mapping */
 	hmap_t *hmap;					/* name -> section_info hashmap */
 	uint32_t sec_cnt;
+	uint32_t name_tab_cnt;			/* ids in name_tab, for the lookup without insertion */
+	uint64_t name_tab_size;
+	uint32_t *name_tab;
 
 	/* status */
 	int8_t type;
 	int8_t kmer_available;
 	uint8_t reserved2[2];
 
-	/* internal params */
-	int64_t iter_init_stack_size;
-
 	/* params */
 	struct gref_params_s params;
 
@@ -147,6 +213,12 @@ struct gref_s {
 	uint64_t seq_len;
 	uint8_t const *seq_lim;
 
+	/* 2bit storage (replaces seq in GREF_STORAGE_2BIT), exc_map has a bit per word of seq_2bit */
+	uint64_t *seq_2bit;
+	uint64_t *seq_exc_map;
+	struct gref_seq_exc_s *seq_exc;
+	int64_t seq_exc_cnt;
+
 	/* link info container */
 	lmm_kvec_t(struct gref_gid_pair_s) link;
 
@@ -155,18 +227,73 @@ struct gref_s {
 	int64_t link_table_size;
 	uint32_t *link_table;
 
-	/* kmer index container */
+	/* kmer index container (dense) */
 	int64_t *kmer_idx_table;
+
+	/* kmer index container (inline), converted from the dense one at the end of the build */
+	struct gref_kmer_slot_s *kmer_slot_table;
+
+	/* kmer index container (compact) */
+	uint64_t *kmer_sb_table;
+	uint16_t *kmer_rel_table;
+	uint32_t *kmer_esc_table;
+	int64_t kmer_esc_size;
+
+	/* kmer index container (hash), tags and slots in groups of GREF_KMER_HASH_GROUP_SIZE */
+	uint8_t *kmer_hash_tag;
+	struct gref_kmer_hash_slot_s *kmer_hash_slot;
+	struct gref_kmer_occ_s *kmer_hash_esc;	/* saturated counts, sorted by kmer */
+	int64_t kmer_hash_group_cnt;
+	int64_t kmer_hash_esc_cnt;
+	struct gref_kmer_run_s *kmer_run;		/* buckets in the kmer order, only during the build */
+	int64_t kmer_run_cnt;
+
+	/* kmer table, entries are packed in entry_size bytes if entry_size != 0 */
 	int64_t kmer_table_size;
 	struct gref_gid_pos_s *kmer_table;
+	uint32_t entry_size;
+	uint32_t entry_pos_bits;
+
+	/* staged updates of the live index (gref_idx_append_*), applied in gref_update_index */
+	int64_t stage_cnt;
+	uint32_t stage_sec_cnt;
+	uint32_t reserved3;
+	uint64_t stage_seq_len;
+	lmm_kvec_t(uint8_t) stage_seq;
+	lmm_kvec_t(struct gref_gid_pair_s) stage_link;
+
+	/* kmers changed by gref_update_index, looked up before the kmer table */
+	struct gref_delta_s *delta;
+
+	/* kmers whose buckets were capped in gref_build_index */
+	struct gref_occ_mask_s *occ_mask;
+
+	/* mapped index file (gref_load_index_mmap) */
+	void *map_base;
+	uint64_t map_size;
+
+	/* anonymous mappings backing the kmer tables (params.table_mem) */
+	struct gref_region_s region[GREF_REGION_CNT];
+
+	/* build profile (gref_get_stats), recorded with GREF_STATS */
+	double phase_sec[GREF_PHASE_CNT];
+	uint32_t max_stack_depth;
+	uint32_t max_expansion;
+	int64_t dup_cnt;				/* repeated occurrences dropped at the enumeration */
+	uint32_t enum_unordered;		/* the last enumeration was not in the (gid, pos) order */
 
 	/* sequence encoder */
 	struct gref_seq_interval_s (*append_seq)(
 		struct gref_s *gref,
 		uint8_t const *seq,
 		int64_t len);
+
+	/* query encoder, specialized for k in GREF_KMER_KERNEL_LIST */
+	uint64_t (*pack_kmer)(
+		uint8_t const *seq,
+		int64_t k);
 };
-_static_assert(sizeof(struct gref_params_s) == 24);
+_static_assert(sizeof(struct gref_params_s) == 48);
 
 /**
  * @fn gref_encode_2bit
@@ -197,6 +324,34 @@ uint8_t gref_encode_2bit(
 	#undef _b
 }
 
+/**
+ * @var gref_encode_4bit_table
+ * @brief mapping IUPAC amb. to 4bit encoding (A = 0x01, C = 0x02, G = 0x04,
+ * T = 0x08), indexed by (c & 0x1f). also passed to gref_arch_table32.
+ */
+/* convert to upper case and subtract offset by 0x40 */
+#define _b(x)	( (x) & 0x1f )
+static uint8_t const gref_encode_4bit_table[32] = {
+	[_b('A')] = 0x01,
+	[_b('C')] = 0x02,
+	[_b('G')] = 0x04,
+	[_b('T')] = 0x08,
+	[_b('U')] = 0x08,
+	[_b('R')] = 0x01 | 0x04,
+	[_b('Y')] = 0x02 | 0x08,
+	[_b('S')] = 0x04 | 0x02,
+	[_b('W')] = 0x01 | 0x08,
+	[_b('K')] = 0x04 | 0x08,
+	[_b('M')] = 0x01 | 0x02,
+	[_b('B')] = 0x02 | 0x04 | 0x08,
+	[_b('D')] = 0x01 | 0x04 | 0x08,
+	[_b('H')] = 0x01 | 0x02 | 0x08,
+	[_b('V')] = 0x01 | 0x02 | 0x04,
+	[_b('N')] = 0,		/* treat 'N' as a gap */
+	[_b('_')] = 0		/* sentinel */
+};
+#undef _b
+
 /**
  * @fn gref_encode_4bit
  * @brief mapping IUPAC amb. to 4bit encoding
@@ -205,35 +360,71 @@ static _force_inline
 uint8_t gref_encode_4bit(
 	uint8_t c)
 {
-	/* convert to upper case and subtract offset by 0x40 */
-	#define _b(x)	( (x) & 0x1f )
+	return(gref_encode_4bit_table[c & 0x1f]);
+}
 
-	/* conversion tables */
-	enum bases {
-		A = 0x01, C = 0x02, G = 0x04, T = 0x08
-	};
-	static uint8_t const table[] = {
-		[_b('A')] = A,
-		[_b('C')] = C,
-		[_b('G')] = G,
-		[_b('T')] = T,
-		[_b('U')] = T,
-		[_b('R')] = A | G,
-		[_b('Y')] = C | T,
-		[_b('S')] = G | C,
-		[_b('W')] = A | T,
-		[_b('K')] = G | T,
-		[_b('M')] = A | C,
-		[_b('B')] = C | G | T,
-		[_b('D')] = A | G | T,
-		[_b('H')] = A | C | T,
-		[_b('V')] = A | C | G,
-		[_b('N')] = 0,		/* treat 'N' as a gap */
-		[_b('_')] = 0		/* sentinel */
-	};
-	return(table[_b(c)]);
+/**
+ * @macro GREF_KMER_KERNEL_LIST
+ * @brief k values that get the fixed-k kernels (2bit packing of the query and
+ * the linear part of the batch iterator); the others go through the generic
+ * version. override with -DGREF_KMER_KERNEL_LIST(_f)="_f(k0) _f(k1) ...".
+ */
+#ifndef GREF_KMER_KERNEL_LIST
+#  define GREF_KMER_KERNEL_LIST(_f)		_f(12) _f(14) _f(16) _f(20)
+#endif
 
-	#undef _b
+/**
+ * @fn gref_pack_kmer_intl
+ * @brief 2bit-pack the first k bases of an ascii seq, the first base at the lsb.
+ * instantiated with constant k below to get the loop unrolled.
+ */
+static _force_inline
+uint64_t gref_pack_kmer_intl(
+	uint8_t const *seq,
+	int64_t const k)
+{
+	uint64_t packed_seq = 0;
+	for(int64_t i = 0; i < k; i++) {
+		packed_seq = (packed_seq>>2) | ((uint64_t)gref_encode_2bit(seq[i])<<(2 * (k - 1)));
+	}
+	return(packed_seq);
+}
+
+/**
+ * @fn gref_pack_kmer, gref_pack_kmer_k*
+ */
+static
+uint64_t gref_pack_kmer(
+	uint8_t const *seq,
+	int64_t k)
+{
+	return(gref_pack_kmer_intl(seq, k));
+}
+
+#define _gref_pack_kmer_kernel(_k) \
+	static \
+	uint64_t gref_pack_kmer_k##_k( \
+		uint8_t const *seq, \
+		int64_t k) \
+	{ \
+		return(gref_pack_kmer_intl(seq, _k)); \
+	}
+GREF_KMER_KERNEL_LIST(_gref_pack_kmer_kernel)
+#undef _gref_pack_kmer_kernel
+
+/**
+ * @fn gref_select_pack_kmer
+ */
+static
+uint64_t (*gref_select_pack_kmer(
+	int64_t k))(uint8_t const *, int64_t)
+{
+	switch(k) {
+		#define _case(_k)	case _k: return(gref_pack_kmer_k##_k);
+		GREF_KMER_KERNEL_LIST(_case)
+		#undef _case
+		default: return(gref_pack_kmer);
+	}
 }
 
 /**
@@ -247,9 +438,13 @@ struct gref_seq_interval_s gref_copy_seq_ascii(
 {
 	uint64_t base = lmm_kv_size(gref->seq);
 	lmm_kv_reserve(gref->lmm, gref->seq, base + len);
+	if(lmm_kv_ptr(gref->seq) == NULL) {
+		return((struct gref_seq_interval_s){ .base = base, .tail = base });
+	}
 
 	/* append */
-	for(int64_t i = 0; i < len; i++) {
+	int64_t i = gref_arch_table32(&lmm_kv_at(gref->seq, base), seq, len, gref_encode_4bit_table);
+	for(; i < len; i++) {
 		lmm_kv_at(gref->seq, base + i) = gref_encode_4bit(seq[i]);
 	}
 
@@ -311,9 +506,24 @@ gref_pool_t *gref_init_pool(
 	restore(p.seq_format, GREF_ASCII);
 	restore(p.copy_mode, GREF_COPY);
 	restore(p.num_threads, 0);
+	restore(p.build_mode, GREF_BUILD_SORT);
+	/* GREF_BUILD_COUNT needs a direct-address index, the hash index is only taken on request */
+	restore(p.kmer_idx_type, (p.k <= 12) ? GREF_KMER_IDX_DENSE
+		: (p.k <= 16 || p.build_mode == GREF_BUILD_COUNT) ? GREF_KMER_IDX_COMPACT : GREF_KMER_IDX_HASH);
 	restore(p.hash_size, 1024);
 	restore(p.seq_head_margin, 0);
 	restore(p.seq_tail_margin, 0);
+	restore(p.step_size, 1);
+	restore(p.minimizer_window, 1);
+	restore(p.max_expansion, GREF_ITER_MAX_EXPANSION);
+	restore(p.kmer_strand, GREF_KMER_BOTH);
+	restore(p.seq_storage, GREF_STORAGE_4BIT);
+	restore(p.table_mem, GREF_MEM_DEFAULT);
+	restore(p.max_occ, 0);
+	restore(p.mask_top_ppm, 0);
+	restore(p.occ_mode, GREF_OCC_DROP);
+	restore(p.entry_format, GREF_ENTRY_PLAIN);
+	restore(p.build_mem_kb, 0);
 	restore(p.lmm, NULL);
 
 	#undef restore
@@ -322,6 +532,17 @@ gref_pool_t *gref_init_pool(
 	if(p.k < 4 || p.k > 32) { return(NULL); }
 	if((uint8_t)p.seq_format > GREF_4BIT) { return(NULL); }
 	if((uint8_t)p.copy_mode > GREF_NOCOPY) { return(NULL); }
+	if((uint8_t)p.build_mode > GREF_BUILD_PARTITION) { return(NULL); }
+	if((uint8_t)p.kmer_idx_type > GREF_KMER_IDX_HASH) { return(NULL); }
+	if(p.kmer_idx_type == GREF_KMER_IDX_HASH && p.build_mode == GREF_BUILD_COUNT) { return(NULL); }
+	if(p.kmer_idx_type == GREF_KMER_IDX_INLINE && p.entry_format == GREF_ENTRY_PACKED) { return(NULL); }
+	if(p.minimizer_window > GREF_ITER_MM_MAX_WINDOW) { return(NULL); }
+	if((uint8_t)p.occ_mode > GREF_OCC_TRUNCATE) { return(NULL); }
+	if((uint8_t)p.entry_format > GREF_ENTRY_PACKED) { return(NULL); }
+	if((uint8_t)p.kmer_strand > GREF_KMER_CANONICAL) { return(NULL); }
+	if(p.kmer_strand == GREF_KMER_CANONICAL && (p.step_size > 1 || p.minimizer_window > 1)) { return(NULL); }
+	if((uint8_t)p.seq_storage > GREF_STORAGE_2BIT) { return(NULL); }
+	if(p.seq_storage == GREF_STORAGE_2BIT && p.copy_mode == GREF_NOCOPY) { return(NULL); }
 	p.seq_head_margin = _roundup(p.seq_head_margin, 16);
 	p.seq_tail_margin = _roundup(p.seq_tail_margin, 16);
 
@@ -349,13 +570,6 @@ gref_pool_t *gref_init_pool(
 	pool->sec_cnt = 0;
 	pool->type = GREF_POOL;
 
-	/* calc iterator buffer size */
-	int64_t buf_size = 1;
-	for(int64_t i = 0; i < (p.k + 1) / 2; i++) {
-		buf_size *= 3;
-	}
-	pool->iter_init_stack_size = MAX2(1024, buf_size);
-
 	/* init seq vector */
 	if(p.copy_mode != GREF_NOCOPY) {
 		lmm_kv_init(lmm, pool->seq);
@@ -393,6 +607,7 @@ gref_pool_t *gref_init_pool(
 	if((pool->append_seq = table[p.seq_format][p.copy_mode]) == NULL) {
 		goto _gref_init_pool_error_handler;
 	}
+	pool->pack_kmer = gref_select_pack_kmer(p.k);
 
 	/* copy params */
 	pool->params = p;
@@ -408,6 +623,251 @@ _gref_init_pool_error_handler:;
 	return(NULL);
 }
 
+/**
+ * @fn gref_is_mapped
+ * @brief check if ptr points into the mapped file
+ */
+static _force_inline
+int gref_is_mapped(
+	struct gref_s const *gref,
+	void const *ptr)
+{
+	return((uint8_t const *)ptr >= (uint8_t const *)gref->map_base
+		&& (uint8_t const *)ptr < (uint8_t const *)gref->map_base + gref->map_size);
+}
+
+/**
+ * @fn gref_find_region
+ * @brief index of the region that starts at ptr, -1 if not found
+ */
+static _force_inline
+int64_t gref_find_region(
+	struct gref_s const *gref,
+	void const *ptr)
+{
+	for(int64_t i = 0; ptr != NULL && i < GREF_REGION_CNT; i++) {
+		if(gref->region[i].ptr == ptr) { return(i); }
+	}
+	return(-1);
+}
+
+/**
+ * @fn gref_free
+ * @brief lmm_free unless ptr points into the mapped file, regions are unmapped
+ */
+static _force_inline
+void gref_free(
+	struct gref_s *gref,
+	void *ptr)
+{
+	if(gref_is_mapped(gref, ptr)) { return; }
+
+	int64_t i = gref_find_region(gref, ptr);
+	if(i >= 0) {
+		munmap(gref->region[i].ptr, gref->region[i].size);
+		gref->region[i] = (struct gref_region_s){ 0 };
+		return;
+	}
+	lmm_free(gref->lmm, ptr);
+	return;
+}
+
+/**
+ * @fn gref_interleave_region
+ * @brief set the interleave policy over the allowed nodes; must be called before
+ * the pages are touched. errors are ignored as the policy is only a hint.
+ */
+static _force_inline
+void gref_interleave_region(
+	void *ptr,
+	uint64_t size)
+{
+	#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+		/* numaif.h constants, the library (libnuma) is not required */
+		#define GREF_MPOL_INTERLEAVE		( 3 )
+		#define GREF_MPOL_F_MEMS_ALLOWED	( 1<<2 )
+		#define GREF_MAX_NODES				( 1024 )
+
+		unsigned long mask[GREF_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+		int mode = 0;
+		if(syscall(SYS_get_mempolicy, &mode, mask, GREF_MAX_NODES, NULL, GREF_MPOL_F_MEMS_ALLOWED) == 0) {
+			syscall(SYS_mbind, ptr, size, GREF_MPOL_INTERLEAVE, mask, GREF_MAX_NODES, 0);
+		}
+
+		#undef GREF_MPOL_INTERLEAVE
+		#undef GREF_MPOL_F_MEMS_ALLOWED
+		#undef GREF_MAX_NODES
+	#endif
+	return;
+}
+
+/**
+ * @fn gref_alloc_region
+ * @brief allocate an anonymous mapping as specified by params.table_mem. tries
+ * MAP_HUGETLB first (if requested), then falls back to normal pages with
+ * MADV_HUGEPAGE. returns NULL if mapping failed or no region slot is left.
+ */
+static
+void *gref_alloc_region(
+	struct gref_s *gref,
+	uint64_t size)
+{
+	uint32_t const flags = gref->params.table_mem;
+	int64_t i = 0;
+	while(i < GREF_REGION_CNT && gref->region[i].ptr != NULL) { i++; }
+	if(i == GREF_REGION_CNT) { return(NULL); }
+
+	#if defined(MAP_ANONYMOUS)
+		uint64_t const huge = (flags & GREF_MEM_HUGETLB_1G) ? (0x01ULL<<30) : (0x01ULL<<21);
+		uint64_t map_size = (size + huge - 1) & ~(huge - 1);
+		void *ptr = MAP_FAILED;
+
+		#if defined(MAP_HUGETLB)
+			if(flags & (GREF_MEM_HUGETLB_2M | GREF_MEM_HUGETLB_1G)) {
+				int hflags = MAP_HUGETLB;
+				#if defined(MAP_HUGE_SHIFT)
+					hflags |= ((flags & GREF_MEM_HUGETLB_1G) ? 30 : 21)<<MAP_HUGE_SHIFT;
+				#endif
+				ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | hflags, -1, 0);
+				debug("hugetlb ptr(%p), size(%llu)", ptr, map_size);
+			}
+		#endif
+
+		if(ptr == MAP_FAILED) {
+			/* no huge page reserved; normal pages, rounded to 2MiB for the transparent huge pages */
+			map_size = (size + (0x01ULL<<21) - 1) & ~((0x01ULL<<21) - 1);
+			ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(ptr == MAP_FAILED) { return(NULL); }
+
+			#if defined(MADV_HUGEPAGE)
+				if(flags & (GREF_MEM_HUGEPAGE | GREF_MEM_HUGETLB_2M | GREF_MEM_HUGETLB_1G)) {
+					madvise(ptr, map_size, MADV_HUGEPAGE);
+				}
+			#endif
+		}
+
+		if(flags & GREF_MEM_INTERLEAVE) {
+			gref_interleave_region(ptr, map_size);
+		}
+		gref->region[i] = (struct gref_region_s){
+			.ptr = ptr,
+			.size = map_size
+		};
+		return(ptr);
+	#else
+		return(NULL);
+	#endif
+}
+
+/**
+ * @fn gref_clean_kmer_idx_table
+ */
+static _force_inline
+void gref_clean_kmer_idx_table(
+	struct gref_s *gref)
+{
+	gref_free(gref, gref->kmer_idx_table); gref->kmer_idx_table = NULL;
+	gref_free(gref, gref->kmer_slot_table); gref->kmer_slot_table = NULL;
+	gref_free(gref, gref->kmer_sb_table); gref->kmer_sb_table = NULL;
+	gref_free(gref, gref->kmer_rel_table); gref->kmer_rel_table = NULL;
+	gref_free(gref, gref->kmer_esc_table); gref->kmer_esc_table = NULL;
+	gref->kmer_esc_size = 0;
+	gref_free(gref, gref->kmer_hash_tag); gref->kmer_hash_tag = NULL;
+	gref_free(gref, gref->kmer_hash_slot); gref->kmer_hash_slot = NULL;
+	gref_free(gref, gref->kmer_hash_esc); gref->kmer_hash_esc = NULL;
+	gref->kmer_hash_group_cnt = gref->kmer_hash_esc_cnt = 0;
+	lmm_free(gref->lmm, gref->kmer_run); gref->kmer_run = NULL;
+	gref->kmer_run_cnt = 0;
+	return;
+}
+
+/**
+ * @struct gref_kmer_tables_s
+ * @brief the kmer table and its index, detached from gref_s
+ */
+struct gref_kmer_tables_s {
+	int64_t *kmer_idx_table;
+	struct gref_kmer_slot_s *kmer_slot_table;
+	uint64_t *kmer_sb_table;
+	uint16_t *kmer_rel_table;
+	uint32_t *kmer_esc_table;
+	int64_t kmer_esc_size;
+	uint8_t *kmer_hash_tag;
+	struct gref_kmer_hash_slot_s *kmer_hash_slot;
+	struct gref_kmer_occ_s *kmer_hash_esc;
+	int64_t kmer_hash_group_cnt;
+	int64_t kmer_hash_esc_cnt;
+	struct gref_kmer_run_s *kmer_run;
+	int64_t kmer_run_cnt;
+	int64_t kmer_table_size;
+	struct gref_gid_pos_s *kmer_table;
+};
+
+/**
+ * @fn gref_swap_kmer_tables
+ * @brief exchange the tables of gref and t
+ */
+static _force_inline
+void gref_swap_kmer_tables(
+	struct gref_s *gref,
+	struct gref_kmer_tables_s *t)
+{
+	struct gref_kmer_tables_s const c = {
+		.kmer_idx_table = gref->kmer_idx_table,
+		.kmer_slot_table = gref->kmer_slot_table,
+		.kmer_sb_table = gref->kmer_sb_table,
+		.kmer_rel_table = gref->kmer_rel_table,
+		.kmer_esc_table = gref->kmer_esc_table,
+		.kmer_esc_size = gref->kmer_esc_size,
+		.kmer_hash_tag = gref->kmer_hash_tag,
+		.kmer_hash_slot = gref->kmer_hash_slot,
+		.kmer_hash_esc = gref->kmer_hash_esc,
+		.kmer_hash_group_cnt = gref->kmer_hash_group_cnt,
+		.kmer_hash_esc_cnt = gref->kmer_hash_esc_cnt,
+		.kmer_run = gref->kmer_run,
+		.kmer_run_cnt = gref->kmer_run_cnt,
+		.kmer_table_size = gref->kmer_table_size,
+		.kmer_table = gref->kmer_table
+	};
+	gref->kmer_idx_table = t->kmer_idx_table;
+	gref->kmer_slot_table = t->kmer_slot_table;
+	gref->kmer_sb_table = t->kmer_sb_table;
+	gref->kmer_rel_table = t->kmer_rel_table;
+	gref->kmer_esc_table = t->kmer_esc_table;
+	gref->kmer_esc_size = t->kmer_esc_size;
+	gref->kmer_hash_tag = t->kmer_hash_tag;
+	gref->kmer_hash_slot = t->kmer_hash_slot;
+	gref->kmer_hash_esc = t->kmer_hash_esc;
+	gref->kmer_hash_group_cnt = t->kmer_hash_group_cnt;
+	gref->kmer_hash_esc_cnt = t->kmer_hash_esc_cnt;
+	gref->kmer_run = t->kmer_run;
+	gref->kmer_run_cnt = t->kmer_run_cnt;
+	gref->kmer_table_size = t->kmer_table_size;
+	gref->kmer_table = t->kmer_table;
+	*t = c;
+	return;
+}
+
+/**
+ * @fn gref_commit_kmer_tables
+ * @brief keep the tables built on gref and free the detached ones in t if
+ * ret == 0, or free the new ones and put back t otherwise. returns ret.
+ */
+static _force_inline
+int gref_commit_kmer_tables(
+	struct gref_s *gref,
+	struct gref_kmer_tables_s *t,
+	int ret)
+{
+	if(ret == 0) { gref_swap_kmer_tables(gref, t); }
+	gref_clean_kmer_idx_table(gref);
+	gref_free(gref, gref->kmer_table); gref->kmer_table = NULL;
+	gref->kmer_table_size = 0;
+	gref_swap_kmer_tables(gref, t);
+	return(ret);
+}
+
 /**
  * @fn gref_clean
  */
@@ -419,37 +879,79 @@ void gref_clean(
 	if(gref != NULL) {
 		/* cleanup, cleanup... */
 		hmap_clean(gref->hmap); gref->hmap = NULL;
-		lmm_kv_destroy(gref->lmm, gref->seq);
-		lmm_kv_destroy(gref->lmm, gref->link);
+		lmm_free(gref->lmm, gref->name_tab); gref->name_tab = NULL;
+		gref_free(gref, lmm_kv_ptr(gref->seq)); lmm_kv_ptr(gref->seq) = NULL;
+		gref_free(gref, lmm_kv_ptr(gref->link)); lmm_kv_ptr(gref->link) = NULL;
 		// free(gref->link_table); gref->link_table = NULL;
-		lmm_free(gref->lmm, gref->kmer_idx_table); gref->kmer_idx_table = NULL;
-		lmm_free(gref->lmm, gref->kmer_table); gref->kmer_table = NULL;
+		lmm_free(gref->lmm, gref->seq_2bit); gref->seq_2bit = NULL;
+		lmm_free(gref->lmm, gref->seq_exc_map); gref->seq_exc_map = NULL;
+		lmm_free(gref->lmm, gref->seq_exc); gref->seq_exc = NULL;
+		gref_clean_kmer_idx_table(gref);
+		gref_free(gref, gref->kmer_table); gref->kmer_table = NULL;
+		lmm_kv_destroy(gref->lmm, gref->stage_seq);
+		lmm_kv_destroy(gref->lmm, gref->stage_link);
+		lmm_free(gref->lmm, gref->delta); gref->delta = NULL;
+		lmm_free(gref->lmm, gref->occ_mask); gref->occ_mask = NULL;
+		if(gref->map_base != NULL) {
+			munmap(gref->map_base, gref->map_size);
+		}
 		lmm_free(gref->lmm, gref);
 	}
 	return;
 }
 
 
+/**
+ * @fn gref_detach_mapped
+ * @brief copy mapped seq and link_table to the heap before they are modified
+ */
+static _force_inline
+int gref_detach_mapped(
+	struct gref_s *gref)
+{
+	if(gref_is_mapped(gref, lmm_kv_ptr(gref->seq))) {
+		uint64_t size = lmm_kv_size(gref->seq);
+		uint8_t *seq = (uint8_t *)lmm_malloc(gref->lmm, MAX2(1, size));
+		if(seq == NULL) { return(-1); }
+		memcpy(seq, lmm_kv_ptr(gref->seq), size);
+
+		/* rebase sections; reverse bases are mirrored around seq_lim in fw_only mode */
+		int64_t diff = seq - lmm_kv_ptr(gref->seq);
+		int64_t rv_diff = (gref->params.seq_direction == GREF_FW_RV) ? diff : -diff;
+		struct gref_section_intl_s *sec =
+			(struct gref_section_intl_s *)hmap_get_object(gref->hmap, 0);
+		for(int64_t i = 0; i < gref->sec_cnt; i++) {
+			sec[i].fw_sec.base += diff;
+			sec[i].rv_sec.base += rv_diff;
+		}
+		if(gref->params.seq_direction == GREF_FW_RV) {
+			gref->seq_lim += diff;
+		}
+		lmm_kv_ptr(gref->seq) = seq;
+	}
+	if(gref_is_mapped(gref, gref->link_table)) {
+		uint64_t size = sizeof(uint32_t) * gref->link_table_size;
+		uint32_t *link = (uint32_t *)lmm_malloc(gref->lmm, MAX2(1, size));
+		if(link == NULL) { return(-1); }
+		memcpy(link, gref->link_table, size);
+		lmm_kv_ptr(gref->link) = (struct gref_gid_pair_s *)link;
+		gref->link_table = link;
+	}
+	return(0);
+}
+
 /* pool modify operation */
 /**
- * @fn gref_append_segment
+ * @fn gref_add_segment
+ * @brief register the sequence in [iv.base, iv.tail) as a segment
  */
-int gref_append_segment(
-	gref_pool_t *_pool,
+static _force_inline
+int gref_add_segment(
+	struct gref_s *pool,
 	char const *name,
 	int32_t name_len,
-	uint8_t const *seq,
-	int64_t seq_len)
+	struct gref_seq_interval_s iv)
 {
-	struct gref_s *pool = (struct gref_s *)_pool;
-	// debug("append segment");
-
-	/* gref object is mutable only when type == POOL */
-	if(pool == NULL || pool->type != GREF_POOL) { return(-1); }
-
-	/* add sequence at the tail of the seq buffer */
-	struct gref_seq_interval_s iv = pool->append_seq(pool, seq, seq_len);
-
 	/* update length */
 	pool->seq_len += iv.tail - iv.base;
 
@@ -481,6 +983,27 @@ int gref_append_segment(
 	return(0);
 }
 
+/**
+ * @fn gref_append_segment
+ */
+int gref_append_segment(
+	gref_pool_t *_pool,
+	char const *name,
+	int32_t name_len,
+	uint8_t const *seq,
+	int64_t seq_len)
+{
+	struct gref_s *pool = (struct gref_s *)_pool;
+	// debug("append segment");
+
+	/* gref object is mutable only when type == POOL */
+	if(pool == NULL || pool->type != GREF_POOL) { return(-1); }
+
+	/* add sequence at the tail of the seq buffer */
+	struct gref_seq_interval_s iv = pool->append_seq(pool, seq, seq_len);
+	return(gref_add_segment(pool, name, name_len, iv));
+}
+
 /**
  * @fn gref_append_link
  */
@@ -520,8 +1043,93 @@ int gref_append_link(
 	return(0);
 }
 
+/**
+ * @fn gref_apply_snp
+ * @brief or the alternate allele into the 4bit base at pos on section id. N
+ * (0x00) is left as is, since the kmers on it are not enumerated anyway.
+ */
+static _force_inline
+int gref_apply_snp(
+	struct gref_s *pool,
+	uint32_t id,
+	int64_t pos,
+	uint8_t snp)
+{
+	struct gref_section_intl_s const *sec =
+		(struct gref_section_intl_s const *)hmap_get_object(pool->hmap, id);
+
+	/* undefined sections have len == 0 */
+	if(pos < 0 || pos >= sec->fw_sec.len) { return(-1); }
+
+	uint8_t const c = (pool->params.seq_format == GREF_ASCII) ? gref_encode_4bit(snp) : (snp & 0x0f);
+	if(c == 0) { return(-1); }
+
+	/* fw_sec.base is relative to the head margin in the pool */
+	uint8_t *p = &lmm_kv_at(pool->seq, pool->params.seq_head_margin + (uint64_t)sec->fw_sec.base + pos);
+	if(*p != 0) { *p |= c; }
+	return(0);
+}
+
+/**
+ * @fn gref_hash_name
+ */
+static _force_inline
+uint64_t gref_hash_name(
+	char const *name,
+	int32_t name_len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for(int32_t i = 0; i < name_len; i++) {
+		h = (h ^ (uint8_t)name[i]) * 0x100000001b3ULL;
+	}
+	return(h ^ (h>>32));
+}
+
+/**
+ * @fn gref_find_id
+ * @brief id of the name, (uint32_t)-1 if not in the hmap. unlike hmap_get_id,
+ * the name is not inserted. the ids are indexed on name_tab, which is extended
+ * to the names added to the hmap since the last lookup.
+ */
+static _force_inline
+uint32_t gref_find_id(
+	struct gref_s *pool,
+	char const *name,
+	int32_t name_len)
+{
+	uint32_t const cnt = hmap_get_count(pool->hmap);
+	if(2 * (uint64_t)cnt >= pool->name_tab_size) {
+		/* rebuild at the load factor below 0.5 */
+		uint64_t size = MAX2(pool->name_tab_size, 64);
+		while(2 * (uint64_t)cnt >= size) { size *= 2; }
+		uint32_t *tab = (uint32_t *)lmm_malloc(pool->lmm, sizeof(uint32_t) * size);
+		if(tab == NULL) { return((uint32_t)-1); }
+		memset(tab, 0xff, sizeof(uint32_t) * size);
+		lmm_free(pool->lmm, pool->name_tab);
+		pool->name_tab = tab;
+		pool->name_tab_size = size;
+		pool->name_tab_cnt = 0;
+	}
+
+	uint64_t const mask = pool->name_tab_size - 1;
+	for(uint32_t id = pool->name_tab_cnt; id < cnt; id++) {
+		struct hmap_key_s key = hmap_get_key(pool->hmap, id);
+		uint64_t j = gref_hash_name(key.str, key.len) & mask;
+		while(pool->name_tab[j] != (uint32_t)-1) { j = (j + 1) & mask; }
+		pool->name_tab[j] = id;
+	}
+	pool->name_tab_cnt = cnt;
+
+	for(uint64_t j = gref_hash_name(name, name_len) & mask; pool->name_tab[j] != (uint32_t)-1; j = (j + 1) & mask) {
+		struct hmap_key_s key = hmap_get_key(pool->hmap, pool->name_tab[j]);
+		if(key.len == name_len && memcmp(key.str, name, name_len) == 0) { return(pool->name_tab[j]); }
+	}
+	return((uint32_t)-1);
+}
+
 /**
  * @fn gref_append_snp
+ * @brief the sequence must be owned by the pool (GREF_COPY)
  */
 int gref_append_snp(
 	gref_pool_t *_pool,
@@ -534,14 +1142,52 @@ int gref_append_snp(
 
 	/* gref object is mutable only when type == POOL */
 	if(pool == NULL || pool->type != GREF_POOL) { return(-1); }
+	if(pool->params.copy_mode != GREF_COPY) { return(-1); }
 
-	/* fixme: not implemented yet */
-	return(0);
+	/* unknown names are not inserted */
+	uint32_t id = gref_find_id(pool, name, name_len);
+	if(id == (uint32_t)-1) { return(-1); }
+	return(gref_apply_snp(pool, id, pos, snp));
+}
+
+/**
+ * @fn gref_append_snp_batch
+ * @brief the name lookup is skipped while consecutive records are on the same
+ * segment (e.g. sorted vcf records). returns the number of records applied; the
+ * records after the first invalid one are not applied.
+ */
+int64_t gref_append_snp_batch(
+	gref_pool_t *_pool,
+	struct gref_snp_s const *snp,
+	int64_t cnt)
+{
+	struct gref_s *pool = (struct gref_s *)_pool;
+
+	/* gref object is mutable only when type == POOL */
+	if(pool == NULL || pool->type != GREF_POOL) { return(-1); }
+	if(pool->params.copy_mode != GREF_COPY) { return(-1); }
+
+	char const *prev_name = NULL;
+	int32_t prev_len = -1;
+	uint32_t id = 0;
+	for(int64_t i = 0; i < cnt; i++) {
+		if(snp[i].name_len != prev_len
+		|| (snp[i].name != prev_name && memcmp(snp[i].name, prev_name, prev_len) != 0)) {
+			id = gref_find_id(pool, snp[i].name, snp[i].name_len);
+			prev_name = snp[i].name;
+			prev_len = snp[i].name_len;
+		}
+		if(id == (uint32_t)-1 || gref_apply_snp(pool, id, snp[i].pos, snp[i].allele) != 0) {
+			return(i);
+		}
+	}
+	return(cnt);
 }
 
 /**
  * @fn gref_split_segment
  * @brief split base section and give new name (splitted) to the latter section.
+ * meant for structural variants; snvs are stored in place with gref_append_snp.
  */
 int gref_split_segment(
 	gref_pool_t *_pool,
@@ -561,17 +1207,487 @@ int gref_split_segment(
 }
 
 /**
- * @fn gref_merge_pools
- * @brief merge two pools
+ * @fn gref_merge_pools_intl
+ * @brief append sections and links of pool2 to pool1. the sequence is copied
+ * as is (not encoded again), ids of pool2 are remapped through the hmap of
+ * pool1. returns -1 if the params differ or a segment is defined in both,
+ * pool2 is left untouched in any case.
  */
-gref_pool_t *gref_merge_pools(
+static
+int gref_merge_pools_intl(
+	struct gref_s *pool1,
+	struct gref_s *pool2)
+{
+	uint32_t *map = NULL;
+
+	/* params must be the same except for those of the runtime */
+	struct gref_params_s p = pool2->params;
+	p.num_threads = pool1->params.num_threads;
+	p.hash_size = pool1->params.hash_size;
+	p.lmm = pool1->params.lmm;
+	p.table_mem = pool1->params.table_mem;
+	if(memcmp(&p, &pool1->params, sizeof(struct gref_params_s)) != 0) {
+		goto _gref_merge_pools_error_handler;
+	}
+
+	/* id mapping; segments are those whose reverse half was set in gref_append_segment */
+	uint32_t const sec_cnt = pool2->sec_cnt;
+	map = (uint32_t *)lmm_malloc(pool1->lmm, sizeof(uint32_t) * MAX2(1, sec_cnt));
+	if(map == NULL) {
+		goto _gref_merge_pools_error_handler;
+	}
+	struct gref_section_intl_s const *sec2 =
+		(struct gref_section_intl_s const *)hmap_get_object(pool2->hmap, 0);
+	for(uint32_t i = 0; i < sec_cnt; i++) {
+		struct hmap_key_s key = hmap_get_key(pool2->hmap, i);
+		map[i] = hmap_get_id(pool1->hmap, key.str, key.len);
+		pool1->sec_cnt = MAX2(pool1->sec_cnt, map[i] + 1);
+	}
+
+	/* sequence, offsets of pool2 are shifted by the current length of pool1 */
+	uint64_t ofs = 0;
+	if(pool1->params.copy_mode == GREF_COPY) {
+		uint64_t const head = pool1->params.seq_head_margin;
+		ofs = lmm_kv_size(pool1->seq) - head;
+		lmm_kv_pushm(pool1->lmm, pool1->seq, lmm_kv_ptr(pool2->seq) + head, lmm_kv_size(pool2->seq) - head);
+		if(lmm_kv_ptr(pool1->seq) == NULL) {
+			goto _gref_merge_pools_error_handler;
+		}
+	}
+	pool1->seq_len += pool2->seq_len;
+
+	/* sections */
+	for(uint32_t i = 0; i < sec_cnt; i++) {
+		if(sec2[i].rv_sec.gid != _encode_id(i, 1)) { continue; }	/* only referenced by links */
+
+		uint32_t id = map[i];
+		struct gref_section_intl_s *sec =
+			(struct gref_section_intl_s *)hmap_get_object(pool1->hmap, id);
+		if(sec->rv_sec.gid == _encode_id(id, 1)) {
+			/* defined in both */
+			goto _gref_merge_pools_error_handler;
+		}
+		sec->base_gid = _encode_id(id, 0);
+		sec->fw_link_idx_base = 0;
+		sec->rv_link_idx_base = 0;
+		sec->fw_sec = (struct gref_section_s){
+			.gid = _encode_id(id, 0),
+			.len = sec2[i].fw_sec.len,
+			.base = sec2[i].fw_sec.base + ofs
+		};
+		sec->rv_sec = (struct gref_section_s){
+			.gid = _encode_id(id, 1),
+			.len = sec2[i].rv_sec.len,
+			.base = NULL
+		};
+	}
+
+	/* links */
+	int64_t const link_cnt = lmm_kv_size(pool2->link);
+	lmm_kv_reserve(pool1->lmm, pool1->link, lmm_kv_size(pool1->link) + link_cnt);
+	if(lmm_kv_ptr(pool1->link) == NULL) {
+		goto _gref_merge_pools_error_handler;
+	}
+	for(int64_t i = 0; i < link_cnt; i++) {
+		struct gref_gid_pair_s l = lmm_kv_at(pool2->link, i);
+		lmm_kv_at(pool1->link, lmm_kv_size(pool1->link) + i) = (struct gref_gid_pair_s){
+			.from = _encode_id(map[_decode_id(l.from)], _decode_dir(l.from)),
+			.to = _encode_id(map[_decode_id(l.to)], _decode_dir(l.to))
+		};
+	}
+	lmm_kv_size(pool1->link) += link_cnt;
+
+	lmm_free(pool1->lmm, map);
+	return(0);
+
+_gref_merge_pools_error_handler:;
+	lmm_free(pool1->lmm, map);
+	return(-1);
+}
+
+/**
+ * @fn gref_merge_pools
+ * @brief append sections and links of pool2 to pool1. both pools are consumed;
+ * NULL is returned if the params differ or a segment is defined in both.
+ */
+gref_pool_t *gref_merge_pools(
 	gref_pool_t *_pool1,
 	gref_pool_t *_pool2)
 {
-	/* not implemented yet */
+	struct gref_s *pool1 = (struct gref_s *)_pool1;
+	struct gref_s *pool2 = (struct gref_s *)_pool2;
+
+	if(pool1 == NULL || pool2 == NULL || pool1 == pool2
+	|| pool1->type != GREF_POOL || pool2->type != GREF_POOL
+	|| gref_merge_pools_intl(pool1, pool2) != 0) {
+		gref_clean((gref_t *)pool1);
+		if(pool2 != pool1) { gref_clean((gref_t *)pool2); }
+		return(NULL);
+	}
+	gref_clean((gref_t *)pool2);
+	return((gref_pool_t *)pool1);
+}
+
+
+/* file loaders */
+#define GREF_LOAD_BLOCK_SIZE		( 4 * 1024 * 1024 )
+
+/**
+ * @fn gref_is_loadable
+ * @brief the loaders encode text out of a reused block buffer, thus the pool
+ * must be in the ascii copy mode.
+ */
+static _force_inline
+int gref_is_loadable(
+	struct gref_s const *pool)
+{
+	return(pool != NULL && pool->type == GREF_POOL
+		&& pool->params.seq_format == GREF_ASCII
+		&& pool->params.copy_mode == GREF_COPY);
+}
+
+/**
+ * @enum gref_fasta_state_e
+ */
+enum gref_fasta_state_e {
+	GREF_FASTA_BOL = 0,				/* head of a line */
+	GREF_FASTA_NAME,				/* in the name field of a header */
+	GREF_FASTA_SKIP,				/* skipping the rest of the line */
+	GREF_FASTA_SEQ					/* in a sequence line */
+};
+
+/**
+ * @fn gref_load_fasta_intl
+ * @brief streaming fasta parser. sequence lines are passed to the encoder
+ * directly from the block buffer and concatenated in the seq array. only the
+ * name is buffered since it may span blocks.
+ */
+static
+int gref_load_fasta_intl(
+	struct gref_s *pool,
+	zf_t *fp,
+	uint64_t block_size)
+{
+	uint8_t *buf = (uint8_t *)lmm_malloc(pool->lmm, block_size);
+	lmm_kvec_t(char) name;
+	lmm_kv_init(pool->lmm, name);
+	if(buf == NULL || lmm_kv_ptr(name) == NULL) {
+		goto _gref_load_fasta_intl_error_handler;
+	}
+
+	#define _flush() ( \
+		gref_add_segment(pool, lmm_kv_ptr(name), lmm_kv_size(name), (struct gref_seq_interval_s){ \
+			.base = base, \
+			.tail = lmm_kv_size(pool->seq) \
+		}) \
+	)
+
+	uint32_t state = GREF_FASTA_BOL;
+	int64_t in_rec = 0;
+	uint64_t base = 0;
+	size_t len;
+	while((len = zfread(fp, buf, block_size)) > 0) {
+		uint8_t const *p = buf, *t = buf + len;
+		while(p < t) {
+			uint8_t const *q = p;
+			switch(state) {
+				case GREF_FASTA_BOL:
+					if(*p == '>') {
+						if(in_rec && _flush() != 0) {
+							goto _gref_load_fasta_intl_error_handler;
+						}
+						in_rec = 0;
+						lmm_kv_clear(pool->lmm, name);
+						state = GREF_FASTA_NAME; p++;
+					} else if(*p == '\n' || *p == '\r') {
+						p++;		/* empty line */
+					} else if(*p == ';') {
+						state = GREF_FASTA_SKIP;		/* comment line */
+					} else {
+						/* lines before the first header are ignored */
+						state = in_rec ? GREF_FASTA_SEQ : GREF_FASTA_SKIP;
+					}
+					break;
+				case GREF_FASTA_NAME:
+					while(q < t && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r') { q++; }
+					lmm_kv_pushm(pool->lmm, name, p, q - p);
+					if(lmm_kv_ptr(name) == NULL) {
+						goto _gref_load_fasta_intl_error_handler;
+					}
+					if(q < t) {
+						/* name terminated; the description is discarded */
+						in_rec = 1;
+						base = lmm_kv_size(pool->seq);
+						state = GREF_FASTA_SKIP;
+					}
+					p = q;
+					break;
+				case GREF_FASTA_SKIP:
+					if((q = memchr(p, '\n', t - p)) == NULL) {
+						p = t;
+					} else {
+						p = q + 1; state = GREF_FASTA_BOL;
+					}
+					break;
+				case GREF_FASTA_SEQ:
+					if((q = memchr(p, '\n', t - p)) == NULL) { q = t; }
+					uint8_t const *e = q;
+					while(e > p && e[-1] == '\r') { e--; }
+					pool->append_seq(pool, p, e - p);
+					if(lmm_kv_ptr(pool->seq) == NULL) {
+						goto _gref_load_fasta_intl_error_handler;
+					}
+					if(q < t) { state = GREF_FASTA_BOL; q++; }
+					p = q;
+					break;
+			}
+		}
+	}
+
+	/* the last record; header at the end of the file without newline */
+	if(state == GREF_FASTA_NAME) {
+		in_rec = 1;
+		base = lmm_kv_size(pool->seq);
+	}
+	if(in_rec && _flush() != 0) {
+		goto _gref_load_fasta_intl_error_handler;
+	}
+	#undef _flush
+
+	lmm_kv_destroy(pool->lmm, name);
+	lmm_free(pool->lmm, buf);
+	return(0);
+
+_gref_load_fasta_intl_error_handler:;
+	lmm_kv_destroy(pool->lmm, name);
+	lmm_free(pool->lmm, buf);
+	return(-1);
+}
+
+/**
+ * @fn gref_load_fasta
+ * @brief append all the records in a (optionally gzipped) fasta file as segments
+ */
+int gref_load_fasta(
+	gref_pool_t *_pool,
+	char const *path)
+{
+	struct gref_s *pool = (struct gref_s *)_pool;
+	if(!gref_is_loadable(pool)) { return(-1); }
+
+	zf_t *fp = zfopen(path, "r");
+	if(fp == NULL) { return(-1); }
+	int ret = gref_load_fasta_intl(pool, fp, GREF_LOAD_BLOCK_SIZE);
+	zfclose(fp);
+	return(ret);
+}
+
+/**
+ * @fn gref_parse_gfa
+ * @brief parse S and L lines in [p, t), which must consist of complete lines.
+ * the other record types are ignored.
+ */
+static
+int gref_parse_gfa(
+	struct gref_s *pool,
+	uint8_t const *p,
+	uint8_t const *t)
+{
+	while(p < t) {
+		uint8_t const *eol = memchr(p, '\n', t - p);
+		if(eol == NULL) { eol = t; }
+		uint8_t const *e = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+		/* split the first five fields, f[cnt] is a sentinel */
+		uint8_t const *f[7] = { p };
+		int64_t cnt = 1;
+		for(uint8_t const *q = p; cnt < 6 && (q = memchr(q, '\t', e - q)) != NULL; ) {
+			f[cnt++] = ++q;
+		}
+		f[cnt] = e + 1;
+		#define _len(_i)		( (int32_t)(f[(_i) + 1] - f[_i] - 1) )
+
+		if(_len(0) == 1 && *p == 'S' && cnt >= 3) {
+			/* '*' stands for an unspecified sequence */
+			int64_t seq_len = (_len(2) == 1 && *f[2] == '*') ? 0 : _len(2);
+			if(gref_append_segment((gref_pool_t *)pool,
+				(char const *)f[1], _len(1), f[2], seq_len) != 0) {
+				return(-1);
+			}
+		} else if(_len(0) == 1 && *p == 'L' && cnt >= 5) {
+			if(_len(2) != 1 || _len(4) != 1) { return(-1); }
+			if(gref_append_link((gref_pool_t *)pool,
+				(char const *)f[1], _len(1), *f[2] == '-',
+				(char const *)f[3], _len(3), *f[4] == '-') != 0) {
+				return(-1);
+			}
+		}
+		#undef _len
+		p = eol + 1;
+	}
+	return(0);
+}
+
+/**
+ * @struct gref_gfa_shard_s
+ */
+struct gref_gfa_shard_s {
+	struct gref_s *pool;
+	uint8_t const *p, *t;
+	int64_t started;				/* run in a worker thread */
+	int64_t ret;
+};
+
+/**
+ * @fn gref_parse_gfa_worker
+ */
+static
+void *gref_parse_gfa_worker(
+	void *arg)
+{
+	struct gref_gfa_shard_s *s = (struct gref_gfa_shard_s *)arg;
+	s->ret = gref_parse_gfa(s->pool, s->p, s->t);
 	return(NULL);
 }
 
+/**
+ * @fn gref_load_gfa_intl
+ * @brief the input is read in chunks of num_threads blocks, each chunk is split
+ * at line boundaries and parsed into per-thread pools, which are merged in the
+ * file order. the resulting ids are identical to those of the sequential parse.
+ */
+static
+int gref_load_gfa_intl(
+	struct gref_s *pool,
+	zf_t *fp,
+	uint64_t block_size)
+{
+	int64_t const num_threads = MAX2(1, pool->params.num_threads);
+	uint64_t size = num_threads * block_size, used = 0;
+	uint8_t *buf = (uint8_t *)lmm_malloc(pool->lmm, size);
+	struct gref_gfa_shard_s *shard = (struct gref_gfa_shard_s *)lmm_malloc(pool->lmm,
+		sizeof(struct gref_gfa_shard_s) * num_threads);
+	pthread_t *th = (pthread_t *)lmm_malloc(pool->lmm, sizeof(pthread_t) * num_threads);
+	if(buf == NULL || shard == NULL || th == NULL) {
+		goto _gref_load_gfa_intl_error_handler;
+	}
+
+	/* the lmm is not thread-safe; the per-thread pools are on malloc */
+	struct gref_params_s params = pool->params;
+	params.lmm = NULL;
+	params.num_threads = 1;
+	for(int64_t i = 0; i < num_threads; i++) {
+		shard[i].pool = NULL;
+	}
+
+	int64_t eof = 0;
+	while(!eof) {
+		size_t len = zfread(fp, buf + used, size - used);
+		eof = (len == 0);
+		used += len;
+
+		/* complete lines; the last line may lack the newline at the end of file */
+		uint8_t *tail = buf + used;
+		while(!eof && tail > buf && tail[-1] != '\n') { tail--; }
+		if(tail == buf && !eof) {
+			/* no newline in the buffer; extend it for the long line */
+			uint8_t *b = (uint8_t *)lmm_realloc(pool->lmm, buf, 2 * size);
+			if(b == NULL) {
+				goto _gref_load_gfa_intl_error_handler;
+			}
+			buf = b; size *= 2;
+			continue;
+		}
+
+		/* split at line boundaries */
+		uint8_t const *p = buf;
+		for(int64_t i = 0; i < num_threads; i++) {
+			uint8_t const *q = MAX2(p, buf + (tail - buf) * (i + 1) / num_threads);
+			if(i == num_threads - 1 || (q = memchr(q, '\n', tail - q)) == NULL) {
+				q = tail;
+			} else {
+				q++;
+			}
+			shard[i].p = p;
+			shard[i].t = q;
+			p = q;
+		}
+
+		/* all the pools are allocated before any thread is started */
+		for(int64_t i = 1; i < num_threads; i++) {
+			if((shard[i].pool = (struct gref_s *)gref_init_pool(&params)) == NULL) {
+				goto _gref_load_gfa_intl_error_handler;
+			}
+		}
+
+		/* the first chunk is parsed into the pool in the current thread */
+		shard[0].pool = pool;
+		for(int64_t i = 1; i < num_threads; i++) {
+			shard[i].started = (pthread_create(&th[i], NULL, gref_parse_gfa_worker, (void *)&shard[i]) == 0);
+		}
+		gref_parse_gfa_worker((void *)&shard[0]);
+		for(int64_t i = 1; i < num_threads; i++) {
+			if(shard[i].started) {
+				pthread_join(th[i], NULL);
+			} else {
+				gref_parse_gfa_worker((void *)&shard[i]);		/* failed to create the thread */
+			}
+		}
+
+		/* merge in the file order */
+		int64_t ret = shard[0].ret;
+		shard[0].pool = NULL;
+		for(int64_t i = 1; i < num_threads; i++) {
+			ret |= shard[i].ret;
+			if(ret == 0) {
+				ret = gref_merge_pools_intl(pool, shard[i].pool);
+			}
+			gref_clean((gref_t *)shard[i].pool); shard[i].pool = NULL;
+		}
+		if(ret != 0) {
+			goto _gref_load_gfa_intl_error_handler;
+		}
+
+		/* move the incomplete line to the head */
+		memmove(buf, tail, buf + used - tail);
+		used -= tail - buf;
+	}
+
+	lmm_free(pool->lmm, th);
+	lmm_free(pool->lmm, shard);
+	lmm_free(pool->lmm, buf);
+	return(0);
+
+_gref_load_gfa_intl_error_handler:;
+	if(shard != NULL) {
+		for(int64_t i = 1; i < num_threads; i++) {
+			gref_clean((gref_t *)shard[i].pool);
+		}
+	}
+	lmm_free(pool->lmm, th);
+	lmm_free(pool->lmm, shard);
+	lmm_free(pool->lmm, buf);
+	return(-1);
+}
+
+/**
+ * @fn gref_load_gfa
+ * @brief append segments and links in a (optionally gzipped) gfa file
+ */
+int gref_load_gfa(
+	gref_pool_t *_pool,
+	char const *path)
+{
+	struct gref_s *pool = (struct gref_s *)_pool;
+	if(!gref_is_loadable(pool)) { return(-1); }
+
+	zf_t *fp = zfopen(path, "r");
+	if(fp == NULL) { return(-1); }
+	int ret = gref_load_gfa_intl(pool, fp, GREF_LOAD_BLOCK_SIZE);
+	zfclose(fp);
+	return(ret);
+}
+
 
 /* build link table (pool -> acv conversion) */
 
@@ -678,6 +1794,174 @@ int gref_build_link_idx_table(
 	return(0);
 }
 
+/* 2bit storage */
+/**
+ * @fn gref_find_exc
+ * @brief returns the exception run containing pos, NULL if pos is ACGT
+ */
+static _force_inline
+struct gref_seq_exc_s const *gref_find_exc(
+	struct gref_s const *gref,
+	uint64_t pos)
+{
+	uint64_t const word = pos>>5;
+	if((gref->seq_exc_map[word>>6] & (0x01ULL<<(word & 0x3f))) == 0) { return(NULL); }
+
+	/* the last run starting at or before pos */
+	int64_t lo = 0, hi = gref->seq_exc_cnt;
+	while(hi - lo > 1) {
+		int64_t mid = (lo + hi) / 2;
+		if(gref->seq_exc[mid].pos <= pos) { lo = mid; } else { hi = mid; }
+	}
+	struct gref_seq_exc_s const *e = &gref->seq_exc[lo];
+	return((e->pos <= pos && pos < e->pos + e->len) ? e : NULL);
+}
+
+/**
+ * @fn gref_decode_base_2bit
+ */
+static _force_inline
+uint8_t gref_decode_base_2bit(
+	struct gref_s const *gref,
+	uint64_t pos)
+{
+	struct gref_seq_exc_s const *e = gref_find_exc(gref, pos);
+	if(e != NULL) { return(e->base); }
+	return(0x01<<(0x03 & (gref->seq_2bit[pos>>5]>>(2 * (pos & 0x1f)))));
+}
+
+/**
+ * @fn gref_decode_2bit
+ * @brief decode [pos, pos + len) of the 2bit array to 4bit codes, word by word,
+ * then overwrite the exceptions.
+ */
+static
+void gref_decode_2bit(
+	struct gref_s const *gref,
+	uint64_t pos,
+	int64_t len,
+	uint8_t *dst)
+{
+	for(int64_t i = 0; i < len;) {
+		uint64_t p = pos + i;
+		uint64_t w = gref->seq_2bit[p>>5]>>(2 * (p & 0x1f));
+		int64_t n = MIN2(len - i, 32 - (int64_t)(p & 0x1f));
+		for(int64_t j = 0; j < n; j++) {
+			dst[i + j] = 0x01<<(0x03 & (w>>(2 * j)));
+		}
+		i += n;
+	}
+
+	/* exceptions overlapping the range */
+	int64_t lo = 0, hi = gref->seq_exc_cnt;
+	while(lo < hi) {
+		int64_t mid = (lo + hi) / 2;
+		if(gref->seq_exc[mid].pos + gref->seq_exc[mid].len <= pos) { lo = mid + 1; } else { hi = mid; }
+	}
+	for(int64_t i = lo; i < gref->seq_exc_cnt && gref->seq_exc[i].pos < pos + len; i++) {
+		struct gref_seq_exc_s const *e = &gref->seq_exc[i];
+		uint64_t head = MAX2(e->pos, pos), tail = MIN2(e->pos + e->len, pos + len);
+		memset(&dst[head - pos], e->base, tail - head);
+	}
+	return;
+}
+
+/**
+ * @fn gref_pack_seq
+ * @brief convert the byte sequence to the 2bit storage. fw bases must be valid
+ * pointers (copy-mode layout). bases are replaced with offsets in the 2bit array,
+ * reverse ones are mirrored around GREF_SEQ_LIM as in the fw_only mode.
+ */
+static
+int gref_pack_seq(
+	struct gref_s *gref)
+{
+	uint64_t const words = (gref->seq_len + 31) / 32 + 1;
+	uint64_t *seq = (uint64_t *)lmm_malloc(gref->lmm, sizeof(uint64_t) * words);
+	uint64_t *map = (uint64_t *)lmm_malloc(gref->lmm, sizeof(uint64_t) * ((words + 63) / 64));
+	if(seq == NULL || map == NULL) {
+		lmm_free(gref->lmm, seq); lmm_free(gref->lmm, map);
+		return(-1);
+	}
+	memset(seq, 0, sizeof(uint64_t) * words);
+	memset(map, 0, sizeof(uint64_t) * ((words + 63) / 64));
+
+	lmm_kvec_t(struct gref_seq_exc_s) exc;
+	lmm_kv_init(gref->lmm, exc);
+
+	struct gref_section_intl_s *sec =
+		(struct gref_section_intl_s *)hmap_get_object(gref->hmap, 0);
+	uint64_t const rv_lim = 2 * (uint64_t)GREF_SEQ_LIM;
+	uint64_t pos = 0;
+	for(int64_t i = 0; i < gref->sec_cnt; i++) {
+		uint8_t const *p = sec[i].fw_sec.base;
+		uint64_t base = pos;
+		for(int64_t j = 0; j < sec[i].fw_sec.len; j++, pos++) {
+			uint8_t c = p[j];
+			if(c != 0 && (c & (c - 1)) == 0) {
+				seq[pos>>5] |= (uint64_t)__builtin_ctz(c)<<(2 * (pos & 0x1f));
+				continue;
+			}
+
+			/* exception, extend the last run if possible */
+			struct gref_seq_exc_s *e = (lmm_kv_size(exc) > 0) ? &lmm_kv_at(exc, lmm_kv_size(exc) - 1) : NULL;
+			if(e != NULL && e->pos + e->len == pos && e->base == c && e->len < UINT32_MAX) {
+				e->len++;
+			} else {
+				lmm_kv_push(gref->lmm, exc, ((struct gref_seq_exc_s){ .pos = pos, .len = 1, .base = c }));
+				if(lmm_kv_ptr(exc) == NULL) {
+					lmm_free(gref->lmm, seq); lmm_free(gref->lmm, map);
+					return(-1);
+				}
+			}
+			map[pos>>11] |= 0x01ULL<<((pos>>5) & 0x3f);
+		}
+		sec[i].fw_sec.base = (uint8_t const *)base;
+		sec[i].rv_sec.base = (uint8_t const *)(rv_lim - base - sec[i].fw_sec.len);
+	}
+
+	/* release byte sequence */
+	gref_free(gref, lmm_kv_ptr(gref->seq));
+	lmm_kv_ptr(gref->seq) = NULL;
+	lmm_kv_size(gref->seq) = lmm_kv_max(gref->seq) = 0;
+
+	gref->seq_lim = GREF_SEQ_LIM;
+	gref->seq_2bit = seq;
+	gref->seq_exc_map = map;
+	gref->seq_exc = lmm_kv_ptr(exc);
+	gref->seq_exc_cnt = lmm_kv_size(exc);
+	return(0);
+}
+
+/**
+ * @fn gref_unpack_seq
+ * @brief restore the byte sequence (copy-mode layout with fw pointers) from the 2bit storage
+ */
+static
+int gref_unpack_seq(
+	struct gref_s *gref)
+{
+	uint64_t const head = gref->params.seq_head_margin;
+	uint8_t *seq = (uint8_t *)lmm_malloc(gref->lmm, MAX2(1, head + gref->seq_len));
+	if(seq == NULL) { return(-1); }
+	gref_decode_2bit(gref, 0, gref->seq_len, seq + head);
+
+	struct gref_section_intl_s *sec =
+		(struct gref_section_intl_s *)hmap_get_object(gref->hmap, 0);
+	for(int64_t i = 0; i < gref->sec_cnt; i++) {
+		sec[i].fw_sec.base = seq + head + (uint64_t)sec[i].fw_sec.base;
+	}
+
+	lmm_kv_ptr(gref->seq) = seq;
+	lmm_kv_size(gref->seq) = lmm_kv_max(gref->seq) = head + gref->seq_len;
+
+	lmm_free(gref->lmm, gref->seq_2bit); gref->seq_2bit = NULL;
+	lmm_free(gref->lmm, gref->seq_exc_map); gref->seq_exc_map = NULL;
+	lmm_free(gref->lmm, gref->seq_exc); gref->seq_exc = NULL;
+	gref->seq_exc_cnt = 0;
+	return(0);
+}
+
 /**
  * @fn gref_*_*_modify_seq
  * @brief calculate pos and lim of reverse section, append rv seq if needed
@@ -745,7 +2029,9 @@ int gref_fr_copy_modify_seq(
 		0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
 	};
 	uint64_t fw_tail_pos = pool->seq_len + pool->params.seq_head_margin;
-	for(int64_t i = 0; i < pool->seq_len; i++) {
+	int64_t i = gref_arch_rev_table16(&lmm_kv_at(pool->seq, fw_tail_pos),
+		&lmm_kv_at(pool->seq, pool->params.seq_head_margin), pool->seq_len, comp);
+	for(; i < pool->seq_len; i++) {
 		lmm_kv_at(pool->seq, fw_tail_pos + i) = comp[lmm_kv_at(pool->seq, fw_tail_pos - 1 - i)];
 	}
 
@@ -754,7 +2040,7 @@ int gref_fr_copy_modify_seq(
 	uint8_t const *rv_lim = pool->seq_lim = seq_base + 2 * pool->seq_len;
 
 	/* add offset to fw pos base, then calc rv pos base */
-	for(int64_t i = 0; i < pool->sec_cnt; i++) {
+	for(i = 0; i < pool->sec_cnt; i++) {
 		sec[i].rv_sec.base = rv_lim - (uint64_t)sec[i].fw_sec.base - sec[i].fw_sec.len;
 		sec[i].fw_sec.base += (uint64_t)seq_base;	/* convert pos to valid pointer */
 		debug("%llu", (uint64_t)(sec[i].rv_sec.base - sec[i].fw_sec.base));
@@ -791,20 +2077,24 @@ int gref_flush_modified_seq(
 		lmm_kv_ptr(acv->seq) = NULL;
 		return(0);
 	}
-
-	/* resize */
-	lmm_kv_resize(acv->lmm, acv->seq, acv->seq_len);
-	lmm_kv_size(acv->seq) = acv->seq_len;
-	if(lmm_kv_ptr(acv->seq) == NULL) { return(-1); }
+	if(acv->seq_2bit != NULL && gref_unpack_seq(acv) != 0) {
+		return(-1);
+	}
 
 	/* subtract seq_base from fw_sec, clear rv_sec with NULL */
 	uint64_t seq_base = (uint64_t)lmm_kv_ptr(acv->seq) + acv->params.seq_head_margin;
 	struct gref_section_intl_s *sec =
 		(struct gref_section_intl_s *)hmap_get_object(acv->hmap, 0);
-	for(int64_t i = 0; i < 2 * (acv->sec_cnt + 1); i++) {
+	for(int64_t i = 0; i < acv->sec_cnt; i++) {
 		sec[i].fw_sec.base -= seq_base;
 		sec[i].rv_sec.base = NULL;
 	}
+
+	/* resize (remove reverse sequence and tail margin) */
+	uint64_t size = acv->params.seq_head_margin + acv->seq_len;
+	lmm_kv_resize(acv->lmm, acv->seq, size);
+	lmm_kv_size(acv->seq) = size;
+	if(lmm_kv_ptr(acv->seq) == NULL) { return(-1); }
 	return(0);
 }
 
@@ -863,9 +2153,38 @@ int gref_expand_link_table(
 			};
 		}
 	}
+	lmm_kv_size(acv->link) = link_table_size;
 	return(0);
 }
 
+/**
+ * @fn gref_modify_seq
+ * @brief convert the pool layout (fw bases at offsets) to that of the archive
+ */
+static
+int gref_modify_seq(
+	struct gref_s *pool)
+{
+	int (*modify_seq[][3])(struct gref_s *pool) = {
+		[GREF_FW_ONLY] = {
+			[GREF_COPY] = gref_fw_copy_modify_seq,
+			[GREF_NOCOPY] = gref_fw_nocopy_modify_seq
+		},
+		[GREF_FW_RV] = {
+			[GREF_COPY] = gref_fr_copy_modify_seq,
+			[GREF_NOCOPY] = gref_fr_nocopy_modify_seq
+		}
+	};
+	if(pool->params.seq_storage == GREF_STORAGE_2BIT) {
+		/* the reverse strand is never materialized */
+		if(gref_fw_copy_modify_seq(pool) != 0 || gref_pack_seq(pool) != 0) {
+			return(-1);
+		}
+		return(0);
+	}
+	return(modify_seq[pool->params.seq_direction][pool->params.copy_mode](pool));
+}
+
 /**
  * @fn gref_freeze_pool
  */
@@ -880,23 +2199,17 @@ gref_acv_t *gref_freeze_pool(
 		goto _gref_freeze_pool_error_handler;
 	}
 
+	memset(gref->phase_sec, 0, sizeof(double) * GREF_PHASE_CNT);
+	_stats_init(t);
+
 	/* push tail sentinel */
 	gref_add_tail_section(gref);
 
 	/* modify seq */
-	int (*modify_seq[][3])(struct gref_s *pool) = {
-		[GREF_FW_ONLY] = {
-			[GREF_COPY] = gref_fw_copy_modify_seq,
-			[GREF_NOCOPY] = gref_fw_nocopy_modify_seq
-		},
-		[GREF_FW_RV] = {
-			[GREF_COPY] = gref_fr_copy_modify_seq,
-			[GREF_NOCOPY] = gref_fr_nocopy_modify_seq
-		}
-	};
-	if(modify_seq[gref->params.seq_direction][gref->params.copy_mode](gref) != 0) {
+	if(gref_modify_seq(gref) != 0) {
 		goto _gref_freeze_pool_error_handler;
 	}
+	_stats_lap(gref, GREF_PHASE_SEQ, t);
 
 	/*
 	struct gref_section_intl_s const *sec = 
@@ -918,6 +2231,7 @@ gref_acv_t *gref_freeze_pool(
 	if(gref_shrink_link_table(gref) != 0) {
 		goto _gref_freeze_pool_error_handler;
 	}
+	_stats_lap(gref, GREF_PHASE_LINK, t);
 
 	/* change type */
 	gref->type = GREF_ACV;
@@ -940,13 +2254,18 @@ gref_pool_t *gref_melt_archive(
 		goto _gref_melt_archive_error_handler;
 	}
 
+	/* copy arrays on the mapped file before modification */
+	if(gref_detach_mapped(gref) != 0) {
+		goto _gref_melt_archive_error_handler;
+	}
+
 	/* flush modifications */
 	if(gref_flush_modified_seq(gref) != 0) {
 		goto _gref_melt_archive_error_handler;
 	}
 
 	/* remove kmer table */
-	lmm_free(acv->lmm, gref->kmer_table); gref->kmer_table = NULL;
+	gref_free(gref, gref->kmer_table); gref->kmer_table = NULL;
 	gref->kmer_table_size = 0;
 
 	/* expand table */
@@ -977,6 +2296,7 @@ struct gref_iter_stack_s {
 	uint32_t sec_gid;
 	uint32_t link_idx;
 	uint8_t const *seq_ptr;
+	uint64_t seq_ofs;				/* offset in seq_2bit instead of seq_ptr in the 2bit storage */
 
 	/* sequence info */
 	uint32_t rem_len;
@@ -1010,55 +2330,230 @@ struct gref_iter_s {
 	uint32_t step_gid;
 	uint8_t seed_len;
 	uint8_t shift_len;
-	uint16_t reserved2;
+	uint8_t backtrack;				/* set when gref_iter_fetch rewinds to a branch */
+	uint8_t reserved2;
 
 	uint8_t const *seq_lim;
 	uint32_t const *link_table;
 	struct gref_section_half_s const *hsec;
+	struct gref_s const *packed;	/* non-NULL in the 2bit storage, stacks hold seq_ofs */
 
 	/* stack mem array */
 	struct gref_iter_stack_s *stack;
 	void *mem_arr[GREF_ITER_INTL_MEM_ARR_LEN];
+
+	/* sampling */
+	uint32_t step_size;
+	uint32_t max_expansion;			/* kmer_table_size never exceeds this */
+	struct gref_iter_mm_s *mm;		/* non-NULL in minimizer mode */
+
+	/* linear part of gref_iter_next_batch, specialized for k in GREF_KMER_KERNEL_LIST */
+	int64_t (*next_batch)(
+		struct gref_iter_s *iter,
+		struct gref_kmer_tuple_s *buf,
+		int64_t cap);
+
+	/* bases skipped at the head of the first section (cleared once the first stack is built) */
+	uint32_t head_pos;
+
+	/* maxima of the stack depth and kmer_table_size, recorded with GREF_STATS */
+	uint16_t max_depth;
+	uint16_t max_table;
 };
-_static_assert(sizeof(struct gref_iter_s) == 96);
+_static_assert(sizeof(struct gref_iter_s) == 136);
 
 /**
- * @fn gref_iter_add_stack
+ * @fn gref_hash_kmer
+ * @brief invertible integer hash on 2k bits (used to order minimizers)
  */
 static _force_inline
-struct gref_iter_stack_s *gref_iter_add_stack(
-	struct gref_iter_s *iter,
-	struct gref_iter_stack_s *stack)
+uint64_t gref_hash_kmer(
+	uint64_t key,
+	uint64_t mask)
 {
-	/* fixme: check remaining memory size and malloc if there is no room */
-	struct gref_iter_stack_s *new_stack = (struct gref_iter_stack_s *)(
-		(uint64_t *)(stack + 1) + stack->kmer_table_size);
-
-	debug("stack(%p), kmer_table_size(%u), new_stack(%p)",
-		stack, stack->kmer_table_size, new_stack);
-
-	/* link to previous stack */
-	new_stack->prev_stack = stack;
-
-	/* copy from previous stack */
-	new_stack->global_rem_len = stack->global_rem_len;
-
-	/* constant */
-	new_stack->shift_len = stack->shift_len;
-
-	/* copy buffer */
-	new_stack->len = stack->len;
-	new_stack->kmer_idx = 0;
-	new_stack->kmer_table_size = stack->kmer_table_size;
-	new_stack->cnt_arr = stack->cnt_arr;
-	memcpy(&new_stack->kmer, &stack->kmer, stack->kmer_table_size * sizeof(uint64_t));
-	return(new_stack);
+	key = (~key + (key<<21)) & mask;
+	key = key ^ (key>>24);
+	key = ((key + (key<<3)) + (key<<8)) & mask;
+	key = key ^ (key>>14);
+	key = ((key + (key<<2)) + (key<<4)) & mask;
+	key = key ^ (key>>28);
+	key = (key + (key<<31)) & mask;
+	return(key);
 }
 
 /**
- * @fn gref_iter_remove_stack
+ * @struct gref_iter_mm_s
+ * @brief minimizer sampler. records are kept per position in a ring buffer. the
+ * iterator walks the paths from the base section in depth-first order; on
+ * backtrack the records before the branch are shared with the previous path,
+ * so only the records after the branch are rewritten.
  */
-static _force_inline
+#define GREF_ITER_MM_RING_SIZE		( 128 )
+#define GREF_ITER_MM_INVALID		( (uint64_t)-1 )
+struct gref_iter_mm_rec_s {
+	uint64_t hash;
+	uint64_t kmer;
+	uint32_t pos;
+	uint32_t emitted;
+};
+struct gref_iter_mm_s {
+	uint64_t mask;
+	uint32_t window_size;
+	uint32_t gid;					/* base gid of the records */
+	int64_t last_pos;				/* tail of the current path, -1 if empty */
+	uint8_t started, done;
+	uint8_t reserved[6];
+
+	/* output queue */
+	int64_t q_head, q_cnt;
+	struct gref_kmer_tuple_s q[GREF_ITER_MM_RING_SIZE];
+	struct gref_iter_mm_rec_s ring[GREF_ITER_MM_RING_SIZE];
+};
+_static_assert(GREF_ITER_MM_RING_SIZE >= GREF_ITER_MM_MAX_WINDOW + 32);
+
+/**
+ * @fn gref_iter_mm_init
+ */
+static _force_inline
+void gref_iter_mm_init(
+	struct gref_iter_mm_s *mm,
+	uint32_t window_size,
+	int64_t k)
+{
+	mm->mask = (uint64_t)-1>>(64 - 2 * k);
+	mm->window_size = window_size;
+	mm->gid = (uint32_t)-1;
+	mm->last_pos = -1;
+	mm->started = mm->done = 0;
+	mm->q_head = mm->q_cnt = 0;
+	return;
+}
+
+/**
+ * @fn gref_iter_mm_push
+ */
+static _force_inline
+void gref_iter_mm_push(
+	struct gref_iter_mm_s *mm,
+	struct gref_iter_mm_rec_s *r)
+{
+	if(r == NULL || r->emitted) { return; }
+	r->emitted = 1;
+	mm->q[mm->q_cnt++] = (struct gref_kmer_tuple_s){
+		.kmer = r->kmer,
+		.gid_pos = (struct gref_gid_pos_s){
+			.pos = r->pos,
+			.gid = mm->gid
+		}
+	};
+	return;
+}
+
+/**
+ * @fn gref_iter_mm_window
+ * @brief push the leftmost minimum in [lo, hi]
+ */
+static _force_inline
+void gref_iter_mm_window(
+	struct gref_iter_mm_s *mm,
+	int64_t lo,
+	int64_t hi)
+{
+	struct gref_iter_mm_rec_s *min = NULL;
+	for(int64_t p = lo; p <= hi; p++) {
+		struct gref_iter_mm_rec_s *r = &mm->ring[p & (GREF_ITER_MM_RING_SIZE - 1)];
+		if(r->hash == GREF_ITER_MM_INVALID) { continue; }
+		if(min == NULL || r->hash < min->hash) { min = r; }
+	}
+	gref_iter_mm_push(mm, min);
+	return;
+}
+
+/**
+ * @fn gref_iter_mm_flush
+ * @brief windows truncated at the tail of the current path
+ */
+static _force_inline
+void gref_iter_mm_flush(
+	struct gref_iter_mm_s *mm)
+{
+	if(mm->last_pos < 0) { return; }
+	int64_t lo = MAX2(0, mm->last_pos - (int64_t)mm->window_size + 2);
+	for(int64_t p = lo; p <= mm->last_pos; p++) {
+		gref_iter_mm_window(mm, p, mm->last_pos);
+	}
+	return;
+}
+
+/**
+ * @fn gref_iter_mm_record
+ * @brief record the minimum of the kmers at the current position, then push
+ * the minimizer of the window ending at the position (truncated at the head
+ * of the section).
+ */
+static _force_inline
+void gref_iter_mm_record(
+	struct gref_iter_mm_s *mm,
+	struct gref_iter_stack_s const *stack)
+{
+	int64_t pos = stack->len - stack->rem_len;
+	struct gref_iter_mm_rec_s *r = &mm->ring[pos & (GREF_ITER_MM_RING_SIZE - 1)];
+
+	*r = (struct gref_iter_mm_rec_s){
+		.hash = GREF_ITER_MM_INVALID,
+		.kmer = 0,
+		.pos = pos,
+		.emitted = 0
+	};
+	for(int64_t i = stack->kmer_idx; i < stack->kmer_table_size; i++) {
+		uint64_t h = gref_hash_kmer(stack->kmer[i], mm->mask);
+		if(h < r->hash) {
+			r->hash = h;
+			r->kmer = stack->kmer[i];
+		}
+	}
+	mm->last_pos = pos;
+	gref_iter_mm_window(mm, MAX2(0, pos - (int64_t)mm->window_size + 1), pos);
+	return;
+}
+
+/**
+ * @fn gref_iter_add_stack
+ */
+static _force_inline
+struct gref_iter_stack_s *gref_iter_add_stack(
+	struct gref_iter_s *iter,
+	struct gref_iter_stack_s *stack)
+{
+	/* the buffer is sized by gref_calc_iter_stack_size, no check needed here */
+	struct gref_iter_stack_s *new_stack = (struct gref_iter_stack_s *)(
+		(uint64_t *)(stack + 1) + stack->kmer_table_size);
+
+	debug("stack(%p), kmer_table_size(%u), new_stack(%p)",
+		stack, stack->kmer_table_size, new_stack);
+
+	/* link to previous stack */
+	new_stack->prev_stack = stack;
+
+	/* copy from previous stack */
+	new_stack->global_rem_len = stack->global_rem_len;
+
+	/* constant */
+	new_stack->shift_len = stack->shift_len;
+
+	/* copy buffer */
+	new_stack->len = stack->len;
+	new_stack->kmer_idx = 0;
+	new_stack->kmer_table_size = stack->kmer_table_size;
+	new_stack->cnt_arr = stack->cnt_arr;
+	memcpy(&new_stack->kmer, &stack->kmer, stack->kmer_table_size * sizeof(uint64_t));
+	return(new_stack);
+}
+
+/**
+ * @fn gref_iter_remove_stack
+ */
+static _force_inline
 struct gref_iter_stack_s *gref_iter_remove_stack(
 	struct gref_iter_stack_s *stack)
 {
@@ -1068,11 +2563,17 @@ struct gref_iter_stack_s *gref_iter_remove_stack(
 
 /**
  * @fn gref_iter_append_base
+ * @brief ambiguous bases are expanded into the kmer table unless the table grows
+ * beyond max_expansion, in which case only the first variant is taken. N (0x00
+ * and 0x0f) is appended as A and recorded as zero in cnt_arr to invalidate the
+ * kmers containing it.
  */
 static _force_inline
 int gref_iter_append_base(
+	struct gref_iter_s const *iter,
 	struct gref_iter_stack_s *stack,
-	uint8_t c)
+	uint8_t c,
+	uint64_t const shift_len)
 {
 	/* conversion tables */
 	static uint8_t const popcnt_table[] = {
@@ -1082,7 +2583,7 @@ int gref_iter_append_base(
 		A = 0x00, C = 0x02, G = 0x04, T = 0x06
 	};
 	static uint8_t const shift_table[][3] = {
-		{},
+		{ A },
 		{ A },
 		{ C },
 		{ A, C },
@@ -1097,13 +2598,23 @@ int gref_iter_append_base(
 		{ G, T },
 		{ A, G, T },
 		{ C, G, T },
-		{},
+		{ A },
 	};
 
-	uint64_t pcnt = popcnt_table[c];
-	stack->cnt_arr = (stack->cnt_arr>>2) | (pcnt<<(stack->shift_len + 2));
+	uint64_t cnt = popcnt_table[c];
 	uint64_t table_size = stack->kmer_table_size;
 
+	/* bound expansion */
+	if(table_size * cnt > iter->max_expansion) {
+		c &= -c;		/* lowest variant */
+		cnt = 1;
+	}
+	uint64_t pcnt = MAX2(1, cnt);
+
+	/* the count of the base leaving the window; shifted out first so that k = 32 fits */
+	uint64_t shrink_skip = 0x03 & stack->cnt_arr;
+	stack->cnt_arr = (stack->cnt_arr>>2) | (cnt<<shift_len);
+
 	/* branch */
 	switch(3 - pcnt) {
 		case 0: memcpy(&stack->kmer[2 * table_size], stack->kmer, sizeof(uint64_t) * table_size);
@@ -1113,12 +2624,12 @@ int gref_iter_append_base(
 	}
 
 	/* append to vector */
-	uint32_t mask = 0x03<<stack->shift_len;
+	uint64_t mask = 0x03ULL<<shift_len;
 	for(int64_t j = 0; j < pcnt; j++) {
 		for(int64_t k = 0; k < table_size; k++) {
 			stack->kmer[j * table_size + k] =
 				  (stack->kmer[j * table_size + k]>>2)
-				| (mask & (stack->conv_table<<(stack->shift_len - shift_table[c][j])));
+				| (mask & ((uint64_t)stack->conv_table<<(shift_len - shift_table[c][j])));
 			debug("%lld, %lld, %lld, %x, %x, %llx",
 				j, k, j * table_size + k, shift_table[c][j], 0x03 & (stack->conv_table>>shift_table[c][j]), stack->kmer[j * table_size + k]);
 		}
@@ -1127,8 +2638,7 @@ int gref_iter_append_base(
 	/* update table_size */
 	table_size *= pcnt;
 
-	/* merge (shrink buffer) */
-	uint64_t shrink_skip = 0x03 & stack->cnt_arr;
+	/* merge (shrink buffer), N is not expanded */
 	debug("cnt_arr(%llx), table_size(%llu), shrink_skip(%llu)",
 		stack->cnt_arr, table_size, shrink_skip);
 	if(shrink_skip > 1) {
@@ -1138,25 +2648,120 @@ int gref_iter_append_base(
 		}
 	}
 
-	/* write back table_size */
-	stack->kmer_idx = 0;
+	/* write back table_size; mark the table consumed if N remains in the window */
+	uint64_t w = stack->cnt_arr;
+	uint64_t valid_mask = 0x5555555555555555ULL>>(62 - shift_len);
 	stack->kmer_table_size = table_size;
+	stack->kmer_idx = (((w | (w>>1)) & valid_mask) == valid_mask) ? 0 : table_size;
 	return(0);
 }
 
+/**
+ * @fn gref_iter_init_seq
+ * @brief set the head of the section on the stack. reverse bases are mirrored
+ * around seq_lim; the 2bit storage keeps them as integer offsets in seq_ofs.
+ */
+static _force_inline
+void gref_iter_init_seq(
+	struct gref_iter_s const *iter,
+	struct gref_iter_stack_s *stack,
+	uint8_t const *base)
+{
+	uint32_t const fw = (base < iter->seq_lim);
+	if(iter->packed == NULL) {
+		stack->seq_ptr = fw ? base : (iter->seq_lim + (iter->seq_lim - base - 1));
+		stack->seq_ofs = 0;
+	} else {
+		uint64_t const b = (uint64_t)base, lim = (uint64_t)iter->seq_lim;
+		stack->seq_ptr = NULL;
+		stack->seq_ofs = fw ? b : (2 * lim - b - 1);
+	}
+	stack->incr = fw ? 1 : -1;
+	stack->conv_table = fw ? 0xe4 : 0x1b;
+	return;
+}
+
+/**
+ * @fn gref_iter_advance_seq
+ */
+static _force_inline
+void gref_iter_advance_seq(
+	struct gref_iter_s const *iter,
+	struct gref_iter_stack_s *stack,
+	int64_t len)
+{
+	if(iter->packed == NULL) {
+		stack->seq_ptr += len * stack->incr;
+	} else {
+		stack->seq_ofs += len * stack->incr;
+	}
+	return;
+}
+
+/**
+ * @fn gref_iter_skip_ambiguous
+ * @brief skip the head of a run of N in the current section. the last seed_len
+ * bases of the run are left to flush the kmer table, since the table state after
+ * seed_len Ns does not depend on the bases before the run.
+ */
+static
+void gref_iter_skip_ambiguous(
+	struct gref_iter_s const *iter,
+	struct gref_iter_stack_s *stack)
+{
+	int64_t run = 0;
+	if(iter->packed == NULL) {
+		run = gref_arch_ambiguous_run(stack->seq_ptr, stack->rem_len, stack->incr);
+	} else {
+		/* the run is in the exception list */
+		uint64_t pos = stack->seq_ofs;
+		struct gref_seq_exc_s const *e = gref_find_exc(iter->packed, pos);
+		run = (e == NULL) ? 0 : MIN2((int64_t)stack->rem_len,
+			(stack->incr > 0) ? (int64_t)(e->pos + e->len - pos) : (int64_t)(pos - e->pos + 1));
+	}
+	int64_t skip = run - iter->seed_len;
+	debug("run(%lld), skip(%lld)", run, skip);
+
+	if(skip > 0) {
+		gref_iter_advance_seq(iter, stack, skip);
+		stack->rem_len -= skip;
+	}
+	return;
+}
+
 /**
  * @fn gref_iter_fetch_base
  */
 static _force_inline
 uint8_t gref_iter_fetch_base(
-	struct gref_iter_stack_s *stack)
+	struct gref_iter_s const *iter,
+	struct gref_iter_stack_s *stack,
+	uint64_t const seed_len)
 {
-	uint8_t c = *stack->seq_ptr;
+	uint8_t c = (iter->packed == NULL)
+		? *stack->seq_ptr
+		: gref_decode_base_2bit(iter->packed, stack->seq_ofs);
+	if((c == 0x00 || c == 0x0f) && stack->rem_len > seed_len) {
+		gref_iter_skip_ambiguous(iter, stack);
+	}
 	stack->rem_len--;
-	stack->seq_ptr += stack->incr;
+	gref_iter_advance_seq(iter, stack, 1);
 	return(c);
 }
 
+/**
+ * @fn gref_iter_get_depth
+ * @brief number of stacks from the root, for the instrumentation
+ */
+static _force_inline
+uint32_t gref_iter_get_depth(
+	struct gref_iter_stack_s const *stack)
+{
+	uint32_t depth = 0;
+	for(; stack != NULL; stack = stack->prev_stack) { depth++; }
+	return(depth);
+}
+
 /**
  * @fn gref_iter_fetch
  */
@@ -1168,7 +2773,8 @@ struct gref_iter_stack_s *gref_iter_fetch(
 	debug("iter_fetch called, check rem_len(%u)", stack->rem_len);
 	if(stack->rem_len > 0) {
 		/* fetch seq */
-		gref_iter_append_base(stack, gref_iter_fetch_base(stack));
+		gref_iter_append_base(iter, stack, gref_iter_fetch_base(iter, stack, iter->seed_len), stack->shift_len);
+		_stats_max(iter->max_table, stack->kmer_table_size);
 		return(stack);
 	} else if(stack->rem_len == 0) {
 		debug("stack(%p), gid(%u), link_idx(%u), link_idx_base(%u), global_rem_len(%d)",
@@ -1177,10 +2783,12 @@ struct gref_iter_stack_s *gref_iter_fetch(
 		if(stack->global_rem_len == 0) {
 			debug("reached tail");
 			stack = stack->prev_stack;
+			iter->backtrack = 1;
 		}
 
 		/* remove stack if no more link remains */
 		while(stack->link_idx == iter->hsec[stack->sec_gid + 1].link_idx_base) {
+			iter->backtrack = 1;
 			debug("stack(%p), gid(%u), link_idx(%u), link_idx_base(%u)",
 				stack, stack->sec_gid, stack->link_idx, iter->hsec[stack->sec_gid + 1].link_idx_base);
 			if((stack = gref_iter_remove_stack(stack)) == NULL) {
@@ -1202,22 +2810,20 @@ struct gref_iter_stack_s *gref_iter_fetch(
 		stack->link_idx = iter->hsec[gid].link_idx_base;
 
 		/* init seq info */
-		uint8_t const *base = iter->hsec[gid].sec.base;
-		stack->seq_ptr = (base < iter->seq_lim)
-			? base : (iter->seq_lim + (iter->seq_lim - base - 1));
+		gref_iter_init_seq(iter, stack, iter->hsec[gid].sec.base);
 		stack->rem_len = MIN2(stack->global_rem_len, iter->hsec[gid].sec.len);
-		stack->incr = (base < iter->seq_lim) ? 1 : -1;
-		stack->conv_table = (base <iter->seq_lim) ? 0xe4 : 0x1b;
 
 		/* adjust global_rem_len and len */
 		stack->global_rem_len -= stack->rem_len;
 		stack->len += stack->rem_len;
 
-		debug("gid(%u), seq_ptr(%p), len(%u), rem_len(%u), global_rem_len(%u)",
-			gid, stack->seq_ptr, stack->len, stack->rem_len, stack->global_rem_len);
+		debug("gid(%u), seq_ptr(%p), seq_ofs(%llu), len(%u), rem_len(%u), global_rem_len(%u)",
+			gid, stack->seq_ptr, (unsigned long long)stack->seq_ofs, stack->len, stack->rem_len, stack->global_rem_len);
 
 		/* fetch seq */
-		gref_iter_append_base(stack, gref_iter_fetch_base(stack));
+		gref_iter_append_base(iter, stack, gref_iter_fetch_base(iter, stack, iter->seed_len), stack->shift_len);
+		_stats_max(iter->max_table, stack->kmer_table_size);
+		_stats_max(iter->max_depth, gref_iter_get_depth(stack));
 		return(stack);
 	}
 
@@ -1239,18 +2845,20 @@ struct gref_iter_stack_s *gref_iter_init_stack(
 
 	/* init stack */
 	stack->prev_stack = NULL;
+	_stats_max(iter->max_depth, 1);
 
 	/* current section info */
 	stack->sec_gid = gid;
 	stack->link_idx = iter->hsec[gid].link_idx_base;
 
 	/* seq info */
-	uint8_t const *base = iter->hsec[gid].sec.base;
-	stack->seq_ptr = (base < iter->seq_lim)
-		? base : (iter->seq_lim + (iter->seq_lim - base - 1));
+	gref_iter_init_seq(iter, stack, iter->hsec[gid].sec.base);
 	stack->rem_len = len;
-	stack->incr = (base < iter->seq_lim) ? 1 : -1;
-	stack->conv_table = (base <iter->seq_lim) ? 0xe4 : 0x1b;
+
+	/* start at head_pos; pos is still counted from the head of the section */
+	uint32_t head = MIN2(iter->head_pos, len);
+	gref_iter_advance_seq(iter, stack, head);
+	stack->rem_len -= head;
 
 	/* global info */
 	stack->global_rem_len = iter->seed_len - 1;
@@ -1275,17 +2883,150 @@ struct gref_iter_stack_s *gref_iter_init_stack(
 
 
 /**
- * @fn gref_iter_init
+ * @fn gref_iter_next_pos
+ * @brief advance by one position. kmers at the position (expanded from
+ * ambiguous bases) are in stack->kmer. returns NULL at the end of the range.
  */
-gref_iter_t *gref_iter_init(
-	gref_acv_t const *acv,
-	gref_iter_params_t const *params)
+static _force_inline
+struct gref_iter_stack_s *gref_iter_next_pos(
+	struct gref_iter_s *iter)
 {
-	struct gref_s const *gref = (struct gref_s const *)acv;
+	struct gref_iter_stack_s *stack = iter->stack;
+	if(stack != NULL && (iter->stack = stack = gref_iter_fetch(iter, stack)) != NULL) {
+		return(stack);
+	}
 
-	debug("init_stack_size(%lld)", gref->iter_init_stack_size);	
-	if(gref == NULL || gref->type == GREF_POOL) { return(NULL); }
+	debug("stack == NULL, stack(%p)", stack);
+	/* update gid and stack for the next section */
+	while((iter->base_gid += iter->step_gid) < iter->tail_gid) {
+		iter->stack = stack = gref_iter_init_stack(iter, (struct gref_iter_stack_s *)(iter + 1));
+
+		/* check if init_stack succeeded */
+		if(stack != NULL) {
+			debug("base_gid(%u), tail_gid(%u), stack(%p)", iter->base_gid, iter->tail_gid, stack);
+			return(stack);
+		}
+	}
+	iter->base_gid = iter->tail_gid;
+	return(NULL);
+}
+
+/**
+ * @fn gref_iter_next_batch_intl
+ * @brief batch enumeration without sampling. k is a constant in the kernels
+ * instantiated from GREF_KMER_KERNEL_LIST, so that the shifts and masks in
+ * append_base are folded.
+ */
+static _force_inline
+int64_t gref_iter_next_batch_intl(
+	struct gref_iter_s *iter,
+	struct gref_kmer_tuple_s *buf,
+	int64_t cap,
+	int64_t const k)
+{
+	int64_t cnt = 0;
+	struct gref_iter_stack_s *stack = iter->stack;
+	while(stack != NULL) {
+		/* flush kmers at the current position */
+		struct gref_gid_pos_s const gid_pos = {
+			.pos = stack->len - stack->rem_len,
+			.gid = iter->base_gid
+		};
+		int64_t n = MIN2(cap - cnt, stack->kmer_table_size - stack->kmer_idx);
+		for(int64_t i = 0; i < n; i++) {
+			buf[cnt + i] = (struct gref_kmer_tuple_s){
+				.kmer = stack->kmer[stack->kmer_idx + i],
+				.gid_pos = gid_pos
+			};
+		}
+		stack->kmer_idx += n;
+		cnt += n;
+		if(cnt == cap) { break; }
+
+		/* the linear part of the section, no link handling needed */
+		if(stack->rem_len > 0) {
+			gref_iter_append_base(iter, stack, gref_iter_fetch_base(iter, stack, k), 2 * (k - 1));
+			continue;
+		}
+
+		/* section boundary */
+		stack = gref_iter_next_pos(iter);
+	}
+	return(cnt);
+}
+
+/**
+ * @fn gref_iter_next_batch_gen, gref_iter_next_batch_k*
+ */
+static
+int64_t gref_iter_next_batch_gen(
+	struct gref_iter_s *iter,
+	struct gref_kmer_tuple_s *buf,
+	int64_t cap)
+{
+	return(gref_iter_next_batch_intl(iter, buf, cap, iter->seed_len));
+}
+
+#define _gref_iter_next_batch_kernel(_k) \
+	static \
+	int64_t gref_iter_next_batch_k##_k( \
+		struct gref_iter_s *iter, \
+		struct gref_kmer_tuple_s *buf, \
+		int64_t cap) \
+	{ \
+		return(gref_iter_next_batch_intl(iter, buf, cap, _k)); \
+	}
+GREF_KMER_KERNEL_LIST(_gref_iter_next_batch_kernel)
+#undef _gref_iter_next_batch_kernel
+
+/**
+ * @fn gref_iter_select_next_batch
+ */
+static
+int64_t (*gref_iter_select_next_batch(
+	int64_t k))(struct gref_iter_s *, struct gref_kmer_tuple_s *, int64_t)
+{
+	switch(k) {
+		#define _case(_k)	case _k: return(gref_iter_next_batch_k##_k);
+		GREF_KMER_KERNEL_LIST(_case)
+		#undef _case
+		default: return(gref_iter_next_batch_gen);
+	}
+}
+
+
+/**
+ * @fn gref_calc_iter_stack_size
+ * @brief stack buffer size in words. a stack is added for each section entered,
+ * consuming at least one base, so at most k stacks are live at once.
+ */
+static _force_inline
+int64_t gref_calc_iter_stack_size(
+	int64_t k,
+	int64_t max_expansion)
+{
+	int64_t stack_words = sizeof(struct gref_iter_stack_s) / sizeof(uint64_t) + max_expansion;
+	return((k + 1) * stack_words);
+}
 
+/**
+ * @fn gref_iter_init_range
+ * @brief create iterator on sections in [base_gid, tail_gid). base_gid must be
+ * a forward gid. lmm can be NULL to make the iterator usable from another thread.
+ * kmers starting before head_pos on base_gid are not enumerated. NULL is
+ * returned for a range without kmers as well; *error (if not NULL) is set only
+ * on allocation failure.
+ */
+static
+struct gref_iter_s *gref_iter_init_range(
+	struct gref_s const *gref,
+	lmm_t *lmm,
+	gref_iter_params_t const *params,
+	uint32_t base_gid,
+	uint32_t tail_gid,
+	uint32_t head_pos,
+	uint32_t *error)
+{
 	/* restore params */
 	static struct gref_iter_params_s const default_params = {
 		.step_size = 1,
@@ -1293,93 +3034,96 @@ gref_iter_t *gref_iter_init(
 	};
 	params = (params == NULL) ? &default_params : params;
 
+	/* empty range */
+	if(base_gid >= tail_gid) { return(NULL); }
+	if(params->minimizer_window > GREF_ITER_MM_MAX_WINDOW) { return(NULL); }
+
 	/* malloc mem */
-	struct gref_iter_s *iter = (struct gref_iter_s *)lmm_malloc(acv->lmm,
-		sizeof(struct gref_iter_s) + sizeof(uint64_t) * gref->iter_init_stack_size);
+	uint32_t max_expansion = (params->max_expansion == 0)
+		? GREF_ITER_MAX_EXPANSION : params->max_expansion;
+	int64_t stack_size = gref_calc_iter_stack_size(gref->params.k, max_expansion);
+	debug("stack_size(%lld)", stack_size);
+	struct gref_iter_s *iter = (struct gref_iter_s *)lmm_malloc(lmm,
+		sizeof(struct gref_iter_s) + sizeof(uint64_t) * stack_size);
 	if(iter == NULL) {
+		if(error != NULL) { *error = 1; }
 		return(NULL);
 	}
-	iter->lmm = acv->lmm;
+	iter->lmm = lmm;
+	iter->max_expansion = max_expansion;
+	iter->backtrack = 0;
+
+	/* sampling */
+	iter->step_size = MAX2(1, params->step_size);
+	iter->mm = NULL;
+	if(params->minimizer_window > 1) {
+		iter->mm = (struct gref_iter_mm_s *)lmm_malloc(lmm, sizeof(struct gref_iter_mm_s));
+		if(iter->mm == NULL) {
+			lmm_free(lmm, iter);
+			if(error != NULL) { *error = 1; }
+			return(NULL);
+		}
+		gref_iter_mm_init(iter->mm, params->minimizer_window, gref->params.k);
+	}
 
 	/* init param container */
 	memset(iter->mem_arr, 0, sizeof(void *) * GREF_ITER_INTL_MEM_ARR_LEN);
 
-	/* iterate from section 0 */
-	iter->base_gid = 0;
-	iter->tail_gid = _encode_id(acv->sec_cnt, 0);
+	/* iterate from base_gid */
+	iter->base_gid = base_gid;
+	iter->tail_gid = tail_gid;
 	iter->step_gid = (params->seq_direction == GREF_FW_RV) ? 1 : 2;
 	
 	/* set params */
-	iter->seed_len = acv->params.k;
-	iter->shift_len = 2 * (acv->params.k - 1);
+	iter->seed_len = gref->params.k;
+	iter->shift_len = 2 * (gref->params.k - 1);
+	iter->next_batch = gref_iter_select_next_batch(gref->params.k);
 	iter->seq_lim = gref->seq_lim;
-	iter->link_table = acv->link_table;
-	iter->hsec = (struct gref_section_half_s const *)hmap_get_object(acv->hmap, 0);
+	iter->link_table = gref->link_table;
+	iter->hsec = (struct gref_section_half_s const *)hmap_get_object(gref->hmap, 0);
+	iter->packed = (gref->seq_2bit != NULL) ? gref : NULL;
+	iter->head_pos = head_pos;
+	iter->max_depth = iter->max_table = 0;
 
 	/* init stack */
 	do {
 		iter->stack = gref_iter_init_stack(iter, (struct gref_iter_stack_s *)(iter + 1));
+		iter->head_pos = 0;
 
 		/* check if init_stack succeeded */
 		if(iter->stack != NULL) {
 			debug("stack(%p), iter(%p), len(%u)", iter->stack, iter, iter->hsec[iter->base_gid].sec.len);
-			return((gref_iter_t *)iter);
+			return(iter);
 		}
 	} while((iter->base_gid += iter->step_gid) < iter->tail_gid);
 
 	debug("no valid stack created");
+	lmm_free(iter->lmm, (void *)iter->mm);
 	lmm_free(iter->lmm, (void *)iter);
 	return(NULL);
 }
 
 /**
- * @fn gref_iter_next
+ * @fn gref_iter_init
  */
-struct gref_kmer_tuple_s gref_iter_next(
-	gref_iter_t *_iter)
+gref_iter_t *gref_iter_init(
+	gref_acv_t const *acv,
+	gref_iter_params_t const *params)
 {
-	struct gref_iter_s *iter = (struct gref_iter_s *)_iter;
-	struct gref_iter_stack_s *stack = iter->stack;
-
-	#define return_kmer(_iter, _stack) { \
-		debug("return kmer(%llx), gid(%u), pos(%u)", \
-			(_stack)->kmer[(_stack)->kmer_idx], \
-			(_stack)->sec_gid, \
-			(_stack)->len - (_stack)->rem_len); \
-		return((struct gref_kmer_tuple_s){ \
-			.kmer = (_stack)->kmer[(_stack)->kmer_idx++], \
-			.gid_pos = (struct gref_gid_pos_s){ \
-				.pos = (_stack)->len - (_stack)->rem_len, \
-				.gid = (_iter)->base_gid \
-			} \
-		}); \
-	}
-
-	debug("stack(%p), kmer_idx(%u), kmer_table_size(%u)", stack, stack->kmer_idx, stack->kmer_table_size);
-	/* if there is remaining kmers, return one from table */
-	if(stack->kmer_idx < stack->kmer_table_size) {
-		return_kmer(iter, stack);
-	}
-
-	/* if no kmer ramains in the table, fetch the next */
-	if((iter->stack = stack = gref_iter_fetch(iter, stack)) != NULL) {
-		return_kmer(iter, stack);
-	}
-
-	debug("stack == NULL, stack(%p)", stack);
-	/* update gid and stack for the next section */
-	while((iter->base_gid += iter->step_gid) < iter->tail_gid) {
-		iter->stack = stack = gref_iter_init_stack(iter, (struct gref_iter_stack_s *)(iter + 1));
+	struct gref_s const *gref = (struct gref_s const *)acv;
+	if(gref == NULL || gref->type == GREF_POOL) { return(NULL); }
 
-		/* check if init_stack succeeded */
-		if(stack != NULL) {
-			debug("base_gid(%u), tail_gid(%u), stack(%p)", iter->base_gid, iter->tail_gid, stack);
-			return_kmer(iter, stack);
-		}
-	}
-	#undef return_kmer
+	/* iterate from section 0 */
+	return((gref_iter_t *)gref_iter_init_range(gref, acv->lmm, params,
+		0, _encode_id(acv->sec_cnt, 0), 0, NULL));
+}
 
-	debug("terminal");
+/**
+ * @fn gref_iter_term
+ */
+static _force_inline
+struct gref_kmer_tuple_s gref_iter_term(void)
+{
 	/* reached the end of graph, all the sections were iterated */
 	return((struct gref_kmer_tuple_s){
 		.kmer = GREF_ITER_KMER_TERM,
@@ -1391,803 +3135,7590 @@ struct gref_kmer_tuple_s gref_iter_next(
 }
 
 /**
- * @fn gref_iter_clean
+ * @fn gref_iter_next_kmer
  */
-void gref_iter_clean(
-	gref_iter_t *_iter)
+static _force_inline
+struct gref_kmer_tuple_s gref_iter_next_kmer(
+	struct gref_iter_s *iter)
 {
-	struct gref_iter_s *iter = (struct gref_iter_s *)_iter;
-	debug("iter(%p)", iter);
+	struct gref_iter_stack_s *stack = iter->stack;
 
-	if(iter != NULL) {
-		debug("stack(%p), iter(%p)", iter->stack, iter);
-		for(int64_t i = 0; i < GREF_ITER_INTL_MEM_ARR_LEN; i++) {
-			lmm_free(iter->lmm, iter->mem_arr[i]); iter->mem_arr[i] = NULL;
+	/* if no kmer ramains in the table, fetch the next */
+	while(stack == NULL || stack->kmer_idx >= stack->kmer_table_size) {
+		if((stack = gref_iter_next_pos(iter)) == NULL) {
+			debug("terminal");
+			return(gref_iter_term());
 		}
-		lmm_free(iter->lmm, (void *)iter);
 	}
-	return;
-}
 
+	debug("return kmer(%llx), gid(%u), pos(%u)",
+		stack->kmer[stack->kmer_idx], stack->sec_gid, stack->len - stack->rem_len);
+	return((struct gref_kmer_tuple_s){
+		.kmer = stack->kmer[stack->kmer_idx++],
+		.gid_pos = (struct gref_gid_pos_s){
+			.pos = stack->len - stack->rem_len,
+			.gid = iter->base_gid
+		}
+	});
+}
 
-/* build kmer index (acv -> idx conversion) */
 /**
- * @fn gref_build_kmer_idx_table
+ * @fn gref_iter_next_minimizer
  */
 static _force_inline
-int64_t *gref_build_kmer_idx_table(
-	struct gref_s *acv,
-	struct gref_kmer_tuple_s *arr,
-	int64_t size)
+struct gref_kmer_tuple_s gref_iter_next_minimizer(
+	struct gref_iter_s *iter)
 {
-	lmm_kvec_t(int64_t) kmer_idx;
-	lmm_kv_init(acv->lmm, kmer_idx);
-
-	/* may fail when main memory is small */
-	uint64_t kmer_idx_size = 0x01 << (2 * acv->params.k);
-	lmm_kv_reserve(acv->lmm, kmer_idx, kmer_idx_size);
-	debug("ptr(%p), size(%llu)", lmm_kv_ptr(kmer_idx), kmer_idx_size);
-	if(lmm_kv_ptr(kmer_idx) == NULL) { return(NULL); }
-
-	uint64_t prev_kmer = 0;
-	lmm_kv_push(acv->lmm, kmer_idx, prev_kmer);
-	for(int64_t i = 0; i < size; i++) {
-		uint64_t kmer = arr[i].kmer;
-		debug("i(%lld), kmer(%llx), id(%u), pos(%u), prev_kmer(%llx)",
-			i, kmer, arr[i].gid_pos.gid, arr[i].gid_pos.pos, prev_kmer);
-
-		if(prev_kmer == kmer) { continue; }
-
-		debug("index table for kmer(%llx) ends at %lld, next_kmer(%llx)", prev_kmer, i, kmer);
+	struct gref_iter_mm_s *mm = iter->mm;
+
+	while(mm->q_head >= mm->q_cnt) {
+		mm->q_head = mm->q_cnt = 0;
+		if(mm->done) { return(gref_iter_term()); }
+
+		/* the first position is loaded in gref_iter_init */
+		struct gref_iter_stack_s *stack = (mm->started)
+			? gref_iter_next_pos(iter)
+			: iter->stack;
+		mm->started = 1;
+
+		if(stack == NULL) {
+			gref_iter_mm_flush(mm);
+			mm->done = 1;
+			continue;
+		}
 
-		/* sequence update detected */
-		for(uint64_t j = prev_kmer + 1; j < kmer + 1; j++) {
-			// debug("fill gaps j(%llx)", j);
-			lmm_kv_push(acv->lmm, kmer_idx, i);
+		if(iter->base_gid != mm->gid) {
+			/* new base section; the ring is cleared as the section may start at head_pos */
+			gref_iter_mm_flush(mm);
+			mm->gid = iter->base_gid;
+			mm->last_pos = -1;
+			for(int64_t i = 0; i < GREF_ITER_MM_RING_SIZE; i++) {
+				mm->ring[i].hash = GREF_ITER_MM_INVALID;
+			}
+		} else if(iter->backtrack) {
+			/* new path, records before the branch are kept */
+			gref_iter_mm_flush(mm);
 		}
-		prev_kmer = kmer;
-	}
-	for(uint64_t j = prev_kmer; j < kmer_idx_size; j++) {
-		// debug("fill tail gaps j(%llx)", j);
-		lmm_kv_push(acv->lmm, kmer_idx, size);
+		iter->backtrack = 0;
+		gref_iter_mm_record(mm, stack);
 	}
-	return(lmm_kv_ptr(kmer_idx));
+	return(mm->q[mm->q_head++]);
 }
 
 /**
- * @fn gref_shrink_kmer_table
+ * @fn gref_iter_next
  */
-static _force_inline
-struct gref_gid_pos_s *gref_shrink_kmer_table(
-	struct gref_s *acv,
-	struct gref_kmer_tuple_s *kmer_table,
-	int64_t kmer_table_size)
+struct gref_kmer_tuple_s gref_iter_next(
+	gref_iter_t *_iter)
 {
-	struct gref_gid_pos_s *packed_pos = (struct gref_gid_pos_s *)kmer_table;
-	
-	for(int64_t i = 0; i < kmer_table_size; i++) {
-		packed_pos[i] = kmer_table[i].gid_pos;
+	struct gref_iter_s *iter = (struct gref_iter_s *)_iter;
+
+	if(iter->mm != NULL) {
+		return(gref_iter_next_minimizer(iter));
+	}
+	if(iter->step_size == 1) {
+		return(gref_iter_next_kmer(iter));
 	}
 
-	return(lmm_realloc(acv->lmm, kmer_table, sizeof(struct gref_gid_pos_s) * kmer_table_size));
+	/* fixed-stride sampling */
+	struct gref_kmer_tuple_s t;
+	do {
+		t = gref_iter_next_kmer(iter);
+	} while(t.gid_pos.gid != (uint32_t)-1 && t.gid_pos.pos % iter->step_size != 0);
+	return(t);
 }
 
 /**
- * @fn gref_build_index
+ * @fn gref_iter_next_batch
+ * @brief fill buf with at most cap tuples. returns the number of tuples
+ * stored, 0 at the end of the enumeration.
  */
-gref_idx_t *gref_build_index(
-	gref_acv_t *acv)
+int64_t gref_iter_next_batch(
+	gref_iter_t *_iter,
+	struct gref_kmer_tuple_s *buf,
+	int64_t cap)
 {
-	struct gref_s *gref = (struct gref_s *)acv;
-
-	if(gref == NULL || gref->type != GREF_ACV) {
-		goto _gref_build_index_error_handler;
-	}
-
-	/* enumerate kmers and pack into vector */
-	lmm_kvec_t(struct gref_kmer_tuple_s) v;
-	lmm_kv_init(acv->lmm, v);
-
-	static struct gref_iter_params_s const iter_params = {
-		.step_size = 1,
-		.seq_direction = GREF_FW_RV
-	};
-	struct gref_iter_s *iter = gref_iter_init(acv, &iter_params);
-	struct gref_kmer_tuple_s t;
-	int64_t i = 0;
-	while((t = gref_iter_next(iter)).gid_pos.gid != (uint32_t)-1) {
-		i++;
-		lmm_kv_push(acv->lmm, v, t);
-	}
-	gref_iter_clean(iter);
-
-	/* sort kmers */
-	if(psort_half(lmm_kv_ptr(v), lmm_kv_size(v),
-		sizeof(struct gref_kmer_tuple_s), acv->params.num_threads) != 0) {
-		lmm_kv_destroy(acv->lmm, v);
-		debug("sort failed");
-		goto _gref_build_index_error_handler;
-	}
-
-	/* build index of kmer table */
-	gref->kmer_idx_table = gref_build_kmer_idx_table(acv, lmm_kv_ptr(v), lmm_kv_size(v));
-	if(gref->kmer_idx_table == NULL) {
-		debug("failed to build index table");
-		goto _gref_build_index_error_handler;
-	}
+	struct gref_iter_s *iter = (struct gref_iter_s *)_iter;
 
-	/* shrink table */
-	gref->kmer_table_size = lmm_kv_size(v);
-	gref->kmer_table = gref_shrink_kmer_table(acv, lmm_kv_ptr(v), lmm_kv_size(v));
-	if(gref->kmer_table == NULL) {
-		debug("failed to shrink");
-		goto _gref_build_index_error_handler;
+	/* sampling modes go through the generic path */
+	if(iter->mm != NULL || iter->step_size != 1) {
+		int64_t cnt = 0;
+		while(cnt < cap) {
+			struct gref_kmer_tuple_s t = gref_iter_next(_iter);
+			if(t.gid_pos.gid == (uint32_t)-1) { break; }
+			buf[cnt++] = t;
+		}
+		return(cnt);
 	}
-
-	/* store misc constants for kmer matching */
-	gref->mask = (0x01<<(2 * gref->params.k)) - 1;
-
-	/* change state */
-	gref->type = GREF_IDX;
-	return((gref_idx_t *)gref);
-
-_gref_build_index_error_handler:;
-	gref_clean((gref_t *)gref);
-	return(NULL);
+	return(iter->next_batch(iter, buf, cap));
 }
 
 /**
- * @fn gref_disable_index
+ * @fn gref_iter_clean
  */
-gref_acv_t *gref_disable_index(
-	gref_idx_t *idx)
+void gref_iter_clean(
+	gref_iter_t *_iter)
 {
-	struct gref_s *gref = (struct gref_s *)idx;
+	struct gref_iter_s *iter = (struct gref_iter_s *)_iter;
+	debug("iter(%p)", iter);
 
-	if(gref == NULL || gref->type != GREF_IDX) {
-		gref_clean((gref_t *)gref);
-		return(NULL);
+	if(iter != NULL) {
+		debug("stack(%p), iter(%p)", iter->stack, iter);
+		for(int64_t i = 0; i < GREF_ITER_INTL_MEM_ARR_LEN; i++) {
+			lmm_free(iter->lmm, iter->mem_arr[i]); iter->mem_arr[i] = NULL;
+		}
+		lmm_free(iter->lmm, (void *)iter->mm); iter->mm = NULL;
+		lmm_free(iter->lmm, (void *)iter);
 	}
+	return;
+}
 
-	/* cleanup kmer_idx_table */
-	lmm_free(idx->lmm, idx->kmer_idx_table); idx->kmer_idx_table = NULL;
 
-	/* change state */
-	gref->type = GREF_ACV;
-	return((gref_acv_t *)gref);
+/* build kmer index (acv -> idx conversion) */
+/**
+ * @fn gref_get_kmer_idx_size
+ * @brief number of buckets (4^k) of the direct-address indices, 0 for k = 32
+ * (only the hash index is available there)
+ */
+static _force_inline
+uint64_t gref_get_kmer_idx_size(
+	struct gref_s const *gref)
+{
+	return((gref->params.k < 32) ? 0x01ULL<<(2 * gref->params.k) : 0);
 }
 
 /**
- * @fn gref_match_2bitpacked
+ * @fn gref_get_kmer_table_bytes
+ * @brief size of the kmer table in bytes; the packed one has a tail padding
+ * for the 8-byte loads in gref_decode_entry.
  */
-struct gref_match_res_s gref_match_2bitpacked(
-	gref_idx_t const *_gref,
-	uint64_t seq)
+static _force_inline
+uint64_t gref_get_kmer_table_bytes(
+	struct gref_s const *gref)
 {
-	struct gref_s const *gref = (struct gref_s const *)_gref;
-	seq &= gref->mask;
-	int64_t base = gref->kmer_idx_table[seq];
-	int64_t tail = gref->kmer_idx_table[seq + 1];
-
-	debug("seq(%llx), mask(%llx), base(%lld), tail(%lld)",
-		seq, gref->mask, base, tail);
-	return((struct gref_match_res_s){
-		.gid_pos_arr = &gref->kmer_table[base],
-		.len = tail - base
-	});
+	return((gref->entry_size == 0)
+		? sizeof(struct gref_gid_pos_s) * gref->kmer_table_size
+		: gref->entry_size * gref->kmer_table_size + sizeof(uint64_t));
 }
 
 /**
- * @fn gref_match
- * @brief seq length must be equal to k.
+ * @fn gref_decode_entry
+ * @brief the i-th entry from ptr, which is an array of gref_gid_pos_s or of packed entries
  */
-struct gref_match_res_s gref_match(
-	gref_idx_t const *_gref,
-	uint8_t const *seq)
+static _force_inline
+struct gref_gid_pos_s gref_decode_entry(
+	struct gref_s const *gref,
+	void const *ptr,
+	int64_t i)
 {
-	struct gref_s const *gref = (struct gref_s const *)_gref;
-	int64_t const seed_len = gref->params.k;
-	int64_t const shift_len = 2 * (seed_len - 1);
-
-	uint64_t packed_seq = 0;
-	for(int64_t i = 0; i < seed_len; i++) {
-		packed_seq = (packed_seq>>2) | (gref_encode_2bit(seq[i])<<shift_len);
+	if(gref->entry_size == 0) {
+		return(((struct gref_gid_pos_s const *)ptr)[i]);
 	}
-	return(gref_match_2bitpacked((gref_t const *)gref, packed_seq));
+
+	uint64_t v;
+	memcpy(&v, (uint8_t const *)ptr + i * gref->entry_size, sizeof(uint64_t));
+	v &= (uint64_t)-1>>(64 - 8 * gref->entry_size);
+	return((struct gref_gid_pos_s){
+		.gid = v>>gref->entry_pos_bits,
+		.pos = v & ((0x01ULL<<gref->entry_pos_bits) - 1)
+	});
 }
 
-/* misc */
-#if 0
 /**
- * @fn gref_dump_index
+ * @fn gref_calc_kmer_offset
+ * @brief head of the bucket of kmer j in the sorted tuple array. j must be
+ * given in ascending order, *i holds the scan position.
  */
-int gref_dump_index(
-	gref_t const *gref,
-	zf_t *outfp)
+static _force_inline
+int64_t gref_calc_kmer_offset(
+	struct gref_kmer_tuple_s const *arr,
+	int64_t size,
+	int64_t *i,
+	uint64_t j)
 {
-	return(0);
+	while(*i < size && arr[*i].kmer < j) { (*i)++; }
+	return(*i);
 }
 
 /**
- * @fn gref_load_index
+ * @fn gref_build_kmer_idx_table
+ * @brief build direct-address table of 4^k + 1 offsets from the sorted tuple array
  */
-gref_t *gref_load_index(
-	zf_t *infp)
+static _force_inline
+int64_t *gref_build_kmer_idx_table(
+	struct gref_s *acv,
+	struct gref_kmer_tuple_s *arr,
+	int64_t size)
 {
-	return(NULL);
+	/* may fail when main memory is small */
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(acv);
+	int64_t *kmer_idx_table = (int64_t *)lmm_malloc(acv->lmm,
+		sizeof(int64_t) * (kmer_idx_size + 1));
+	debug("ptr(%p), size(%llu)", kmer_idx_table, kmer_idx_size);
+	if(kmer_idx_table == NULL) { return(NULL); }
+
+	int64_t i = 0;
+	for(uint64_t j = 0; j < kmer_idx_size + 1; j++) {
+		kmer_idx_table[j] = gref_calc_kmer_offset(arr, size, &i, j);
+	}
+	return(kmer_idx_table);
 }
-#endif
 
 /**
- * @fn gref_get_section_count
+ * @macro GREF_KMER_SB_*
+ * @brief compact kmer index. offsets are stored relative to the superblock base
+ * in 16 bits. superblocks spanning more than 2^16 occurrences are escaped to
+ * 32-bit relative offsets, the index of which is stored in the upper 24 bits
+ * of the superblock entry.
  */
-int64_t gref_get_section_count(
-	gref_t const *_gref)
-{
-	struct gref_s *gref = (struct gref_s *)_gref;
-	return((int64_t)gref->sec_cnt);
-}
+#define GREF_KMER_SB_SHIFT			( 6 )
+#define GREF_KMER_SB_SIZE			( 0x01ULL<<GREF_KMER_SB_SHIFT )
+#define GREF_KMER_SB_BASE_BITS		( 40 )
+#define GREF_KMER_SB_BASE_MASK		( (0x01ULL<<GREF_KMER_SB_BASE_BITS) - 1 )
+#define GREF_KMER_SB_ESC_MAX		( (0x01ULL<<(64 - GREF_KMER_SB_BASE_BITS)) - 1 )
 
 /**
- * @fn gref_get_section
- * @brief type must be ACV or IDX, otherwise return value is invalid
+ * @fn gref_build_kmer_sb_table
+ * @brief build compact index from the dense table (if kmer_idx_table != NULL)
+ * or the sorted tuple array.
  */
-struct gref_section_s const *gref_get_section(
-	gref_acv_t const *_gref,
-	uint32_t gid)
+static _force_inline
+int gref_build_kmer_sb_table(
+	struct gref_s *acv,
+	int64_t const *kmer_idx_table,
+	struct gref_kmer_tuple_s const *arr,
+	int64_t size)
 {
-	struct gref_s *gref = (struct gref_s *)_gref;
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(acv);
+	uint64_t sb_cnt = kmer_idx_size>>GREF_KMER_SB_SHIFT;
+
+	uint64_t *sb = (uint64_t *)lmm_malloc(acv->lmm, sizeof(uint64_t) * (sb_cnt + 1));
+	uint16_t *rel = (uint16_t *)lmm_malloc(acv->lmm, sizeof(uint16_t) * kmer_idx_size);
+	lmm_kvec_t(uint32_t) esc;
+	lmm_kv_init(acv->lmm, esc);
+	if(sb == NULL || rel == NULL || lmm_kv_ptr(esc) == NULL) {
+		goto _gref_build_kmer_sb_table_error_handler;
+	}
 
-	struct gref_section_half_s *base =
-		(struct gref_section_half_s *)hmap_get_object(gref->hmap, 0);
-	return((struct gref_section_s const *)&base[gid].sec);
+	int64_t i = 0;
+	int64_t offset[GREF_KMER_SB_SIZE + 1];
+	offset[GREF_KMER_SB_SIZE] = 0;
+	for(uint64_t j = 0; j < sb_cnt; j++) {
+		/* load offsets of the superblock and the head of the next one */
+		offset[0] = offset[GREF_KMER_SB_SIZE];
+		for(uint64_t k = (j == 0) ? 0 : 1; k < GREF_KMER_SB_SIZE + 1; k++) {
+			uint64_t kmer = (j<<GREF_KMER_SB_SHIFT) + k;
+			offset[k] = (kmer_idx_table != NULL) ? kmer_idx_table[kmer]
+				: gref_calc_kmer_offset(arr, size, &i, kmer);
+		}
+		if((uint64_t)offset[0] > GREF_KMER_SB_BASE_MASK) {
+			goto _gref_build_kmer_sb_table_error_handler;
+		}
+
+		uint16_t *r = &rel[j<<GREF_KMER_SB_SHIFT];
+		if(offset[GREF_KMER_SB_SIZE] - offset[0] <= UINT16_MAX) {
+			sb[j] = offset[0];
+			for(uint64_t k = 0; k < GREF_KMER_SB_SIZE; k++) {
+				r[k] = offset[k] - offset[0];
+			}
+		} else {
+			/* escape */
+			uint64_t esc_idx = lmm_kv_size(esc)>>GREF_KMER_SB_SHIFT;
+			if(esc_idx + 1 > GREF_KMER_SB_ESC_MAX || offset[GREF_KMER_SB_SIZE] - offset[0] > UINT32_MAX) {
+				goto _gref_build_kmer_sb_table_error_handler;
+			}
+			debug("escape superblock(%llu), span(%lld)", j, offset[GREF_KMER_SB_SIZE] - offset[0]);
+			sb[j] = offset[0] | ((esc_idx + 1)<<GREF_KMER_SB_BASE_BITS);
+			for(uint64_t k = 0; k < GREF_KMER_SB_SIZE; k++) {
+				lmm_kv_push(acv->lmm, esc, offset[k] - offset[0]);
+				r[k] = 0;
+			}
+		}
+	}
+	sb[sb_cnt] = offset[GREF_KMER_SB_SIZE];
+
+	acv->kmer_sb_table = sb;
+	acv->kmer_rel_table = rel;
+	acv->kmer_esc_table = lmm_kv_ptr(esc);
+	acv->kmer_esc_size = lmm_kv_size(esc);
+	return(0);
+
+_gref_build_kmer_sb_table_error_handler:;
+	lmm_free(acv->lmm, sb);
+	lmm_free(acv->lmm, rel);
+	lmm_kv_destroy(acv->lmm, esc);
+	return(-1);
 }
 
 /**
- * @fn gref_get_link
- * @brief type must be ACV or IDX, otherwise return value is invalid
+ * @fn gref_build_kmer_sb_table_count
+ * @brief build compact index in place from the 16-bit counters in kmer_rel_table
+ * (of GREF_BUILD_COUNT). a saturated counter is completed with the occurrences
+ * in ovf, sorted by kmer. the offsets are the heads of the buckets.
  */
-struct gref_link_s gref_get_link(
-	gref_acv_t const *_gref,
-	uint32_t gid)
+static
+int gref_build_kmer_sb_table_count(
+	struct gref_s *acv,
+	struct gref_kmer_occ_s const *ovf,
+	int64_t ovf_cnt)
 {
-	struct gref_s *gref = (struct gref_s *)_gref;
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(acv);
+	uint64_t sb_cnt = kmer_idx_size>>GREF_KMER_SB_SHIFT;
+
+	uint64_t *sb = (uint64_t *)lmm_malloc(acv->lmm, sizeof(uint64_t) * (sb_cnt + 1));
+	uint16_t *rel = acv->kmer_rel_table;
+	lmm_kvec_t(uint32_t) esc;
+	lmm_kv_init(acv->lmm, esc);
+	if(sb == NULL || lmm_kv_ptr(esc) == NULL) {
+		goto _gref_build_kmer_sb_table_count_error_handler;
+	}
 
-	struct gref_section_half_s *base =
-		(struct gref_section_half_s *)hmap_get_object(gref->hmap, 0);
-	return((struct gref_link_s){
-		.gid_arr = &gref->link_table[base[gid].link_idx_base],
-		.len = base[gid + 1].link_idx_base - base[gid].link_idx_base
-	});
+	int64_t i = 0;
+	int64_t offset[GREF_KMER_SB_SIZE + 1];
+	offset[GREF_KMER_SB_SIZE] = 0;
+	for(uint64_t j = 0; j < sb_cnt; j++) {
+		/* counts to offsets, the counters of the superblock are read before overwritten */
+		uint16_t *r = &rel[j<<GREF_KMER_SB_SHIFT];
+		offset[0] = offset[GREF_KMER_SB_SIZE];
+		for(uint64_t k = 0; k < GREF_KMER_SB_SIZE; k++) {
+			int64_t c = r[k];
+			if(c == UINT16_MAX) {
+				uint64_t kmer = (j<<GREF_KMER_SB_SHIFT) + k;
+				while(i < ovf_cnt && ovf[i].kmer < kmer) { i++; }
+				c += (i < ovf_cnt && ovf[i].kmer == kmer) ? ovf[i].occ : 0;
+			}
+			offset[k + 1] = offset[k] + c;
+		}
+		if((uint64_t)offset[0] > GREF_KMER_SB_BASE_MASK) {
+			goto _gref_build_kmer_sb_table_count_error_handler;
+		}
+
+		if(offset[GREF_KMER_SB_SIZE] - offset[0] <= UINT16_MAX) {
+			sb[j] = offset[0];
+			for(uint64_t k = 0; k < GREF_KMER_SB_SIZE; k++) {
+				r[k] = offset[k] - offset[0];
+			}
+		} else {
+			/* escape */
+			uint64_t esc_idx = lmm_kv_size(esc)>>GREF_KMER_SB_SHIFT;
+			if(esc_idx + 1 > GREF_KMER_SB_ESC_MAX || offset[GREF_KMER_SB_SIZE] - offset[0] > UINT32_MAX) {
+				goto _gref_build_kmer_sb_table_count_error_handler;
+			}
+			sb[j] = offset[0] | ((esc_idx + 1)<<GREF_KMER_SB_BASE_BITS);
+			for(uint64_t k = 0; k < GREF_KMER_SB_SIZE; k++) {
+				lmm_kv_push(acv->lmm, esc, offset[k] - offset[0]);
+				r[k] = 0;
+			}
+			if(lmm_kv_ptr(esc) == NULL) {
+				goto _gref_build_kmer_sb_table_count_error_handler;
+			}
+		}
+	}
+	sb[sb_cnt] = offset[GREF_KMER_SB_SIZE];
+
+	acv->kmer_sb_table = sb;
+	acv->kmer_esc_table = lmm_kv_ptr(esc);
+	acv->kmer_esc_size = lmm_kv_size(esc);
+	return(0);
+
+_gref_build_kmer_sb_table_count_error_handler:;
+	lmm_free(acv->lmm, sb);
+	lmm_kv_destroy(acv->lmm, esc);
+	return(-1);
 }
 
 /**
- * @fn gref_get_name
+ * @struct gref_kmer_slot_s
+ * @brief bucket slot of the inline index. ofs_cnt holds the head of the bucket
+ * in kmer_table (upper 40 bits) and the number of entries (lower 24 bits). a
+ * saturated count means the tail is found at the head of the next slot. the
+ * first entry of the bucket is copied to inl, thus a singleton bucket is read
+ * without touching kmer_table. the kmer table keeps all the entries, so that
+ * the [base, tail) view of the buckets is the same as the other indices.
  */
-struct gref_str_s gref_get_name(
-	gref_t const *_gref,
-	uint32_t gid)
+#define GREF_KMER_SLOT_CNT_BITS		( 24 )
+#define GREF_KMER_SLOT_CNT_MASK		( (0x01ULL<<GREF_KMER_SLOT_CNT_BITS) - 1 )
+struct gref_kmer_slot_s {
+	uint64_t ofs_cnt;
+	struct gref_gid_pos_s inl;
+};
+_static_assert(sizeof(struct gref_kmer_slot_s) == 16);
+
+/**
+ * @fn gref_build_kmer_slot_table
+ * @brief convert the dense kmer_idx_table to the inline slots, the dense one is freed.
+ */
+static
+int gref_build_kmer_slot_table(
+	struct gref_s *gref)
 {
-	struct gref_s *gref = (struct gref_s *)_gref;
-	struct hmap_key_s key = hmap_get_key(gref->hmap, _decode_id(gid));
-	return((struct gref_str_s){
-		.str = key.str,
-		.len = key.len
-	});
+	uint64_t const kmer_idx_size = gref_get_kmer_idx_size(gref);
+	int64_t const *kmer_idx_table = gref->kmer_idx_table;
+	if((uint64_t)kmer_idx_table[kmer_idx_size] >= 0x01ULL<<(64 - GREF_KMER_SLOT_CNT_BITS)) {
+		return(-1);
+	}
+
+	struct gref_kmer_slot_s *slot = (struct gref_kmer_slot_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_kmer_slot_s) * (kmer_idx_size + 1));
+	if(slot == NULL) { return(-1); }
+
+	for(uint64_t kmer = 0; kmer < kmer_idx_size + 1; kmer++) {
+		int64_t const base = kmer_idx_table[kmer];
+		int64_t const cnt = (kmer < kmer_idx_size) ? kmer_idx_table[kmer + 1] - base : 0;
+		slot[kmer] = (struct gref_kmer_slot_s){
+			.ofs_cnt = ((uint64_t)base<<GREF_KMER_SLOT_CNT_BITS) | MIN2((uint64_t)cnt, GREF_KMER_SLOT_CNT_MASK),
+			.inl = (cnt > 0) ? gref->kmer_table[base] : (struct gref_gid_pos_s){ 0, 0 }
+		};
+	}
+
+	gref_free(gref, gref->kmer_idx_table);
+	gref->kmer_idx_table = NULL;
+	gref->kmer_slot_table = slot;
+	return(0);
 }
 
-#if 0
-/* deprecated */
 /**
- * @fn gref_get_ptr
+ * @struct gref_kmer_hash_slot_s
+ * @brief slot of the hash index. the table is an open addressing on groups of
+ * 16 slots, with a tag byte per slot (0 for empty, 0x80 | the top 7 bits of the
+ * hash otherwise). a lookup compares the tags of the home group at once, checks
+ * the kmers of the matched slots, and moves to the next group until it finds a
+ * group with an empty slot. ofs_cnt is laid out as in gref_kmer_slot_s; the
+ * saturated counts are found in kmer_hash_esc. the load factor is kept below
+ * 0.8, thus the table takes about 21 bytes per distinct kmer.
  */
-uint8_t const *gref_get_ptr(
-	gref_t const *_gref)
+#define GREF_KMER_HASH_GROUP_SIZE	( 16 )
+struct gref_kmer_hash_slot_s {
+	uint64_t kmer;
+	uint64_t ofs_cnt;
+};
+_static_assert(sizeof(struct gref_kmer_hash_slot_s) == 16);
+
+/**
+ * @fn gref_hash64
+ * @brief 64-bit mixer (the finalizer of murmur3)
+ */
+static _force_inline
+uint64_t gref_hash64(
+	uint64_t key)
 {
-	struct gref_s const *gref = (struct gref_s const *)_gref;
-	return((uint8_t const *)lmm_kv_ptr(gref->seq) + gref->params.seq_head_margin);
+	key ^= key>>33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key>>33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key>>33;
+	return(key);
 }
-#endif
 
 /**
- * @fn gref_get_total_len
+ * @fn gref_hash_tag
  */
-int64_t gref_get_total_len(
-	gref_t const *_gref)
+static _force_inline
+uint8_t gref_hash_tag(
+	uint64_t h)
 {
-	struct gref_s const *gref = (struct gref_s const *)_gref;
-	return(gref->seq_len);
+	return(0x80 | (h>>57));
 }
 
 /**
- * @fn gref_get_lim
- * @brief type must be ACV or IDX, otherwise return value is invalid
+ * @fn gref_hash_find
+ * @brief returns the index of the slot of kmer, -1 if not found
  */
-uint8_t const *gref_get_lim(
-	gref_acv_t const *_gref)
+static _force_inline
+int64_t gref_hash_find(
+	struct gref_s const *gref,
+	uint64_t kmer)
 {
-	struct gref_s const *gref = (struct gref_s const *)_gref;
-	return(gref->seq_lim);
+	uint64_t const h = gref_hash64(kmer);
+	uint64_t const gmask = gref->kmer_hash_group_cnt - 1;
+	uint8_t const tag = gref_hash_tag(h);
+	for(uint64_t g = h & gmask;; g = (g + 1) & gmask) {
+		uint8_t const *t = &gref->kmer_hash_tag[g * GREF_KMER_HASH_GROUP_SIZE];
+		for(uint32_t m = gref_arch_match16(t, tag); m != 0; m &= m - 1) {
+			int64_t i = g * GREF_KMER_HASH_GROUP_SIZE + __builtin_ctz(m);
+			if(gref->kmer_hash_slot[i].kmer == kmer) { return(i); }
+		}
+		if(gref_arch_match16(t, 0) != 0) { return(-1); }
+	}
+	return(-1);
 }
 
 /**
- * unittests
+ * @fn gref_build_kmer_runs
+ * @brief collect the heads of the buckets from the sorted tuple array
  */
-unittest_config(
-	.name = "gref",
-	.depends_on = { "psort", "hmap", "zf" }
-);
+static
+int gref_build_kmer_runs(
+	struct gref_s *gref,
+	struct gref_kmer_tuple_s const *arr,
+	int64_t size)
+{
+	int64_t cnt = 0;
+	for(int64_t i = 0; i < size; i++) {
+		cnt += (i == 0 || arr[i].kmer != arr[i - 1].kmer);
+	}
+	struct gref_kmer_run_s *run = (struct gref_kmer_run_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_kmer_run_s) * (cnt + 1));
+	if(run == NULL) { return(-1); }
+
+	int64_t j = 0;
+	for(int64_t i = 0; i < size; i++) {
+		if(i != 0 && arr[i].kmer == arr[i - 1].kmer) { continue; }
+		run[j++] = (struct gref_kmer_run_s){ .kmer = arr[i].kmer, .base = i };
+	}
+	run[cnt] = (struct gref_kmer_run_s){ .kmer = UINT64_MAX, .base = size };
+
+	lmm_free(gref->lmm, gref->kmer_run);
+	gref->kmer_run = run;
+	gref->kmer_run_cnt = cnt;
+	return(0);
+}
 
 /**
- * @fn unittest_random_base
+ * @fn gref_build_kmer_hash_table
+ * @brief insert the runs into a new hash table, the runs are freed. empty runs
+ * (dropped by the occurrence cap) are not inserted.
+ */
+static
+int gref_build_kmer_hash_table(
+	struct gref_s *gref)
+{
+	struct gref_kmer_run_s const *run = gref->kmer_run;
+	int64_t const run_cnt = gref->kmer_run_cnt;
+	if((uint64_t)run[run_cnt].base >= 0x01ULL<<(64 - GREF_KMER_SLOT_CNT_BITS)) {
+		return(-1);
+	}
+
+	int64_t group_cnt = 1;
+	while(group_cnt * GREF_KMER_HASH_GROUP_SIZE * 4 < run_cnt * 5) { group_cnt *= 2; }
+	int64_t const slot_cnt = group_cnt * GREF_KMER_HASH_GROUP_SIZE;
+
+	uint8_t *tag = (uint8_t *)lmm_malloc(gref->lmm, slot_cnt);
+	struct gref_kmer_hash_slot_s *slot = (struct gref_kmer_hash_slot_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_kmer_hash_slot_s) * slot_cnt);
+	lmm_kvec_t(struct gref_kmer_occ_s) esc;
+	lmm_kv_init(gref->lmm, esc);
+	if(tag == NULL || slot == NULL) {
+		lmm_free(gref->lmm, tag); lmm_free(gref->lmm, slot);
+		lmm_kv_destroy(gref->lmm, esc);
+		return(-1);
+	}
+	memset(tag, 0, slot_cnt);
+	memset(slot, 0, sizeof(struct gref_kmer_hash_slot_s) * slot_cnt);
+
+	for(int64_t i = 0; i < run_cnt; i++) {
+		int64_t const cnt = run[i + 1].base - run[i].base;
+		if(cnt == 0) { continue; }
+
+		uint64_t const h = gref_hash64(run[i].kmer);
+		uint64_t g = h & (group_cnt - 1);
+		uint32_t m;
+		while((m = gref_arch_match16(&tag[g * GREF_KMER_HASH_GROUP_SIZE], 0)) == 0) {
+			g = (g + 1) & (group_cnt - 1);
+		}
+		int64_t const j = g * GREF_KMER_HASH_GROUP_SIZE + __builtin_ctz(m);
+		tag[j] = gref_hash_tag(h);
+		slot[j] = (struct gref_kmer_hash_slot_s){
+			.kmer = run[i].kmer,
+			.ofs_cnt = ((uint64_t)run[i].base<<GREF_KMER_SLOT_CNT_BITS) | MIN2((uint64_t)cnt, GREF_KMER_SLOT_CNT_MASK)
+		};
+
+		/* kept in the kmer order */
+		if((uint64_t)cnt >= GREF_KMER_SLOT_CNT_MASK) {
+			lmm_kv_push(gref->lmm, esc, ((struct gref_kmer_occ_s){ .kmer = run[i].kmer, .occ = cnt }));
+			if(lmm_kv_ptr(esc) == NULL) {
+				lmm_free(gref->lmm, tag); lmm_free(gref->lmm, slot);
+				return(-1);
+			}
+		}
+	}
+	debug("run_cnt(%lld), group_cnt(%lld), esc(%llu)", run_cnt, group_cnt, lmm_kv_size(esc));
+
+	gref->kmer_hash_tag = tag;
+	gref->kmer_hash_slot = slot;
+	gref->kmer_hash_group_cnt = group_cnt;
+	gref->kmer_hash_esc = lmm_kv_ptr(esc);
+	gref->kmer_hash_esc_cnt = lmm_kv_size(esc);
+	lmm_free(gref->lmm, gref->kmer_run);
+	gref->kmer_run = NULL;
+	gref->kmer_run_cnt = 0;
+	return(0);
+}
+
+/**
+ * @fn gref_get_hash_bytes
+ * @brief sizes of the tag, slot, and esc arrays of the hash index
  */
 static _force_inline
-char unittest_random_base(void)
+uint64_t gref_get_hash_bytes(
+	struct gref_s const *gref,
+	uint64_t *size)
 {
-	char const table[4] = {0x01, 0x02, 0x04, 0x08};
-	return(table[rand() % 4]);
+	uint64_t const slot_cnt = gref->kmer_hash_group_cnt * GREF_KMER_HASH_GROUP_SIZE;
+	size[0] = slot_cnt;
+	size[1] = sizeof(struct gref_kmer_hash_slot_s) * slot_cnt;
+	size[2] = sizeof(struct gref_kmer_occ_s) * gref->kmer_hash_esc_cnt;
+	return(size[0] + size[1] + size[2]);
 }
 
 /**
- * @fn unittest_generate_random_sequence
+ * @fn gref_place_table
+ * @brief move a table to a region; left as is if it is small or in the mapped file
  */
 static _force_inline
-char *unittest_generate_random_sequence(
-	int64_t len)
+void gref_place_table(
+	struct gref_s *gref,
+	void **ptr,
+	uint64_t size)
 {
-	char *seq;		/** a pointer to sequence */
-	seq = (char *)malloc(sizeof(char) * (len + 1));
+	if(*ptr == NULL || size < GREF_REGION_MIN_SIZE
+	|| gref_is_mapped(gref, *ptr) || gref_find_region(gref, *ptr) >= 0) {
+		return;
+	}
 
-	if(seq == NULL) { return NULL; }
-	for(int64_t i = 0; i < len; i++) {
-		seq[i] = unittest_random_base();
+	void *region = gref_alloc_region(gref, size);
+	if(region == NULL) { return; }		/* stay on the heap */
+	memcpy(region, *ptr, size);
+	gref_free(gref, *ptr);
+	*ptr = region;
+	return;
+}
+
+/**
+ * @fn gref_place_kmer_tables
+ * @brief move the kmer tables to the memory specified by params.table_mem
+ */
+static
+void gref_place_kmer_tables(
+	struct gref_s *gref)
+{
+	if(gref->params.table_mem == GREF_MEM_DEFAULT) { return; }
+
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(gref);
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_DENSE) {
+		gref_place_table(gref, (void **)&gref->kmer_idx_table, sizeof(int64_t) * (kmer_idx_size + 1));
+	} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_INLINE) {
+		gref_place_table(gref, (void **)&gref->kmer_slot_table,
+			sizeof(struct gref_kmer_slot_s) * (kmer_idx_size + 1));
+	} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH) {
+		uint64_t size[3];
+		gref_get_hash_bytes(gref, size);
+		gref_place_table(gref, (void **)&gref->kmer_hash_tag, size[0]);
+		gref_place_table(gref, (void **)&gref->kmer_hash_slot, size[1]);
+		gref_place_table(gref, (void **)&gref->kmer_hash_esc, size[2]);
+	} else {
+		gref_place_table(gref, (void **)&gref->kmer_sb_table,
+			sizeof(uint64_t) * ((kmer_idx_size>>GREF_KMER_SB_SHIFT) + 1));
+		gref_place_table(gref, (void **)&gref->kmer_rel_table, sizeof(uint16_t) * kmer_idx_size);
+		gref_place_table(gref, (void **)&gref->kmer_esc_table, sizeof(uint32_t) * gref->kmer_esc_size);
 	}
-	seq[len] = '\0';
-	return seq;
+	gref_place_table(gref, (void **)&gref->kmer_table, gref_get_kmer_table_bytes(gref));
+	return;
 }
 
+/**
+ * @fn gref_get_bucket
+ * @brief returns [base, tail) of the bucket in the kmer_table
+ */
+struct gref_bucket_s {
+	int64_t base;
+	int64_t tail;
+};
+static _force_inline
+int64_t gref_get_sb_offset(
+	struct gref_s const *gref,
+	uint64_t e,
+	uint64_t kmer)
+{
+	uint64_t esc_idx = e>>GREF_KMER_SB_BASE_BITS;
+	int64_t rel = (esc_idx == 0)
+		? gref->kmer_rel_table[kmer]
+		: gref->kmer_esc_table[((esc_idx - 1)<<GREF_KMER_SB_SHIFT) + (kmer & (GREF_KMER_SB_SIZE - 1))];
+	return((e & GREF_KMER_SB_BASE_MASK) + rel);
+}
+static _force_inline
+struct gref_bucket_s gref_get_slot_bucket(
+	struct gref_s const *gref,
+	uint64_t kmer)
+{
+	uint64_t const e = gref->kmer_slot_table[kmer].ofs_cnt;
+	int64_t const base = e>>GREF_KMER_SLOT_CNT_BITS;
+	int64_t const cnt = ((e & GREF_KMER_SLOT_CNT_MASK) == GREF_KMER_SLOT_CNT_MASK)
+		? (int64_t)(gref->kmer_slot_table[kmer + 1].ofs_cnt>>GREF_KMER_SLOT_CNT_BITS) - base
+		: (int64_t)(e & GREF_KMER_SLOT_CNT_MASK);
+	return((struct gref_bucket_s){
+		.base = base,
+		.tail = base + cnt
+	});
+}
+static _force_inline
+struct gref_bucket_s gref_get_hash_bucket(
+	struct gref_s const *gref,
+	uint64_t kmer)
+{
+	int64_t const i = gref_hash_find(gref, kmer);
+	if(i < 0) {
+		return((struct gref_bucket_s){ .base = 0, .tail = 0 });
+	}
 
-#define _str(x)		x, strlen(x)
-#define _seq(x)		(uint8_t const *)(x), strlen(x)
+	uint64_t const e = gref->kmer_hash_slot[i].ofs_cnt;
+	int64_t const base = e>>GREF_KMER_SLOT_CNT_BITS;
+	int64_t cnt = e & GREF_KMER_SLOT_CNT_MASK;
+	if((uint64_t)cnt == GREF_KMER_SLOT_CNT_MASK) {
+		int64_t lo = 0, hi = gref->kmer_hash_esc_cnt;
+		while(lo < hi) {
+			int64_t mid = (lo + hi) / 2;
+			if(gref->kmer_hash_esc[mid].kmer < kmer) { lo = mid + 1; } else { hi = mid; }
+		}
+		cnt = gref->kmer_hash_esc[lo].occ;
+	}
+	return((struct gref_bucket_s){
+		.base = base,
+		.tail = base + cnt
+	});
+}
+static _force_inline
+struct gref_bucket_s gref_get_bucket(
+	struct gref_s const *gref,
+	uint64_t kmer)
+{
+	/* the inline index is on the dense table until gref_build_kmer_slot_table */
+	if(gref->kmer_slot_table != NULL) {
+		return(gref_get_slot_bucket(gref, kmer));
+	}
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH) {
+		return(gref_get_hash_bucket(gref, kmer));
+	}
+	if(gref->params.kmer_idx_type != GREF_KMER_IDX_COMPACT) {
+		return((struct gref_bucket_s){
+			.base = gref->kmer_idx_table[kmer],
+			.tail = gref->kmer_idx_table[kmer + 1]
+		});
+	}
 
-#define _pack(x) ({ \
-	uint64_t _packed_seq = 0; \
-	int64_t _len = strlen(x); \
-	uint8_t _shift_len = 2 * (_len - 1); \
-	for(int64_t i = 0; i < _len; i++) { \
-		_packed_seq = (_packed_seq>>2) | (gref_encode_2bit((x)[i])<<_shift_len); \
-	} \
-	_packed_seq; \
-})
+	/* compact */
+	uint64_t e = gref->kmer_sb_table[kmer>>GREF_KMER_SB_SHIFT];
+	int64_t base = gref_get_sb_offset(gref, e, kmer);
+	int64_t tail = (((kmer + 1) & (GREF_KMER_SB_SIZE - 1)) == 0)
+		? (int64_t)(gref->kmer_sb_table[(kmer>>GREF_KMER_SB_SHIFT) + 1] & GREF_KMER_SB_BASE_MASK)
+		: gref_get_sb_offset(gref, e, kmer + 1);
+	return((struct gref_bucket_s){
+		.base = base,
+		.tail = tail
+	});
+}
 
-/* make pool context */
-unittest()
+/**
+ * @fn gref_get_nth_bucket, gref_get_bucket_cnt
+ * @brief buckets in the kmer order during the build; the runs of the hash index,
+ * or all the kmers of the direct-address ones.
+ */
+static _force_inline
+uint64_t gref_get_bucket_cnt(
+	struct gref_s const *gref)
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4));
+	return((gref->kmer_run != NULL) ? (uint64_t)gref->kmer_run_cnt : gref_get_kmer_idx_size(gref));
+}
+static _force_inline
+struct gref_bucket_s gref_get_nth_bucket(
+	struct gref_s const *gref,
+	uint64_t j)
+{
+	if(gref->kmer_run != NULL) {
+		return((struct gref_bucket_s){
+			.base = gref->kmer_run[j].base,
+			.tail = gref->kmer_run[j + 1].base
+		});
+	}
+	return(gref_get_bucket(gref, j));
+}
 
-	assert(pool != NULL);
+/**
+ * @fn gref_revcomp_kmer
+ */
+static _force_inline
+uint64_t gref_revcomp_kmer(
+	uint64_t kmer,
+	int64_t k)
+{
+	/* complement, then reverse 2bit fields */
+	uint64_t x = __builtin_bswap64(~kmer);
+	x = ((x & 0x0f0f0f0f0f0f0f0fULL)<<4) | ((x>>4) & 0x0f0f0f0f0f0f0f0fULL);
+	x = ((x & 0x3333333333333333ULL)<<2) | ((x>>2) & 0x3333333333333333ULL);
+	return(x>>(64 - 2 * k));
+}
 
-	gref_clean(pool);
+/**
+ * @fn gref_canonical_kmer
+ * @brief returns the kmer to be looked up in the canonical index, *rv is set if
+ * it is the reverse complement of the given one.
+ */
+static _force_inline
+uint64_t gref_canonical_kmer(
+	struct gref_s const *gref,
+	uint64_t kmer,
+	uint32_t *rv)
+{
+	uint64_t rc = gref_revcomp_kmer(kmer, gref->params.k);
+	*rv = (rc < kmer);
+	return(MIN2(kmer, rc));
 }
 
-/* add segment */
-unittest()
+/**
+ * @fn gref_enum_filter_canonical
+ * @brief drop tuples whose kmer is larger than its reverse complement. each
+ * occurrence is enumerated on both strands, thus exactly one remains (both for
+ * palindromes).
+ */
+static _force_inline
+int64_t gref_enum_filter_canonical(
+	struct gref_kmer_tuple_s *buf,
+	int64_t cnt,
+	int64_t k)
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
+	int64_t j = 0;
+	for(int64_t i = 0; i < cnt; i++) {
+		buf[j] = buf[i];
+		j += (buf[i].kmer <= gref_revcomp_kmer(buf[i].kmer, k));
+	}
+	return(j);
+}
 
-	int ret = gref_append_segment(pool, _str("sec0"), _seq("AARA"));
-	assert(ret == 0, "ret(%d)", ret);
+/**
+ * @fn gref_cmp_gid_pos
+ * @brief (gid, pos) order
+ */
+static
+int gref_cmp_gid_pos(
+	void const *a,
+	void const *b)
+{
+	struct gref_gid_pos_s const *x = (struct gref_gid_pos_s const *)a, *y = (struct gref_gid_pos_s const *)b;
+	uint64_t u = ((uint64_t)x->gid<<32) | x->pos, v = ((uint64_t)y->gid<<32) | y->pos;
+	return((u > v) - (u < v));
+}
 
-	ret = gref_append_segment(pool, _str("sec1"), _seq("MAAA"));
-	assert(ret == 0, "ret(%d)", ret);
+/**
+ * @fn gref_sort_gid_pos
+ * @brief sort a bucket in the (gid, pos) order, returns nonzero if it was not
+ * strictly ascending. most buckets are already in order.
+ */
+static _force_inline
+int64_t gref_sort_gid_pos(
+	struct gref_gid_pos_s *arr,
+	int64_t len)
+{
+	int64_t i = 1;
+	while(i < len && gref_cmp_gid_pos(&arr[i - 1], &arr[i]) < 0) { i++; }
+	if(i >= len) { return(0); }
+	qsort(arr, len, sizeof(struct gref_gid_pos_s), gref_cmp_gid_pos);
+	return(1);
+}
 
-	ret = gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
-	assert(ret == 0, "ret(%d)", ret);
+/**
+ * @fn gref_unique_gid_pos
+ * @brief sort a bucket in the (gid, pos) order and remove the repeated
+ * occurrences, returns the new length.
+ */
+static _force_inline
+int64_t gref_unique_gid_pos(
+	struct gref_gid_pos_s *arr,
+	int64_t len)
+{
+	if(gref_sort_gid_pos(arr, len) == 0) { return(len); }
+	int64_t j = 1;
+	for(int64_t i = 1; i < len; i++) {
+		if(gref_cmp_gid_pos(&arr[j - 1], &arr[i]) == 0) { continue; }
+		arr[j++] = arr[i];
+	}
+	return(j);
+}
 
-	ret = gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
-	assert(ret == 0, "ret(%d)", ret);
+/**
+ * @fn gref_cmp_kmer_tuple_gid_pos
+ * @brief (gid, pos) order of tuples
+ */
+static
+int gref_cmp_kmer_tuple_gid_pos(
+	void const *a,
+	void const *b)
+{
+	return(gref_cmp_gid_pos(
+		&((struct gref_kmer_tuple_s const *)a)->gid_pos,
+		&((struct gref_kmer_tuple_s const *)b)->gid_pos));
+}
 
-	ret = gref_append_segment(pool, _str("sec2"), _seq("ACGT"));
-	assert(ret == 0, "ret(%d)", ret);
+/**
+ * @fn gref_order_kmer_tuples
+ * @brief sort each run of a kmer (of the tuples sorted by kmer) in the (gid,
+ * pos) order. runs already in order are only scanned.
+ */
+static
+void gref_order_kmer_tuples(
+	struct gref_kmer_tuple_s *arr,
+	int64_t cnt)
+{
+	for(int64_t i = 0; i < cnt;) {
+		int64_t const h = i++;
+		int64_t sorted = 1;
+		for(; i < cnt && arr[i].kmer == arr[h].kmer; i++) {
+			sorted &= gref_cmp_gid_pos(&arr[i - 1].gid_pos, &arr[i].gid_pos) < 0;
+		}
+		if(sorted) { continue; }
+		qsort(&arr[h], i - h, sizeof(struct gref_kmer_tuple_s), gref_cmp_kmer_tuple_gid_pos);
+	}
+	return;
+}
+
+/**
+ * @fn gref_shrink_kmer_table
+ */
+static _force_inline
+struct gref_gid_pos_s *gref_shrink_kmer_table(
+	struct gref_s *acv,
+	struct gref_kmer_tuple_s *kmer_table,
+	int64_t kmer_table_size)
+{
+	struct gref_gid_pos_s *packed_pos = (struct gref_gid_pos_s *)kmer_table;
+	
+	for(int64_t i = 0; i < kmer_table_size; i++) {
+		packed_pos[i] = kmer_table[i].gid_pos;
+	}
+
+	return(lmm_realloc(acv->lmm, kmer_table, sizeof(struct gref_gid_pos_s) * MAX2(1, kmer_table_size)));
+}
+
+/**
+ * @enum gref_enum_mode
+ * @brief what the shard worker does on each kmer
+ */
+enum gref_enum_mode {
+	GREF_ENUM_COLLECT			= 1,	/* push tuples to the shard-local vector */
+	GREF_ENUM_COUNT				= 2,	/* count occurrences in kmer_idx_table[kmer + 1] */
+	GREF_ENUM_SCATTER			= 3,	/* store gid_pos at kmer_table[kmer_idx_table[kmer]++] */
+	GREF_ENUM_SPILL				= 4,	/* write tuples to the partitions of the spill file */
+	GREF_ENUM_COUNT_COMPACT		= 5,	/* count occurrences in kmer_rel_table[kmer], saturated ones in ovf */
+	GREF_ENUM_SCATTER_COMPACT	= 6		/* GREF_ENUM_SCATTER on the heads of the compact index */
+};
+
+/**
+ * @struct gref_spill_s
+ * @brief temporary file of GREF_BUILD_PARTITION. the kmers are partitioned on
+ * their top GREF_SPILL_PREFIX_BITS bits; each shard buffers blk_size tuples
+ * per partition (at most GREF_SPILL_BLK_SIZE, fewer if many partitions would
+ * exceed the budget) and appends the full blocks at the tail of the file. blk
+ * records the location of the blocks.
+ */
+#define GREF_SPILL_PREFIX_BITS		( 16 )
+#define GREF_SPILL_BLK_SIZE			( 512 )
+#define GREF_SPILL_BLK_MIN_SIZE		( 16 )
+struct gref_spill_blk_s {
+	uint64_t ofs;					/* in bytes */
+	uint32_t part;
+	uint32_t cnt;
+};
+struct gref_spill_s {
+	int fd;
+	uint32_t shift;					/* kmer>>shift is the prefix */
+	uint32_t part_cnt;
+	uint32_t blk_size;				/* tuples buffered per partition in a shard */
+	uint32_t *part;					/* prefix -> partition */
+	uint64_t tail;					/* advanced atomically */
+	int64_t error;
+	pthread_mutex_t lock;			/* for blk */
+	lmm_kvec_t(struct gref_spill_blk_s) blk;
+};
+
+/**
+ * @struct gref_enum_ovf_s
+ * @brief occurrences beyond the saturated 16-bit counters of the compact count
+ * pass, kmer -> count in open addressing (occ == 0 is empty).
+ */
+struct gref_enum_ovf_s {
+	uint64_t cnt;
+	uint64_t mask;					/* slot count - 1 */
+	struct gref_kmer_occ_s *slot;
+};
+#define GREF_ENUM_OVF_INIT_SIZE		( 64 )
+
+/**
+ * @struct gref_enum_shard_s
+ * @brief kmer enumeration context for a contiguous gid range
+ */
+struct gref_enum_shard_s {
+	struct gref_s const *gref;
+	lmm_t *lmm;
+	uint32_t base_gid;
+	uint32_t tail_gid;
+	uint32_t mode;
+	uint32_t shared;				/* tables are updated from multiple threads */
+	uint32_t head_pos;				/* passed to gref_iter_init_range */
+	uint16_t max_depth;				/* iterator maxima for gref_get_stats */
+	uint16_t max_table;
+	uint32_t started;				/* run in a worker thread */
+	uint32_t error;					/* allocation failed in the worker */
+	uint32_t unordered;				/* the tuples were not enumerated in the (gid, pos) order */
+	uint32_t reserved;
+	int64_t dup_cnt;				/* tuples repeated on another path, dropped */
+	int64_t *kmer_idx_table;
+	struct gref_gid_pos_s *kmer_table;
+	struct gref_spill_s *spill;		/* spill mode, and the prefix shift of the count mode */
+	struct gref_enum_ovf_s ovf;		/* compact count mode */
+	lmm_kvec_t(struct gref_kmer_tuple_s) v;
+};
+
+/**
+ * @struct gref_enum_dedup_s
+ * @brief (kmer, pos) of the junction tuples enumerated on the current base gid.
+ * all the tuples of a gid are enumerated before the next gid, thus the set is
+ * cleared (by bumping gen) when the gid changes.
+ */
+struct gref_enum_dedup_slot_s {
+	uint64_t kmer;
+	uint32_t pos;
+	uint32_t gen;					/* occupied if equal to gen of the set */
+};
+struct gref_enum_dedup_s {
+	uint32_t gid;
+	uint32_t gen;
+	uint64_t cnt;
+	uint64_t mask;					/* slot count - 1 */
+	struct gref_enum_dedup_slot_s *slot;
+};
+#define GREF_ENUM_DEDUP_INIT_SIZE	( 256 )
+
+/**
+ * @fn gref_enum_dedup_probe
+ * @brief returns the slot of (kmer, pos), or the empty one where it goes
+ */
+static _force_inline
+struct gref_enum_dedup_slot_s *gref_enum_dedup_probe(
+	struct gref_enum_dedup_s const *d,
+	uint64_t kmer,
+	uint32_t pos)
+{
+	uint64_t h = gref_hash_kmer(kmer + pos * 0x9e3779b97f4a7c15ULL, (uint64_t)-1) & d->mask;
+	while(d->slot[h].gen == d->gen && (d->slot[h].kmer != kmer || d->slot[h].pos != pos)) {
+		h = (h + 1) & d->mask;
+	}
+	return(&d->slot[h]);
+}
+
+/**
+ * @fn gref_enum_dedup_expand
+ */
+static
+int gref_enum_dedup_expand(
+	struct gref_enum_dedup_s *d,
+	lmm_t *lmm)
+{
+	struct gref_enum_dedup_s n = {
+		.gid = d->gid,
+		.gen = 1,
+		.cnt = d->cnt,
+		.mask = (d->slot == NULL) ? GREF_ENUM_DEDUP_INIT_SIZE - 1 : 2 * d->mask + 1
+	};
+	n.slot = (struct gref_enum_dedup_slot_s *)lmm_malloc(lmm, sizeof(struct gref_enum_dedup_slot_s) * (n.mask + 1));
+	if(n.slot == NULL) { return(-1); }
+	memset(n.slot, 0, sizeof(struct gref_enum_dedup_slot_s) * (n.mask + 1));
+
+	for(uint64_t i = 0; d->slot != NULL && i <= d->mask; i++) {
+		if(d->slot[i].gen != d->gen) { continue; }
+		*gref_enum_dedup_probe(&n, d->slot[i].kmer, d->slot[i].pos) = (struct gref_enum_dedup_slot_s){
+			.kmer = d->slot[i].kmer,
+			.pos = d->slot[i].pos,
+			.gen = n.gen
+		};
+	}
+	lmm_free(lmm, d->slot);
+	*d = n;
+	return(0);
+}
+
+/**
+ * @fn gref_enum_filter_junction
+ * @brief drop the tuples already enumerated on another path. only a kmer
+ * running over the tail of its section (pos + k > len) depends on the path,
+ * the others are passed without lookup. returns the new count, -1 on failure.
+ */
+static _force_inline
+int64_t gref_enum_filter_junction(
+	struct gref_enum_dedup_s *d,
+	lmm_t *lmm,
+	struct gref_section_half_s const *hsec,
+	struct gref_kmer_tuple_s *buf,
+	int64_t cnt,
+	int64_t k)
+{
+	int64_t j = 0;
+	for(int64_t i = 0; i < cnt; i++) {
+		struct gref_gid_pos_s const gp = buf[i].gid_pos;
+		buf[j] = buf[i];
+		if(gp.pos + k <= hsec[gp.gid].sec.len) { j++; continue; }
+
+		if(gp.gid != d->gid) {
+			/* clear */
+			d->gid = gp.gid;
+			d->cnt = 0;
+			if(++d->gen == 0 && d->slot != NULL) {
+				memset(d->slot, 0, sizeof(struct gref_enum_dedup_slot_s) * (d->mask + 1));
+				d->gen = 1;
+			}
+		}
+		if(2 * (d->cnt + 1) > d->mask + 1 && gref_enum_dedup_expand(d, lmm) != 0) { return(-1); }
+
+		struct gref_enum_dedup_slot_s *s = gref_enum_dedup_probe(d, buf[i].kmer, gp.pos);
+		if(s->gen == d->gen) { continue; }		/* repeated */
+		*s = (struct gref_enum_dedup_slot_s){ .kmer = buf[i].kmer, .pos = gp.pos, .gen = d->gen };
+		d->cnt++;
+		j++;
+	}
+	return(j);
+}
+
+/**
+ * @fn gref_enum_ovf_probe
+ */
+static _force_inline
+struct gref_kmer_occ_s *gref_enum_ovf_probe(
+	struct gref_enum_ovf_s const *o,
+	uint64_t kmer)
+{
+	uint64_t h = gref_hash_kmer(kmer, (uint64_t)-1) & o->mask;
+	while(o->slot[h].occ != 0 && o->slot[h].kmer != kmer) {
+		h = (h + 1) & o->mask;
+	}
+	return(&o->slot[h]);
+}
+
+/**
+ * @fn gref_enum_ovf_add
+ * @brief count an occurrence of a saturated kmer. returns -1 on allocation failure.
+ */
+static
+int gref_enum_ovf_add(
+	struct gref_enum_ovf_s *o,
+	lmm_t *lmm,
+	uint64_t kmer)
+{
+	if(2 * (o->cnt + 1) > o->mask + 1) {
+		/* expand */
+		struct gref_enum_ovf_s n = {
+			.cnt = o->cnt,
+			.mask = (o->slot == NULL) ? GREF_ENUM_OVF_INIT_SIZE - 1 : 2 * o->mask + 1
+		};
+		n.slot = (struct gref_kmer_occ_s *)lmm_malloc(lmm, sizeof(struct gref_kmer_occ_s) * (n.mask + 1));
+		if(n.slot == NULL) { return(-1); }
+		memset(n.slot, 0, sizeof(struct gref_kmer_occ_s) * (n.mask + 1));
+		for(uint64_t i = 0; o->slot != NULL && i <= o->mask; i++) {
+			if(o->slot[i].occ == 0) { continue; }
+			*gref_enum_ovf_probe(&n, o->slot[i].kmer) = o->slot[i];
+		}
+		lmm_free(lmm, o->slot);
+		*o = n;
+	}
+
+	struct gref_kmer_occ_s *e = gref_enum_ovf_probe(o, kmer);
+	if(e->occ == 0) { e->kmer = kmer; o->cnt++; }
+	e->occ++;
+	return(0);
+}
+
+/**
+ * @fn gref_enum_count16
+ * @brief increment the 16-bit counter unless saturated. returns nonzero if saturated.
+ */
+static _force_inline
+int gref_enum_count16(
+	uint16_t *c,
+	uint32_t shared)
+{
+	uint16_t v = *c;
+	if(!shared) {
+		if(v == UINT16_MAX) { return(1); }
+		*c = v + 1;
+		return(0);
+	}
+	while(v != UINT16_MAX) {
+		uint16_t const p = __sync_val_compare_and_swap(c, v, v + 1);
+		if(p == v) { return(0); }
+		v = p;
+	}
+	return(1);
+}
+
+/**
+ * @fn gref_spill_write
+ * @brief append a block of the partition; the location is reserved atomically.
+ */
+static
+void gref_spill_write(
+	struct gref_spill_s *sp,
+	uint32_t part,
+	struct gref_kmer_tuple_s const *arr,
+	uint32_t cnt)
+{
+	uint64_t const size = sizeof(struct gref_kmer_tuple_s) * cnt;
+	uint64_t const ofs = __sync_fetch_and_add(&sp->tail, size);
+	for(uint64_t done = 0; done < size;) {
+		ssize_t r = pwrite(sp->fd, (uint8_t const *)arr + done, size - done, ofs + done);
+		if(r <= 0) { sp->error = 1; return; }
+		done += r;
+	}
+
+	pthread_mutex_lock(&sp->lock);
+	lmm_kv_push(NULL, sp->blk, ((struct gref_spill_blk_s){ .ofs = ofs, .part = part, .cnt = cnt }));
+	if(lmm_kv_ptr(sp->blk) == NULL) { sp->error = 1; }
+	pthread_mutex_unlock(&sp->lock);
+	return;
+}
+
+/**
+ * @fn gref_spill_read
+ */
+static
+int gref_spill_read(
+	struct gref_spill_s const *sp,
+	struct gref_spill_blk_s const *blk,
+	struct gref_kmer_tuple_s *arr)
+{
+	uint64_t const size = sizeof(struct gref_kmer_tuple_s) * blk->cnt;
+	for(uint64_t done = 0; done < size;) {
+		ssize_t r = pread(sp->fd, (uint8_t *)arr + done, size - done, blk->ofs + done);
+		if(r <= 0) { return(-1); }
+		done += r;
+	}
+	return(0);
+}
+
+/**
+ * @fn gref_enum_dedup_batch
+ * @brief filter the repeated junction tuples of the batch and check the order.
+ * returns the new count, or -1 (with s->error set) on failure.
+ */
+static _force_inline
+int64_t gref_enum_dedup_batch(
+	struct gref_enum_shard_s *s,
+	struct gref_enum_dedup_s *dedup,
+	struct gref_section_half_s const *hsec,
+	struct gref_kmer_tuple_s *buf,
+	int64_t cnt,
+	int64_t k,
+	uint64_t *last)
+{
+	int64_t const fcnt = gref_enum_filter_junction(dedup, s->lmm, hsec, buf, cnt, k);
+	if(fcnt < 0) { s->error = 1; return(-1); }
+	s->dup_cnt += cnt - fcnt;
+
+	for(int64_t i = 0; i < fcnt; i++) {
+		uint64_t const gp = ((uint64_t)buf[i].gid_pos.gid<<32) | buf[i].gid_pos.pos;
+		s->unordered |= (gp < *last);
+		*last = gp;
+	}
+	return(fcnt);
+}
+
+/**
+ * @fn gref_enum_shard_worker
+ */
+static
+void *gref_enum_shard_worker(
+	void *arg)
+{
+	struct gref_enum_shard_s *s = (struct gref_enum_shard_s *)arg;
+
+	struct gref_iter_params_s const iter_params = {
+		.step_size = s->gref->params.step_size,
+		.seq_direction = GREF_FW_RV,
+		.minimizer_window = s->gref->params.minimizer_window,
+		.max_expansion = s->gref->params.max_expansion
+	};
+	struct gref_iter_s *iter = gref_iter_init_range(s->gref, s->lmm, &iter_params,
+		s->base_gid, s->tail_gid, s->head_pos, &s->error);
+	if(iter == NULL) { return(NULL); }
+
+	#define GREF_ENUM_BATCH_SIZE		( 1024 )
+	struct gref_kmer_tuple_s buf[GREF_ENUM_BATCH_SIZE];
+	int64_t *kmer_idx_table = s->kmer_idx_table;
+	struct gref_gid_pos_s *kmer_table = s->kmer_table;
+	struct gref_spill_s *sp = s->spill;
+	uint32_t const shift = (sp == NULL) ? 0 : sp->shift;
+	int64_t const k = s->gref->params.k;
+	int64_t const canonical = (s->gref->params.kmer_strand == GREF_KMER_CANONICAL);
+	struct gref_section_half_s const *hsec =
+		(struct gref_section_half_s const *)hmap_get_object(s->gref->hmap, 0);
+	struct gref_enum_dedup_s dedup = { .gid = (uint32_t)-1 };
+	uint64_t last = 0;
+	int64_t cnt, fcnt;
+
+	/* cnt is the number of enumerated tuples, fcnt is that of the filtered ones */
+	#define _next_batch(_buf) ( \
+		cnt = gref_iter_next_batch((gref_iter_t *)iter, (_buf), GREF_ENUM_BATCH_SIZE), \
+		fcnt = canonical ? gref_enum_filter_canonical((_buf), cnt, k) : cnt, \
+		fcnt = gref_enum_dedup_batch(s, &dedup, hsec, (_buf), fcnt, k, &last), \
+		(fcnt < 0) ? 0 : cnt \
+	)
+	switch(s->mode) {
+		case GREF_ENUM_COLLECT:
+			/* write directly to the tail of the vector, grown geometrically */
+			while(1) {
+				uint64_t const size = lmm_kv_size(s->v);
+				if(lmm_kv_max(s->v) < size + GREF_ENUM_BATCH_SIZE) {
+					lmm_kv_reserve(s->lmm, s->v, MAX2(2 * size, size + GREF_ENUM_BATCH_SIZE));
+				}
+				if(lmm_kv_ptr(s->v) == NULL) { s->error = 1; break; }
+				if(_next_batch(&lmm_kv_at(s->v, lmm_kv_size(s->v))) == 0) { break; }
+				lmm_kv_size(s->v) += fcnt;
+			}
+			break;
+		case GREF_ENUM_COUNT:
+			while(_next_batch(buf) > 0) {
+				for(int64_t j = 0; j < fcnt; j++) {
+					if(s->shared) {
+						__sync_fetch_and_add(&kmer_idx_table[(buf[j].kmer>>shift) + 1], 1);
+					} else {
+						kmer_idx_table[(buf[j].kmer>>shift) + 1]++;
+					}
+				}
+			}
+			break;
+		case GREF_ENUM_SCATTER:
+			while(_next_batch(buf) > 0) {
+				for(int64_t j = 0; j < fcnt; j++) {
+					int64_t i = (s->shared)
+						? __sync_fetch_and_add(&kmer_idx_table[buf[j].kmer], 1)
+						: kmer_idx_table[buf[j].kmer]++;
+					kmer_table[i] = buf[j].gid_pos;
+				}
+			}
+			break;
+		case GREF_ENUM_COUNT_COMPACT: {
+			uint16_t *rel = s->gref->kmer_rel_table;
+			while(s->error == 0 && _next_batch(buf) > 0) {
+				for(int64_t j = 0; j < fcnt; j++) {
+					if(gref_enum_count16(&rel[buf[j].kmer], s->shared) == 0) { continue; }
+					if(gref_enum_ovf_add(&s->ovf, s->lmm, buf[j].kmer) != 0) { s->error = 1; break; }
+				}
+			}
+			break;
+		}
+		case GREF_ENUM_SCATTER_COMPACT: {
+			/* a superblock never spans more than 2^16 (escaped: 2^32) occurrences, thus the heads do not overflow */
+			uint64_t const *sb = s->gref->kmer_sb_table;
+			uint16_t *rel = s->gref->kmer_rel_table;
+			uint32_t *esc = s->gref->kmer_esc_table;
+			while(_next_batch(buf) > 0) {
+				for(int64_t j = 0; j < fcnt; j++) {
+					uint64_t const kmer = buf[j].kmer, e = sb[kmer>>GREF_KMER_SB_SHIFT];
+					uint64_t const esc_idx = e>>GREF_KMER_SB_BASE_BITS;
+					int64_t r;
+					if(esc_idx == 0) {
+						r = (s->shared) ? __sync_fetch_and_add(&rel[kmer], 1) : rel[kmer]++;
+					} else {
+						uint32_t *c = &esc[((esc_idx - 1)<<GREF_KMER_SB_SHIFT) + (kmer & (GREF_KMER_SB_SIZE - 1))];
+						r = (s->shared) ? __sync_fetch_and_add(c, 1) : (*c)++;
+					}
+					kmer_table[(e & GREF_KMER_SB_BASE_MASK) + r] = buf[j].gid_pos;
+				}
+			}
+			break;
+		}
+		case GREF_ENUM_SPILL: {
+			uint32_t const blk_size = sp->blk_size;
+			struct gref_kmer_tuple_s *pbuf = (struct gref_kmer_tuple_s *)lmm_malloc(s->lmm,
+				sizeof(struct gref_kmer_tuple_s) * blk_size * sp->part_cnt);
+			uint32_t *pcnt = (uint32_t *)lmm_malloc(s->lmm, sizeof(uint32_t) * sp->part_cnt);
+			if(pbuf == NULL || pcnt == NULL) {
+				sp->error = s->error = 1;
+				lmm_free(s->lmm, pbuf); lmm_free(s->lmm, pcnt);
+				break;
+			}
+			memset(pcnt, 0, sizeof(uint32_t) * sp->part_cnt);
+			while(_next_batch(buf) > 0) {
+				for(int64_t j = 0; j < fcnt; j++) {
+					uint32_t const p = sp->part[buf[j].kmer>>shift];
+					pbuf[p * blk_size + pcnt[p]++] = buf[j];
+					if(pcnt[p] == blk_size) {
+						gref_spill_write(sp, p, &pbuf[p * blk_size], blk_size);
+						pcnt[p] = 0;
+					}
+				}
+			}
+			for(uint32_t p = 0; p < sp->part_cnt; p++) {
+				if(pcnt[p] == 0) { continue; }
+				gref_spill_write(sp, p, &pbuf[p * blk_size], pcnt[p]);
+			}
+			lmm_free(s->lmm, pbuf);
+			lmm_free(s->lmm, pcnt);
+			break;
+		}
+	}
+	#undef _next_batch
+	#undef GREF_ENUM_BATCH_SIZE
+	lmm_free(s->lmm, dedup.slot);
+	s->max_depth = iter->max_depth;
+	s->max_table = iter->max_table;
+	gref_iter_clean((gref_iter_t *)iter);
+	return(NULL);
+}
+
+/**
+ * @fn gref_enum_run
+ * @brief enumerate all the kmers in the archive. the gid space is divided into
+ * num_threads ranges of roughly the same sequence length, each iterated by an
+ * independent iterator. a shard whose thread could not be created is run in
+ * the current thread. the shard array is returned in *shard_out unless it is
+ * NULL (the collect and the compact count modes). returns -1 if a shard failed.
+ */
+static
+int gref_enum_run(
+	struct gref_s *acv,
+	uint32_t mode,
+	int64_t *kmer_idx_table,
+	struct gref_gid_pos_s *kmer_table,
+	struct gref_spill_s *spill,
+	struct gref_enum_shard_s **shard_out,
+	int64_t *num_shards)
+{
+	int64_t num_threads = MAX2(1, acv->params.num_threads);
+	num_threads = MIN2(num_threads, MAX2(1, acv->sec_cnt));
+
+	struct gref_enum_shard_s *shard = (struct gref_enum_shard_s *)lmm_malloc(acv->lmm,
+		sizeof(struct gref_enum_shard_s) * num_threads);
+	pthread_t *th = (pthread_t *)lmm_malloc(acv->lmm, sizeof(pthread_t) * num_threads);
+	if(shard == NULL || th == NULL) {
+		lmm_free(acv->lmm, shard); lmm_free(acv->lmm, th);
+		return(-1);
+	}
+
+	/* split sections so that each shard has roughly the same length */
+	struct gref_section_intl_s const *sec =
+		(struct gref_section_intl_s const *)hmap_get_object(acv->hmap, 0);
+	uint64_t acc_len = 0;
+	uint32_t id = 0;
+	for(int64_t i = 0; i < num_threads; i++) {
+		uint64_t lim_len = (acv->seq_len * (i + 1)) / num_threads;
+		shard[i].base_gid = _encode_id(id, 0);
+		while(id < acv->sec_cnt && (acc_len < lim_len || i == num_threads - 1)) {
+			acc_len += sec[id++].fw_sec.len;
+		}
+		shard[i].tail_gid = _encode_id(id, 0);
+
+		/* the lmm is not thread-safe; fall back to malloc in the workers */
+		shard[i].gref = acv;
+		shard[i].lmm = (num_threads == 1) ? acv->lmm : NULL;
+		shard[i].mode = mode;
+		shard[i].shared = (num_threads > 1);
+		shard[i].head_pos = 0;
+		shard[i].max_depth = shard[i].max_table = 0;
+		shard[i].started = shard[i].error = 0;
+		shard[i].unordered = 0;
+		shard[i].dup_cnt = 0;
+		shard[i].kmer_idx_table = kmer_idx_table;
+		shard[i].kmer_table = kmer_table;
+		shard[i].spill = spill;
+		shard[i].ovf = (struct gref_enum_ovf_s){ 0 };
+		lmm_kv_init(shard[i].lmm, shard[i].v);
+		debug("shard(%lld), base_gid(%u), tail_gid(%u)", i, shard[i].base_gid, shard[i].tail_gid);
+	}
+
+	/* run, the first shard is processed in the current thread */
+	for(int64_t i = 1; i < num_threads; i++) {
+		shard[i].started = (pthread_create(&th[i], NULL, gref_enum_shard_worker, (void *)&shard[i]) == 0);
+	}
+	gref_enum_shard_worker((void *)&shard[0]);
+	for(int64_t i = 1; i < num_threads; i++) {
+		if(shard[i].started) {
+			pthread_join(th[i], NULL);
+		} else {
+			debug("failed to create thread, shard(%lld) runs inline", i);
+			gref_enum_shard_worker((void *)&shard[i]);
+		}
+	}
+	lmm_free(acv->lmm, th);
+	uint32_t error = 0;
+	acv->dup_cnt = 0;
+	acv->enum_unordered = 0;
+	for(int64_t i = 0; i < num_threads; i++) {
+		acv->max_stack_depth = MAX2(acv->max_stack_depth, shard[i].max_depth);
+		acv->max_expansion = MAX2(acv->max_expansion, shard[i].max_table);
+		acv->dup_cnt += shard[i].dup_cnt;
+		acv->enum_unordered |= shard[i].unordered;
+		error |= shard[i].error;
+	}
+
+	*num_shards = num_threads;
+	if(shard_out != NULL && error == 0) {
+		*shard_out = shard;
+		return(0);
+	}
+	for(int64_t i = 0; i < num_threads; i++) {
+		lmm_kv_destroy(shard[i].lmm, shard[i].v);
+		lmm_free(shard[i].lmm, shard[i].ovf.slot);
+	}
+	lmm_free(acv->lmm, shard);
+	return((error != 0) ? -1 : 0);
+}
+
+/**
+ * @fn gref_collect_kmers
+ * @brief collect all the (kmer, gid, pos) tuples. the shard results are concatenated
+ * in the gid order, thus the output is identical to that of the single-threaded iteration.
+ */
+static
+int gref_collect_kmers(
+	struct gref_s *acv,
+	struct gref_kmer_tuple_s **arr,
+	int64_t *size)
+{
+	int64_t num_shards = 0;
+	struct gref_enum_shard_s *shard = NULL;
+	if(gref_enum_run(acv, GREF_ENUM_COLLECT, NULL, NULL, NULL, &shard, &num_shards) != 0) { return(-1); }
+
+	/* concatenate */
+	int64_t total = 0;
+	for(int64_t i = 0; i < num_shards; i++) {
+		total += lmm_kv_size(shard[i].v);
+	}
+	lmm_kv_reserve(acv->lmm, shard[0].v, total);
+	for(int64_t i = 1; i < num_shards; i++) {
+		if(lmm_kv_ptr(shard[0].v) != NULL) {
+			memcpy(&lmm_kv_at(shard[0].v, lmm_kv_size(shard[0].v)), lmm_kv_ptr(shard[i].v),
+				sizeof(struct gref_kmer_tuple_s) * lmm_kv_size(shard[i].v));
+			lmm_kv_size(shard[0].v) += lmm_kv_size(shard[i].v);
+		}
+		lmm_kv_destroy(shard[i].lmm, shard[i].v);
+	}
+	*arr = lmm_kv_ptr(shard[0].v);
+	*size = lmm_kv_size(shard[0].v);
+
+	lmm_free(acv->lmm, shard);
+	return((*arr == NULL) ? -1 : 0);
+}
+
+/**
+ * @fn gref_build_index_sort
+ * @brief collect tuples, sort them, then pack into the kmer table.
+ */
+static
+int gref_build_index_sort(
+	struct gref_s *gref)
+{
+	_stats_init(t);
+
+	/* enumerate kmers and pack into vector */
+	struct gref_kmer_tuple_s *kmer_arr = NULL;
+	int64_t kmer_cnt = 0;
+	if(gref_collect_kmers(gref, &kmer_arr, &kmer_cnt) != 0) {
+		debug("enumeration failed");
+		return(-1);
+	}
+	_stats_lap(gref, GREF_PHASE_ENUMERATE, t);
+
+	/* sort kmers */
+	if(psort_half(kmer_arr, kmer_cnt,
+		sizeof(struct gref_kmer_tuple_s), gref->params.num_threads) != 0) {
+		lmm_free(gref->lmm, kmer_arr);
+		debug("sort failed");
+		return(-1);
+	}
+	gref_order_kmer_tuples(kmer_arr, kmer_cnt);
+	_stats_lap(gref, GREF_PHASE_SORT, t);
+
+	/* build index of kmer table */
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH) {
+		/* the hash table is built from the runs after the cap */
+		if(gref_build_kmer_runs(gref, kmer_arr, kmer_cnt) != 0) {
+			lmm_free(gref->lmm, kmer_arr);
+			return(-1);
+		}
+	} else if(gref->params.kmer_idx_type != GREF_KMER_IDX_COMPACT) {
+		gref->kmer_idx_table = gref_build_kmer_idx_table(gref, kmer_arr, kmer_cnt);
+		if(gref->kmer_idx_table == NULL) {
+			lmm_free(gref->lmm, kmer_arr);
+			debug("failed to build index table");
+			return(-1);
+		}
+	} else {
+		if(gref_build_kmer_sb_table(gref, NULL, kmer_arr, kmer_cnt) != 0) {
+			lmm_free(gref->lmm, kmer_arr);
+			debug("failed to build compact index table");
+			return(-1);
+		}
+	}
+
+	/* shrink table */
+	gref->kmer_table_size = kmer_cnt;
+	gref->kmer_table = gref_shrink_kmer_table(gref, kmer_arr, kmer_cnt);
+	if(gref->kmer_table == NULL) {
+		debug("failed to shrink");
+		return(-1);
+	}
+	_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+	return(0);
+}
+
+/**
+ * @fn gref_cmp_kmer_occ
+ */
+static
+int gref_cmp_kmer_occ(
+	void const *a,
+	void const *b)
+{
+	uint64_t const x = ((struct gref_kmer_occ_s const *)a)->kmer, y = ((struct gref_kmer_occ_s const *)b)->kmer;
+	return((x > y) - (x < y));
+}
+
+/**
+ * @fn gref_build_index_count_compact
+ * @brief gref_build_index_count on the compact index. the kmers are counted in
+ * 16-bit counters, which are converted to the relative offsets in place, thus
+ * the peak memory is that of the compact index and the kmer table. the few
+ * occurrences beyond a saturated counter are counted in the shard-local sets.
+ */
+static
+int gref_build_index_count_compact(
+	struct gref_s *gref)
+{
+	uint64_t const kmer_idx_size = gref_get_kmer_idx_size(gref);
+	uint64_t const sb_cnt = kmer_idx_size>>GREF_KMER_SB_SHIFT;
+	struct gref_enum_shard_s *shard = NULL;
+	int64_t num_shards = 0;
+	lmm_kvec_t(struct gref_kmer_occ_s) ovf;
+	lmm_kv_init(gref->lmm, ovf);
+	_stats_init(t);
+
+	gref->kmer_rel_table = (uint16_t *)lmm_malloc(gref->lmm, sizeof(uint16_t) * kmer_idx_size);
+	if(gref->kmer_rel_table == NULL || lmm_kv_ptr(ovf) == NULL) {
+		goto _gref_build_index_count_compact_error_handler;
+	}
+	memset(gref->kmer_rel_table, 0, sizeof(uint16_t) * kmer_idx_size);
+
+	/* count */
+	if(gref_enum_run(gref, GREF_ENUM_COUNT_COMPACT, NULL, NULL, NULL, &shard, &num_shards) != 0) {
+		debug("count pass failed");
+		goto _gref_build_index_count_compact_error_handler;
+	}
+	_stats_lap(gref, GREF_PHASE_ENUMERATE, t);
+
+	/* gather the saturated counters in the kmer order */
+	for(int64_t i = 0; i < num_shards; i++) {
+		for(uint64_t j = 0; shard[i].ovf.slot != NULL && j <= shard[i].ovf.mask; j++) {
+			if(shard[i].ovf.slot[j].occ == 0) { continue; }
+			lmm_kv_push(gref->lmm, ovf, shard[i].ovf.slot[j]);
+		}
+		lmm_free(shard[i].lmm, shard[i].ovf.slot);
+		lmm_kv_destroy(shard[i].lmm, shard[i].v);
+	}
+	lmm_free(gref->lmm, shard); shard = NULL;
+	if(lmm_kv_ptr(ovf) == NULL) { goto _gref_build_index_count_compact_error_handler; }
+	qsort(lmm_kv_ptr(ovf), lmm_kv_size(ovf), sizeof(struct gref_kmer_occ_s), gref_cmp_kmer_occ);
+	int64_t ovf_cnt = 0;
+	for(uint64_t i = 0; i < lmm_kv_size(ovf); i++) {
+		if(ovf_cnt > 0 && lmm_kv_at(ovf, ovf_cnt - 1).kmer == lmm_kv_at(ovf, i).kmer) {
+			lmm_kv_at(ovf, ovf_cnt - 1).occ += lmm_kv_at(ovf, i).occ;
+		} else {
+			lmm_kv_at(ovf, ovf_cnt++) = lmm_kv_at(ovf, i);
+		}
+	}
+
+	/* counts to offsets */
+	if(gref_build_kmer_sb_table_count(gref, lmm_kv_ptr(ovf), ovf_cnt) != 0) {
+		goto _gref_build_index_count_compact_error_handler;
+	}
+	int64_t const kmer_cnt = gref->kmer_sb_table[sb_cnt];
+	debug("kmer_cnt(%lld), esc_size(%lld)", kmer_cnt, gref->kmer_esc_size);
+	_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+
+	/* scatter */
+	gref->kmer_table = (struct gref_gid_pos_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_gid_pos_s) * MAX2(1, kmer_cnt));
+	if(gref->kmer_table == NULL) {
+		goto _gref_build_index_count_compact_error_handler;
+	}
+	if(gref_enum_run(gref, GREF_ENUM_SCATTER_COMPACT, NULL, gref->kmer_table, NULL, NULL, &num_shards) != 0) {
+		debug("scatter pass failed");
+		goto _gref_build_index_count_compact_error_handler;
+	}
+	_stats_lap(gref, GREF_PHASE_ENUMERATE, t);
+
+	/* each head was advanced to the head of the next bucket; shift back in each superblock */
+	for(uint64_t j = 0; j < sb_cnt; j++) {
+		uint64_t const esc_idx = gref->kmer_sb_table[j]>>GREF_KMER_SB_BASE_BITS;
+		if(esc_idx == 0) {
+			uint16_t *r = &gref->kmer_rel_table[j<<GREF_KMER_SB_SHIFT];
+			memmove(&r[1], &r[0], sizeof(uint16_t) * (GREF_KMER_SB_SIZE - 1));
+			r[0] = 0;
+		} else {
+			uint32_t *r = &gref->kmer_esc_table[(esc_idx - 1)<<GREF_KMER_SB_SHIFT];
+			memmove(&r[1], &r[0], sizeof(uint32_t) * (GREF_KMER_SB_SIZE - 1));
+			r[0] = 0;
+		}
+	}
+	gref->kmer_table_size = kmer_cnt;
+
+	/* the shards are scattered in parallel, and a branch rewinds the position; sort the buckets */
+	if(num_shards > 1 || gref->enum_unordered) {
+		for(uint64_t i = 0; i < kmer_idx_size; i++) {
+			struct gref_bucket_s const b = gref_get_bucket(gref, i);
+			if(b.tail - b.base > 1) { gref_sort_gid_pos(&gref->kmer_table[b.base], b.tail - b.base); }
+		}
+	}
+	lmm_kv_destroy(gref->lmm, ovf);
+	_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+	return(0);
+
+_gref_build_index_count_compact_error_handler:;
+	lmm_kv_destroy(gref->lmm, ovf);
+	gref_clean_kmer_idx_table(gref);
+	lmm_free(gref->lmm, gref->kmer_table); gref->kmer_table = NULL;
+	gref->kmer_table_size = 0;
+	return(-1);
+}
+
+/**
+ * @fn gref_build_index_count
+ * @brief two-pass counting sort. the first pass counts occurrences of each kmer in
+ * kmer_idx_table, and the second pass scatters gid_pos directly into kmer_table.
+ * no tuple vector is allocated. the occurrences in a bucket are sorted in the
+ * (gid, pos) order. the compact index is counted in its own table (see
+ * gref_build_index_count_compact) instead of the dense one.
+ */
+static
+int gref_build_index_count(
+	struct gref_s *gref)
+{
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_COMPACT) {
+		return(gref_build_index_count_compact(gref));
+	}
+
+	/* the table has 4^k + 1 elements, the last one holds the total count */
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(gref);
+	int64_t *kmer_idx_table = (int64_t *)lmm_malloc(gref->lmm,
+		sizeof(int64_t) * (kmer_idx_size + 1));
+	if(kmer_idx_table == NULL) { return(-1); }
+	memset(kmer_idx_table, 0, sizeof(int64_t) * (kmer_idx_size + 1));
+	_stats_init(t);
+
+	/* count, shifted by one so that the prefix sum gives the bucket heads */
+	int64_t num_shards = 0;
+	if(gref_enum_run(gref, GREF_ENUM_COUNT, kmer_idx_table, NULL, NULL, NULL, &num_shards) != 0) {
+		lmm_free(gref->lmm, kmer_idx_table);
+		debug("count pass failed");
+		return(-1);
+	}
+	_stats_lap(gref, GREF_PHASE_ENUMERATE, t);
+	for(uint64_t i = 1; i < kmer_idx_size + 1; i++) {
+		kmer_idx_table[i] += kmer_idx_table[i - 1];
+	}
+	int64_t kmer_cnt = kmer_idx_table[kmer_idx_size];
+	debug("kmer_cnt(%lld)", kmer_cnt);
+	_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+
+	/* scatter */
+	struct gref_gid_pos_s *kmer_table = (struct gref_gid_pos_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_gid_pos_s) * MAX2(1, kmer_cnt));
+	if(kmer_table == NULL) {
+		lmm_free(gref->lmm, kmer_idx_table);
+		return(-1);
+	}
+	if(gref_enum_run(gref, GREF_ENUM_SCATTER, kmer_idx_table, kmer_table, NULL, NULL, &num_shards) != 0) {
+		lmm_free(gref->lmm, kmer_idx_table);
+		lmm_free(gref->lmm, kmer_table);
+		debug("scatter pass failed");
+		return(-1);
+	}
+	_stats_lap(gref, GREF_PHASE_ENUMERATE, t);
+
+	/* each head was advanced to the head of the next bucket; shift back */
+	memmove(&kmer_idx_table[1], &kmer_idx_table[0], sizeof(int64_t) * kmer_idx_size);
+	kmer_idx_table[0] = 0;
+
+	/* the shards are scattered in parallel, and a branch rewinds the position; sort the buckets */
+	if(num_shards > 1 || gref->enum_unordered) {
+		for(uint64_t i = 0; i < kmer_idx_size; i++) {
+			int64_t const len = kmer_idx_table[i + 1] - kmer_idx_table[i];
+			if(len > 1) { gref_sort_gid_pos(&kmer_table[kmer_idx_table[i]], len); }
+		}
+	}
+
+	gref->kmer_table_size = kmer_cnt;
+	gref->kmer_table = kmer_table;
+	gref->kmer_idx_table = kmer_idx_table;
+	_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+	return(0);
+}
+
+/**
+ * @fn gref_spill_open
+ * @brief temporary file in TMPDIR (or /tmp), unlinked on open
+ */
+static
+int gref_spill_open(void)
+{
+	char const *dir = getenv("TMPDIR");
+	if(dir == NULL || dir[0] == '\0') { dir = "/tmp"; }
+
+	char path[4096];
+	if(snprintf(path, sizeof(path), "%s/gref_spill.XXXXXX", dir) >= (int)sizeof(path)) { return(-1); }
+	int fd = mkstemp(path);
+	if(fd >= 0) { unlink(path); }
+	return(fd);
+}
+
+/**
+ * @fn gref_cmp_spill_blk
+ * @brief by partition, then by offset
+ */
+static
+int gref_cmp_spill_blk(
+	void const *a,
+	void const *b)
+{
+	struct gref_spill_blk_s const *x = (struct gref_spill_blk_s const *)a, *y = (struct gref_spill_blk_s const *)b;
+	if(x->part != y->part) { return((x->part > y->part) - (x->part < y->part)); }
+	return((x->ofs > y->ofs) - (x->ofs < y->ofs));
+}
+
+/**
+ * @fn gref_build_index_partition
+ * @brief external-memory build. the kmers are counted per prefix, then the
+ * tuples are spilled to a temporary file in partitions of consecutive prefixes,
+ * each of which (with the sort buffer) fits in params.build_mem_kb. the spill
+ * buffers of the shards are shrunk to fit in the budget as well. the partitions
+ * are sorted one at a time in the kmer order and appended to the kmer table and
+ * the bucket table (the runs for the hash index, which is built from them after
+ * the cap). a prefix is never split, thus a partition exceeds the budget if a
+ * single prefix does. the kmer table and the bucket table are kept in memory.
+ */
+#define GREF_BUILD_MEM_DEFAULT		( 0x01ULL<<30 )
+static
+int gref_build_index_partition(
+	struct gref_s *gref)
+{
+	_stats_init(t);
+	uint32_t const kbits = 2 * gref->params.k;
+	uint32_t const pbits = MIN2(kbits, GREF_SPILL_PREFIX_BITS);
+	uint64_t const prefix_cnt = 0x01ULL<<pbits;
+
+	struct gref_spill_s sp = { .fd = -1, .shift = kbits - pbits };
+	pthread_mutex_init(&sp.lock, NULL);
+	lmm_kv_init(NULL, sp.blk);
+	lmm_kvec_t(struct gref_kmer_run_s) run;
+	lmm_kv_init(gref->lmm, run);
+	lmm_kvec_t(struct gref_kmer_occ_s) ovf;	/* saturated counters of the compact index */
+	lmm_kv_init(gref->lmm, ovf);
+	struct gref_kmer_tuple_s *buf = NULL;
+	struct gref_gid_pos_s *kmer_table = NULL;
+	uint32_t const type = gref->params.kmer_idx_type;
+	uint64_t const kmer_idx_size = gref_get_kmer_idx_size(gref);
+
+	int64_t *hist = (int64_t *)lmm_malloc(gref->lmm, sizeof(int64_t) * (prefix_cnt + 1));
+	sp.part = (uint32_t *)lmm_malloc(gref->lmm, sizeof(uint32_t) * prefix_cnt);
+	if(hist == NULL || sp.part == NULL) { goto _gref_build_index_partition_error_handler; }
+	memset(hist, 0, sizeof(int64_t) * (prefix_cnt + 1));
+
+	/* count tuples per prefix */
+	int64_t num_shards = 0;
+	if(gref_enum_run(gref, GREF_ENUM_COUNT, hist, NULL, &sp, NULL, &num_shards) != 0) {
+		goto _gref_build_index_partition_error_handler;
+	}
+
+	/* partitions of consecutive prefixes */
+	uint64_t const budget = (gref->params.build_mem_kb == 0)
+		? GREF_BUILD_MEM_DEFAULT : (uint64_t)gref->params.build_mem_kb<<10;
+	int64_t const part_lim = MAX2(1, budget / (2 * sizeof(struct gref_kmer_tuple_s)));
+	int64_t total = 0, acc = 0, max_part = 0;
+	for(uint64_t p = 0; p < prefix_cnt; p++) {
+		int64_t const c = hist[p + 1];
+		if(acc > 0 && acc + c > part_lim) {
+			max_part = MAX2(max_part, acc);
+			sp.part_cnt++;
+			acc = 0;
+		}
+		sp.part[p] = sp.part_cnt;
+		acc += c;
+		total += c;
+	}
+	max_part = MAX2(max_part, acc);
+	sp.part_cnt++;
+	lmm_free(gref->lmm, hist); hist = NULL;
+
+	/* the spill buffers of all the shards in the budget */
+	uint64_t const spill_lim = budget / (sizeof(struct gref_kmer_tuple_s) * sp.part_cnt * MAX2(1, gref->params.num_threads));
+	sp.blk_size = MAX2(GREF_SPILL_BLK_MIN_SIZE, MIN2(GREF_SPILL_BLK_SIZE, spill_lim));
+	debug("total(%lld), part_cnt(%u), max_part(%lld), blk_size(%u)", total, sp.part_cnt, max_part, sp.blk_size);
+
+	/* spill */
+	if((sp.fd = gref_spill_open()) < 0) { goto _gref_build_index_partition_error_handler; }
+	if(gref_enum_run(gref, GREF_ENUM_SPILL, NULL, NULL, &sp, NULL, &num_shards) != 0
+	|| sp.error != 0) {
+		goto _gref_build_index_partition_error_handler;
+	}
+	_stats_lap(gref, GREF_PHASE_ENUMERATE, t);
+
+	/* sort and append partitions */
+	struct gref_spill_blk_s const *blk = lmm_kv_ptr(sp.blk);
+	uint64_t const blk_cnt = lmm_kv_size(sp.blk);
+	qsort(lmm_kv_ptr(sp.blk), blk_cnt, sizeof(struct gref_spill_blk_s), gref_cmp_spill_blk);
+
+	buf = (struct gref_kmer_tuple_s *)lmm_malloc(gref->lmm, sizeof(struct gref_kmer_tuple_s) * MAX2(1, max_part));
+	kmer_table = (struct gref_gid_pos_s *)lmm_malloc(gref->lmm, sizeof(struct gref_gid_pos_s) * MAX2(1, total));
+	if(buf == NULL || kmer_table == NULL) { goto _gref_build_index_partition_error_handler; }
+
+	/* the direct-address bucket tables are filled as the partitions are sorted, without the runs */
+	if(type == GREF_KMER_IDX_COMPACT) {
+		gref->kmer_rel_table = (uint16_t *)lmm_malloc(gref->lmm, sizeof(uint16_t) * kmer_idx_size);
+		if(gref->kmer_rel_table == NULL) { goto _gref_build_index_partition_error_handler; }
+		memset(gref->kmer_rel_table, 0, sizeof(uint16_t) * kmer_idx_size);
+	} else if(type != GREF_KMER_IDX_HASH) {
+		gref->kmer_idx_table = (int64_t *)lmm_malloc(gref->lmm, sizeof(int64_t) * (kmer_idx_size + 1));
+		if(gref->kmer_idx_table == NULL) { goto _gref_build_index_partition_error_handler; }
+	}
+
+	int64_t ofs = 0;
+	uint64_t next = 0;					/* the first kmer whose head is not stored in kmer_idx_table */
+	for(uint64_t b = 0; b < blk_cnt;) {
+		uint32_t const part = blk[b].part;
+		int64_t n = 0;
+		for(; b < blk_cnt && blk[b].part == part; b++) {
+			if(n + blk[b].cnt > max_part || gref_spill_read(&sp, &blk[b], &buf[n]) != 0) {
+				goto _gref_build_index_partition_error_handler;
+			}
+			n += blk[b].cnt;
+		}
+		if(ofs + n > total || psort_half(buf, n, sizeof(struct gref_kmer_tuple_s), gref->params.num_threads) != 0) {
+			goto _gref_build_index_partition_error_handler;
+		}
+		gref_order_kmer_tuples(buf, n);
+		_stats_lap(gref, GREF_PHASE_SORT, t);
+
+		for(int64_t i = 0; i < n; i++) {
+			uint64_t const kmer = buf[i].kmer;
+			kmer_table[ofs + i] = buf[i].gid_pos;
+			if(type == GREF_KMER_IDX_COMPACT) {
+				/* count, completed with ovf as in the count build */
+				if(gref_enum_count16(&gref->kmer_rel_table[kmer], 0) == 0) { continue; }
+				if(lmm_kv_size(ovf) > 0 && lmm_kv_at(ovf, lmm_kv_size(ovf) - 1).kmer == kmer) {
+					lmm_kv_at(ovf, lmm_kv_size(ovf) - 1).occ++;
+				} else {
+					lmm_kv_push(gref->lmm, ovf, ((struct gref_kmer_occ_s){ .kmer = kmer, .occ = 1 }));
+				}
+			} else if(i == 0 || kmer != buf[i - 1].kmer) {
+				if(type == GREF_KMER_IDX_HASH) {
+					lmm_kv_push(gref->lmm, run, ((struct gref_kmer_run_s){ .kmer = kmer, .base = ofs + i }));
+				} else {
+					for(; next <= kmer; next++) { gref->kmer_idx_table[next] = ofs + i; }
+				}
+			}
+		}
+		if(lmm_kv_ptr(run) == NULL || lmm_kv_ptr(ovf) == NULL) { goto _gref_build_index_partition_error_handler; }
+		ofs += n;
+		_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+	}
+
+	close(sp.fd);
+	lmm_free(gref->lmm, buf);
+	lmm_free(gref->lmm, sp.part);
+	lmm_kv_destroy(NULL, sp.blk);
+	pthread_mutex_destroy(&sp.lock);
+
+	gref->kmer_table = kmer_table;
+	gref->kmer_table_size = ofs;
+
+	/* close the bucket table; the hash index keeps the runs until after the cap */
+	int ret = 0;
+	if(type == GREF_KMER_IDX_HASH) {
+		lmm_kv_push(gref->lmm, run, ((struct gref_kmer_run_s){ .kmer = UINT64_MAX, .base = ofs }));
+		lmm_free(gref->lmm, gref->kmer_run);
+		gref->kmer_run = lmm_kv_ptr(run);
+		gref->kmer_run_cnt = lmm_kv_size(run) - 1;
+		ret = (lmm_kv_ptr(run) == NULL) ? -1 : 0;
+	} else if(type == GREF_KMER_IDX_COMPACT) {
+		ret = gref_build_kmer_sb_table_count(gref, lmm_kv_ptr(ovf), lmm_kv_size(ovf));
+		lmm_kv_destroy(gref->lmm, run);
+	} else {
+		for(; next <= kmer_idx_size; next++) { gref->kmer_idx_table[next] = ofs; }
+		lmm_kv_destroy(gref->lmm, run);
+	}
+	lmm_kv_destroy(gref->lmm, ovf);
+	_stats_lap(gref, GREF_PHASE_KMER_TABLE, t);
+	return(ret);
+
+_gref_build_index_partition_error_handler:;
+	if(sp.fd >= 0) { close(sp.fd); }
+	lmm_free(gref->lmm, hist);
+	lmm_free(gref->lmm, buf);
+	lmm_free(gref->lmm, kmer_table);
+	lmm_free(gref->lmm, sp.part);
+	lmm_kv_destroy(NULL, sp.blk);
+	lmm_kv_destroy(gref->lmm, run);
+	lmm_kv_destroy(gref->lmm, ovf);
+	gref_clean_kmer_idx_table(gref);
+	pthread_mutex_destroy(&sp.lock);
+	return(-1);
+}
+
+/**
+ * @struct gref_occ_mask_s
+ * @brief kmers whose buckets were capped, with the original counts. filter has
+ * a bit per hashed kmer, as in gref_delta_s.
+ */
+#define GREF_OCC_FILTER_BITS		( 0x01ULL<<16 )
+struct gref_occ_mask_s {
+	int64_t cnt;
+	struct gref_kmer_occ_s *arr;	/* sorted by kmer */
+	uint64_t filter[GREF_OCC_FILTER_BITS / 64];
+};
+
+/**
+ * @fn gref_build_occ_mask
+ * @brief copy the sorted array into a new mask object
+ */
+static
+int gref_build_occ_mask(
+	struct gref_s *gref,
+	struct gref_kmer_occ_s const *arr,
+	int64_t cnt)
+{
+	struct gref_occ_mask_s *m = (struct gref_occ_mask_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_occ_mask_s) + sizeof(struct gref_kmer_occ_s) * cnt);
+	if(m == NULL) { return(-1); }
+
+	m->cnt = cnt;
+	m->arr = (struct gref_kmer_occ_s *)(m + 1);
+	memcpy(m->arr, arr, sizeof(struct gref_kmer_occ_s) * cnt);
+	memset(m->filter, 0, sizeof(uint64_t) * (GREF_OCC_FILTER_BITS / 64));
+	for(int64_t i = 0; i < cnt; i++) {
+		uint64_t h = gref_hash_kmer(arr[i].kmer, gref->mask) & (GREF_OCC_FILTER_BITS - 1);
+		m->filter[h>>6] |= 0x01ULL<<(h & 0x3f);
+	}
+
+	lmm_free(gref->lmm, gref->occ_mask);
+	gref->occ_mask = m;
+	return(0);
+}
+
+/**
+ * @fn gref_occ_mask_find
+ * @brief returns the index of kmer in the mask, -1 if not found
+ */
+static _force_inline
+int64_t gref_occ_mask_find(
+	struct gref_s const *gref,
+	uint64_t kmer)
+{
+	struct gref_occ_mask_s const *m = gref->occ_mask;
+	if(m == NULL) { return(-1); }
+
+	uint64_t h = gref_hash_kmer(kmer, gref->mask) & (GREF_OCC_FILTER_BITS - 1);
+	if((m->filter[h>>6] & (0x01ULL<<(h & 0x3f))) == 0) { return(-1); }
+
+	int64_t lo = 0, hi = m->cnt;
+	while(lo < hi) {
+		int64_t mid = (lo + hi) / 2;
+		if(m->arr[mid].kmer < kmer) { lo = mid + 1; } else { hi = mid; }
+	}
+	return((lo < m->cnt && m->arr[lo].kmer == kmer) ? lo : -1);
+}
+
+/**
+ * @fn gref_cmp_occ
+ * @brief descending order
+ */
+static
+int gref_cmp_occ(
+	void const *a,
+	void const *b)
+{
+	int64_t x = *(int64_t const *)a, y = *(int64_t const *)b;
+	return((x < y) - (x > y));
+}
+
+/**
+ * @fn gref_calc_occ_cap
+ * @brief the cap from the bucket size distribution: the smallest size c such
+ * that at most mask_top_ppm of the distinct kmers have more than c occurrences,
+ * bounded by max_occ. sizes up to GREF_OCC_HIST_SIZE are counted in the
+ * histogram, larger ones are collected and sorted. returns -1 on failure.
+ */
+#define GREF_OCC_HIST_SIZE			( 0x01ULL<<16 )
+static
+int64_t gref_calc_occ_cap(
+	struct gref_s const *gref)
+{
+	int64_t const max_occ = (gref->params.max_occ == 0) ? INT64_MAX : (int64_t)gref->params.max_occ;
+	if(gref->params.mask_top_ppm == 0) { return(max_occ); }
+
+	uint64_t *hist = (uint64_t *)lmm_malloc(gref->lmm, sizeof(uint64_t) * GREF_OCC_HIST_SIZE);
+	lmm_kvec_t(int64_t) large;
+	lmm_kv_init(gref->lmm, large);
+	if(hist == NULL) { return(-1); }
+	memset(hist, 0, sizeof(uint64_t) * GREF_OCC_HIST_SIZE);
+
+	uint64_t const bucket_cnt = gref_get_bucket_cnt(gref);
+	uint64_t distinct = 0;
+	for(uint64_t j = 0; j < bucket_cnt; j++) {
+		struct gref_bucket_s b = gref_get_nth_bucket(gref, j);
+		int64_t len = b.tail - b.base;
+		distinct += (len != 0);
+		if((uint64_t)len < GREF_OCC_HIST_SIZE) {
+			hist[len]++;
+		} else {
+			lmm_kv_push(gref->lmm, large, len);
+		}
+	}
+	uint64_t const limit = distinct * gref->params.mask_top_ppm / 1000000;
+	uint64_t const large_cnt = lmm_kv_size(large);
+	debug("distinct(%llu), limit(%llu), large(%llu)", distinct, limit, large_cnt);
+
+	int64_t cap = 0;
+	if(limit < large_cnt) {
+		/* descending; the limit-th one is the largest size left */
+		qsort(lmm_kv_ptr(large), large_cnt, sizeof(int64_t), gref_cmp_occ);
+		cap = lmm_kv_at(large, limit);
+	} else {
+		uint64_t acc = large_cnt;
+		for(int64_t len = GREF_OCC_HIST_SIZE - 1; len > 0; len--) {
+			if(acc + hist[len] > limit) { cap = len; break; }
+			acc += hist[len];
+		}
+	}
+	lmm_free(gref->lmm, hist);
+	lmm_kv_destroy(gref->lmm, large);
+	return(MIN2(cap, max_occ));
+}
+
+/**
+ * @fn gref_compact_kmer_table
+ * @brief drop or truncate the buckets above the cap.
+ * the kmer table and the bucket table (dense, compact, or the runs) are
+ * compacted in place, a superblock at a time: the old offsets of the superblock
+ * are loaded before its entries are rewritten, and the offsets never exceed the
+ * old ones, thus escaped superblocks remain valid and the others still fit in
+ * 16 bits.
+ */
+static
+int gref_compact_kmer_table(
+	struct gref_s *gref,
+	int64_t cap,
+	int64_t keep)
+{
+	lmm_kvec_t(struct gref_kmer_occ_s) masked;
+	lmm_kv_init(gref->lmm, masked);
+	if(lmm_kv_ptr(masked) == NULL) { return(-1); }
+
+	struct gref_gid_pos_s *kt = gref->kmer_table;
+	struct gref_kmer_run_s *run = gref->kmer_run;
+	uint64_t const kmer_idx_size = gref_get_kmer_idx_size(gref);
+	uint64_t const bucket_cnt = gref_get_bucket_cnt(gref);
+	int64_t ofs = 0;
+	for(uint64_t j = 0; j < bucket_cnt; j += GREF_KMER_SB_SIZE) {
+		/* the last block of the runs may be partial */
+		uint64_t const w = MIN2(GREF_KMER_SB_SIZE, bucket_cnt - j);
+		int64_t prev[GREF_KMER_SB_SIZE + 1], curr[GREF_KMER_SB_SIZE + 1];
+		for(uint64_t k = 0; k < w; k++) {
+			prev[k] = gref_get_nth_bucket(gref, j + k).base;
+		}
+		prev[w] = gref_get_nth_bucket(gref, j + w - 1).tail;
+
+		for(uint64_t k = 0; k < w; k++) {
+			int64_t len = prev[k + 1] - prev[k];
+			curr[k] = ofs;
+			if(len > cap) {
+				lmm_kv_push(gref->lmm, masked, ((struct gref_kmer_occ_s){
+					.kmer = (run != NULL) ? run[j + k].kmer : j + k,
+					.occ = len
+				}));
+				if(lmm_kv_ptr(masked) == NULL) { return(-1); }
+				len = keep;
+			}
+			if(len > 0 && ofs != prev[k]) {
+				memmove(&kt[ofs], &kt[prev[k]], sizeof(struct gref_gid_pos_s) * len);
+			}
+			ofs += len;
+		}
+		curr[w] = ofs;
+
+		/* write back */
+		if(run != NULL) {
+			for(uint64_t k = 0; k < w; k++) { run[j + k].base = curr[k]; }
+			continue;
+		}
+		if(gref->params.kmer_idx_type != GREF_KMER_IDX_COMPACT) {
+			memcpy(&gref->kmer_idx_table[j], curr, sizeof(int64_t) * GREF_KMER_SB_SIZE);
+			continue;
+		}
+		uint64_t *e = &gref->kmer_sb_table[j>>GREF_KMER_SB_SHIFT];
+		uint64_t esc_idx = *e>>GREF_KMER_SB_BASE_BITS;
+		*e = (esc_idx<<GREF_KMER_SB_BASE_BITS) | curr[0];
+		for(uint64_t k = 0; k < GREF_KMER_SB_SIZE; k++) {
+			if(esc_idx == 0) {
+				gref->kmer_rel_table[j + k] = curr[k] - curr[0];
+			} else {
+				gref->kmer_esc_table[((esc_idx - 1)<<GREF_KMER_SB_SHIFT) + k] = curr[k] - curr[0];
+			}
+		}
+	}
+	if(run != NULL) {
+		run[bucket_cnt].base = ofs;
+	} else if(gref->params.kmer_idx_type != GREF_KMER_IDX_COMPACT) {
+		gref->kmer_idx_table[kmer_idx_size] = ofs;
+	} else {
+		gref->kmer_sb_table[kmer_idx_size>>GREF_KMER_SB_SHIFT] = ofs;
+	}
+	debug("cap(%lld), masked(%llu), kmer_table_size(%lld -> %lld)",
+		cap, lmm_kv_size(masked), gref->kmer_table_size, ofs);
+	if(ofs == gref->kmer_table_size) {
+		lmm_kv_destroy(gref->lmm, masked);
+		return(0);
+	}
+
+	/* shrink; the old table remains valid if realloc fails */
+	kt = (struct gref_gid_pos_s *)lmm_realloc(gref->lmm, kt, sizeof(struct gref_gid_pos_s) * MAX2(1, ofs));
+	if(kt != NULL) { gref->kmer_table = kt; }
+	gref->kmer_table_size = ofs;
+
+	int ret = (lmm_kv_size(masked) == 0) ? 0
+		: gref_build_occ_mask(gref, lmm_kv_ptr(masked), lmm_kv_size(masked));
+	lmm_kv_destroy(gref->lmm, masked);
+	return(ret);
+}
+
+/**
+ * @fn gref_cap_kmer_table
+ * @brief drop or truncate the buckets above the cap. the repeated occurrences
+ * are dropped at the enumeration, thus the cap is calculated on the unique
+ * buckets; the table is not swept without a cap.
+ */
+static
+int gref_cap_kmer_table(
+	struct gref_s *gref)
+{
+	if(gref->params.max_occ == 0 && gref->params.mask_top_ppm == 0) { return(0); }
+
+	int64_t const cap = gref_calc_occ_cap(gref);
+	if(cap < 0) { return(-1); }
+	int64_t const keep = (gref->params.occ_mode == GREF_OCC_TRUNCATE) ? cap : 0;
+	return(gref_compact_kmer_table(gref, cap, keep));
+}
+
+/**
+ * @fn gref_pack_kmer_table
+ * @brief convert the kmer table to the packed entries (gid<<pos_bits | pos in
+ * entry_size bytes, little endian). done in place, as each entry is written
+ * below the next one to be read.
+ */
+static
+int gref_pack_kmer_table(
+	struct gref_s *gref)
+{
+	if(gref->params.entry_format != GREF_ENTRY_PACKED) { return(0); }
+
+	/* widths from the largest gid and the longest section */
+	struct gref_section_intl_s const *sec =
+		(struct gref_section_intl_s const *)hmap_get_object(gref->hmap, 0);
+	uint64_t max_len = 1;
+	for(int64_t i = 0; i < gref->sec_cnt; i++) {
+		max_len = MAX2(max_len, sec[i].fw_sec.len);
+	}
+	#define _bits(_x)		( 64 - __builtin_clzll((uint64_t)(_x) | 0x01) )
+	uint32_t const pos_bits = _bits(max_len - 1);
+	uint32_t const gid_bits = _bits(MAX2(1, 2 * gref->sec_cnt) - 1);
+	#undef _bits
+	uint32_t const entry_size = (pos_bits + gid_bits + 7) / 8;
+	debug("pos_bits(%u), gid_bits(%u), entry_size(%u)", pos_bits, gid_bits, entry_size);
+
+	struct gref_gid_pos_s const *src = gref->kmer_table;
+	uint8_t *dst = (uint8_t *)gref->kmer_table;
+	for(int64_t i = 0; i < gref->kmer_table_size; i++) {
+		uint64_t v = ((uint64_t)src[i].gid<<pos_bits) | src[i].pos;
+		memcpy(&dst[i * entry_size], &v, sizeof(uint64_t));
+	}
+
+	gref->entry_size = entry_size;
+	gref->entry_pos_bits = pos_bits;
+	uint64_t const size = gref_get_kmer_table_bytes(gref);
+	dst = (uint8_t *)lmm_realloc(gref->lmm, dst, size);
+	if(dst == NULL) {
+		/* the entries are already packed; the table is unusable */
+		gref->kmer_table = NULL;
+		return(-1);
+	}
+	memset(&dst[entry_size * gref->kmer_table_size], 0, sizeof(uint64_t));
+	gref->kmer_table = (struct gref_gid_pos_s *)dst;
+	return(0);
+}
+
+/**
+ * @fn gref_build_index
+ */
+gref_idx_t *gref_build_index(
+	gref_acv_t *acv)
+{
+	struct gref_s *gref = (struct gref_s *)acv;
+
+	if(gref == NULL || gref->type != GREF_ACV) {
+		goto _gref_build_index_error_handler;
+	}
+	gref->entry_size = gref->entry_pos_bits = 0;
+	memset(&gref->phase_sec[GREF_PHASE_ENUMERATE], 0,
+		sizeof(double) * (GREF_PHASE_CNT - GREF_PHASE_ENUMERATE));
+	gref->max_stack_depth = gref->max_expansion = 0;
+	gref->dup_cnt = 0;
+
+	/* build kmer table and its index */
+	int (*build[])(struct gref_s *gref) = {
+		[GREF_BUILD_SORT] = gref_build_index_sort,
+		[GREF_BUILD_COUNT] = gref_build_index_count,
+		[GREF_BUILD_PARTITION] = gref_build_index_partition
+	};
+	if(build[gref->params.build_mode](gref) != 0) {
+		goto _gref_build_index_error_handler;
+	}
+
+	/* store misc constants for kmer matching */
+	gref->mask = (uint64_t)-1>>(64 - 2 * gref->params.k);
+
+	/* occurrence cap and packing, then move the (shrunk) tables */
+	_stats_init(t);
+	if(gref_cap_kmer_table(gref) != 0) {
+		goto _gref_build_index_error_handler;
+	}
+	_stats_lap(gref, GREF_PHASE_CAP, t);
+	if(gref_pack_kmer_table(gref) != 0) {
+		goto _gref_build_index_error_handler;
+	}
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_INLINE && gref_build_kmer_slot_table(gref) != 0) {
+		goto _gref_build_index_error_handler;
+	}
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH && gref_build_kmer_hash_table(gref) != 0) {
+		goto _gref_build_index_error_handler;
+	}
+	_stats_lap(gref, GREF_PHASE_PACK, t);
+	gref_place_kmer_tables(gref);
+	_stats_lap(gref, GREF_PHASE_PLACE, t);
+
+	/* change state */
+	gref->type = GREF_IDX;
+	return((gref_idx_t *)gref);
+
+_gref_build_index_error_handler:;
+	gref_clean((gref_t *)gref);
+	return(NULL);
+}
+
+/* incremental update */
+/**
+ * @fn gref_stage_id
+ * @brief hmap_get_id on the live index. the new object may take the slot of the
+ * tail sentinel, whose link index is restored.
+ */
+static _force_inline
+uint32_t gref_stage_id(
+	struct gref_s *idx,
+	char const *name,
+	int32_t name_len)
+{
+	uint32_t id = hmap_get_id(idx->hmap, name, name_len);
+	struct gref_section_half_s *sec_half =
+		(struct gref_section_half_s *)hmap_get_object(idx->hmap, 0);
+	sec_half[2 * idx->sec_cnt].link_idx_base = idx->link_table_size;
+
+	idx->stage_sec_cnt = MAX3(idx->stage_sec_cnt, idx->sec_cnt, id + 1);
+	return(id);
+}
+
+/**
+ * @fn gref_swap_stage_seq
+ * @brief swap seq and stage_seq to reuse the encoders on the staging buffer
+ */
+static _force_inline
+void gref_swap_stage_seq(
+	struct gref_s *idx)
+{
+	uint8_t *ptr = lmm_kv_ptr(idx->seq);
+	uint64_t size = lmm_kv_size(idx->seq), max = lmm_kv_max(idx->seq);
+
+	lmm_kv_ptr(idx->seq) = lmm_kv_ptr(idx->stage_seq);
+	lmm_kv_size(idx->seq) = lmm_kv_size(idx->stage_seq);
+	lmm_kv_max(idx->seq) = lmm_kv_max(idx->stage_seq);
+
+	lmm_kv_ptr(idx->stage_seq) = ptr;
+	lmm_kv_size(idx->stage_seq) = size;
+	lmm_kv_max(idx->stage_seq) = max;
+	return;
+}
+
+/**
+ * @fn gref_idx_append_segment
+ */
+int gref_idx_append_segment(
+	gref_idx_t *_idx,
+	char const *name,
+	int32_t name_len,
+	uint8_t const *seq,
+	int64_t seq_len)
+{
+	struct gref_s *idx = (struct gref_s *)_idx;
+	if(idx == NULL || idx->type != GREF_IDX) { return(-1); }
+
+	/* sections in the index cannot be redefined */
+	uint32_t id = gref_stage_id(idx, name, name_len);
+	if(id < idx->sec_cnt) { return(-1); }
+
+	/* encode into the staging buffer; the base is the offset in it until applied */
+	gref_swap_stage_seq(idx);
+	struct gref_seq_interval_s iv = idx->append_seq(idx, seq, seq_len);
+	gref_swap_stage_seq(idx);
+	if(idx->params.copy_mode == GREF_COPY && lmm_kv_ptr(idx->stage_seq) == NULL) { return(-1); }
+
+	idx->stage_seq_len += iv.tail - iv.base;
+	idx->stage_cnt++;
+
+	/* store section info, same as gref_append_segment */
+	uint64_t const max_sec_len = 0x80000000;
+	uint64_t len = MIN2(iv.tail - iv.base, max_sec_len);
+	struct gref_section_intl_s *sec =
+		(struct gref_section_intl_s *)hmap_get_object(idx->hmap, id);
+	sec->base_gid = _encode_id(id, 0);
+	sec->fw_sec = (struct gref_section_s){
+		.gid = _encode_id(id, 0),
+		.len = len,
+		.base = (void *)iv.base
+	};
+	sec->rv_sec = (struct gref_section_s){
+		.gid = _encode_id(id, 1),
+		.len = len,
+		.base = NULL
+	};
+	return(0);
+}
+
+/**
+ * @fn gref_idx_append_link
+ */
+int gref_idx_append_link(
+	gref_idx_t *_idx,
+	char const *src,
+	int32_t src_len,
+	int32_t src_ori,
+	char const *dst,
+	int32_t dst_len,
+	int32_t dst_ori)
+{
+	struct gref_s *idx = (struct gref_s *)_idx;
+	if(idx == NULL || idx->type != GREF_IDX) { return(-1); }
+
+	uint32_t src_id = gref_stage_id(idx, src, src_len);
+	uint32_t dst_id = gref_stage_id(idx, dst, dst_len);
+
+	/* forward and reverse links */
+	struct gref_gid_pair_s const link[2] = {
+		{ .from = _encode_id(src_id, src_ori), .to = _encode_id(dst_id, dst_ori) },
+		{ .from = _encode_id(dst_id, _rev(dst_ori)), .to = _encode_id(src_id, _rev(src_ori)) }
+	};
+	lmm_kv_pushm(idx->lmm, idx->stage_link, link, 2);
+	if(lmm_kv_ptr(idx->stage_link) == NULL) { return(-1); }
+
+	idx->stage_cnt++;
+	return(0);
+}
+
+/**
+ * @struct gref_delta_s
+ * @brief buckets changed by gref_update_index. each bucket is stored as a whole
+ * (the original one with the changes applied), thus a lookup hitting the delta
+ * does not read the kmer table. filter has a bit per hashed kmer.
+ */
+#define GREF_DELTA_FILTER_BITS		( 0x01ULL<<16 )
+struct gref_delta_s {
+	int64_t kmer_cnt;
+	uint64_t *kmer;					/* sorted */
+	int64_t *base;					/* kmer_cnt + 1 offsets in gid_pos */
+	struct gref_gid_pos_s *gid_pos;
+	uint64_t filter[GREF_DELTA_FILTER_BITS / 64];
+};
+
+/**
+ * @fn gref_delta_find
+ * @brief returns the index of kmer in the delta, -1 if not found
+ */
+static _force_inline
+int64_t gref_delta_find(
+	struct gref_s const *gref,
+	uint64_t kmer)
+{
+	struct gref_delta_s const *d = gref->delta;
+	if(d == NULL) { return(-1); }
+
+	uint64_t h = gref_hash_kmer(kmer, gref->mask) & (GREF_DELTA_FILTER_BITS - 1);
+	if((d->filter[h>>6] & (0x01ULL<<(h & 0x3f))) == 0) { return(-1); }
+
+	int64_t lo = 0, hi = d->kmer_cnt;
+	while(lo < hi) {
+		int64_t mid = (lo + hi) / 2;
+		if(d->kmer[mid] < kmer) { lo = mid + 1; } else { hi = mid; }
+	}
+	return((lo < d->kmer_cnt && d->kmer[lo] == kmer) ? lo : -1);
+}
+
+/**
+ * @fn gref_delta_span
+ * @brief for each gid, the number of bases at the tail of the section from which
+ * kmers (and minimizer windows) may run over one of the staged links. the links
+ * are walked backward from the sources of the staged ones.
+ */
+static
+uint32_t *gref_delta_span(
+	struct gref_s *gref)
+{
+	uint32_t const gid_cnt = 2 * gref->stage_sec_cnt;
+	uint32_t const old_gid_cnt = 2 * gref->sec_cnt;
+	/* windows on the junction, and margin for those truncated at head_pos */
+	uint32_t const span = gref->params.k - 1 + 2 * (gref->params.minimizer_window - 1);
+	struct gref_section_half_s const *hsec =
+		(struct gref_section_half_s const *)hmap_get_object(gref->hmap, 0);
+	struct gref_gid_pair_s const *link = lmm_kv_ptr(gref->stage_link);
+	int64_t const link_cnt = lmm_kv_size(gref->stage_link);
+
+	uint32_t *rem = (uint32_t *)lmm_malloc(gref->lmm, sizeof(uint32_t) * MAX2(1, gid_cnt));
+	if(rem == NULL) { return(NULL); }
+	memset(rem, 0, sizeof(uint32_t) * gid_cnt);
+
+	lmm_kvec_t(uint32_t) q;
+	lmm_kv_init(gref->lmm, q);
+
+	#define _push(_gid, _r) { \
+		if((_r) > rem[(_gid)]) { \
+			rem[(_gid)] = (_r); \
+			lmm_kv_push(gref->lmm, q, (_gid)); \
+		} \
+	}
+	for(int64_t i = 0; i < link_cnt; i++) {
+		_push(link[i].from, span);
+	}
+	while(lmm_kv_size(q) > 0) {
+		uint32_t gid = lmm_kv_pop(gref->lmm, q);
+		uint32_t len = hsec[gid].sec.len;
+		if(len >= rem[gid]) { continue; }
+
+		/* predecessors, the reverses of the links from the reverse strand */
+		uint32_t r = rem[gid] - len;
+		if(gid < old_gid_cnt) {
+			for(int64_t j = hsec[_rev(gid)].link_idx_base; j < hsec[_rev(gid) + 1].link_idx_base; j++) {
+				_push(_rev(gref->link_table[j]), r);
+			}
+		}
+		for(int64_t i = 0; i < link_cnt; i++) {
+			if(link[i].to == gid) { _push(link[i].from, r); }
+		}
+	}
+	#undef _push
+
+	lmm_kv_destroy(gref->lmm, q);
+	return(rem);
+}
+
+/**
+ * @fn gref_delta_collect
+ * @brief enumerate the kmers on [0, gid_cnt) affected by the staged links on the current graph
+ */
+static
+void gref_delta_collect(
+	struct gref_s *gref,
+	struct gref_enum_shard_s *s,
+	uint32_t const *span,
+	uint32_t gid_cnt)
+{
+	struct gref_section_half_s const *hsec =
+		(struct gref_section_half_s const *)hmap_get_object(gref->hmap, 0);
+	for(uint32_t gid = 0; gid < gid_cnt; gid++) {
+		uint32_t len = hsec[gid].sec.len;
+		if(span[gid] == 0 || len == 0) { continue; }
+
+		s->base_gid = gid;
+		s->tail_gid = gid + 1;
+		s->head_pos = (len > span[gid]) ? len - span[gid] : 0;
+		gref_enum_shard_worker((void *)s);
+	}
+	return;
+}
+
+/**
+ * @fn gref_delta_diff
+ * @brief cancel the tuples found both in prev and curr (sorted by kmer, then
+ * by (gid, pos)). the remaining ones are packed at the head of each array.
+ */
+static
+void gref_delta_diff(
+	struct gref_kmer_tuple_s *prev,
+	int64_t *prev_cnt,
+	struct gref_kmer_tuple_s *curr,
+	int64_t *curr_cnt)
+{
+	int64_t i = 0, j = 0, pcnt = 0, ccnt = 0;
+	while(i < *prev_cnt || j < *curr_cnt) {
+		uint64_t kmer = (j >= *curr_cnt || (i < *prev_cnt && prev[i].kmer < curr[j].kmer))
+			? prev[i].kmer : curr[j].kmer;
+
+		int64_t pi = i, cj = j;
+		while(i < *prev_cnt && prev[i].kmer == kmer) { i++; }
+		while(j < *curr_cnt && curr[j].kmer == kmer) { j++; }
+
+		/* merge the two runs in the (gid, pos) order, an equal pair cancels */
+		while(pi < i || cj < j) {
+			int c = (cj >= j) ? -1 : (pi >= i) ? 1 : gref_cmp_gid_pos(&prev[pi].gid_pos, &curr[cj].gid_pos);
+			if(c < 0) {
+				prev[pcnt++] = prev[pi++];
+			} else if(c > 0) {
+				curr[ccnt++] = curr[cj++];
+			} else {
+				pi++; cj++;
+			}
+		}
+	}
+	*prev_cnt = pcnt;
+	*curr_cnt = ccnt;
+	return;
+}
+
+/**
+ * @fn gref_delta_build
+ * @brief rebuild the delta; buckets of the kmers in add or del are taken from the
+ * current delta (or the kmer table), then del is removed and add is merged in
+ * the (gid, pos) order. both arrays must be sorted by kmer, then by (gid, pos).
+ */
+static
+int gref_delta_build(
+	struct gref_s *gref,
+	struct gref_kmer_tuple_s const *add,
+	int64_t add_cnt,
+	struct gref_kmer_tuple_s const *del,
+	int64_t del_cnt)
+{
+	struct gref_delta_s const *d = gref->delta;
+	int64_t const dcnt = (d == NULL) ? 0 : d->kmer_cnt;
+	struct gref_delta_s *n = NULL;
+
+	/* the first pass counts keys and (the upper bound of) the occurrences */
+	int64_t kcnt = 0, ecnt = 0;
+	for(int64_t pass = 0; pass < 2; pass++) {
+		int64_t i = 0, j = 0, l = 0;
+		kcnt = 0; ecnt = 0;
+		while(i < add_cnt || j < del_cnt || l < dcnt) {
+			uint64_t kmer = UINT64_MAX;
+			if(i < add_cnt) { kmer = MIN2(kmer, add[i].kmer); }
+			if(j < del_cnt) { kmer = MIN2(kmer, del[j].kmer); }
+			if(l < dcnt) { kmer = MIN2(kmer, d->kmer[l]); }
+
+			/* current bucket */
+			struct gref_gid_pos_s const *src = NULL;
+			int64_t len = 0;
+			if(l < dcnt && d->kmer[l] == kmer) {
+				src = &d->gid_pos[d->base[l]];
+				len = d->base[l + 1] - d->base[l];
+				l++;
+			} else {
+				struct gref_bucket_s b = gref_get_bucket(gref, kmer);
+				src = &gref->kmer_table[b.base];
+				len = b.tail - b.base;
+			}
+			int64_t dh = j, ah = i;
+			while(j < del_cnt && del[j].kmer == kmer) { j++; }
+			while(i < add_cnt && add[i].kmer == kmer) { i++; }
+
+			if(n == NULL) {
+				kcnt++;
+				ecnt += len + i - ah;
+				continue;
+			}
+
+			n->kmer[kcnt] = kmer;
+			n->base[kcnt++] = ecnt;
+			uint64_t h = gref_hash_kmer(kmer, gref->mask) & (GREF_DELTA_FILTER_BITS - 1);
+			n->filter[h>>6] |= 0x01ULL<<(h & 0x3f);
+
+			/* merge in the (gid, pos) order; an occurrence is removed for each tuple in del */
+			int64_t e = 0;
+			while(e < len || ah < i) {
+				struct gref_gid_pos_s const k = (ah >= i || (e < len && gref_cmp_gid_pos(&src[e], &add[ah].gid_pos) <= 0))
+					? src[e] : add[ah].gid_pos;
+				int64_t ns = 0, na = 0, nd = 0;
+				while(e < len && gref_cmp_gid_pos(&src[e], &k) == 0) { e++; ns++; }
+				while(ah < i && gref_cmp_gid_pos(&add[ah].gid_pos, &k) == 0) { ah++; na++; }
+				while(dh < j && gref_cmp_gid_pos(&del[dh].gid_pos, &k) < 0) { dh++; }
+				while(dh < j && gref_cmp_gid_pos(&del[dh].gid_pos, &k) == 0) { dh++; nd++; }
+				if(ns > nd || na > 0) { n->gid_pos[ecnt++] = k; }
+			}
+		}
+		if(n != NULL) { break; }
+
+		/* allocate in a chunk */
+		n = (struct gref_delta_s *)lmm_malloc(gref->lmm, sizeof(struct gref_delta_s)
+			+ sizeof(uint64_t) * kcnt + sizeof(int64_t) * (kcnt + 1)
+			+ sizeof(struct gref_gid_pos_s) * ecnt);
+		if(n == NULL) { return(-1); }
+		memset(n->filter, 0, sizeof(uint64_t) * (GREF_DELTA_FILTER_BITS / 64));
+		n->kmer = (uint64_t *)(n + 1);
+		n->base = (int64_t *)(n->kmer + kcnt);
+		n->gid_pos = (struct gref_gid_pos_s *)(n->base + kcnt + 1);
+	}
+	n->kmer_cnt = kcnt;
+	n->base[kcnt] = ecnt;
+
+	lmm_free(gref->lmm, gref->delta);
+	gref->delta = n;
+	return(0);
+}
+
+/**
+ * @fn gref_apply_staged
+ * @brief add the staged segments and links to the archive. if build_delta is
+ * set, the kmers on the new sections and those changed around the new links
+ * are stored in the delta.
+ */
+static
+int gref_apply_staged(
+	struct gref_s *gref,
+	int64_t build_delta)
+{
+	if(gref->stage_cnt == 0) { return(0); }
+
+	uint32_t const sec_cnt = gref->sec_cnt;
+	uint32_t const stage_sec_cnt = gref->stage_sec_cnt;
+	uint32_t *span = NULL;
+
+	/* kmers around the new links, before the update */
+	struct gref_enum_shard_s prev = {
+		.gref = gref,
+		.lmm = gref->lmm,
+		.mode = GREF_ENUM_COLLECT
+	};
+	struct gref_enum_shard_s curr = prev;
+	lmm_kv_init(gref->lmm, prev.v);
+	lmm_kv_init(gref->lmm, curr.v);
+	if(build_delta) {
+		if((span = gref_delta_span(gref)) == NULL) {
+			goto _gref_apply_staged_error_handler;
+		}
+		gref_delta_collect(gref, &prev, span, 2 * sec_cnt);
+	}
+
+	/* back to the pool layout (link pairs, fw sequence at offsets) */
+	if(gref_detach_mapped(gref) != 0
+	|| gref_expand_link_table(gref) != 0
+	|| gref_flush_modified_seq(gref) != 0) {
+		goto _gref_apply_staged_error_handler;
+	}
+
+	/* append the staged sequence */
+	struct gref_section_intl_s *sec =
+		(struct gref_section_intl_s *)hmap_get_object(gref->hmap, 0);
+	if(gref->params.copy_mode == GREF_COPY) {
+		lmm_kv_pushm(gref->lmm, gref->seq, lmm_kv_ptr(gref->stage_seq), lmm_kv_size(gref->stage_seq));
+		if(lmm_kv_ptr(gref->seq) == NULL) {
+			goto _gref_apply_staged_error_handler;
+		}
+		for(int64_t i = sec_cnt; i < stage_sec_cnt; i++) {
+			sec[i].fw_sec.base += gref->seq_len;
+		}
+	}
+	gref->seq_len += gref->stage_seq_len;
+	gref->sec_cnt = stage_sec_cnt;
+	lmm_kv_pushm(gref->lmm, gref->link, lmm_kv_ptr(gref->stage_link), lmm_kv_size(gref->stage_link));
+	if(lmm_kv_ptr(gref->link) == NULL) {
+		goto _gref_apply_staged_error_handler;
+	}
+
+	/* rebuild, same as gref_freeze_pool */
+	gref_add_tail_section(gref);
+	if(gref_modify_seq(gref) != 0
+	|| gref_build_link_idx_table(gref) != 0
+	|| gref_shrink_link_table(gref) != 0) {
+		goto _gref_apply_staged_error_handler;
+	}
+
+	/* clear stage */
+	lmm_kv_clear(gref->lmm, gref->stage_seq);
+	lmm_kv_clear(gref->lmm, gref->stage_link);
+	gref->stage_cnt = 0;
+	gref->stage_seq_len = 0;
+
+	if(build_delta) {
+		/* the same sections after the update, then all the new sections */
+		gref_delta_collect(gref, &curr, span, 2 * sec_cnt);
+		curr.base_gid = _encode_id(sec_cnt, 0);
+		curr.tail_gid = _encode_id(stage_sec_cnt, 0);
+		curr.head_pos = 0;
+		gref_enum_shard_worker((void *)&curr);
+		if(prev.error || curr.error || lmm_kv_ptr(prev.v) == NULL || lmm_kv_ptr(curr.v) == NULL) {
+			goto _gref_apply_staged_error_handler;
+		}
+
+		int64_t prev_cnt = lmm_kv_size(prev.v), curr_cnt = lmm_kv_size(curr.v);
+		if(psort_half(lmm_kv_ptr(prev.v), prev_cnt, sizeof(struct gref_kmer_tuple_s), gref->params.num_threads) != 0
+		|| psort_half(lmm_kv_ptr(curr.v), curr_cnt, sizeof(struct gref_kmer_tuple_s), gref->params.num_threads) != 0) {
+			goto _gref_apply_staged_error_handler;
+		}
+		gref_order_kmer_tuples(lmm_kv_ptr(prev.v), prev_cnt);
+		gref_order_kmer_tuples(lmm_kv_ptr(curr.v), curr_cnt);
+		gref_delta_diff(lmm_kv_ptr(prev.v), &prev_cnt, lmm_kv_ptr(curr.v), &curr_cnt);
+		if(gref_delta_build(gref, lmm_kv_ptr(curr.v), curr_cnt, lmm_kv_ptr(prev.v), prev_cnt) != 0) {
+			goto _gref_apply_staged_error_handler;
+		}
+	}
+	lmm_free(gref->lmm, span);
+	lmm_kv_destroy(gref->lmm, prev.v);
+	lmm_kv_destroy(gref->lmm, curr.v);
+	return(0);
+
+_gref_apply_staged_error_handler:;
+	lmm_free(gref->lmm, span);
+	lmm_kv_destroy(gref->lmm, prev.v);
+	lmm_kv_destroy(gref->lmm, curr.v);
+	return(-1);
+}
+
+/**
+ * @fn gref_update_index
+ */
+int gref_update_index(
+	gref_idx_t *idx)
+{
+	struct gref_s *gref = (struct gref_s *)idx;
+	if(gref == NULL || gref->type != GREF_IDX) { return(-1); }
+
+	/* the delta is diffed against the buckets, which do not hold the capped occurrences */
+	if(gref->params.max_occ != 0 || gref->params.mask_top_ppm != 0) { return(-1); }
+
+	/* the delta buckets are in the plain format */
+	if(gref->entry_size != 0) { return(-1); }
+	return(gref_apply_staged(gref, 1));
+}
+
+/**
+ * @fn gref_merge_delta_hash
+ * @brief gref_merge_delta for the hash index; the buckets are collected from the
+ * slots and sorted, merged with the delta in the kmer order, and a new hash table
+ * is built from the merged runs.
+ */
+static
+int gref_merge_delta_hash(
+	struct gref_s *gref,
+	int64_t kmer_cnt)
+{
+	struct gref_delta_s const *d = gref->delta;
+	int64_t const slot_cnt = gref->kmer_hash_group_cnt * GREF_KMER_HASH_GROUP_SIZE;
+
+	int64_t prev_cnt = 0;
+	for(int64_t i = 0; i < slot_cnt; i++) { prev_cnt += (gref->kmer_hash_tag[i] != 0); }
+	struct gref_kmer_run_s *prev = (struct gref_kmer_run_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_kmer_run_s) * MAX2(1, prev_cnt));
+	struct gref_kmer_run_s *run = (struct gref_kmer_run_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_kmer_run_s) * (prev_cnt + d->kmer_cnt + 1));
+	struct gref_gid_pos_s *kmer_table = (struct gref_gid_pos_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_gid_pos_s) * MAX2(1, kmer_cnt));
+	if(prev == NULL || run == NULL || kmer_table == NULL) { goto _gref_merge_delta_hash_error_handler; }
+
+	for(int64_t i = 0, j = 0; i < slot_cnt; i++) {
+		if(gref->kmer_hash_tag[i] == 0) { continue; }
+		prev[j++] = (struct gref_kmer_run_s){ .kmer = gref->kmer_hash_slot[i].kmer, .base = 0 };
+	}
+	if(psort_half(prev, prev_cnt, sizeof(struct gref_kmer_run_s), gref->params.num_threads) != 0) {
+		goto _gref_merge_delta_hash_error_handler;
+	}
+
+	/* copy buckets in the kmer order */
+	int64_t i = 0, j = 0, run_cnt = 0, ofs = 0;
+	while(i < prev_cnt || j < d->kmer_cnt) {
+		uint64_t const kmer = (j == d->kmer_cnt || (i < prev_cnt && prev[i].kmer < d->kmer[j]))
+			? prev[i].kmer : d->kmer[j];
+
+		struct gref_gid_pos_s const *src = NULL;
+		int64_t len = 0;
+		if(j < d->kmer_cnt && d->kmer[j] == kmer) {
+			src = &d->gid_pos[d->base[j]];
+			len = d->base[j + 1] - d->base[j];
+			j++;
+		} else {
+			struct gref_bucket_s b = gref_get_hash_bucket(gref, kmer);
+			src = &gref->kmer_table[b.base];
+			len = b.tail - b.base;
+		}
+		i += (i < prev_cnt && prev[i].kmer == kmer);
+
+		/* drop the emptied buckets */
+		if(len == 0) { continue; }
+		run[run_cnt++] = (struct gref_kmer_run_s){ .kmer = kmer, .base = ofs };
+		memcpy(&kmer_table[ofs], src, sizeof(struct gref_gid_pos_s) * len);
+		ofs += len;
+	}
+	run[run_cnt] = (struct gref_kmer_run_s){ .kmer = UINT64_MAX, .base = ofs };
+	lmm_free(gref->lmm, prev);
+
+	/* build the hash table aside; the current tables are freed only if it succeeded */
+	struct gref_kmer_tables_s t = {
+		.kmer_run = run,
+		.kmer_run_cnt = run_cnt,
+		.kmer_table_size = kmer_cnt,
+		.kmer_table = kmer_table
+	};
+	gref_swap_kmer_tables(gref, &t);
+	if(gref_commit_kmer_tables(gref, &t, gref_build_kmer_hash_table(gref)) != 0) {
+		return(-1);
+	}
+	lmm_free(gref->lmm, gref->delta); gref->delta = NULL;
+	gref_place_kmer_tables(gref);
+	return(0);
+
+_gref_merge_delta_hash_error_handler:;
+	lmm_free(gref->lmm, prev);
+	lmm_free(gref->lmm, run);
+	lmm_free(gref->lmm, kmer_table);
+	return(-1);
+}
+
+/**
+ * @fn gref_merge_delta
+ * @brief rebuild the kmer table and its index with the delta buckets. the new
+ * tables are built aside and swapped at the end.
+ */
+int gref_merge_delta(
+	gref_idx_t *idx)
+{
+	struct gref_s *gref = (struct gref_s *)idx;
+	if(gref == NULL || gref->type != GREF_IDX) { return(-1); }
+
+	struct gref_delta_s const *d = gref->delta;
+	if(d == NULL) { return(0); }
+
+	/* count */
+	int64_t kmer_cnt = gref->kmer_table_size;
+	for(int64_t i = 0; i < d->kmer_cnt; i++) {
+		struct gref_bucket_s b = gref_get_bucket(gref, d->kmer[i]);
+		kmer_cnt += (d->base[i + 1] - d->base[i]) - (b.tail - b.base);
+	}
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH) {
+		return(gref_merge_delta_hash(gref, kmer_cnt));
+	}
+
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(gref);
+	int64_t *kmer_idx_table = (int64_t *)lmm_malloc(gref->lmm,
+		sizeof(int64_t) * (kmer_idx_size + 1));
+	struct gref_gid_pos_s *kmer_table = (struct gref_gid_pos_s *)lmm_malloc(gref->lmm,
+		sizeof(struct gref_gid_pos_s) * MAX2(1, kmer_cnt));
+	if(kmer_idx_table == NULL || kmer_table == NULL) {
+		lmm_free(gref->lmm, kmer_idx_table);
+		lmm_free(gref->lmm, kmer_table);
+		return(-1);
+	}
+
+	/* copy buckets in the kmer order */
+	int64_t j = 0, ofs = 0;
+	for(uint64_t kmer = 0; kmer < kmer_idx_size; kmer++) {
+		kmer_idx_table[kmer] = ofs;
+
+		struct gref_gid_pos_s const *src = NULL;
+		int64_t len = 0;
+		if(j < d->kmer_cnt && d->kmer[j] == kmer) {
+			src = &d->gid_pos[d->base[j]];
+			len = d->base[j + 1] - d->base[j];
+			j++;
+		} else {
+			struct gref_bucket_s b = gref_get_bucket(gref, kmer);
+			src = &gref->kmer_table[b.base];
+			len = b.tail - b.base;
+		}
+		memcpy(&kmer_table[ofs], src, sizeof(struct gref_gid_pos_s) * len);
+		ofs += len;
+	}
+	kmer_idx_table[kmer_idx_size] = ofs;
+
+	/* build the index aside; the current tables are freed only if it succeeded */
+	struct gref_kmer_tables_s t = {
+		.kmer_idx_table = kmer_idx_table,
+		.kmer_table_size = kmer_cnt,
+		.kmer_table = kmer_table
+	};
+	gref_swap_kmer_tables(gref, &t);
+	int ret = 0;
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_INLINE) {
+		ret = gref_build_kmer_slot_table(gref);
+	} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_COMPACT) {
+		if((ret = gref_build_kmer_sb_table(gref, kmer_idx_table, NULL, 0)) == 0) {
+			lmm_free(gref->lmm, gref->kmer_idx_table); gref->kmer_idx_table = NULL;
+		}
+	}
+	if(gref_commit_kmer_tables(gref, &t, ret) != 0) { return(-1); }
+	lmm_free(gref->lmm, gref->delta); gref->delta = NULL;
+	gref_place_kmer_tables(gref);
+	return(0);
+}
+
+/**
+ * @fn gref_disable_index
+ */
+gref_acv_t *gref_disable_index(
+	gref_idx_t *idx)
+{
+	struct gref_s *gref = (struct gref_s *)idx;
+
+	if(gref == NULL || gref->type != GREF_IDX) {
+		gref_clean((gref_t *)gref);
+		return(NULL);
+	}
+
+	/* staged updates are kept in the archive; the delta is dropped with the index */
+	if(gref_apply_staged(gref, 0) != 0) {
+		gref_clean((gref_t *)gref);
+		return(NULL);
+	}
+	lmm_free(gref->lmm, gref->delta); gref->delta = NULL;
+	lmm_free(gref->lmm, gref->occ_mask); gref->occ_mask = NULL;
+
+	/* cleanup kmer_idx_table */
+	gref_clean_kmer_idx_table(gref);
+
+	/* change state */
+	gref->type = GREF_ACV;
+	return((gref_acv_t *)gref);
+}
+
+/**
+ * @fn gref_lookup
+ * @brief bucket of the kmer, the delta is searched first
+ */
+static _force_inline
+struct gref_match_res_s gref_lookup(
+	struct gref_s const *gref,
+	uint64_t kmer,
+	uint32_t rv)
+{
+	int64_t i = gref_delta_find(gref, kmer);
+	if(i >= 0) {
+		struct gref_delta_s const *d = gref->delta;
+		return((struct gref_match_res_s){
+			.gid_pos_arr = &d->gid_pos[d->base[i]],
+			.len = d->base[i + 1] - d->base[i],
+			.rv = rv
+		});
+	}
+
+	struct gref_bucket_s b = gref_get_bucket(gref, kmer);
+	debug("kmer(%llx), mask(%llx), base(%lld), tail(%lld)",
+		kmer, gref->mask, b.base, b.tail);
+	if(gref->kmer_slot_table != NULL && b.tail - b.base == 1) {
+		return((struct gref_match_res_s){
+			.gid_pos_arr = &gref->kmer_slot_table[kmer].inl,
+			.len = 1,
+			.rv = rv,
+			.masked = (gref_occ_mask_find(gref, kmer) >= 0)
+		});
+	}
+	uint64_t const entry_size = (gref->entry_size == 0) ? sizeof(struct gref_gid_pos_s) : gref->entry_size;
+	return((struct gref_match_res_s){
+		.gid_pos_arr = (uint8_t const *)gref->kmer_table + b.base * entry_size,
+		.len = b.tail - b.base,
+		.rv = rv,
+		.masked = (gref_occ_mask_find(gref, kmer) >= 0)
+	});
+}
+
+/**
+ * @fn gref_match_2bitpacked
+ */
+struct gref_match_res_s gref_match_2bitpacked(
+	gref_idx_t const *_gref,
+	uint64_t seq)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	uint32_t rv = 0;
+	seq &= gref->mask;
+	if(gref->params.kmer_strand == GREF_KMER_CANONICAL) {
+		seq = gref_canonical_kmer(gref, seq, &rv);
+	}
+	return(gref_lookup(gref, seq, rv));
+}
+
+/**
+ * @fn gref_match_get
+ */
+struct gref_gid_pos_s gref_match_get(
+	gref_idx_t const *_gref,
+	struct gref_match_res_s const *res,
+	int64_t i)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return(gref_decode_entry(gref, res->gid_pos_arr, i));
+}
+
+/**
+ * @fn gref_match_decode
+ */
+int64_t gref_match_decode(
+	gref_idx_t const *_gref,
+	struct gref_match_res_s const *res,
+	struct gref_gid_pos_s *dst)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref->entry_size == 0) {
+		memcpy(dst, res->gid_pos_arr, sizeof(struct gref_gid_pos_s) * res->len);
+		return(res->len);
+	}
+	for(int64_t i = 0; i < res->len; i++) {
+		dst[i] = gref_decode_entry(gref, res->gid_pos_arr, i);
+	}
+	return(res->len);
+}
+
+/**
+ * @fn gref_match_count_2bitpacked
+ * @brief the original count is returned for the capped kmers
+ */
+int64_t gref_match_count_2bitpacked(
+	gref_idx_t const *_gref,
+	uint64_t seq)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	uint32_t rv = 0;
+	seq &= gref->mask;
+	if(gref->params.kmer_strand == GREF_KMER_CANONICAL) {
+		seq = gref_canonical_kmer(gref, seq, &rv);
+	}
+
+	int64_t i = gref_occ_mask_find(gref, seq);
+	if(i >= 0) { return(gref->occ_mask->arr[i].occ); }
+	return(gref_lookup(gref, seq, rv).len);
+}
+
+/**
+ * @fn gref_match_count
+ * @brief seq length must be equal to k.
+ */
+int64_t gref_match_count(
+	gref_idx_t const *_gref,
+	uint8_t const *seq)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return(gref_match_count_2bitpacked((gref_t const *)gref, gref->pack_kmer(seq, gref->params.k)));
+}
+
+/**
+ * @fn gref_prefetch_bucket
+ */
+static _force_inline
+void gref_prefetch_bucket(
+	struct gref_s const *gref,
+	uint64_t kmer)
+{
+	if(gref->params.kmer_idx_type == GREF_KMER_IDX_DENSE) {
+		_prefetch(&gref->kmer_idx_table[kmer]);
+	} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_INLINE) {
+		_prefetch(&gref->kmer_slot_table[kmer]);
+	} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH) {
+		uint64_t const g = gref_hash64(kmer) & (gref->kmer_hash_group_cnt - 1);
+		_prefetch(&gref->kmer_hash_tag[g * GREF_KMER_HASH_GROUP_SIZE]);
+		_prefetch(&gref->kmer_hash_slot[g * GREF_KMER_HASH_GROUP_SIZE]);
+	} else {
+		_prefetch(&gref->kmer_sb_table[kmer>>GREF_KMER_SB_SHIFT]);
+		_prefetch(&gref->kmer_rel_table[kmer]);
+	}
+	return;
+}
+
+/**
+ * @fn gref_match_batch
+ * @brief cnt lookups of 2bit-packed kmers. processed in windows of
+ * GREF_MATCH_BATCH_SIZE; the bucket table lines of a window are prefetched
+ * first, then the heads of the buckets in kmer_table.
+ */
+int64_t gref_match_batch(
+	gref_idx_t const *_gref,
+	uint64_t const *seq,
+	int64_t cnt,
+	struct gref_match_res_s *res)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref == NULL || gref->type != GREF_IDX) { return(-1); }
+
+	int64_t const canonical = (gref->params.kmer_strand == GREF_KMER_CANONICAL);
+	for(int64_t i = 0; i < cnt; i += GREF_MATCH_BATCH_SIZE) {
+		int64_t const len = MIN2(cnt - i, GREF_MATCH_BATCH_SIZE);
+		uint64_t kmer[GREF_MATCH_BATCH_SIZE];
+		uint32_t rv[GREF_MATCH_BATCH_SIZE] = { 0 };
+
+		/* bucket table */
+		for(int64_t j = 0; j < len; j++) {
+			kmer[j] = seq[i + j] & gref->mask;
+			if(canonical) { kmer[j] = gref_canonical_kmer(gref, kmer[j], &rv[j]); }
+			gref_prefetch_bucket(gref, kmer[j]);
+		}
+
+		/* kmer table */
+		for(int64_t j = 0; j < len; j++) {
+			res[i + j] = gref_lookup(gref, kmer[j], rv[j]);
+			_prefetch(res[i + j].gid_pos_arr);
+		}
+	}
+	return(cnt);
+}
+
+/**
+ * @fn gref_match
+ * @brief seq length must be equal to k.
+ */
+struct gref_match_res_s gref_match(
+	gref_idx_t const *_gref,
+	uint8_t const *seq)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return(gref_match_2bitpacked((gref_t const *)gref, gref->pack_kmer(seq, gref->params.k)));
+}
+
+/**
+ * @fn gref_match_lower_bound
+ * @brief first entry at or after key ((gid<<32) | pos) in [lo, len) of a bucket.
+ * gallops from lo, then narrows down with binary search, so that consecutive
+ * searches with increasing keys cost O(log distance).
+ */
+static _force_inline
+int64_t gref_match_lower_bound(
+	struct gref_s const *gref,
+	void const *arr,
+	int64_t lo,
+	int64_t len,
+	uint64_t key)
+{
+	#define _key(_i)	({ \
+		struct gref_gid_pos_s const _e = gref_decode_entry(gref, arr, (_i)); \
+		((uint64_t)_e.gid<<32) | _e.pos; \
+	})
+
+	int64_t hi = lo, step = 1;
+	while(hi < len && _key(hi) < key) {
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
+	}
+	hi = MIN2(hi, len);
+	while(lo < hi) {
+		int64_t const mid = (lo + hi) / 2;
+		if(_key(mid) < key) { lo = mid + 1; } else { hi = mid; }
+	}
+	return(lo);
+
+	#undef _key
+}
+
+/**
+ * @fn gref_match_in_range
+ * @brief entries of the kmer on gid in [pos_lo, pos_hi), taken out of the
+ * bucket (sorted in the (gid, pos) order) with binary search.
+ */
+struct gref_match_res_s gref_match_in_range(
+	gref_idx_t const *_gref,
+	uint64_t kmer,
+	uint32_t gid,
+	uint32_t pos_lo,
+	uint32_t pos_hi)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	struct gref_match_res_s r = gref_match_2bitpacked(_gref, kmer);
+	if(pos_lo >= pos_hi) {
+		r.len = 0;
+		return(r);
+	}
+
+	uint64_t const entry_size = (gref->entry_size == 0) ? sizeof(struct gref_gid_pos_s) : gref->entry_size;
+	int64_t const lo = gref_match_lower_bound(gref, r.gid_pos_arr, 0, r.len, ((uint64_t)gid<<32) | pos_lo);
+	int64_t const hi = gref_match_lower_bound(gref, r.gid_pos_arr, lo, r.len, ((uint64_t)gid<<32) | pos_hi);
+	r.gid_pos_arr = (uint8_t const *)r.gid_pos_arr + lo * entry_size;
+	r.len = hi - lo;
+	return(r);
+}
+
+/**
+ * @fn gref_match_intersect
+ * @brief entries e of res[0] such that (e.gid, e.pos + dist[i]) is in res[i] for
+ * all i in [1, cnt). res[0] is filtered against res[1], res[2], ... in turn;
+ * each pass is a merge with galloping over res[i]. dst must have room for
+ * res[0].len entries. returns the number of entries stored.
+ */
+int64_t gref_match_intersect(
+	gref_idx_t const *_gref,
+	struct gref_match_res_s const *res,
+	int64_t const *dist,
+	int64_t cnt,
+	struct gref_gid_pos_s *dst)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref == NULL || gref->type != GREF_IDX || cnt <= 0) { return(-1); }
+
+	int64_t n = gref_match_decode(_gref, &res[0], dst);
+	for(int64_t i = 1; i < cnt && n > 0; i++) {
+		int64_t cur = 0, m = 0;
+		for(int64_t j = 0; j < n; j++) {
+			int64_t const pos = (int64_t)dst[j].pos + dist[i];
+			if(pos < 0 || pos > UINT32_MAX) { continue; }
+
+			uint64_t const key = ((uint64_t)dst[j].gid<<32) | (uint64_t)pos;
+			cur = gref_match_lower_bound(gref, res[i].gid_pos_arr, cur, res[i].len, key);
+			if(cur >= res[i].len) { break; }
+
+			struct gref_gid_pos_s const e = gref_decode_entry(gref, res[i].gid_pos_arr, cur);
+			if((((uint64_t)e.gid<<32) | e.pos) == key) { dst[m++] = dst[j]; }
+		}
+		n = m;
+	}
+	return(n);
+}
+
+/* seed extension */
+#define GREF_EXTEND_MAX_SECTIONS	( 4096 )	/* sections visited per direction */
+
+/**
+ * @struct gref_extend_frame_s
+ * @brief a section on the path being extended
+ */
+struct gref_extend_frame_s {
+	uint32_t gid;
+	uint32_t link_idx;			/* next link to visit */
+	int64_t qofs;				/* query offset at the head of the section (or at ofs) */
+	int64_t qend;				/* query offset after the matched run */
+};
+
+/**
+ * @fn gref_extend_comp_4bit
+ * @brief complement of the 4bit codes in the bytes of a word (bit reversal of the low nibble)
+ */
+static _force_inline
+uint64_t gref_extend_comp_4bit(
+	uint64_t x)
+{
+	uint64_t const m1 = 0x0101010101010101ULL;
+	return(((x & m1)<<3) | ((x & (m1<<1))<<1) | ((x>>1) & (m1<<1)) | ((x>>3) & m1));
+}
+
+/**
+ * @fn gref_extend_run
+ * @brief number of bases matching q on the section from ofs, at most len. a
+ * graph base matches if it contains the query base (alternate alleles and
+ * IUPAC codes); N (0x00 and 0x0f) never matches. the byte sequence is compared
+ * eight bases at a time, 2bit storage base by base.
+ */
+static _force_inline
+int64_t gref_extend_run(
+	struct gref_s const *gref,
+	struct gref_section_s const *sec,
+	int64_t ofs,
+	uint8_t const *q,
+	int64_t len)
+{
+	static uint8_t const comp[16] = {
+		0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+		0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+	};
+
+	/* the same mirroring as gref_iter_init_seq, on integer offsets in the 2bit storage */
+	uint8_t const *lim = gref->seq_lim, *base = sec->base;
+	int64_t const incr = (base < lim) ? 1 : -1;
+	if(gref->seq_2bit != NULL) {
+		uint64_t const b = (uint64_t)base, l = (uint64_t)lim;
+		uint64_t const pos = ((base < lim) ? b : (2 * l - b - 1)) + ofs * incr;
+		int64_t i = 0;
+		for(; i < len; i++) {
+			uint8_t g = gref_decode_base_2bit(gref, pos + i * incr);
+			g = (incr > 0) ? g : comp[g];
+			if((g & q[i]) == 0 || g == 0x0f) { break; }
+		}
+		return(i);
+	}
+	uint8_t const *p = ((base < lim) ? base : (lim + (lim - base - 1))) + ofs * incr;
+
+	int64_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	{
+		uint64_t const lo = 0x0101010101010101ULL, hi = 0x8080808080808080ULL, n = 0x0f0f0f0f0f0f0f0fULL;
+		for(; i + 8 <= len; i += 8) {
+			uint64_t g, x;
+			if(incr > 0) {
+				memcpy(&g, p + i, sizeof(uint64_t));
+			} else {
+				memcpy(&g, p - i - 7, sizeof(uint64_t));
+				g = gref_extend_comp_4bit(__builtin_bswap64(g));
+			}
+			memcpy(&x, q + i, sizeof(uint64_t));
+
+			/* the lowest flag of the zero-byte test is exact */
+			uint64_t const t = g & x, u = g ^ n;
+			uint64_t const z = ((t - lo) & ~t & hi) | ((u - lo) & ~u & hi);
+			if(z != 0) { return(i + (__builtin_ctzll(z)>>3)); }
+		}
+	}
+#endif
+	for(; i < len; i++) {
+		uint8_t g = p[i * incr];
+		g = (incr > 0) ? g : comp[g];
+		if((g & q[i]) == 0 || g == 0x0f) { break; }
+	}
+	return(i);
+}
+
+/**
+ * @fn gref_extend_dfs
+ * @brief longest match of q[0, qlen) from (gid, ofs) along the links, depth
+ * first with the stack in frame (cap entries). the gids of the best path are
+ * copied to path; returns the matched length, the path length in *path_len,
+ * and the offset after the last matched base in the last section in *tail_ofs.
+ */
+static _force_inline
+int64_t gref_extend_dfs(
+	struct gref_s const *gref,
+	struct gref_section_half_s const *hsec,
+	uint32_t gid,
+	int64_t ofs,
+	uint8_t const *q,
+	int64_t qlen,
+	struct gref_extend_frame_s *frame,
+	uint32_t *path,
+	int64_t cap,
+	int64_t *path_len,
+	int64_t *tail_ofs)
+{
+	int64_t best = -1, budget = GREF_EXTEND_MAX_SECTIONS;
+	int64_t depth = 0;
+
+	frame[0] = (struct gref_extend_frame_s){ .gid = gid, .qofs = 0 };
+	frame[0].qend = gref_extend_run(gref, &hsec[gid].sec, ofs,
+		q, MIN2(qlen, (int64_t)hsec[gid].sec.len - ofs));
+	frame[0].link_idx = hsec[gid].link_idx_base;
+
+	while(depth >= 0) {
+		struct gref_extend_frame_s *f = &frame[depth];
+		int64_t const head = (depth == 0) ? ofs : 0;
+		int64_t const full = (head + f->qend - f->qofs == hsec[f->gid].sec.len) && f->qend < qlen;
+		uint32_t const tail = hsec[f->gid + 1].link_idx_base;
+
+		/* go down to the next section */
+		if(full && f->link_idx < tail && depth + 1 < cap && budget > 0) {
+			uint32_t const next = gref->link_table[f->link_idx++];
+			struct gref_extend_frame_s *g = &frame[++depth];
+			*g = (struct gref_extend_frame_s){
+				.gid = next,
+				.link_idx = hsec[next].link_idx_base,
+				.qofs = f->qend
+			};
+			g->qend = g->qofs + gref_extend_run(gref, &hsec[next].sec, 0,
+				&q[g->qofs], MIN2(qlen - g->qofs, (int64_t)hsec[next].sec.len));
+			budget--;
+			continue;
+		}
+
+		/* leaf (no more links visited from here); sections without a matched base are not on the path */
+		if(f->link_idx == hsec[f->gid].link_idx_base || full == 0) {
+			if(f->qend > best) {
+				int64_t const d = (depth > 0 && f->qend == f->qofs) ? depth - 1 : depth;
+				best = f->qend;
+				for(int64_t i = 0; i <= d; i++) { path[i] = frame[i].gid; }
+				*path_len = d + 1;
+				*tail_ofs = (d == 0 ? ofs : 0) + frame[d].qend - frame[d].qofs;
+			}
+		}
+		depth--;
+	}
+	return(best);
+}
+
+/**
+ * @fn gref_match_extend
+ * @brief extend a seed (the kmer at qpos on the query, hit at (gid, pos)) to
+ * both sides along the graph. leftward is the extension of the reverse
+ * complement of the query head on the reverse section from len - pos. the
+ * longest path is taken at each branch (the first one in the link order for
+ * ties). returns 0 on success, -1 if the seed does not match or on error.
+ */
+int gref_match_extend(
+	gref_idx_t const *_gref,
+	uint8_t const *query,
+	int64_t qlen,
+	int64_t qpos,
+	struct gref_gid_pos_s hit,
+	struct gref_mem_s *mem,
+	uint32_t *path,
+	int64_t path_cap)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref == NULL || gref->type != GREF_IDX || mem == NULL || path == NULL || path_cap <= 0) { return(-1); }
+
+	int64_t const k = gref->params.k;
+	struct gref_section_half_s const *hsec = (struct gref_section_half_s const *)hmap_get_object(gref->hmap, 0);
+	if(qpos < 0 || qpos + k > qlen || hit.gid >= 2 * gref->sec_cnt
+	|| hit.pos >= hsec[hit.gid].sec.len) {				/* the seed may span sections */
+		return(-1);
+	}
+
+	/* 4bit query, forward from qpos and reverse complement up to qpos */
+	static uint8_t const comp[16] = {
+		0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+		0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+	};
+	uint8_t *q = (uint8_t *)lmm_malloc(gref->lmm, qlen + 16
+		+ sizeof(struct gref_extend_frame_s) * path_cap + sizeof(uint32_t) * path_cap);
+	if(q == NULL) { return(-1); }
+	uint8_t *rq = q + (qlen - qpos);
+	struct gref_extend_frame_s *frame = (struct gref_extend_frame_s *)_roundup((uintptr_t)(q + qlen), 16);
+	uint32_t *lpath = (uint32_t *)(frame + path_cap);
+	for(int64_t i = qpos; i < qlen; i++) { q[i - qpos] = gref_encode_4bit(query[i]); }
+	for(int64_t i = 0; i < qpos; i++) { rq[i] = comp[gref_encode_4bit(query[qpos - 1 - i])]; }
+
+	/* rightward, the seed included */
+	int64_t rlen = 0, rofs = 0, llen = 0, lofs = 0;
+	int64_t const r = gref_extend_dfs(gref, hsec, hit.gid, hit.pos, q, qlen - qpos,
+		frame, path, path_cap, &rlen, &rofs);
+	if(r < k) {
+		lmm_free(gref->lmm, q);
+		return(-1);
+	}
+
+	/* leftward on the reverse sections; its first section is the head of the right path */
+	uint32_t const rgid = hit.gid ^ 0x01;
+	int64_t const l = gref_extend_dfs(gref, hsec, rgid, hsec[rgid].sec.len - hit.pos, rq, qpos,
+		frame, lpath, path_cap - rlen + 1, &llen, &lofs);
+
+	/* concatenate */
+	memmove(&path[llen - 1], path, sizeof(uint32_t) * rlen);
+	for(int64_t i = 1; i < llen; i++) { path[llen - 1 - i] = lpath[i] ^ 0x01; }
+
+	uint32_t const lgid = lpath[llen - 1], tgid = path[llen + rlen - 2];
+	*mem = (struct gref_mem_s){
+		.qpos = qpos - l,
+		.len = l + r,
+		.head = { .gid = lgid ^ 0x01, .pos = hsec[lgid].sec.len - lofs },
+		.tail = { .gid = tgid, .pos = rofs - 1 },
+		.path_len = llen + rlen - 1
+	};
+	lmm_free(gref->lmm, q);
+	return(0);
+}
+
+/* streaming matcher */
+/**
+ * @struct gref_match_stream_s
+ * @brief aliased to gref_match_stream_t
+ */
+struct gref_match_stream_s {
+	lmm_t *lmm;
+	struct gref_s const *gref;
+
+	/* query */
+	uint8_t const *seq;
+	int64_t len;
+	int64_t pos;					/* next base to be fed */
+	int64_t valid_len;				/* #valid bases since the last restart */
+
+	/* rolling kmers */
+	uint64_t fw_kmer, rv_kmer;
+	uint32_t step_size;
+	uint8_t seq_direction;
+	uint8_t seq_format;
+	uint8_t shift_len;
+	uint8_t minimizer_window;
+
+	/* minimizer windows (fw, rv) */
+	int64_t mm_last[2];
+	uint64_t mm_hash[2][GREF_ITER_MM_MAX_WINDOW];
+	uint64_t mm_kmer[2][GREF_ITER_MM_MAX_WINDOW];
+
+	/* result buffer */
+	int64_t buf_head, buf_cnt;
+	uint64_t kmer[2 * GREF_MATCH_BATCH_SIZE];
+	struct gref_match_stream_res_s res[2 * GREF_MATCH_BATCH_SIZE];
+	struct gref_match_res_s match[2 * GREF_MATCH_BATCH_SIZE];
+};
+
+/**
+ * @fn gref_match_stream_init
+ */
+gref_match_stream_t *gref_match_stream_init(
+	gref_idx_t const *idx,
+	uint8_t const *seq,
+	int64_t len,
+	gref_match_stream_params_t const *params)
+{
+	struct gref_s const *gref = (struct gref_s const *)idx;
+	if(gref == NULL || gref->type != GREF_IDX || (seq == NULL && len > 0)) { return(NULL); }
+
+	struct gref_match_stream_params_s const default_params = { 0 };
+	struct gref_match_stream_params_s p = (params == NULL) ? default_params : *params;
+
+	/* restore defaults */
+	#define restore(param, def)		{ (param) = ((uint64_t)(param) == 0) ? (def) : (param); }
+	restore(p.step_size, 1);
+	restore(p.seq_direction, GREF_FW_ONLY);
+	restore(p.seq_format, GREF_ASCII);
+	#undef restore
+
+	if((uint8_t)p.seq_direction > GREF_FW_RV) { return(NULL); }
+	if((uint8_t)p.seq_format > GREF_4BIT) { return(NULL); }
+	if(p.minimizer_window > GREF_ITER_MM_MAX_WINDOW) { return(NULL); }
+
+	struct gref_match_stream_s *stream = (struct gref_match_stream_s *)lmm_malloc(
+		gref->lmm, sizeof(struct gref_match_stream_s));
+	if(stream == NULL) { return(NULL); }
+
+	*stream = (struct gref_match_stream_s){
+		.lmm = gref->lmm,
+		.gref = gref,
+		.seq = seq,
+		.len = len,
+		.pos = 0,
+		.valid_len = 0,
+		.fw_kmer = 0,
+		.rv_kmer = 0,
+		.step_size = p.step_size,
+		.seq_direction = p.seq_direction,
+		.seq_format = p.seq_format,
+		.shift_len = 2 * (gref->params.k - 1),
+		.minimizer_window = MAX2(1, p.minimizer_window),
+		.mm_last = { -1, -1 },
+		.buf_head = 0,
+		.buf_cnt = 0
+	};
+	return((gref_match_stream_t *)stream);
+}
+
+/**
+ * @fn gref_match_stream_minimizer
+ * @brief push minimizers of the windows ending at qpos. ties are broken in the
+ * same way as the iterator: leftmost on the strand the kmer is read from.
+ */
+static _force_inline
+int64_t gref_match_stream_minimizer(
+	struct gref_match_stream_s *stream,
+	int64_t qpos,
+	int64_t dir_cnt,
+	int64_t cnt)
+{
+	int64_t const w = stream->minimizer_window;
+	int64_t const k = stream->gref->params.k;
+	uint64_t const mask = stream->gref->mask;
+	uint64_t const kmer[2] = { stream->fw_kmer, stream->rv_kmer };
+	int64_t pushed = 0;
+
+	for(int64_t d = 0; d < dir_cnt; d++) {
+		int64_t slot = qpos & (GREF_ITER_MM_MAX_WINDOW - 1);
+		stream->mm_hash[d][slot] = gref_hash_kmer(kmer[d], mask);
+		stream->mm_kmer[d][slot] = kmer[d];
+
+		/* window is not filled yet */
+		if(stream->valid_len - k + 1 < w) { continue; }
+
+		int64_t min_pos = qpos - w + 1;
+		for(int64_t p = qpos - w + 2; p <= qpos; p++) {
+			uint64_t h = stream->mm_hash[d][p & (GREF_ITER_MM_MAX_WINDOW - 1)];
+			uint64_t m = stream->mm_hash[d][min_pos & (GREF_ITER_MM_MAX_WINDOW - 1)];
+			if(d == 0 ? (h < m) : (h <= m)) { min_pos = p; }
+		}
+		if(min_pos == stream->mm_last[d]) { continue; }
+		stream->mm_last[d] = min_pos;
+
+		stream->kmer[cnt + pushed] = stream->mm_kmer[d][min_pos & (GREF_ITER_MM_MAX_WINDOW - 1)];
+		stream->res[cnt + pushed++] = (struct gref_match_stream_res_s){
+			.pos = min_pos,
+			.dir = (d == 0) ? GREF_FW : GREF_RV
+		};
+	}
+	return(pushed);
+}
+
+/**
+ * @fn gref_match_stream_fill
+ * @brief feed bases until the buffer gets full, then look up them in a batch
+ */
+static _force_inline
+void gref_match_stream_fill(
+	struct gref_match_stream_s *stream)
+{
+	int64_t const k = stream->gref->params.k;
+	uint64_t const mask = stream->gref->mask;
+	/* the reverse complement falls in the same bucket in the canonical index */
+	int64_t const dir_cnt = (stream->seq_direction == GREF_FW_RV
+		&& stream->gref->params.kmer_strand != GREF_KMER_CANONICAL) ? 2 : 1;
+	int64_t cnt = 0;
+
+	while(cnt + dir_cnt <= GREF_MATCH_BATCH_SIZE && stream->pos < stream->len) {
+		uint8_t c = stream->seq[stream->pos++];
+		uint8_t c4 = (stream->seq_format == GREF_ASCII) ? gref_encode_4bit(c) : c;
+
+		/* restart the window at gaps and ambiguous bases */
+		if(c4 == 0 || (c4 & (c4 - 1)) != 0) {
+			stream->valid_len = 0;
+			stream->mm_last[0] = stream->mm_last[1] = -1;
+			continue;
+		}
+		uint64_t c2 = __builtin_ctz(c4);
+
+		/* roll; the first base of the kmer is at the lsb */
+		stream->fw_kmer = (stream->fw_kmer>>2) | (c2<<stream->shift_len);
+		stream->rv_kmer = ((stream->rv_kmer<<2) | (0x03 ^ c2)) & mask;
+		if(++stream->valid_len < k) { continue; }
+
+		int64_t qpos = stream->pos - k;
+		if(stream->minimizer_window > 1) {
+			cnt += gref_match_stream_minimizer(stream, qpos, dir_cnt, cnt);
+			continue;
+		}
+		if(qpos % stream->step_size != 0) { continue; }
+
+		stream->kmer[cnt] = stream->fw_kmer;
+		stream->res[cnt++] = (struct gref_match_stream_res_s){ .pos = qpos, .dir = GREF_FW };
+		if(dir_cnt == 2) {
+			stream->kmer[cnt] = stream->rv_kmer;
+			stream->res[cnt++] = (struct gref_match_stream_res_s){ .pos = qpos, .dir = GREF_RV };
+		}
+	}
+
+	gref_match_batch((gref_idx_t const *)stream->gref, stream->kmer, cnt, stream->match);
+	for(int64_t i = 0; i < cnt; i++) {
+		stream->res[i].dir ^= stream->match[i].rv;
+		stream->res[i].res = stream->match[i];
+	}
+	stream->buf_head = 0;
+	stream->buf_cnt = cnt;
+	return;
+}
+
+/**
+ * @fn gref_match_stream_next
+ * @brief returns pos == -1 at the end of the query
+ */
+struct gref_match_stream_res_s gref_match_stream_next(
+	gref_match_stream_t *_stream)
+{
+	struct gref_match_stream_s *stream = (struct gref_match_stream_s *)_stream;
+
+	while(stream->buf_head >= stream->buf_cnt) {
+		if(stream->pos >= stream->len) {
+			return((struct gref_match_stream_res_s){
+				.pos = -1,
+				.res = { .gid_pos_arr = NULL, .len = 0 }
+			});
+		}
+		gref_match_stream_fill(stream);
+	}
+	return(stream->res[stream->buf_head++]);
+}
+
+/**
+ * @fn gref_match_stream_clean
+ */
+void gref_match_stream_clean(
+	gref_match_stream_t *_stream)
+{
+	struct gref_match_stream_s *stream = (struct gref_match_stream_s *)_stream;
+	if(stream != NULL) {
+		lmm_free(stream->lmm, stream);
+	}
+	return;
+}
+
+
+/* shared index handle */
+/**
+ * @struct gref_handle_reader_s
+ * @brief epoch observed by a reader, 0 while quiescent. padded to a cache line
+ * so that readers do not write to the same line.
+ */
+struct gref_handle_reader_s {
+	uint64_t volatile epoch;
+	uint64_t pad[7];
+};
+_static_assert(sizeof(struct gref_handle_reader_s) == 64);
+
+/**
+ * @struct gref_handle_s
+ * @brief aliased to gref_handle_t
+ */
+struct gref_handle_s {
+	struct gref_s *volatile idx;
+	uint64_t volatile epoch;		/* bumped on every publish, starts at 1 */
+	pthread_mutex_t lock;			/* serializes writers */
+	uint32_t reader_cnt;
+	uint32_t reserved;
+	struct gref_handle_reader_s *reader;
+};
+
+/**
+ * @fn gref_handle_init
+ * @brief the handle takes the ownership of idx
+ */
+gref_handle_t *gref_handle_init(
+	gref_idx_t *idx,
+	uint32_t reader_cnt)
+{
+	if(idx == NULL || idx->type != GREF_IDX || reader_cnt == 0) { return(NULL); }
+
+	struct gref_handle_s *handle = (struct gref_handle_s *)malloc(sizeof(struct gref_handle_s));
+	if(handle == NULL) { return(NULL); }
+
+	void *reader = NULL;
+	if(posix_memalign(&reader, sizeof(struct gref_handle_reader_s),
+		sizeof(struct gref_handle_reader_s) * reader_cnt) != 0) {
+		free(handle);
+		return(NULL);
+	}
+	memset(reader, 0, sizeof(struct gref_handle_reader_s) * reader_cnt);
+
+	*handle = (struct gref_handle_s){
+		.idx = idx,
+		.epoch = 1,
+		.reader_cnt = reader_cnt,
+		.reader = (struct gref_handle_reader_s *)reader
+	};
+	pthread_mutex_init(&handle->lock, NULL);
+	return((gref_handle_t *)handle);
+}
+
+/**
+ * @fn gref_handle_acquire
+ * @brief announce the current epoch in the reader slot, then load the index.
+ * the slot is written before idx is read (full barrier), so a writer scanning
+ * the slots after swapping idx either sees the slot or the reader sees the new
+ * index.
+ */
+gref_idx_t const *gref_handle_acquire(
+	gref_handle_t *_handle,
+	uint32_t reader)
+{
+	struct gref_handle_s *handle = (struct gref_handle_s *)_handle;
+	if(reader >= handle->reader_cnt) { return(NULL); }
+
+	handle->reader[reader].epoch = handle->epoch;
+	__sync_synchronize();
+	return((gref_idx_t const *)handle->idx);
+}
+
+/**
+ * @fn gref_handle_release
+ */
+void gref_handle_release(
+	gref_handle_t *_handle,
+	uint32_t reader)
+{
+	struct gref_handle_s *handle = (struct gref_handle_s *)_handle;
+	if(reader >= handle->reader_cnt) { return; }
+
+	/* reads on the index complete before the slot is cleared */
+	__sync_synchronize();
+	handle->reader[reader].epoch = 0;
+	return;
+}
+
+/**
+ * @fn gref_handle_publish
+ * @brief swap in idx, wait for the readers that may hold the old one, then
+ * clean it. readers acquiring after the swap get idx.
+ */
+int gref_handle_publish(
+	gref_handle_t *_handle,
+	gref_idx_t *idx)
+{
+	struct gref_handle_s *handle = (struct gref_handle_s *)_handle;
+	if(handle == NULL || idx == NULL || idx->type != GREF_IDX) { return(-1); }
+
+	pthread_mutex_lock(&handle->lock);
+	struct gref_s *prev = handle->idx;
+	handle->idx = idx;
+	uint64_t const epoch = __sync_fetch_and_add(&handle->epoch, 1);
+
+	/* readers announced at or before epoch may still be on prev */
+	for(int64_t i = 0; i < handle->reader_cnt; i++) {
+		uint64_t e;
+		while((e = handle->reader[i].epoch) != 0 && e <= epoch) {
+			sched_yield();
+		}
+	}
+	pthread_mutex_unlock(&handle->lock);
+
+	if(prev != idx) { gref_clean(prev); }
+	return(0);
+}
+
+/**
+ * @fn gref_handle_clean
+ * @brief no reader may be between acquire and release
+ */
+void gref_handle_clean(
+	gref_handle_t *_handle)
+{
+	struct gref_handle_s *handle = (struct gref_handle_s *)_handle;
+	if(handle != NULL) {
+		gref_clean(handle->idx);
+		pthread_mutex_destroy(&handle->lock);
+		free(handle->reader);
+		free(handle);
+	}
+	return;
+}
+
+/* dump and load */
+/**
+ * @macro GREF_INDEX_*
+ * @brief on-disk format: a header followed by blobs, each aligned to
+ * GREF_INDEX_ALIGN from the head of the file so that the whole file can be
+ * mapped and the arrays used in place. all fields are in the native byte order.
+ */
+#define GREF_INDEX_MAGIC			"GREFIDX"
+#define GREF_INDEX_VERSION			( 4 )
+#define GREF_INDEX_ALIGN			( 4096 )
+
+/**
+ * @enum gref_index_blob
+ */
+enum gref_index_blob {
+	GREF_INDEX_NAME = 0,		/* (int32_t len, char str[len]) * (sec_cnt + 1) */
+	GREF_INDEX_SECTION,			/* section objects without the hmap header */
+	GREF_INDEX_LINK,			/* link_table */
+	GREF_INDEX_SEQ,				/* head margin, fw (, rv), tail margin */
+	GREF_INDEX_KMER_IDX,		/* dense bucket table */
+	GREF_INDEX_KMER_SB,			/* compact bucket table */
+	GREF_INDEX_KMER_REL,
+	GREF_INDEX_KMER_ESC,
+	GREF_INDEX_KMER_TABLE,
+	GREF_INDEX_OCC_MASK,		/* (uint64_t kmer, int64_t occ) * mask count */
+	GREF_INDEX_KMER_HASH_TAG,	/* hash index, 16 * group count tags */
+	GREF_INDEX_KMER_HASH_SLOT,
+	GREF_INDEX_KMER_HASH_ESC,	/* (uint64_t kmer, int64_t cnt) * saturated slots */
+	GREF_INDEX_BLOB_CNT
+};
+
+/**
+ * @struct gref_index_header_s
+ */
+struct gref_index_header_s {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+
+	/* object info */
+	struct gref_params_s params;
+	int8_t type;
+	uint8_t entry_size;				/* 0 for gref_gid_pos_s */
+	uint8_t entry_pos_bits;
+	uint8_t reserved[1];
+	uint32_t sec_cnt;
+	uint64_t seq_len;
+	int64_t link_table_size;
+	int64_t kmer_table_size;
+	int64_t kmer_esc_size;
+
+	/* blob locations */
+	struct gref_index_blob_s {
+		uint64_t offset;
+		uint64_t size;
+	} blob[GREF_INDEX_BLOB_CNT];
+};
+#define GREF_INDEX_SECTION_OFFSET	( sizeof(hmap_header_t) )
+#define GREF_INDEX_SECTION_SIZE		( sizeof(struct gref_section_intl_s) - GREF_INDEX_SECTION_OFFSET )
+
+/**
+ * @fn gref_dump_write
+ * @brief write len bytes and pad to the next blob boundary if align != 0
+ */
+static _force_inline
+int gref_dump_write(
+	zf_t *fp,
+	void const *ptr,
+	uint64_t len,
+	uint64_t *offset)
+{
+	if(len > 0 && zfwrite(fp, (void *)ptr, len) != len) { return(-1); }
+	*offset += len;
+	return(0);
+}
+static _force_inline
+int gref_dump_pad(
+	zf_t *fp,
+	uint64_t *offset)
+{
+	uint8_t const zero[256] = { 0 };
+	uint64_t tail = _roundup(*offset, GREF_INDEX_ALIGN);
+	while(*offset < tail) {
+		if(gref_dump_write(fp, zero, MIN2(tail - *offset, 256), offset) != 0) { return(-1); }
+	}
+	return(0);
+}
+
+/**
+ * @fn gref_dump_seq
+ * @brief write sequence blob, sections are packed in the order of id.
+ */
+static _force_inline
+int gref_dump_seq(
+	struct gref_s const *gref,
+	zf_t *fp,
+	uint64_t *offset)
+{
+	struct gref_section_intl_s const *sec =
+		(struct gref_section_intl_s const *)hmap_get_object(gref->hmap, 0);
+	uint8_t const zero[256] = { 0 };
+
+	/* head margin */
+	if(gref_dump_write(fp, zero, gref->params.seq_head_margin, offset) != 0) { return(-1); }
+
+	/* forward, the 2bit storage is decoded into the 4bit layout */
+	uint8_t buf[256];
+	for(int64_t i = 0; i < gref->sec_cnt; i++) {
+		if(gref->seq_2bit == NULL) {
+			if(gref_dump_write(fp, sec[i].fw_sec.base, sec[i].fw_sec.len, offset) != 0) { return(-1); }
+			continue;
+		}
+		for(int64_t j = 0; j < sec[i].fw_sec.len; j += 256) {
+			int64_t len = MIN2(sec[i].fw_sec.len - j, 256);
+			gref_decode_2bit(gref, (uint64_t)sec[i].fw_sec.base + j, len, buf);
+			if(gref_dump_write(fp, buf, len, offset) != 0) { return(-1); }
+		}
+	}
+
+	/* reverse-complement of the whole forward blob */
+	if(gref->params.seq_direction == GREF_FW_RV) {
+		static uint8_t const comp[16] = {
+			0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+			0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+		};
+		uint8_t fw[256];
+		for(int64_t i = gref->sec_cnt - 1; i >= 0; i--) {
+			for(int64_t j = sec[i].fw_sec.len; j > 0; j -= 256) {
+				int64_t len = MIN2(j, 256);
+				uint8_t const *src = &sec[i].fw_sec.base[j - len];
+				if(gref->seq_2bit != NULL) {
+					gref_decode_2bit(gref, (uint64_t)sec[i].fw_sec.base + j - len, len, fw);
+					src = fw;
+				}
+				for(int64_t k = 0; k < len; k++) {
+					buf[k] = comp[src[len - 1 - k]];
+				}
+				if(gref_dump_write(fp, buf, len, offset) != 0) { return(-1); }
+			}
+		}
+	}
+
+	/* tail margin */
+	if(gref_dump_write(fp, zero, gref->params.seq_tail_margin, offset) != 0) { return(-1); }
+	return(0);
+}
+
+/**
+ * @fn gref_dump_index
+ * @brief dump acv or idx object to fp. the sequence is always stored in the
+ * copy-mode layout, so the loaded object does not depend on the original buffer.
+ */
+int gref_dump_index(
+	gref_acv_t const *_gref,
+	zf_t *fp)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref == NULL || fp == NULL || gref->type == GREF_POOL) { return(-1); }
+
+	/* the delta and the staged updates are not serialized; merge them first */
+	if(gref->delta != NULL || gref->stage_cnt != 0) { return(-1); }
+
+	int64_t const sec_cnt = gref->sec_cnt;
+	struct gref_section_intl_s const *sec =
+		(struct gref_section_intl_s const *)hmap_get_object(gref->hmap, 0);
+
+	/* build header */
+	struct gref_index_header_s hdr = {
+		.magic = GREF_INDEX_MAGIC,
+		.version = GREF_INDEX_VERSION,
+		.header_size = sizeof(struct gref_index_header_s),
+		.params = gref->params,
+		.type = gref->type,
+		.sec_cnt = sec_cnt,
+		.seq_len = 0,
+		.link_table_size = gref->link_table_size,
+		.kmer_table_size = (gref->type == GREF_IDX) ? gref->kmer_table_size : 0,
+		.kmer_esc_size = (gref->type == GREF_IDX) ? gref->kmer_esc_size : 0,
+		.entry_size = (gref->type == GREF_IDX) ? gref->entry_size : 0,
+		.entry_pos_bits = (gref->type == GREF_IDX) ? gref->entry_pos_bits : 0
+	};
+	hdr.params.copy_mode = GREF_COPY;
+	hdr.params.lmm = NULL;
+
+	/* calc blob sizes */
+	uint64_t name_size = 0;
+	for(int64_t i = 0; i < sec_cnt + 1; i++) {
+		name_size += sizeof(int32_t) + hmap_get_key(gref->hmap, i).len;
+		hdr.seq_len += sec[i].fw_sec.len;
+	}
+	uint64_t kmer_idx_size = gref_get_kmer_idx_size(gref);
+	uint64_t size[GREF_INDEX_BLOB_CNT] = {
+		[GREF_INDEX_NAME] = name_size,
+		[GREF_INDEX_SECTION] = GREF_INDEX_SECTION_SIZE * (sec_cnt + 1),
+		[GREF_INDEX_LINK] = sizeof(uint32_t) * gref->link_table_size,
+		[GREF_INDEX_SEQ] = gref->params.seq_head_margin
+			+ hdr.seq_len * ((gref->params.seq_direction == GREF_FW_RV) ? 2 : 1)
+			+ gref->params.seq_tail_margin
+	};
+	if(gref->type == GREF_IDX) {
+		if(gref->params.kmer_idx_type == GREF_KMER_IDX_DENSE) {
+			size[GREF_INDEX_KMER_IDX] = sizeof(int64_t) * (kmer_idx_size + 1);
+		} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_INLINE) {
+			size[GREF_INDEX_KMER_IDX] = sizeof(struct gref_kmer_slot_s) * (kmer_idx_size + 1);
+		} else if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH) {
+			gref_get_hash_bytes(gref, &size[GREF_INDEX_KMER_HASH_TAG]);
+		} else {
+			size[GREF_INDEX_KMER_SB] = sizeof(uint64_t) * ((kmer_idx_size>>GREF_KMER_SB_SHIFT) + 1);
+			size[GREF_INDEX_KMER_REL] = sizeof(uint16_t) * kmer_idx_size;
+			size[GREF_INDEX_KMER_ESC] = sizeof(uint32_t) * gref->kmer_esc_size;
+		}
+		size[GREF_INDEX_KMER_TABLE] = gref_get_kmer_table_bytes(gref);
+		size[GREF_INDEX_OCC_MASK] = (gref->occ_mask == NULL) ? 0
+			: sizeof(struct gref_kmer_occ_s) * gref->occ_mask->cnt;
+	}
+	uint64_t offset = _roundup(sizeof(struct gref_index_header_s), GREF_INDEX_ALIGN);
+	for(int64_t i = 0; i < GREF_INDEX_BLOB_CNT; i++) {
+		hdr.blob[i] = (struct gref_index_blob_s){
+			.offset = offset,
+			.size = size[i]
+		};
+		offset = _roundup(offset + size[i], GREF_INDEX_ALIGN);
+	}
+
+	/* header */
+	offset = 0;
+	if(gref_dump_write(fp, &hdr, sizeof(struct gref_index_header_s), &offset) != 0
+	|| gref_dump_pad(fp, &offset) != 0) {
+		return(-1);
+	}
+
+	/* names */
+	for(int64_t i = 0; i < sec_cnt + 1; i++) {
+		struct hmap_key_s key = hmap_get_key(gref->hmap, i);
+		int32_t len = key.len;
+		if(gref_dump_write(fp, &len, sizeof(int32_t), &offset) != 0
+		|| gref_dump_write(fp, key.str, len, &offset) != 0) {
+			return(-1);
+		}
+	}
+	if(gref_dump_pad(fp, &offset) != 0) { return(-1); }
+
+	/* sections, base pointers are replaced with offsets in the seq blob */
+	uint64_t base = 0;
+	for(int64_t i = 0; i < sec_cnt + 1; i++) {
+		struct gref_section_intl_s s = sec[i];
+		s.fw_sec.base = (i < sec_cnt) ? (uint8_t const *)base : NULL;
+		s.rv_sec.base = NULL;
+		base += s.fw_sec.len;
+		if(gref_dump_write(fp, (uint8_t const *)&s + GREF_INDEX_SECTION_OFFSET,
+			GREF_INDEX_SECTION_SIZE, &offset) != 0) {
+			return(-1);
+		}
+	}
+	if(gref_dump_pad(fp, &offset) != 0) { return(-1); }
+
+	/* link table */
+	if(gref_dump_write(fp, gref->link_table, size[GREF_INDEX_LINK], &offset) != 0
+	|| gref_dump_pad(fp, &offset) != 0) {
+		return(-1);
+	}
+
+	/* sequence */
+	if(gref_dump_seq(gref, fp, &offset) != 0
+	|| gref_dump_pad(fp, &offset) != 0) {
+		return(-1);
+	}
+
+	/* kmer index */
+	void const *ptr[GREF_INDEX_BLOB_CNT] = {
+		[GREF_INDEX_KMER_IDX] = (gref->kmer_slot_table != NULL)
+			? (void const *)gref->kmer_slot_table : (void const *)gref->kmer_idx_table,
+		[GREF_INDEX_KMER_SB] = gref->kmer_sb_table,
+		[GREF_INDEX_KMER_REL] = gref->kmer_rel_table,
+		[GREF_INDEX_KMER_ESC] = gref->kmer_esc_table,
+		[GREF_INDEX_KMER_TABLE] = gref->kmer_table,
+		[GREF_INDEX_OCC_MASK] = (gref->occ_mask == NULL) ? NULL : gref->occ_mask->arr,
+		[GREF_INDEX_KMER_HASH_TAG] = gref->kmer_hash_tag,
+		[GREF_INDEX_KMER_HASH_SLOT] = gref->kmer_hash_slot,
+		[GREF_INDEX_KMER_HASH_ESC] = gref->kmer_hash_esc
+	};
+	for(int64_t i = GREF_INDEX_KMER_IDX; i < GREF_INDEX_BLOB_CNT; i++) {
+		if(gref_dump_write(fp, ptr[i], size[i], &offset) != 0
+		|| gref_dump_pad(fp, &offset) != 0) {
+			return(-1);
+		}
+	}
+	return(0);
+}
+
+/**
+ * @fn gref_load_check_header
+ */
+static _force_inline
+int gref_load_check_header(
+	struct gref_index_header_s const *hdr,
+	uint64_t file_size)
+{
+	if(memcmp(hdr->magic, GREF_INDEX_MAGIC, sizeof(GREF_INDEX_MAGIC)) != 0
+	|| hdr->version != GREF_INDEX_VERSION
+	|| hdr->header_size != sizeof(struct gref_index_header_s)) {
+		debug("broken header");
+		return(-1);
+	}
+	if(hdr->type != GREF_ACV && hdr->type != GREF_IDX) { return(-1); }
+
+	uint64_t prev_tail = sizeof(struct gref_index_header_s);
+	for(int64_t i = 0; i < GREF_INDEX_BLOB_CNT; i++) {
+		if(hdr->blob[i].offset < prev_tail
+		|| hdr->blob[i].offset % GREF_INDEX_ALIGN != 0
+		|| hdr->blob[i].offset + hdr->blob[i].size > file_size) {
+			debug("broken blob(%lld), offset(%llu), size(%llu)", i, hdr->blob[i].offset, hdr->blob[i].size);
+			return(-1);
+		}
+		prev_tail = hdr->blob[i].offset + hdr->blob[i].size;
+	}
+	return(0);
+}
+
+/**
+ * @fn gref_load_index_intl
+ * @brief build object from blobs. arrays other than names, sections and the mask are
+ * used in place (owned by the object unless they are in the mapped range).
+ */
+static
+struct gref_s *gref_load_index_intl(
+	struct gref_index_header_s const *hdr,
+	void *blob[GREF_INDEX_BLOB_CNT],
+	void *map_base,
+	uint64_t map_size)
+{
+	struct gref_params_s p = hdr->params;
+	struct gref_s *gref = (struct gref_s *)lmm_malloc(NULL, sizeof(struct gref_s));
+	if(gref == NULL) { return(NULL); }
+	memset(gref, 0, sizeof(struct gref_s));
+
+	/* arrays */
+	gref->map_base = map_base;
+	gref->map_size = map_size;
+	lmm_kv_ptr(gref->seq) = (uint8_t *)blob[GREF_INDEX_SEQ];
+	lmm_kv_size(gref->seq) = lmm_kv_max(gref->seq) = hdr->blob[GREF_INDEX_SEQ].size;
+	lmm_kv_ptr(gref->link) = (struct gref_gid_pair_s *)blob[GREF_INDEX_LINK];
+	lmm_kv_size(gref->link) = lmm_kv_max(gref->link) = hdr->link_table_size / 2;
+	gref->link_table = (uint32_t *)blob[GREF_INDEX_LINK];
+	gref->link_table_size = hdr->link_table_size;
+	gref->kmer_idx_table = (int64_t *)blob[GREF_INDEX_KMER_IDX];
+	if(p.kmer_idx_type == GREF_KMER_IDX_INLINE) {
+		/* the kmer_idx blob holds the slots */
+		gref->kmer_slot_table = (struct gref_kmer_slot_s *)gref->kmer_idx_table;
+		gref->kmer_idx_table = NULL;
+	}
+	gref->kmer_sb_table = (uint64_t *)blob[GREF_INDEX_KMER_SB];
+	gref->kmer_rel_table = (uint16_t *)blob[GREF_INDEX_KMER_REL];
+	gref->kmer_esc_table = (uint32_t *)blob[GREF_INDEX_KMER_ESC];
+	gref->kmer_esc_size = hdr->kmer_esc_size;
+	gref->kmer_table = (struct gref_gid_pos_s *)blob[GREF_INDEX_KMER_TABLE];
+	gref->kmer_table_size = hdr->kmer_table_size;
+	gref->kmer_hash_tag = (uint8_t *)blob[GREF_INDEX_KMER_HASH_TAG];
+	gref->kmer_hash_slot = (struct gref_kmer_hash_slot_s *)blob[GREF_INDEX_KMER_HASH_SLOT];
+	gref->kmer_hash_esc = (struct gref_kmer_occ_s *)blob[GREF_INDEX_KMER_HASH_ESC];
+	gref->kmer_hash_group_cnt = hdr->blob[GREF_INDEX_KMER_HASH_TAG].size / GREF_KMER_HASH_GROUP_SIZE;
+	gref->kmer_hash_esc_cnt = hdr->blob[GREF_INDEX_KMER_HASH_ESC].size / sizeof(struct gref_kmer_occ_s);
+	gref->entry_size = hdr->entry_size;
+	gref->entry_pos_bits = hdr->entry_pos_bits;
+
+	/* check sizes */
+	uint64_t kmer_idx_size = (p.k < 32) ? 0x01ULL<<(2 * p.k) : 0;
+	int64_t const group_cnt = gref->kmer_hash_group_cnt;
+	if(p.k < 4 || p.k > 32
+	|| hdr->blob[GREF_INDEX_SECTION].size != GREF_INDEX_SECTION_SIZE * (hdr->sec_cnt + 1)
+	|| hdr->blob[GREF_INDEX_LINK].size != sizeof(uint32_t) * hdr->link_table_size
+	|| hdr->blob[GREF_INDEX_SEQ].size != p.seq_head_margin + p.seq_tail_margin
+		+ hdr->seq_len * ((p.seq_direction == GREF_FW_RV) ? 2 : 1)) {
+		goto _gref_load_index_intl_error_handler;
+	}
+	if(hdr->type == GREF_IDX && (
+		hdr->entry_size > sizeof(uint64_t) || hdr->entry_pos_bits > 32
+	|| hdr->blob[GREF_INDEX_KMER_TABLE].size != gref_get_kmer_table_bytes(gref)
+	|| (uint8_t)p.kmer_idx_type > GREF_KMER_IDX_HASH
+	|| (p.kmer_idx_type == GREF_KMER_IDX_DENSE
+		&& hdr->blob[GREF_INDEX_KMER_IDX].size != sizeof(int64_t) * (kmer_idx_size + 1))
+	|| (p.kmer_idx_type == GREF_KMER_IDX_INLINE
+		&& (hdr->entry_size != 0
+		 || hdr->blob[GREF_INDEX_KMER_IDX].size != sizeof(struct gref_kmer_slot_s) * (kmer_idx_size + 1)))
+	|| (p.kmer_idx_type == GREF_KMER_IDX_COMPACT
+		&& (hdr->blob[GREF_INDEX_KMER_SB].size != sizeof(uint64_t) * ((kmer_idx_size>>GREF_KMER_SB_SHIFT) + 1)
+		 || hdr->blob[GREF_INDEX_KMER_REL].size != sizeof(uint16_t) * kmer_idx_size
+		 || hdr->blob[GREF_INDEX_KMER_ESC].size != sizeof(uint32_t) * hdr->kmer_esc_size))
+	|| (p.kmer_idx_type == GREF_KMER_IDX_HASH
+		&& (group_cnt == 0 || (group_cnt & (group_cnt - 1)) != 0
+		 || hdr->blob[GREF_INDEX_KMER_HASH_SLOT].size != sizeof(struct gref_kmer_hash_slot_s) * GREF_KMER_HASH_GROUP_SIZE * group_cnt
+		 || hdr->blob[GREF_INDEX_KMER_HASH_ESC].size % sizeof(struct gref_kmer_occ_s) != 0)))) {
+		goto _gref_load_index_intl_error_handler;
+	}
+
+	/* rebuild name -> section mapping */
+	gref->hmap = hmap_init(
+		sizeof(struct gref_section_intl_s),
+		HMAP_PARAMS( .hmap_size = p.hash_size, .lmm = NULL ));
+	if(gref->hmap == NULL) {
+		goto _gref_load_index_intl_error_handler;
+	}
+	uint8_t const *name = (uint8_t const *)blob[GREF_INDEX_NAME];
+	uint8_t const *name_lim = name + hdr->blob[GREF_INDEX_NAME].size;
+	for(int64_t i = 0; i < hdr->sec_cnt + 1; i++) {
+		int32_t len;
+		if(name + sizeof(int32_t) > name_lim) { goto _gref_load_index_intl_error_handler; }
+		memcpy(&len, name, sizeof(int32_t)); name += sizeof(int32_t);
+		if(len < 0 || name + len > name_lim) { goto _gref_load_index_intl_error_handler; }
+
+		uint32_t id = hmap_get_id(gref->hmap, (char const *)name, len);
+		if(id != i) { goto _gref_load_index_intl_error_handler; }
+		name += len;
+
+		struct gref_section_intl_s *sec =
+			(struct gref_section_intl_s *)hmap_get_object(gref->hmap, id);
+		memcpy((uint8_t *)sec + GREF_INDEX_SECTION_OFFSET,
+			(uint8_t const *)blob[GREF_INDEX_SECTION] + GREF_INDEX_SECTION_SIZE * i,
+			GREF_INDEX_SECTION_SIZE);
+	}
+	gref->sec_cnt = hdr->sec_cnt;
+
+	/* convert offsets to pointers (copy-mode layout) */
+	struct gref_section_intl_s *sec =
+		(struct gref_section_intl_s *)hmap_get_object(gref->hmap, 0);
+	uint8_t const *seq_base = lmm_kv_ptr(gref->seq) + p.seq_head_margin;
+	uint8_t const *rv_lim = (p.seq_direction == GREF_FW_RV)
+		? (gref->seq_lim = seq_base + 2 * hdr->seq_len)
+		: (gref->seq_lim = GREF_SEQ_LIM) + (uint64_t)GREF_SEQ_LIM;
+	for(int64_t i = 0; i < gref->sec_cnt; i++) {
+		uint64_t rel = (uint64_t)sec[i].fw_sec.base;
+		if(rel + sec[i].fw_sec.len > hdr->seq_len) { goto _gref_load_index_intl_error_handler; }
+
+		sec[i].fw_sec.base = seq_base + rel;
+		sec[i].rv_sec.base = (p.seq_direction == GREF_FW_RV)
+			? rv_lim - rel - sec[i].fw_sec.len
+			: rv_lim - (uint64_t)sec[i].fw_sec.base - sec[i].fw_sec.len;
+	}
+
+	/* restore params and misc */
+	p.copy_mode = GREF_COPY;
+	p.lmm = NULL;
+	gref->params = p;
+	gref->type = hdr->type;
+	gref->seq_len = hdr->seq_len;
+	gref->mask = (uint64_t)-1>>(64 - 2 * p.k);
+	gref->append_seq = (p.seq_format == GREF_4BIT) ? gref_copy_seq_4bit : gref_copy_seq_ascii;
+	gref->pack_kmer = gref_select_pack_kmer(p.k);
+
+	/* capped kmers, copied into the mask object */
+	uint64_t mask_size = hdr->blob[GREF_INDEX_OCC_MASK].size;
+	if(mask_size % sizeof(struct gref_kmer_occ_s) != 0
+	|| (mask_size != 0 && gref_build_occ_mask(gref, (struct gref_kmer_occ_s const *)blob[GREF_INDEX_OCC_MASK],
+		mask_size / sizeof(struct gref_kmer_occ_s)) != 0)) {
+		goto _gref_load_index_intl_error_handler;
+	}
+
+	/* the file holds the 4bit layout; repack (the mapped pages are no longer touched) */
+	if(p.seq_storage == GREF_STORAGE_2BIT && gref_pack_seq(gref) != 0) {
+		goto _gref_load_index_intl_error_handler;
+	}
+	return(gref);
+
+_gref_load_index_intl_error_handler:;
+	gref_clean((gref_t *)gref);
+	return(NULL);
+}
+
+/**
+ * @fn gref_load_index
+ * @brief load object from fp, arrays are read into the heap.
+ */
+gref_acv_t *gref_load_index(
+	zf_t *fp)
+{
+	if(fp == NULL) { return(NULL); }
+
+	struct gref_index_header_s hdr;
+	uint64_t offset = 0;
+	if(zfread(fp, &hdr, sizeof(struct gref_index_header_s)) != sizeof(struct gref_index_header_s)
+	|| gref_load_check_header(&hdr, UINT64_MAX) != 0) {
+		return(NULL);
+	}
+	offset += sizeof(struct gref_index_header_s);
+
+	/* read blobs in order */
+	void *blob[GREF_INDEX_BLOB_CNT] = { 0 };
+	for(int64_t i = 0; i < GREF_INDEX_BLOB_CNT; i++) {
+		/* skip padding */
+		uint8_t buf[256];
+		while(offset < hdr.blob[i].offset) {
+			uint64_t len = MIN2(hdr.blob[i].offset - offset, 256);
+			if(zfread(fp, buf, len) != len) { goto _gref_load_index_error_handler; }
+			offset += len;
+		}
+		if(hdr.blob[i].size == 0) { continue; }
+
+		if((blob[i] = lmm_malloc(NULL, hdr.blob[i].size)) == NULL
+		|| zfread(fp, blob[i], hdr.blob[i].size) != hdr.blob[i].size) {
+			goto _gref_load_index_error_handler;
+		}
+		offset += hdr.blob[i].size;
+	}
+
+	/* names and sections are copied into hmap; the others are owned by gref */
+	struct gref_s *gref = gref_load_index_intl(&hdr, blob, NULL, 0);
+	lmm_free(NULL, blob[GREF_INDEX_NAME]);
+	lmm_free(NULL, blob[GREF_INDEX_SECTION]);
+	lmm_free(NULL, blob[GREF_INDEX_OCC_MASK]);
+	if(gref != NULL && gref->type == GREF_IDX) {
+		gref_place_kmer_tables(gref);
+	}
+	return((gref_acv_t *)gref);
+
+_gref_load_index_error_handler:;
+	for(int64_t i = 0; i < GREF_INDEX_BLOB_CNT; i++) {
+		lmm_free(NULL, blob[i]);
+	}
+	return(NULL);
+}
+
+/**
+ * @fn gref_load_index_mmap
+ * @brief map an uncompressed index file read-only. sequence, link and kmer
+ * tables are used in place; the pages are shared between processes.
+ */
+gref_acv_t *gref_load_index_mmap(
+	char const *path)
+{
+	if(path == NULL) { return(NULL); }
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) { return(NULL); }
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(struct gref_index_header_s)) {
+		close(fd);
+		return(NULL);
+	}
+	uint64_t size = st.st_size;
+	void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED) { return(NULL); }
+
+	struct gref_index_header_s const *hdr = (struct gref_index_header_s const *)base;
+	if(gref_load_check_header(hdr, size) != 0) {
+		munmap(base, size);
+		return(NULL);
+	}
+
+	void *blob[GREF_INDEX_BLOB_CNT] = { 0 };
+	for(int64_t i = 0; i < GREF_INDEX_BLOB_CNT; i++) {
+		blob[i] = (hdr->blob[i].size == 0) ? NULL : (uint8_t *)base + hdr->blob[i].offset;
+	}
+
+	/* base is unmapped in gref_clean, including the failure path */
+	return((gref_acv_t *)gref_load_index_intl(hdr, blob, base, size));
+}
+
+/**
+ * @fn gref_get_section_count
+ */
+int64_t gref_get_section_count(
+	gref_t const *_gref)
+{
+	struct gref_s *gref = (struct gref_s *)_gref;
+	return((int64_t)gref->sec_cnt);
+}
+
+/**
+ * @fn gref_get_section
+ * @brief type must be ACV or IDX, otherwise return value is invalid
+ */
+struct gref_section_s const *gref_get_section(
+	gref_acv_t const *_gref,
+	uint32_t gid)
+{
+	struct gref_s *gref = (struct gref_s *)_gref;
+
+	struct gref_section_half_s *base =
+		(struct gref_section_half_s *)hmap_get_object(gref->hmap, 0);
+	return((struct gref_section_s const *)&base[gid].sec);
+}
+
+/**
+ * @fn gref_get_packed_seq
+ */
+struct gref_packed_seq_s gref_get_packed_seq(
+	gref_acv_t const *_gref)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return((struct gref_packed_seq_s){
+		.seq = gref->seq_2bit,
+		.exc = gref->seq_exc,
+		.exc_cnt = gref->seq_exc_cnt,
+		.len = (gref->seq_2bit != NULL) ? gref->seq_len : 0
+	});
+}
+
+/**
+ * @fn gref_decode_section
+ * @brief type must be ACV or IDX
+ */
+int64_t gref_decode_section(
+	gref_acv_t const *_gref,
+	uint32_t gid,
+	uint8_t *dst)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	static uint8_t const comp[16] = {
+		0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+		0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+	};
+
+	/* decode forward, then reverse-complement in place */
+	struct gref_section_half_s const *hsec =
+		(struct gref_section_half_s const *)hmap_get_object(gref->hmap, 0);
+	struct gref_section_s const *fw = &hsec[gid & ~0x01].sec;
+	int64_t len = fw->len;
+	if(gref->seq_2bit != NULL) {
+		gref_decode_2bit(gref, (uint64_t)fw->base, len, dst);
+	} else {
+		memcpy(dst, fw->base, len);
+	}
+	if((gid & 0x01) != 0) {
+		for(int64_t i = 0; i < len / 2; i++) {
+			uint8_t t = dst[i];
+			dst[i] = comp[dst[len - 1 - i]];
+			dst[len - 1 - i] = comp[t];
+		}
+		if((len & 0x01) != 0) { dst[len / 2] = comp[dst[len / 2]]; }
+	}
+	return(len);
+}
+
+/**
+ * @fn gref_get_link
+ * @brief type must be ACV or IDX, otherwise return value is invalid
+ */
+struct gref_link_s gref_get_link(
+	gref_acv_t const *_gref,
+	uint32_t gid)
+{
+	struct gref_s *gref = (struct gref_s *)_gref;
+
+	struct gref_section_half_s *base =
+		(struct gref_section_half_s *)hmap_get_object(gref->hmap, 0);
+	return((struct gref_link_s){
+		.gid_arr = &gref->link_table[base[gid].link_idx_base],
+		.len = base[gid + 1].link_idx_base - base[gid].link_idx_base
+	});
+}
+
+/**
+ * @fn gref_get_name
+ */
+struct gref_str_s gref_get_name(
+	gref_t const *_gref,
+	uint32_t gid)
+{
+	struct gref_s *gref = (struct gref_s *)_gref;
+	struct hmap_key_s key = hmap_get_key(gref->hmap, _decode_id(gid));
+	return((struct gref_str_s){
+		.str = key.str,
+		.len = key.len
+	});
+}
+
+/* flat graph view */
+/**
+ * @fn gref_graph_init
+ * @brief copy section bases, lengths, link offsets and names into arrays in a
+ * single block. the link table and the name strings are not copied.
+ */
+gref_graph_t *gref_graph_init(
+	gref_acv_t const *_gref)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref == NULL || (gref->type != GREF_ACV && gref->type != GREF_IDX)) { return(NULL); }
+
+	uint64_t const cnt = gref->sec_cnt, gcnt = 2 * cnt;
+	uint64_t const size = sizeof(struct gref_graph_s)
+		+ sizeof(uint8_t const *) * gcnt			/* base */
+		+ sizeof(char const *) * cnt				/* name */
+		+ sizeof(uint32_t) * gcnt					/* len */
+		+ sizeof(uint32_t) * (gcnt + 1)				/* link_idx */
+		+ sizeof(int32_t) * cnt;					/* name_len */
+	struct gref_graph_s *graph = (struct gref_graph_s *)malloc(size);
+	if(graph == NULL) { return(NULL); }
+
+	/* pointer arrays first to keep them aligned */
+	uint8_t const **base = (uint8_t const **)(graph + 1);
+	char const **name = (char const **)(base + gcnt);
+	uint32_t *len = (uint32_t *)(name + cnt);
+	uint32_t *link_idx = len + gcnt;
+	int32_t *name_len = (int32_t *)(link_idx + gcnt + 1);
+
+	struct gref_section_half_s const *hsec =
+		(struct gref_section_half_s const *)hmap_get_object(gref->hmap, 0);
+	for(uint64_t i = 0; i < gcnt; i++) {
+		base[i] = hsec[i].sec.base;
+		len[i] = hsec[i].sec.len;
+		link_idx[i] = hsec[i].link_idx_base;
+	}
+	link_idx[gcnt] = hsec[gcnt].link_idx_base;
+
+	for(uint64_t i = 0; i < cnt; i++) {
+		struct hmap_key_s key = hmap_get_key(gref->hmap, i);
+		name[i] = key.str;
+		name_len[i] = key.len;
+	}
+
+	*graph = (struct gref_graph_s){
+		.gid_cnt = gcnt,
+		.lim = gref->seq_lim,
+		.base = base,
+		.len = len,
+		.link_idx = link_idx,
+		.link_table = gref->link_table,
+		.name = name,
+		.name_len = name_len
+	};
+	return((gref_graph_t *)graph);
+}
+
+/**
+ * @fn gref_graph_clean
+ */
+void gref_graph_clean(
+	gref_graph_t *graph)
+{
+	free((void *)graph);
+	return;
+}
+
+/**
+ * @macro _gref_graph_prefetch_dist
+ * @brief gids looked ahead in the batch accessors
+ */
+#define _gref_graph_prefetch_dist	( 8 )
+
+/**
+ * @fn gref_graph_get_section
+ * @brief batch version of gref_get_section. returns cnt, or -1 if a gid is out of range.
+ */
+int64_t gref_graph_get_section(
+	gref_graph_t const *graph,
+	uint32_t const *gid,
+	int64_t cnt,
+	struct gref_section_s *dst)
+{
+	for(int64_t i = 0; i < cnt; i++) {
+		if((int64_t)gid[i] >= graph->gid_cnt) { return(-1); }
+	}
+
+	for(int64_t i = 0; i < cnt; i++) {
+		if(i + _gref_graph_prefetch_dist < cnt) {
+			uint32_t const n = gid[i + _gref_graph_prefetch_dist];
+			_prefetch(&graph->base[n]);
+			_prefetch(&graph->len[n]);
+		}
+		dst[i] = (struct gref_section_s){
+			.gid = gid[i],
+			.len = graph->len[gid[i]],
+			.base = graph->base[gid[i]]
+		};
+	}
+	return(cnt);
+}
+
+/**
+ * @fn gref_graph_get_link
+ * @brief batch version of gref_get_link. returns cnt, or -1 if a gid is out of range.
+ */
+int64_t gref_graph_get_link(
+	gref_graph_t const *graph,
+	uint32_t const *gid,
+	int64_t cnt,
+	struct gref_link_s *dst)
+{
+	for(int64_t i = 0; i < cnt; i++) {
+		if((int64_t)gid[i] >= graph->gid_cnt) { return(-1); }
+	}
+
+	for(int64_t i = 0; i < cnt; i++) {
+		if(i + _gref_graph_prefetch_dist < cnt) {
+			uint32_t const n = gid[i + _gref_graph_prefetch_dist];
+			_prefetch(&graph->link_idx[n]);
+		}
+		uint32_t const head = graph->link_idx[gid[i]];
+		dst[i] = (struct gref_link_s){
+			.gid_arr = &graph->link_table[head],
+			.len = graph->link_idx[gid[i] + 1] - head
+		};
+	}
+	return(cnt);
+}
+
+/**
+ * @fn gref_graph_get_name
+ * @brief batch version of gref_get_name. returns cnt, or -1 if a gid is out of range.
+ */
+int64_t gref_graph_get_name(
+	gref_graph_t const *graph,
+	uint32_t const *gid,
+	int64_t cnt,
+	struct gref_str_s *dst)
+{
+	for(int64_t i = 0; i < cnt; i++) {
+		if((int64_t)gid[i] >= graph->gid_cnt) { return(-1); }
+	}
+
+	for(int64_t i = 0; i < cnt; i++) {
+		if(i + _gref_graph_prefetch_dist < cnt) {
+			uint32_t const n = gref_id(gid[i + _gref_graph_prefetch_dist]);
+			_prefetch(&graph->name[n]);
+			_prefetch(&graph->name_len[n]);
+		}
+		uint32_t const id = gref_id(gid[i]);
+		dst[i] = (struct gref_str_s){
+			.str = graph->name[id],
+			.len = graph->name_len[id]
+		};
+	}
+	return(cnt);
+}
+
+#if 0
+/* deprecated */
+/**
+ * @fn gref_get_ptr
+ */
+uint8_t const *gref_get_ptr(
+	gref_t const *_gref)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return((uint8_t const *)lmm_kv_ptr(gref->seq) + gref->params.seq_head_margin);
+}
+#endif
+
+/**
+ * @fn gref_get_total_len
+ */
+int64_t gref_get_total_len(
+	gref_t const *_gref)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return(gref->seq_len);
+}
+
+/**
+ * @fn gref_get_lim
+ * @brief type must be ACV or IDX, otherwise return value is invalid
+ */
+uint8_t const *gref_get_lim(
+	gref_acv_t const *_gref)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	return(gref->seq_lim);
+}
+
+/**
+ * @fn gref_get_stats
+ */
+int gref_get_stats(
+	gref_t const *_gref,
+	struct gref_stats_s *stats)
+{
+	struct gref_s const *gref = (struct gref_s const *)_gref;
+	if(gref == NULL || stats == NULL) { return(-1); }
+	memset(stats, 0, sizeof(struct gref_stats_s));
+
+	/* sequence, the 2bit storage is sized as in gref_pack_seq */
+	if(gref->seq_2bit != NULL) {
+		uint64_t const words = (gref->seq_len + 31) / 32 + 1;
+		stats->seq_bytes = sizeof(uint64_t) * (words + (words + 63) / 64)
+			+ sizeof(struct gref_seq_exc_s) * gref->seq_exc_cnt;
+	} else {
+		stats->seq_bytes = lmm_kv_max(gref->seq);
+	}
+
+	/* links, the pool keeps both directions, the link table packs them into a half */
+	stats->link_bytes = sizeof(struct gref_gid_pair_s) * lmm_kv_max(gref->link);
+	stats->link_cnt = ((gref->type == GREF_POOL) ? (int64_t)lmm_kv_size(gref->link) : gref->link_table_size) / 2;
+
+	/* sections and names */
+	uint32_t const obj_cnt = hmap_get_count(gref->hmap);
+	stats->hmap_bytes = sizeof(struct gref_section_intl_s) * obj_cnt;
+	for(uint32_t i = 0; i < obj_cnt; i++) {
+		stats->hmap_bytes += hmap_get_key(gref->hmap, i).len;
+	}
+	stats->sec_cnt = gref->sec_cnt;
+	stats->seq_len = gref->seq_len;
+
+	if(gref->type == GREF_IDX) {
+		uint64_t const kmer_idx_size = gref_get_kmer_idx_size(gref);
+		uint64_t hash_size[3] = { 0 };
+		stats->kmer_idx_bytes = (gref->params.kmer_idx_type == GREF_KMER_IDX_HASH)
+			? gref_get_hash_bytes(gref, hash_size)
+			: (gref->params.kmer_idx_type == GREF_KMER_IDX_DENSE)
+			? sizeof(int64_t) * (kmer_idx_size + 1)
+			: (gref->params.kmer_idx_type == GREF_KMER_IDX_INLINE)
+			? sizeof(struct gref_kmer_slot_s) * (kmer_idx_size + 1)
+			: sizeof(uint64_t) * ((kmer_idx_size>>GREF_KMER_SB_SHIFT) + 1)
+				+ sizeof(uint16_t) * kmer_idx_size
+				+ sizeof(uint32_t) * gref->kmer_esc_size;
+		stats->kmer_table_bytes = gref_get_kmer_table_bytes(gref);
+		stats->kmer_cnt = gref->kmer_table_size;
+		stats->dup_cnt = gref->dup_cnt;
+
+		/* bucket size distribution, over the occupied slots for the hash index */
+		uint64_t const scan_size = (gref->params.kmer_idx_type == GREF_KMER_IDX_HASH)
+			? hash_size[0] : kmer_idx_size;
+		for(uint64_t i = 0; i < scan_size; i++) {
+			if(gref->params.kmer_idx_type == GREF_KMER_IDX_HASH && gref->kmer_hash_tag[i] == 0) { continue; }
+			struct gref_bucket_s b = (gref->params.kmer_idx_type == GREF_KMER_IDX_HASH)
+				? gref_get_hash_bucket(gref, gref->kmer_hash_slot[i].kmer)
+				: gref_get_bucket(gref, i);
+			int64_t n = b.tail - b.base;
+			if(n <= 0) { continue; }
+			stats->bucket_cnt++;
+			stats->max_bucket_size = MAX2(stats->max_bucket_size, n);
+			stats->bucket_hist[63 - __builtin_clzll(n)]++;
+		}
+	}
+
+	/* staged kmers and capped kmers */
+	if(gref->delta != NULL) {
+		int64_t const kcnt = gref->delta->kmer_cnt;
+		stats->aux_bytes += sizeof(struct gref_delta_s)
+			+ sizeof(uint64_t) * kcnt + sizeof(int64_t) * (kcnt + 1)
+			+ sizeof(struct gref_gid_pos_s) * gref->delta->base[kcnt];
+	}
+	if(gref->occ_mask != NULL) {
+		stats->aux_bytes += sizeof(struct gref_occ_mask_s)
+			+ sizeof(struct gref_kmer_occ_s) * gref->occ_mask->cnt;
+	}
+	stats->total_bytes = stats->seq_bytes + stats->link_bytes
+		+ stats->kmer_idx_bytes + stats->kmer_table_bytes
+		+ stats->hmap_bytes + stats->aux_bytes;
+
+	/* build profile */
+	stats->max_stack_depth = gref->max_stack_depth;
+	stats->max_expansion = gref->max_expansion;
+	memcpy(stats->phase_sec, gref->phase_sec, sizeof(double) * GREF_PHASE_CNT);
+	return(0);
+}
+
+/**
+ * unittests
+ */
+unittest_config(
+	.name = "gref",
+	.depends_on = { "psort", "hmap", "zf" }
+);
+
+/**
+ * @fn unittest_random_base
+ */
+static _force_inline
+char unittest_random_base(void)
+{
+	char const table[4] = {0x01, 0x02, 0x04, 0x08};
+	return(table[rand() % 4]);
+}
+
+/**
+ * @fn unittest_generate_random_sequence
+ */
+static _force_inline
+char *unittest_generate_random_sequence(
+	int64_t len)
+{
+	char *seq;		/** a pointer to sequence */
+	seq = (char *)malloc(sizeof(char) * (len + 1));
+
+	if(seq == NULL) { return NULL; }
+	for(int64_t i = 0; i < len; i++) {
+		seq[i] = unittest_random_base();
+	}
+	seq[len] = '\0';
+	return seq;
+}
+
+/**
+ * @fn unittest_match_cmp
+ * @brief nonzero if the first len entries of a (on ga) and b (on gb) differ
+ */
+static _force_inline
+int64_t unittest_match_cmp(
+	gref_idx_t const *ga,
+	struct gref_match_res_s const *a,
+	gref_idx_t const *gb,
+	struct gref_match_res_s const *b,
+	int64_t len)
+{
+	for(int64_t i = 0; i < len; i++) {
+		struct gref_gid_pos_s const x = gref_match_get(ga, a, i), y = gref_match_get(gb, b, i);
+		if(x.gid != y.gid || x.pos != y.pos) { return(1); }
+	}
+	return(0);
+}
+
+#define _str(x)		x, strlen(x)
+#define _seq(x)		(uint8_t const *)(x), strlen(x)
+
+#define _pack(x) ({ \
+	uint64_t _packed_seq = 0; \
+	int64_t _len = strlen(x); \
+	uint8_t _shift_len = 2 * (_len - 1); \
+	for(int64_t i = 0; i < _len; i++) { \
+		_packed_seq = (_packed_seq>>2) | ((uint64_t)gref_encode_2bit((x)[i])<<_shift_len); \
+	} \
+	_packed_seq; \
+})
+
+/* ascii encoder and reverse-complement */
+unittest()
+{
+	char const *bases = "ACGTUacgtuRYSWKMBDHVNryswkmbdhvn-_*.";
+	int64_t const len = 1000 + 7;		/* not a multiple of the vector width */
+
+	srand(0);
+	char *seq = (char *)malloc(len + 1);
+	for(int64_t i = 0; i < len; i++) {
+		seq[i] = bases[rand() % strlen(bases)];
+	}
+	seq[len] = '\0';
+
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 4, .seq_direction = GREF_FW_RV));
+	gref_append_segment(pool, _str("sec0"), (uint8_t const *)seq, len);
+	gref_acv_t *acv = gref_freeze_pool(pool);
+
+	static uint8_t const comp[16] = {
+		0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+		0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+	};
+	struct gref_section_s const *fw = gref_get_section(acv, gref_gid(0, GREF_FW));
+	struct gref_section_s const *rv = gref_get_section(acv, gref_gid(0, GREF_RV));
+	int64_t fw_mismatch = 0, rv_mismatch = 0;
+	for(int64_t i = 0; i < len; i++) {
+		fw_mismatch += (fw->base[i] != gref_encode_4bit(seq[i]));
+		rv_mismatch += (rv->base[i] != comp[gref_encode_4bit(seq[len - 1 - i])]);
+	}
+	assert(fw_mismatch == 0, "%lld", fw_mismatch);
+	assert(rv_mismatch == 0, "%lld", rv_mismatch);
+
+	gref_clean(acv);
+	free(seq);
+}
+
+/* make pool context */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4));
+
+	assert(pool != NULL);
+
+	gref_clean(pool);
+}
+
+/* add segment */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	int ret = gref_append_segment(pool, _str("sec0"), _seq("AARA"));
+	assert(ret == 0, "ret(%d)", ret);
+
+	ret = gref_append_segment(pool, _str("sec1"), _seq("MAAA"));
+	assert(ret == 0, "ret(%d)", ret);
+
+	ret = gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	assert(ret == 0, "ret(%d)", ret);
+
+	ret = gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	assert(ret == 0, "ret(%d)", ret);
+
+	ret = gref_append_segment(pool, _str("sec2"), _seq("ACGT"));
+	assert(ret == 0, "ret(%d)", ret);
+
+	ret = gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+	assert(ret == 0, "ret(%d)", ret);
+
+	/* section count */
+	assert(gref_get_section_count(pool) == 3, "%lld", gref_get_section_count(pool));
+
+	/* total len */
+	assert(gref_get_total_len(pool) == 12, "len(%lld)", gref_get_total_len(pool));
+
+	gref_clean(pool);
+}
+
+/* archive (fw_copy) */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_direction = GREF_FW_ONLY,
+		.copy_mode = GREF_COPY,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	/* append */
+	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
+	gref_append_segment(pool, _str("sec1"), _seq("M"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+
+	/* build index */
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	assert(acv != NULL, "acv(%p)", acv);
+
+	assert(acv->type == GREF_ACV, "%d", acv->type);
+	assert(acv->link_table != NULL, "%p", acv->link_table);
+
+	/* section count */
+	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+
+	/* total len */
+	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+
+	/* get lim */
+	assert(gref_get_lim(acv) == GREF_SEQ_LIM, "lim(%p)", gref_get_lim(acv));
+
+	/* check bases at the head of the sections */
+	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
+	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
+	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
+
+	gref_clean(acv);
+}
+
+/* archive (fw_nocopy) */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_direction = GREF_FW_ONLY,
+		.seq_format = GREF_4BIT,
+		.copy_mode = GREF_NOCOPY,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	/* append */
+	gref_append_segment(pool, _str("sec0"), _seq("\x04\x04\x05\x01"));
+	gref_append_segment(pool, _str("sec1"), _seq("\x03"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	gref_append_segment(pool, _str("sec2"), _seq("\x01\x03\x07\x07\x04\x08\x04\x08"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+
+	/* build index */
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	assert(acv != NULL, "acv(%p)", acv);
+
+	assert(acv->type == GREF_ACV, "%d", acv->type);
+	assert(acv->link_table != NULL, "%p", acv->link_table);
+
+	/* section count */
+	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+
+	/* total len */
+	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+
+	/* get lim */
+	assert(gref_get_lim(acv) == GREF_SEQ_LIM, "lim(%p)", gref_get_lim(acv));
+
+	/* check bases at the head of the sections */
+	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
+	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
+	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
+
+	gref_clean(acv);
+}
+
+/* archive (fr_copy) */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_direction = GREF_FW_RV,
+		.copy_mode = GREF_COPY,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	/* append */
+	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
+	gref_append_segment(pool, _str("sec1"), _seq("M"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+
+	/* build index */
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	assert(acv != NULL, "acv(%p)", acv);
+
+	assert(acv->type == GREF_ACV, "%d", acv->type);
+	assert(acv->link_table != NULL, "%p", acv->link_table);
+
+	/* section count */
+	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+
+	/* total len */
+	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+
+	/* get lim */
+	assert(gref_get_lim(acv) == lmm_kv_ptr(acv->seq) + 2 * acv->seq_len + 32, "lim(%p)", gref_get_lim(acv));
+
+	/* check bases at the head of the sections */
+	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
+	assert(gref_get_section(acv, 1)->base[0] == 0x08, "%x", gref_get_section(acv, 1)->base[0]);
+	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
+	assert(gref_get_section(acv, 3)->base[0] == 0x0c, "%x", gref_get_section(acv, 3)->base[0]);
+	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
+	assert(gref_get_section(acv, 5)->base[0] == 0x01, "%x", gref_get_section(acv, 5)->base[0]);
+
+	gref_clean(acv);
+}
+
+/* archive (fr_nocopy) */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_direction = GREF_FW_RV,
+		.seq_format = GREF_4BIT,
+		.copy_mode = GREF_NOCOPY,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	/* append */
+	#define _seqrv(x)		(uint8_t const *)(x), strlen(x)/2
+
+	gref_append_segment(pool, _str("sec0"), _seqrv("\x04\x04\x05\x01\x08\x0a\x02\x02"));
+	gref_append_segment(pool, _str("sec1"), _seqrv("\x03\x0c"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	gref_append_segment(pool, _str("sec2"), _seqrv("\x01\x03\x07\x07\x04\x08\x04\x08\x01\x02\x01\x02\x0e\x0e\x0c\x08"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+
+	#undef _seqrv
+
+	/* build index */
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	assert(acv != NULL, "acv(%p)", acv);
+
+	assert(acv->type == GREF_ACV, "%d", acv->type);
+	assert(acv->link_table != NULL, "%p", acv->link_table);
+
+	/* section count */
+	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+
+	/* total len */
+	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+
+	/* get lim */
+	assert(gref_get_lim(acv) == GREF_SEQ_LIM, "lim(%p)", gref_get_lim(acv));
+
+	/* check bases at the head of the sections */
+	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
+	assert(gref_get_section(acv, 1)->base[0] == 0x08, "%x", gref_get_section(acv, 1)->base[0]);
+	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
+	assert(gref_get_section(acv, 3)->base[0] == 0x0c, "%x", gref_get_section(acv, 3)->base[0]);
+	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
+	assert(gref_get_section(acv, 5)->base[0] == 0x01, "%x", gref_get_section(acv, 5)->base[0]);
+
+	gref_clean(acv);
+}
+
+/* archive (fr_copy / large sequence) */
+unittest()
+{
+	int64_t const len = 100000;
+	int64_t const cnt = 1000;
+
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_direction = GREF_FW_RV,
+		.seq_format = GREF_4BIT,
+		.copy_mode = GREF_COPY,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	/* dump */
+	for(int64_t i = 0; i < cnt; i++) {
+
+		/* name */
+		char buf[1024];
+		sprintf(buf, "seq%" PRId64 "", i);
+
+		/* seq */
+		char *seq = unittest_generate_random_sequence(len);
+
+		/* append */
+		gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
+		free(seq);
+	}
+
+	/* freeze */
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	assert(acv != NULL, "acv(%p)", acv);
+
+	assert(acv->type == GREF_ACV, "%d", acv->type);
+	assert(acv->link_table != NULL, "%p", acv->link_table);
+
+	/* section count */
+	assert(gref_get_section_count(acv) == cnt, "%lld", gref_get_section_count(acv));
+
+	/* total len */
+	assert(gref_get_total_len(acv) == cnt * len, "len(%lld)", gref_get_total_len(acv));
+
+	gref_clean(acv);
+}
+
+
+/* seed iteration */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32,
+		.seq_direction = GREF_FW_ONLY));
+	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
+	gref_append_segment(pool, _str("sec1"), _seq("M"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+	
+	/* build archive */
+	gref_acv_t *acv = gref_freeze_pool(pool);
+
+	/* create iterator */
+	gref_iter_t *iter = gref_iter_init(acv, NULL);
+	assert(iter != NULL, "%p", iter);
+
+	/* enumerate */
+	#define _f(_i)					gref_iter_next(_i)
+	#define _check_kmer(_t, _k, _id, _pos) ( \
+		   (_t).kmer == _pack(_k) \
+		&& (_t).gid_pos.gid == _encode_id(_id, 0) \
+		&& (_t).gid_pos.pos == (_pos) \
+	)
+	#define _print_kmer(_t) \
+		"kmer(%llx), sec(%u), pos(%u)", \
+		(_t).kmer, _decode_id((_t).gid_pos.gid), (_t).gid_pos.pos
+
+	struct gref_kmer_tuple_s t;
+
+	/* sec0 */
+	t = _f(iter); assert(_check_kmer(t, "GGAA", 0, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GGGA", 0, 0), _print_kmer(t));
+
+	/* sec0-sec1 */
+	t = _f(iter); assert(_check_kmer(t, "GAAA", 0, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GGAA", 0, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GAAC", 0, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GGAC", 0, 1), _print_kmer(t));
+
+	/* sec0-sec1-sec2 */
+	t = _f(iter); assert(_check_kmer(t, "AAAA", 0, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GAAA", 0, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "AACA", 0, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GACA", 0, 2), _print_kmer(t));
+
+	t = _f(iter); assert(_check_kmer(t, "AAAC", 0, 3), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACAC", 0, 3), _print_kmer(t));
+
+	/* sec0-sec2 */
+	t = _f(iter); assert(_check_kmer(t, "GAAA", 0, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GGAA", 0, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "AAAC", 0, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GAAC", 0, 2), _print_kmer(t));
+
+	t = _f(iter); assert(_check_kmer(t, "AACA", 0, 3), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "AACC", 0, 3), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "AACG", 0, 3), _print_kmer(t));
+
+	/* sec1-sec2 */
+	t = _f(iter); assert(_check_kmer(t, "AACA", 1, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CACA", 1, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "AACC", 1, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CACC", 1, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "AACG", 1, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CACG", 1, 0), _print_kmer(t));
+
+	/* sec2 */
+	t = _f(iter); assert(_check_kmer(t, "ACAA", 2, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACCA", 2, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACGA", 2, 0), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "ACAC", 2, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACCC", 2, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACGC", 2, 0), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "ACAG", 2, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACCG", 2, 0), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "ACGG", 2, 0), _print_kmer(t));
+
+	t = _f(iter); assert(_check_kmer(t, "CAAG", 2, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CCAG", 2, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CGAG", 2, 1), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "CACG", 2, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CCCG", 2, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CGCG", 2, 1), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "CAGG", 2, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CCGG", 2, 1), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CGGG", 2, 1), _print_kmer(t));
+
+	t = _f(iter); assert(_check_kmer(t, "AAGT", 2, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CAGT", 2, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GAGT", 2, 2), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "ACGT", 2, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CCGT", 2, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GCGT", 2, 2), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "AGGT", 2, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CGGT", 2, 2), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GGGT", 2, 2), _print_kmer(t));
+	
+	t = _f(iter); assert(_check_kmer(t, "AGTG", 2, 3), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "CGTG", 2, 3), _print_kmer(t));
+	t = _f(iter); assert(_check_kmer(t, "GGTG", 2, 3), _print_kmer(t));
+
+	t = _f(iter); assert(_check_kmer(t, "GTGT", 2, 4), _print_kmer(t));
+
+	t = _f(iter); assert(t.kmer == GREF_ITER_KMER_TERM, "%llx, %llx", t.kmer, GREF_ITER_KMER_TERM);
+	assert(t.gid_pos.gid == (uint32_t)-1, "gid(%u)", t.gid_pos.gid);
+
+	#undef _f
+	#undef _check_kmer
+	#undef _print_kmer
+
+	gref_iter_clean(iter);
+	gref_clean(acv);
+}
+
+/* build index */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = 4,
+		.seq_head_margin = 32,
+		.seq_tail_margin = 32));
+
+	/* append */
+	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
+	gref_append_segment(pool, _str("sec1"), _seq("MGGG"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
+	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
+	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+
+	/* build index */	
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	assert(acv != NULL, "acv(%p)", acv);
+
+	gref_idx_t *idx = gref_build_index(pool);
+	assert(idx != NULL, "idx(%p)", idx);
+
+	/* section count */
+	assert(gref_get_section_count(idx) == 3, "%lld", gref_get_section_count(idx));
+
+	/* total len */
+	assert(gref_get_total_len(idx) == 16, "len(%lld)", gref_get_total_len(idx));
+
+	gref_clean(idx);
+}
+
+/* build index with multiple threads */
+unittest()
+{
+	int64_t const len = 1000;
+	int64_t const cnt = 20;
+
+	gref_idx_t *idx[2] = { NULL, NULL };
+	for(int64_t j = 0; j < 2; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_format = GREF_4BIT,
+			.num_threads = (j == 0) ? 1 : 4));
+
+		for(int64_t i = 0; i < cnt; i++) {
+			char buf[1024];
+			sprintf(buf, "seq%" PRId64 "", i);
+
+			char *seq = unittest_generate_random_sequence(len);
+			gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
+			free(seq);
+
+			if(i > 0) {
+				char prev[1024];
+				sprintf(prev, "seq%" PRId64 "", i - 1);
+				gref_append_link(pool, prev, strlen(prev), 0, buf, strlen(buf), 0);
+			}
+		}
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL, "idx(%p)", idx[j]);
+	}
+
+	/* must be identical to the single-threaded result */
+	assert(idx[0]->kmer_table_size == idx[1]->kmer_table_size, "%lld, %lld",
+		idx[0]->kmer_table_size, idx[1]->kmer_table_size);
+	assert(memcmp(idx[0]->kmer_idx_table, idx[1]->kmer_idx_table,
+		sizeof(int64_t) * ((0x01<<(2 * 8)) + 1)) == 0);
+	assert(memcmp(idx[0]->kmer_table, idx[1]->kmer_table,
+		sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0);
+
+	gref_clean(idx[0]);
+	gref_clean(idx[1]);
+}
+
+/* build index with two-pass counting sort */
+unittest()
+{
+	int64_t const len = 1000;
+	int64_t const cnt = 20;
+
+	gref_idx_t *idx[3] = { NULL, NULL, NULL };
+	for(int64_t j = 0; j < 3; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_format = GREF_4BIT,
+			.build_mode = (j == 0) ? GREF_BUILD_SORT : GREF_BUILD_COUNT,
+			.num_threads = (j == 2) ? 4 : 1));
+
+		for(int64_t i = 0; i < cnt; i++) {
+			char buf[1024];
+			sprintf(buf, "seq%" PRId64 "", i);
+
+			char *seq = unittest_generate_random_sequence(len);
+			gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
+			free(seq);
+
+			if(i > 0) {
+				char prev[1024];
+				sprintf(prev, "seq%" PRId64 "", i - 1);
+				gref_append_link(pool, prev, strlen(prev), 0, buf, strlen(buf), 0);
+			}
+		}
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL, "idx(%p)", idx[j]);
+	}
+
+	/* single-threaded counting sort keeps the iteration order */
+	assert(idx[0]->kmer_table_size == idx[1]->kmer_table_size, "%lld, %lld",
+		idx[0]->kmer_table_size, idx[1]->kmer_table_size);
+	assert(memcmp(idx[0]->kmer_idx_table, idx[1]->kmer_idx_table,
+		sizeof(int64_t) * ((0x01<<(2 * 8)) + 1)) == 0);
+	assert(memcmp(idx[0]->kmer_table, idx[1]->kmer_table,
+		sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0);
+
+	/* multithreaded: bucket boundaries are the same, the order in a bucket may differ */
+	assert(memcmp(idx[0]->kmer_idx_table, idx[2]->kmer_idx_table,
+		sizeof(int64_t) * ((0x01<<(2 * 8)) + 1)) == 0);
+	uint64_t sum[2] = { 0, 0 };
+	for(int64_t i = 0; i < idx[0]->kmer_table_size; i++) {
+		sum[0] += idx[0]->kmer_table[i].gid * 0x10001 + idx[0]->kmer_table[i].pos;
+		sum[1] += idx[2]->kmer_table[i].gid * 0x10001 + idx[2]->kmer_table[i].pos;
+	}
+	assert(sum[0] == sum[1], "%llu, %llu", sum[0], sum[1]);
+
+	/* match */
+	struct gref_match_res_s r = gref_match(idx[2], (uint8_t const *)"ACGTACGT");
+	assert(r.len == gref_match(idx[0], (uint8_t const *)"ACGTACGT").len, "%lld", r.len);
+
+	gref_clean(idx[0]);
+	gref_clean(idx[1]);
+	gref_clean(idx[2]);
+}
+
+/* canonical kmer index */
+unittest()
+{
+	int64_t const len = 1000;
+	int64_t const cnt = 20;
+
+	/* both strands, canonical from sorted array, canonical from counting sort */
+	gref_idx_t *idx[3] = { NULL, NULL, NULL };
+	for(int64_t j = 0; j < 3; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_format = GREF_4BIT,
+			.build_mode = (j == 2) ? GREF_BUILD_COUNT : GREF_BUILD_SORT,
+			.kmer_strand = (j == 0) ? GREF_KMER_BOTH : GREF_KMER_CANONICAL));
+
+		for(int64_t i = 0; i < cnt; i++) {
+			char buf[1024];
+			sprintf(buf, "seq%" PRId64 "", i);
+
+			char *seq = unittest_generate_random_sequence(len);
+			gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
+			free(seq);
+
+			if(i > 0) {
+				char prev[1024];
+				sprintf(prev, "seq%" PRId64 "", i - 1);
+				gref_append_link(pool, prev, strlen(prev), 0, buf, strlen(buf), i & 0x01);
+			}
+		}
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL, "idx(%p)", idx[j]);
+	}
+	assert(gref_init_pool(GREF_PARAMS(.kmer_strand = GREF_KMER_CANONICAL, .step_size = 2)) == NULL);
+
+	/* each bucket of the canonical index is that of the canonical kmer in the stranded one */
+	int64_t total = 0, mismatch = 0;
+	for(uint64_t kmer = 0; kmer < 0x01ULL<<(2 * 8); kmer++) {
+		uint64_t rc = gref_revcomp_kmer(kmer, 8);
+		struct gref_match_res_s e = gref_match_2bitpacked(idx[0], MIN2(kmer, rc));
+		total += (kmer <= rc) ? e.len : 0;
+
+		for(int64_t j = 1; j < 3; j++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[j], kmer);
+			uint64_t sum[2] = { 0, 0 };
+			for(int64_t i = 0; i < MIN2(r.len, e.len); i++) {
+				struct gref_gid_pos_s const p = gref_match_get(idx[j], &r, i), q = gref_match_get(idx[0], &e, i);
+				sum[0] += p.gid * 0x10001 + p.pos;
+				sum[1] += q.gid * 0x10001 + q.pos;
+			}
+			mismatch += (r.len != e.len || r.rv != (rc < kmer) || sum[0] != sum[1]);
+		}
+	}
+	assert(mismatch == 0, "%lld", mismatch);
+	assert(idx[1]->kmer_table_size == total, "%lld, %lld", idx[1]->kmer_table_size, total);
+	assert(idx[2]->kmer_table_size == total, "%lld, %lld", idx[2]->kmer_table_size, total);
+	assert(2 * total < idx[0]->kmer_table_size + idx[0]->kmer_table_size / 50,
+		"%lld, %lld", total, idx[0]->kmer_table_size);
+
+	/* batch and ascii queries are canonicalized as well */
+	uint64_t q[2] = { _pack("ACGTTGCA"), _pack("TTTTGGGG") };
+	struct gref_match_res_s b[2];
+	gref_match_batch(idx[1], q, 2, b);
+	struct gref_match_res_s a = gref_match(idx[1], (uint8_t const *)"TTTTGGGG");
+	assert(b[0].rv == 0 && b[1].rv == 1 && a.rv == 1, "%u, %u, %u", b[0].rv, b[1].rv, a.rv);
+	assert(a.len == b[1].len && a.gid_pos_arr == b[1].gid_pos_arr);
+
+	gref_clean(idx[0]);
+	gref_clean(idx[1]);
+	gref_clean(idx[2]);
+}
+
+/* compact kmer index */
+unittest()
+{
+	int64_t const len = 1000;
+	int64_t const cnt = 20;
+
+	/* dense, compact from sorted array, from counting sort (single and multithreaded), and from partitions */
+	gref_idx_t *idx[5] = { NULL, NULL, NULL, NULL, NULL };
+	for(int64_t j = 0; j < 5; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_format = GREF_4BIT,
+			.build_mode = (j == 4) ? GREF_BUILD_PARTITION : ((j >= 2) ? GREF_BUILD_COUNT : GREF_BUILD_SORT),
+			.kmer_idx_type = (j == 0) ? GREF_KMER_IDX_DENSE : GREF_KMER_IDX_COMPACT,
+			.num_threads = (j == 3) ? 4 : 1,
+			.build_mem_kb = 4));
+
+		for(int64_t i = 0; i < cnt; i++) {
+			char buf[1024];
+			sprintf(buf, "seq%" PRId64 "", i);
+
+			char *seq = unittest_generate_random_sequence(len);
+			gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
+			free(seq);
+		}
+
+		/* long homopolymer run to make a superblock spill over 16 bits */
+		char *poly = (char *)malloc(70001);
+		memset(poly, 0x01, 70000); poly[70000] = '\0';		/* 4bit 'A' */
+		gref_append_segment(pool, _str("poly"), (uint8_t const *)poly, 70000);
+		free(poly);
+
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL, "idx(%p)", idx[j]);
+	}
+	assert(idx[0]->kmer_idx_table != NULL && idx[0]->kmer_sb_table == NULL);
+	assert(idx[1]->kmer_idx_table == NULL && idx[1]->kmer_sb_table != NULL);
+	assert(idx[1]->kmer_esc_size > 0, "%lld", idx[1]->kmer_esc_size);
+
+	/* the count and partition builds have no dense table, and the saturated counter of the homopolymer is completed */
+	for(int64_t j = 2; j < 5; j++) {
+		assert(idx[j]->kmer_idx_table == NULL && idx[j]->kmer_esc_size == idx[1]->kmer_esc_size, "j(%lld)", j);
+	}
+
+	/* bucket boundaries must be the same for all kmers */
+	for(int64_t j = 1; j < 5; j++) {
+		int64_t mismatch = 0;
+		for(uint64_t kmer = 0; kmer < (0x01ULL<<(2 * 8)); kmer++) {
+			struct gref_bucket_s b = gref_get_bucket(idx[0], kmer);
+			struct gref_bucket_s c = gref_get_bucket(idx[j], kmer);
+			mismatch += (b.base != c.base || b.tail != c.tail);
+		}
+		assert(mismatch == 0, "j(%lld), mismatch(%lld)", j, mismatch);
+		assert(idx[j]->kmer_table_size == idx[0]->kmer_table_size);
+		assert(memcmp(idx[0]->kmer_table, idx[j]->kmer_table,
+			sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0, "j(%lld)", j);
+	}
+
+	/* match */
+	struct gref_match_res_s r = gref_match(idx[1], (uint8_t const *)"AAAAAAAA");
+	assert(r.len == gref_match(idx[0], (uint8_t const *)"AAAAAAAA").len, "%lld", r.len);
+	assert(r.len >= 70000 - 8 + 1, "%lld", r.len);
+
+	for(int64_t j = 0; j < 5; j++) { gref_clean(idx[j]); }
+}
+
+/* iterator with k > 16 */
+unittest()
+{
+	int64_t const k = 24;
+	int64_t const len = 200;
+
+	srand(0);
+	char *seq = unittest_generate_random_sequence(len);
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+		.k = k,
+		.seq_format = GREF_4BIT));
+	gref_append_segment(pool, _str("sec0"), (uint8_t const *)seq, len);
+	gref_acv_t *acv = gref_freeze_pool(pool);
+
+	gref_iter_t *iter = gref_iter_init(acv, NULL);
+	assert(iter != NULL, "%p", iter);
+
+	/* forward strand */
+	for(int64_t i = 0; i < len - k + 1; i++) {
+		struct gref_kmer_tuple_s t = gref_iter_next(iter);
+		char buf[32] = { 0 };
+		for(int64_t j = 0; j < k; j++) {
+			buf[j] = "-AC-G---T"[(uint8_t)seq[i + j]];
+		}
+		assert(t.kmer == _pack(buf), "i(%lld), kmer(%llx), %llx", i, t.kmer, _pack(buf));
+		assert(t.gid_pos.gid == _encode_id(0, 0) && t.gid_pos.pos == i,
+			"gid(%u), pos(%u)", t.gid_pos.gid, t.gid_pos.pos);
+	}
+
+	gref_iter_clean(iter);
+	gref_clean(acv);
+	free(seq);
+}
+
+/* 2bit storage */
+unittest()
+{
+	char const *path = "test_gref_2bit_storage.gref";
+	int64_t const len = 1000;
+	int64_t const cnt = 10;
+
+	/* 4bit and 2bit storage of the same graph, ambiguous bases and N runs included */
+	gref_idx_t *idx[2];
+	for(int64_t j = 0; j < 2; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_direction = GREF_FW_RV,
+			.seq_storage = (j == 0) ? GREF_STORAGE_4BIT : GREF_STORAGE_2BIT));
+
+		for(int64_t i = 0; i < cnt; i++) {
+			char name[1024], seq[len + 1];
+			sprintf(name, "seq%" PRId64 "", i);
+			for(int64_t p = 0; p < len; p++) {
+				seq[p] = (p >= 300 && p < 500) ? 'N' : "ACGTACGTACGTACGTACGTRNYM"[rand() % 24];
+			}
+			seq[len] = '\0';
+			gref_append_segment(pool, name, strlen(name), (uint8_t const *)seq, len);
+
+			if(i > 0) {
+				char prev[1024];
+				sprintf(prev, "seq%" PRId64 "", i - 1);
+				gref_append_link(pool, prev, strlen(prev), 0, name, strlen(name), i & 0x01);
+			}
+		}
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL, "idx(%p)", idx[j]);
+	}
+	assert(gref_get_packed_seq(idx[0]).seq == NULL);
+	assert(gref_get_packed_seq(idx[1]).seq != NULL && lmm_kv_ptr(idx[1]->seq) == NULL);
+	assert(gref_get_packed_seq(idx[1]).len == len * cnt);
+	assert(gref_init_pool(GREF_PARAMS(.seq_storage = GREF_STORAGE_2BIT, .copy_mode = GREF_NOCOPY)) == NULL);
+
+	/* sections and kmers */
+	uint8_t a[len], b[len];
+	int64_t mismatch = 0;
+	for(int64_t i = 0; i < 2 * cnt; i++) {
+		assert(gref_decode_section(idx[0], i, a) == len);
+		assert(gref_decode_section(idx[1], i, b) == len);
+		mismatch += memcmp(a, b, len) != 0;
+	}
+	assert(mismatch == 0, "%lld", mismatch);
+	assert(memcmp(a, gref_get_section(idx[0], 2 * cnt - 1)->base, len) == 0);
+	assert(idx[0]->kmer_table_size == idx[1]->kmer_table_size, "%lld, %lld",
+		idx[0]->kmer_table_size, idx[1]->kmer_table_size);
+	assert(memcmp(idx[0]->kmer_table, idx[1]->kmer_table,
+		sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0);
+
+	/* dump and load */
+	zf_t *fp = zfopen(path, "w");
+	assert(gref_dump_index(idx[1], fp) == 0);
+	zfclose(fp);
+	gref_idx_t *ld = gref_load_index_mmap(path);
+	assert(ld != NULL && gref_get_packed_seq(ld).seq != NULL);
+	for(int64_t i = 0; i < 2 * cnt; i++) {
+		gref_decode_section(idx[0], i, a);
+		gref_decode_section(ld, i, b);
+		mismatch += memcmp(a, b, len) != 0;
+	}
+	assert(mismatch == 0, "%lld", mismatch);
+	gref_clean(ld);
+	remove(path);
+
+	/* melt, append, and freeze again */
+	for(int64_t j = 0; j < 2; j++) {
+		gref_pool_t *pool = gref_melt_archive(gref_disable_index(idx[j]));
+		assert(pool != NULL);
+		gref_append_segment(pool, _str("tail"), _seq("ACGTNNNNRACGTACGTT"));
+		gref_append_link(pool, _str("seq0"), 0, _str("tail"), 0);
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL);
+	}
+	for(int64_t i = 0; i < 2 * (cnt + 1); i++) {
+		int64_t l = gref_decode_section(idx[0], i, a);
+		assert(gref_decode_section(idx[1], i, b) == l);
+		mismatch += memcmp(a, b, l) != 0;
+	}
+	assert(mismatch == 0, "%lld", mismatch);
+	assert(idx[0]->kmer_table_size == idx[1]->kmer_table_size);
+	assert(memcmp(idx[0]->kmer_table, idx[1]->kmer_table,
+		sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0);
+
+	gref_clean(idx[0]);
+	gref_clean(idx[1]);
+}
+
+/* dump and load index */
+unittest()
+{
+	char const *path = "test_gref_dump_index.gref";
+	int64_t const len = 1000;
+	int64_t const cnt = 10;
+
+	for(int64_t j = 0; j < 4; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_format = GREF_4BIT,
+			.seq_direction = (j & 0x01) ? GREF_FW_RV : GREF_FW_ONLY,
+			.kmer_idx_type = (j & 0x02) ? GREF_KMER_IDX_COMPACT : GREF_KMER_IDX_DENSE,
+			.seq_head_margin = 32,
+			.seq_tail_margin = 32));
+
+		for(int64_t i = 0; i < cnt; i++) {
+			char buf[1024];
+			sprintf(buf, "seq%" PRId64 "", i);
+
+			char *seq = unittest_generate_random_sequence(len);
+			gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
+			free(seq);
+
+			if(i > 0) {
+				char prev[1024];
+				sprintf(prev, "seq%" PRId64 "", i - 1);
+				gref_append_link(pool, prev, strlen(prev), 0, buf, strlen(buf), 0);
+			}
+		}
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL, "idx(%p)", idx);
+
+		/* dump */
+		zf_t *fp = zfopen(path, "w");
+		assert(gref_dump_index(idx, fp) == 0);
+		zfclose(fp);
+
+		/* load with zf and mmap */
+		fp = zfopen(path, "r");
+		gref_idx_t *ld[2] = { gref_load_index(fp), gref_load_index_mmap(path) };
+		zfclose(fp);
+
+		for(int64_t k = 0; k < 2; k++) {
+			assert(ld[k] != NULL, "j(%lld), k(%lld)", j, k);
+			assert(gref_get_section_count(ld[k]) == cnt, "%lld", gref_get_section_count(ld[k]));
+			assert(gref_get_total_len(ld[k]) == len * cnt, "%lld", gref_get_total_len(ld[k]));
+
+			/* sections, names, and links */
+			for(int64_t i = 0; i < 2 * cnt; i++) {
+				struct gref_section_s const *a = gref_get_section(idx, i);
+				struct gref_section_s const *b = gref_get_section(ld[k], i);
+				assert(a->gid == b->gid && a->len == b->len, "gid(%u, %u), len(%u, %u)", a->gid, b->gid, a->len, b->len);
+
+				struct gref_str_s na = gref_get_name(idx, i), nb = gref_get_name(ld[k], i);
+				assert(na.len == nb.len && memcmp(na.str, nb.str, na.len) == 0);
+
+				struct gref_link_s la = gref_get_link(idx, i), lb = gref_get_link(ld[k], i);
+				assert(la.len == lb.len && memcmp(la.gid_arr, lb.gid_arr, sizeof(uint32_t) * la.len) == 0);
+			}
+
+			/* kmer table and match */
+			assert(idx->kmer_table_size == ld[k]->kmer_table_size);
+			assert(memcmp(idx->kmer_table, ld[k]->kmer_table,
+				sizeof(struct gref_gid_pos_s) * idx->kmer_table_size) == 0);
+			struct gref_match_res_s ra = gref_match(idx, (uint8_t const *)"ACGTACGT");
+			struct gref_match_res_s rb = gref_match(ld[k], (uint8_t const *)"ACGTACGT");
+			assert(ra.len == rb.len && unittest_match_cmp(idx, &ra, ld[k], &rb, ra.len) == 0, "%lld, %lld", ra.len, rb.len);
+
+			/* iterator reads the loaded sequence */
+			gref_iter_t *ia = gref_iter_init(idx, NULL);
+			gref_iter_t *ib = gref_iter_init(ld[k], NULL);
+			int64_t mismatch = 0;
+			struct gref_kmer_tuple_s ta, tb;
+			do {
+				ta = gref_iter_next(ia);
+				tb = gref_iter_next(ib);
+				mismatch += (ta.kmer != tb.kmer
+					|| ta.gid_pos.gid != tb.gid_pos.gid
+					|| ta.gid_pos.pos != tb.gid_pos.pos);
+			} while(ta.gid_pos.gid != (uint32_t)-1 && tb.gid_pos.gid != (uint32_t)-1);
+			assert(mismatch == 0, "j(%lld), k(%lld), mismatch(%lld)", j, k, mismatch);
+			gref_iter_clean(ia);
+			gref_iter_clean(ib);
+		}
+
+		/* mapped object can be converted back to a pool */
+		gref_pool_t *melted = gref_melt_archive(gref_disable_index(ld[1]));
+		assert(melted != NULL);
+		assert(gref_append_segment(melted, _str("seqx"), (uint8_t const *)"\x01\x02\x04\x08", 4) == 0);
+		gref_clean(melted);
+
+		gref_clean(ld[0]);
+		gref_clean(idx);
+	}
+	remove(path);
+
+	/* broken file */
+	zf_t *fp = zfopen(path, "w");
+	zfwrite(fp, (void *)"GREFIDX", 8);
+	zfclose(fp);
+	assert(gref_load_index_mmap(path) == NULL);
+	fp = zfopen(path, "r");
+	assert(gref_load_index(fp) == NULL);
+	zfclose(fp);
+	remove(path);
+}
+
+/* batched match */
+unittest()
+{
+	int64_t const cnt = 100;		/* not a multiple of GREF_MATCH_BATCH_SIZE */
+
+	for(int64_t j = 0; j < 2; j++) {
+		srand(0);
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.seq_format = GREF_4BIT,
+			.kmer_idx_type = (j == 0) ? GREF_KMER_IDX_DENSE : GREF_KMER_IDX_COMPACT));
+		char *seq = unittest_generate_random_sequence(10000);
+		gref_append_segment(pool, _str("sec0"), (uint8_t const *)seq, strlen(seq));
+		free(seq);
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL, "idx(%p)", idx);
+
+		uint64_t kmer[cnt];
+		struct gref_match_res_s res[cnt];
+		for(int64_t i = 0; i < cnt; i++) {
+			kmer[i] = ((uint64_t)rand()<<32) ^ rand();	/* upper bits are masked */
+		}
+		assert(gref_match_batch(idx, kmer, cnt, res) == cnt);
+		for(int64_t i = 0; i < cnt; i++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx, kmer[i]);
+			assert(r.gid_pos_arr == res[i].gid_pos_arr && r.len == res[i].len,
+				"i(%lld), (%p, %lld), (%p, %lld)", i, r.gid_pos_arr, r.len, res[i].gid_pos_arr, res[i].len);
+		}
+		gref_clean(idx);
+	}
+}
+
+/* streaming matcher */
+unittest()
+{
+	int64_t const k = 8;
+	char const *query = "ACGTTGCANACGTACGGTACGTRCGTAGCTAGCTTTTTTTTTGACGAGT";
+	int64_t const len = strlen(query);
+
+	srand(0);
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = k, .seq_format = GREF_4BIT));
+	char *seq = unittest_generate_random_sequence(10000);
+	gref_append_segment(pool, _str("sec0"), (uint8_t const *)seq, strlen(seq));
+	free(seq);
+	gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+	assert(idx != NULL, "idx(%p)", idx);
+
+	/* revcomp of the query */
+	char rquery[256] = { 0 };
+	for(int64_t i = 0; i < len; i++) {
+		char c = query[len - 1 - i];
+		rquery[i] = (c == 'A') ? 'T' : (c == 'C') ? 'G' : (c == 'G') ? 'C' : (c == 'T') ? 'A' : 'N';
+	}
 
-	ret = gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
-	assert(ret == 0, "ret(%d)", ret);
+	for(int64_t step = 1; step < 4; step++) {
+		gref_match_stream_t *stream = gref_match_stream_init(idx, (uint8_t const *)query, len,
+			GREF_MATCH_STREAM_PARAMS( .step_size = step, .seq_direction = GREF_FW_RV ));
+		assert(stream != NULL);
 
-	/* section count */
-	assert(gref_get_section_count(pool) == 3, "%lld", gref_get_section_count(pool));
+		/* compare with gref_match at every valid window */
+		for(int64_t i = 0; i < len - k + 1; i++) {
+			int64_t amb = 0;
+			for(int64_t j = 0; j < k; j++) { amb += (query[i + j] == 'N' || query[i + j] == 'R'); }
+			if(amb != 0 || i % step != 0) { continue; }
 
-	/* total len */
-	assert(gref_get_total_len(pool) == 12, "len(%lld)", gref_get_total_len(pool));
+			struct gref_match_res_s fw = gref_match(idx, (uint8_t const *)&query[i]);
+			struct gref_match_res_s rv = gref_match(idx, (uint8_t const *)&rquery[len - k - i]);
+			struct gref_match_stream_res_s r;
 
-	gref_clean(pool);
+			r = gref_match_stream_next(stream);
+			assert(r.pos == i && r.dir == GREF_FW, "i(%lld), pos(%lld), dir(%u)", i, r.pos, r.dir);
+			assert(r.res.gid_pos_arr == fw.gid_pos_arr && r.res.len == fw.len, "i(%lld)", i);
+
+			r = gref_match_stream_next(stream);
+			assert(r.pos == i && r.dir == GREF_RV, "i(%lld), pos(%lld), dir(%u)", i, r.pos, r.dir);
+			assert(r.res.gid_pos_arr == rv.gid_pos_arr && r.res.len == rv.len, "i(%lld)", i);
+		}
+		assert(gref_match_stream_next(stream).pos == -1);
+		gref_match_stream_clean(stream);
+	}
+	gref_clean(idx);
 }
 
-/* archive (fw_copy) */
+/* batch iterator */
 unittest()
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_direction = GREF_FW_ONLY,
-		.copy_mode = GREF_COPY,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
-
-	/* append */
-	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
-	gref_append_segment(pool, _str("sec1"), _seq("M"));
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 4));
+	gref_append_segment(pool, _str("sec0"), _seq("GGRAACGTNNACGTMMACGTACGT"));
+	gref_append_segment(pool, _str("sec1"), _seq("MGGG"));
 	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
 	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
 	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
 	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
-
-	/* build index */
 	gref_acv_t *acv = gref_freeze_pool(pool);
-	assert(acv != NULL, "acv(%p)", acv);
 
-	assert(acv->type == GREF_ACV, "%d", acv->type);
-	assert(acv->link_table != NULL, "%p", acv->link_table);
+	int64_t const caps[] = { 1, 3, 7, 1024 };
+	for(int64_t c = 0; c < sizeof(caps) / sizeof(int64_t); c++) {
+		gref_iter_t *iter = gref_iter_init(acv, GREF_ITER_PARAMS(.seq_direction = GREF_FW_RV));
+		gref_iter_t *batch = gref_iter_init(acv, GREF_ITER_PARAMS(.seq_direction = GREF_FW_RV));
+
+		struct gref_kmer_tuple_s buf[1024];
+		int64_t total = 0, cnt, mismatch = 0;
+		while((cnt = gref_iter_next_batch(batch, buf, caps[c])) > 0) {
+			assert(cnt <= caps[c], "%lld", cnt);
+			for(int64_t i = 0; i < cnt; i++) {
+				struct gref_kmer_tuple_s t = gref_iter_next(iter);
+				mismatch += (t.kmer != buf[i].kmer
+					|| t.gid_pos.gid != buf[i].gid_pos.gid
+					|| t.gid_pos.pos != buf[i].gid_pos.pos);
+			}
+			total += cnt;
+		}
+		assert(mismatch == 0, "cap(%lld), mismatch(%lld)", caps[c], mismatch);
+		assert(total > 0 && gref_iter_next(iter).gid_pos.gid == (uint32_t)-1, "total(%lld)", total);
+		assert(gref_iter_next_batch(batch, buf, caps[c]) == 0);
 
-	/* section count */
-	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+		gref_iter_clean(iter);
+		gref_iter_clean(batch);
+	}
+	gref_clean(acv);
+}
 
-	/* total len */
-	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+/* N runs are skipped and kmers after them are enumerated */
+unittest()
+{
+	int64_t const k = 8, flen = 37, nlen = 1000, tlen = 45;
+	char *seq = (char *)malloc(flen + nlen + tlen + 1);
+	char *rv = (char *)malloc(flen + nlen + tlen + 1);
+	char const *acgt = "ACGT";
+	for(int64_t i = 0; i < flen + nlen + tlen; i++) {
+		seq[i] = (i >= flen && i < flen + nlen) ? 'N' : acgt[(i * 7 + i / 3) & 0x03];
+	}
+	seq[flen + nlen + tlen] = '\0';
+	for(int64_t i = 0; i < flen + nlen + tlen; i++) {
+		char c = seq[flen + nlen + tlen - 1 - i];
+		rv[i] = (c == 'N') ? 'N' : acgt[3 - (strchr(acgt, c) - acgt)];
+	}
 
-	/* get lim */
-	assert(gref_get_lim(acv) == GREF_SEQ_LIM, "lim(%p)", gref_get_lim(acv));
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = k));
+	gref_append_segment(pool, _str("sec0"), _seq(seq));
+	gref_acv_t *acv = gref_freeze_pool(pool);
+	gref_iter_t *iter = gref_iter_init(acv, GREF_ITER_PARAMS(.seq_direction = GREF_FW_RV));
+
+	/* compare with the windows of the raw sequence */
+	int64_t cnt = 0, mismatch = 0;
+	for(int64_t d = 0; d < 2; d++) {
+		char const *s = (d == 0) ? seq : rv;
+		for(int64_t p = 0; p + k <= flen + nlen + tlen; p++) {
+			uint64_t kmer = 0;
+			int64_t valid = 1;
+			for(int64_t i = 0; i < k; i++) {
+				valid &= s[p + i] != 'N';
+				kmer |= (valid ? (uint64_t)(strchr(acgt, s[p + i]) - acgt) : 0)<<(2 * i);
+			}
+			if(!valid) { continue; }
 
-	/* check bases at the head of the sections */
-	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
-	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
-	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
+			struct gref_kmer_tuple_s t = gref_iter_next(iter);
+			mismatch += (t.kmer != kmer || t.gid_pos.gid != d || t.gid_pos.pos != p);
+			cnt++;
+		}
+	}
+	assert(cnt == 2 * (flen + tlen - 2 * (k - 1)), "%lld", cnt);
+	assert(mismatch == 0, "%lld", mismatch);
+	assert(gref_iter_next(iter).gid_pos.gid == (uint32_t)-1);
 
+	gref_iter_clean(iter);
 	gref_clean(acv);
+	free(seq);
+	free(rv);
 }
 
-/* archive (fw_nocopy) */
+/* incremental update */
 unittest()
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_direction = GREF_FW_ONLY,
-		.seq_format = GREF_4BIT,
-		.copy_mode = GREF_NOCOPY,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
+	struct gref_params_s const params[] = {
+		{ .k = 8 },
+		{ .k = 8, .seq_direction = GREF_FW_RV, .kmer_strand = GREF_KMER_CANONICAL, .kmer_idx_type = GREF_KMER_IDX_COMPACT },
+		{ .k = 7, .minimizer_window = 4, .seq_storage = GREF_STORAGE_2BIT },
+		{ .k = 6, .step_size = 3, .seq_direction = GREF_FW_RV },
+		{ .k = 6, .seq_direction = GREF_FW_RV, .kmer_idx_type = GREF_KMER_IDX_INLINE }	/* repetitive */
+	};
+	int64_t const seg_len[] = { 300, 200, 5, 150, 3, 120 };
+	int64_t const seg_cnt[] = { 3, 5, 6 };			/* segments in the base graph and after each update */
+	struct { int64_t src, src_ori, dst, dst_ori, batch; } const link[] = {
+		{ 0, 0, 1, 0, 0 }, { 1, 0, 2, 0, 0 },
+		{ 0, 0, 3, 0, 1 }, { 3, 0, 4, 0, 1 }, { 4, 1, 1, 0, 1 }, { 2, 0, 0, 1, 1 },
+		{ 5, 0, 0, 0, 2 }, { 2, 0, 3, 1, 2 }, { 4, 0, 2, 0, 2 }
+	};
 
-	/* append */
-	gref_append_segment(pool, _str("sec0"), _seq("\x04\x04\x05\x01"));
-	gref_append_segment(pool, _str("sec1"), _seq("\x03"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
-	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
-	gref_append_segment(pool, _str("sec2"), _seq("\x01\x03\x07\x07\x04\x08\x04\x08"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+	for(int64_t j = 0; j < sizeof(params) / sizeof(struct gref_params_s); j++) {
+		char seq[6][512], name[6][8];
+		srand(j);
+		for(int64_t i = 0; i < 6; i++) {
+			sprintf(name[i], "seg%" PRId64 "", i);
+			for(int64_t p = 0; p < seg_len[i]; p++) {
+				seq[i][p] = (j == 4) ? "AC"[rand() % 16 == 0]
+					: "ACGTACGTACGTACGTACGTACGTACGTRN"[rand() % 30];
+			}
+		}
+		#define _seg(_i)		name[_i], strlen(name[_i]), (uint8_t const *)seq[_i], seg_len[_i]
+		#define _link(_l)		name[(_l).src], strlen(name[(_l).src]), (_l).src_ori, name[(_l).dst], strlen(name[(_l).dst]), (_l).dst_ori
+
+		/* the base graph, then two batches of updates */
+		gref_pool_t *pool = gref_init_pool(&params[j]);
+		for(int64_t i = 0; i < seg_cnt[0]; i++) { gref_append_segment(pool, _seg(i)); }
+		for(int64_t l = 0; l < sizeof(link) / sizeof(link[0]); l++) {
+			if(link[l].batch == 0) { gref_append_link(pool, _link(link[l])); }
+		}
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL);
+		assert(gref_idx_append_segment(idx, _seg(0)) == -1);
 
-	/* build index */
-	gref_acv_t *acv = gref_freeze_pool(pool);
-	assert(acv != NULL, "acv(%p)", acv);
+		for(int64_t b = 1; b < 3; b++) {
+			for(int64_t i = seg_cnt[b - 1]; i < seg_cnt[b]; i++) {
+				assert(gref_idx_append_segment(idx, _seg(i)) == 0);
+			}
+			for(int64_t l = 0; l < sizeof(link) / sizeof(link[0]); l++) {
+				if(link[l].batch == b) { assert(gref_idx_append_link(idx, _link(link[l])) == 0); }
+			}
+			assert(gref_update_index(idx) == 0);
+		}
+		assert(gref_get_section_count(idx) == 6, "%lld", gref_get_section_count(idx));
+		assert(idx->delta != NULL);
+		assert(gref_dump_index(idx, NULL) == -1);
+
+		/* built at once */
+		pool = gref_init_pool(&params[j]);
+		for(int64_t i = 0; i < 6; i++) { gref_append_segment(pool, _seg(i)); }
+		for(int64_t l = 0; l < sizeof(link) / sizeof(link[0]); l++) { gref_append_link(pool, _link(link[l])); }
+		gref_idx_t *ref = gref_build_index(gref_freeze_pool(pool));
+		assert(ref != NULL);
+		#undef _seg
+		#undef _link
+
+		/* compare buckets as sets */
+		#define _diff(_a, _b) ({ \
+			int64_t _mismatch = 0; \
+			for(uint64_t _k = 0; _k < 0x01ULL<<(2 * params[j].k); _k++) { \
+				struct gref_match_res_s _r[2] = { gref_match_2bitpacked((_a), _k), gref_match_2bitpacked((_b), _k) }; \
+				uint64_t _e[2][2048]; \
+				if(_r[0].len != _r[1].len || _r[0].len > 2048) { _mismatch++; continue; } \
+				for(int64_t _x = 0; _x < 2; _x++) { \
+					for(int64_t _y = 0; _y < _r[_x].len; _y++) { \
+						struct gref_gid_pos_s const _p = gref_match_get((_x == 0) ? (_a) : (_b), &_r[_x], _y); \
+						uint64_t _v = ((uint64_t)_p.gid<<32) | _p.pos; \
+						int64_t _z = _y; \
+						while(_z > 0 && _e[_x][_z - 1] > _v) { _e[_x][_z] = _e[_x][_z - 1]; _z--; } \
+						_e[_x][_z] = _v; \
+					} \
+				} \
+				_mismatch += memcmp(_e[0], _e[1], sizeof(uint64_t) * _r[0].len) != 0; \
+			} \
+			_mismatch; \
+		})
+		assert(_diff(idx, ref) == 0, "j(%lld), mismatch(%lld)", j, _diff(idx, ref));
+
+		/* merged */
+		assert(gref_merge_delta(idx) == 0);
+		assert(idx->delta == NULL);
+		assert(idx->kmer_table_size == ref->kmer_table_size, "%lld, %lld",
+			idx->kmer_table_size, ref->kmer_table_size);
+		assert(_diff(idx, ref) == 0, "j(%lld), mismatch(%lld)", j, _diff(idx, ref));
+		#undef _diff
+
+		gref_clean(idx);
+		gref_clean(ref);
+	}
+}
 
-	assert(acv->type == GREF_ACV, "%d", acv->type);
-	assert(acv->link_table != NULL, "%p", acv->link_table);
+/* merge pools */
+unittest()
+{
+	int64_t const cnt = 8, len = 400;
+	char seq[8][401], name[8][8];
+	srand(1);
+	for(int64_t i = 0; i < cnt; i++) {
+		sprintf(name[i], "seq%" PRId64 "", i);
+		for(int64_t p = 0; p < len; p++) { seq[i][p] = "ACGTACGTACGTRN"[rand() % 14]; }
+		seq[i][len] = '\0';
+	}
+	#define _seg(_i)		name[_i], strlen(name[_i]), (uint8_t const *)seq[_i], len
+	#define _link(_i)		name[(_i) - 1], strlen(name[(_i) - 1]), 0, name[_i], strlen(name[_i]), (_i) & 0x01
 
-	/* section count */
-	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+	/* all in a pool */
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS( .k = 8, .seq_head_margin = 32 ));
+	for(int64_t i = 0; i < cnt; i++) {
+		gref_append_segment(pool, _seg(i));
+		if(i > 0) { gref_append_link(pool, _link(i)); }
+	}
+	gref_idx_t *ref = gref_build_index(gref_freeze_pool(pool));
+
+	/* halves, the first link of the latter refers to the former */
+	gref_pool_t *shard[2];
+	for(int64_t j = 0; j < 2; j++) {
+		shard[j] = gref_init_pool(GREF_PARAMS( .k = 8, .seq_head_margin = 32, .num_threads = j + 1 ));
+		for(int64_t i = j * cnt / 2; i < (j + 1) * cnt / 2; i++) {
+			gref_append_segment(shard[j], _seg(i));
+			if(i > 0) { gref_append_link(shard[j], _link(i)); }
+		}
+	}
+	pool = gref_merge_pools(shard[0], shard[1]);
+	assert(pool != NULL);
+	gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+	assert(idx != NULL);
+
+	assert(gref_get_section_count(idx) == cnt, "%lld", gref_get_section_count(idx));
+	assert(gref_get_total_len(idx) == gref_get_total_len(ref));
+	int64_t mismatch = 0;
+	for(int64_t i = 0; i < 2 * cnt; i++) {
+		uint8_t a[len], b[len];
+		struct gref_link_s la = gref_get_link(idx, i), lb = gref_get_link(ref, i);
+		mismatch += gref_decode_section(idx, i, a) != len || gref_decode_section(ref, i, b) != len;
+		mismatch += memcmp(a, b, len) != 0;
+		mismatch += la.len != lb.len || memcmp(la.gid_arr, lb.gid_arr, sizeof(uint32_t) * la.len) != 0;
+	}
+	assert(mismatch == 0, "%lld", mismatch);
+	assert(idx->kmer_table_size == ref->kmer_table_size);
+	assert(memcmp(idx->kmer_table, ref->kmer_table,
+		sizeof(struct gref_gid_pos_s) * idx->kmer_table_size) == 0);
+	gref_clean(idx);
+	gref_clean(ref);
+	#undef _seg
+	#undef _link
+
+	/* duplicated segment, and different params */
+	for(int64_t j = 0; j < 2; j++) {
+		shard[0] = gref_init_pool(GREF_PARAMS( .k = 8 ));
+		shard[1] = gref_init_pool(GREF_PARAMS( .k = 8 + j ));
+		gref_append_segment(shard[0], _str("x"), _seq("ACGTACGTACGT"));
+		gref_append_segment(shard[1], _str((j == 0) ? "x" : "y"), _seq("ACGTACGTACGT"));
+		assert(gref_merge_pools(shard[0], shard[1]) == NULL);
+	}
+}
 
-	/* total len */
-	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+/* fasta and gfa loaders */
+unittest()
+{
+	char const *path = "test_gref_loader.txt";
+	int64_t const cnt = 12;
+	char seq[12][301], name[12][8];
+	int64_t len[12];
+	srand(2);
+	for(int64_t i = 0; i < cnt; i++) {
+		sprintf(name[i], "seg%" PRId64 "", i);
+		len[i] = 1 + rand() % 300;
+		for(int64_t p = 0; p < len[i]; p++) { seq[i][p] = "ACGTACGTacgtRN"[rand() % 14]; }
+		seq[i][len[i]] = '\0';
+	}
+	#define _seg(_i)		name[_i], strlen(name[_i]), (uint8_t const *)seq[_i], len[_i]
+	#define _link(_i, _j)	name[_i], strlen(name[_i]), (_i) & 0x01, name[_j], strlen(name[_j]), ((_j) & 0x02) != 0
+	#define _ori(_o)		( (_o) ? '-' : '+' )
+
+	/* fasta: line width 60, descriptions, comments, empty lines, and crlf in the latter half */
+	for(int64_t j = 0; j < 2; j++) {
+		FILE *fp = fopen(path, "w");
+		fprintf(fp, "; ignored\n");
+		for(int64_t i = 0; i < cnt; i++) {
+			char const *nl = (i >= cnt / 2) ? "\r\n" : "\n";
+			fprintf(fp, ">%s%s%s", name[i], (i & 0x01) ? " desc ription" : "", nl);
+			if(i % 3 == 0) { fprintf(fp, ";comment ACGT%s", nl); }
+			for(int64_t p = 0; p < len[i]; p += 60) {
+				fprintf(fp, "%.*s%s", (int)MIN2(60, len[i] - p), &seq[i][p], nl);
+			}
+			if(i & 0x02) { fprintf(fp, "%s", nl); }
+		}
+		fclose(fp);
 
-	/* get lim */
-	assert(gref_get_lim(acv) == GREF_SEQ_LIM, "lim(%p)", gref_get_lim(acv));
+		gref_pool_t *ref = gref_init_pool(GREF_PARAMS( .k = 8 ));
+		for(int64_t i = 0; i < cnt; i++) {
+			gref_append_segment(ref, _seg(i));
+		}
+		gref_idx_t *ridx = gref_build_index(gref_freeze_pool(ref));
+
+		uint64_t const block_size[3] = { 7, 61, GREF_LOAD_BLOCK_SIZE };
+		for(int64_t b = 0; b < 3; b++) {
+			gref_pool_t *pool = gref_init_pool(GREF_PARAMS( .k = 8 ));
+			zf_t *zfp = zfopen(path, "r");
+			assert(gref_load_fasta_intl((struct gref_s *)pool, zfp, block_size[b]) == 0);
+			zfclose(zfp);
+			gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+
+			assert(gref_get_section_count(idx) == cnt, "%lld", gref_get_section_count(idx));
+			int64_t mismatch = 0;
+			for(int64_t i = 0; i < cnt; i++) {
+				uint8_t a[301], c[301];
+				struct gref_str_s s = gref_get_name(idx, _encode_id(i, 0));
+				mismatch += s.len != (int32_t)strlen(name[i]) || memcmp(s.str, name[i], s.len) != 0;
+				mismatch += gref_decode_section(idx, _encode_id(i, 0), a) != len[i];
+				mismatch += gref_decode_section(ridx, _encode_id(i, 0), c) != len[i];
+				mismatch += memcmp(a, c, len[i]) != 0;
+			}
+			assert(mismatch == 0, "%lld", mismatch);
+			assert(((struct gref_s *)idx)->kmer_table_size == ((struct gref_s *)ridx)->kmer_table_size);
+			gref_clean(idx);
+		}
+		gref_clean(ridx);
+	}
 
-	/* check bases at the head of the sections */
-	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
-	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
-	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
+	/* gfa: links to segments not yet defined, and the other record types */
+	FILE *fp = fopen(path, "w");
+	fprintf(fp, "H\tVN:Z:1.0\n");
+	for(int64_t i = 0; i < cnt; i++) {
+		if(i % 5 == 1 && i + 1 < cnt) {
+			fprintf(fp, "L\t%s\t%c\t%s\t%c\t0M\n", name[i], _ori(i & 0x01), name[i + 1], _ori((i + 1) & 0x02));
+		}
+		fprintf(fp, "S\t%s\t%s\tLN:i:%" PRId64 "%s", name[i], seq[i], len[i], (i & 0x01) ? "\r\n" : "\n");
+		if(i > 0) {
+			fprintf(fp, "L\t%s\t%c\t%s\t%c\t0M\n", name[i - 1], _ori((i - 1) & 0x01), name[i], _ori(i & 0x02));
+		}
+	}
+	fprintf(fp, "P\tp1\tseg0+,seg1-\t*");
+	fclose(fp);
 
-	gref_clean(acv);
+	gref_pool_t *ref = gref_init_pool(GREF_PARAMS( .k = 8 ));
+	for(int64_t i = 0; i < cnt; i++) {
+		if(i % 5 == 1 && i + 1 < cnt) { gref_append_link(ref, _link(i, i + 1)); }
+		gref_append_segment(ref, _seg(i));
+		if(i > 0) { gref_append_link(ref, _link(i - 1, i)); }
+	}
+	gref_idx_t *ridx = gref_build_index(gref_freeze_pool(ref));
+
+	for(int64_t j = 0; j < 6; j++) {
+		uint64_t const block_size[3] = { 13, 200, GREF_LOAD_BLOCK_SIZE };
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS( .k = 8, .num_threads = (j & 0x01) ? 3 : 1 ));
+		zf_t *zfp = zfopen(path, "r");
+		assert(gref_load_gfa_intl((struct gref_s *)pool, zfp, block_size[j / 2]) == 0, "%lld", j);
+		zfclose(zfp);
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL);
+
+		assert(gref_get_section_count(idx) == cnt, "%lld", gref_get_section_count(idx));
+		int64_t mismatch = 0;
+		for(int64_t i = 0; i < 2 * cnt; i++) {
+			uint8_t a[301], c[301];
+			struct gref_str_s s = gref_get_name(idx, i);
+			struct gref_link_s la = gref_get_link(idx, i), lb = gref_get_link(ridx, i);
+			mismatch += s.len != (int32_t)strlen(name[i>>1]) || memcmp(s.str, name[i>>1], s.len) != 0;
+			mismatch += gref_decode_section(idx, i, a) != len[i>>1];
+			mismatch += gref_decode_section(ridx, i, c) != len[i>>1];
+			mismatch += memcmp(a, c, len[i>>1]) != 0;
+			mismatch += la.len != lb.len || memcmp(la.gid_arr, lb.gid_arr, sizeof(uint32_t) * la.len) != 0;
+		}
+		assert(mismatch == 0, "%lld, %lld", j, mismatch);
+		assert(((struct gref_s *)idx)->kmer_table_size == ((struct gref_s *)ridx)->kmer_table_size);
+		assert(memcmp(((struct gref_s *)idx)->kmer_table, ((struct gref_s *)ridx)->kmer_table,
+			sizeof(struct gref_gid_pos_s) * ((struct gref_s *)idx)->kmer_table_size) == 0);
+		gref_clean(idx);
+	}
+	gref_clean(ridx);
+
+	/* malformed link, and unsupported mode */
+	fp = fopen(path, "w");
+	fprintf(fp, "S\tx\tACGT\nL\tx\t+\tx\t\t0M\n");
+	fclose(fp);
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS( .k = 8 ));
+	assert(gref_load_gfa(pool, path) == -1);
+	gref_clean(pool);
+	pool = gref_init_pool(GREF_PARAMS( .k = 8, .seq_format = GREF_4BIT ));
+	assert(gref_load_fasta(pool, path) == -1);
+	assert(gref_load_gfa(pool, "/nonexistent/path.gfa") == -1);
+	gref_clean(pool);
+	remove(path);
+	#undef _seg
+	#undef _link
+	#undef _ori
 }
 
-/* archive (fr_copy) */
+/* huge page and interleaved kmer tables */
 unittest()
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_direction = GREF_FW_RV,
-		.copy_mode = GREF_COPY,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
+	char const *path = "test_gref_table_mem.gref";
+	int64_t const len = 20000;
+	uint8_t seq[20000];
+	srand(3);
+	for(int64_t i = 0; i < len; i++) { seq[i] = "ACGT"[rand() % 4]; }
+
+	uint8_t const table_mem[5] = {
+		GREF_MEM_DEFAULT,
+		GREF_MEM_HUGEPAGE,
+		GREF_MEM_HUGETLB_2M,
+		GREF_MEM_HUGETLB_1G | GREF_MEM_INTERLEAVE,
+		GREF_MEM_HUGEPAGE | GREF_MEM_INTERLEAVE
+	};
+	for(int64_t t = 0; t < 2; t++) {
+		struct gref_s *idx[5];
+		for(int64_t j = 0; j < 5; j++) {
+			gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+				.k = 10,
+				.kmer_idx_type = (t == 0) ? GREF_KMER_IDX_DENSE : GREF_KMER_IDX_COMPACT,
+				.table_mem = table_mem[j]));
+			gref_append_segment(pool, _str("seq"), seq, len);
+			idx[j] = gref_build_index(gref_freeze_pool(pool));
+			assert(idx[j] != NULL);
+		}
 
-	/* append */
-	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
-	gref_append_segment(pool, _str("sec1"), _seq("M"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
-	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
-	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+		/* the tables larger than the threshold are moved to the regions */
+		uint64_t const kmer_idx_size = 0x01ULL<<20;
+		for(int64_t j = 0; j < 5; j++) {
+			void const *p = (t == 0) ? (void const *)idx[j]->kmer_idx_table : (void const *)idx[j]->kmer_rel_table;
+			assert((gref_find_region(idx[j], p) >= 0) == (j != 0), "%lld, %lld", t, j);
+			assert(gref_find_region(idx[j], idx[j]->kmer_table) == -1);		/* small */
+			assert(idx[j]->kmer_table_size == idx[0]->kmer_table_size);
+			assert(memcmp(idx[j]->kmer_table, idx[0]->kmer_table,
+				sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0);
+			if(t == 0) {
+				assert(memcmp(idx[j]->kmer_idx_table, idx[0]->kmer_idx_table,
+					sizeof(int64_t) * (kmer_idx_size + 1)) == 0);
+			} else {
+				assert(memcmp(idx[j]->kmer_rel_table, idx[0]->kmer_rel_table,
+					sizeof(uint16_t) * kmer_idx_size) == 0);
+			}
+		}
 
-	/* build index */
-	gref_acv_t *acv = gref_freeze_pool(pool);
-	assert(acv != NULL, "acv(%p)", acv);
+		/* placed on load */
+		zf_t *fp = zfopen(path, "w");
+		assert(gref_dump_index(idx[4], fp) == 0);
+		zfclose(fp);
+		fp = zfopen(path, "r");
+		struct gref_s *ld = gref_load_index(fp);
+		zfclose(fp);
+		assert(ld != NULL);
+		void const *p = (t == 0) ? (void const *)ld->kmer_idx_table : (void const *)ld->kmer_rel_table;
+		assert(gref_find_region(ld, p) >= 0);
+		assert(gref_match(ld, (uint8_t const *)"ACGTACGTAC").len == gref_match(idx[0], (uint8_t const *)"ACGTACGTAC").len);
+		gref_clean(ld);
+
+		for(int64_t j = 0; j < 5; j++) {
+			gref_clean(idx[j]);
+		}
+	}
+	remove(path);
+}
 
-	assert(acv->type == GREF_ACV, "%d", acv->type);
-	assert(acv->link_table != NULL, "%p", acv->link_table);
+/* occurrence cap */
+unittest()
+{
+	char const *path = "test_gref_occ_cap.gref";
+	int64_t const len = 30000;
+	uint8_t seq[30000];
+	srand(4);
+	for(int64_t i = 0; i < len; i++) {
+		/* satellite-like repeats with a few random bases */
+		seq[i] = ((i / 3000) & 0x01) ? "ACGTTGCAAG"[i % 10] : "ACGT"[rand() % 4];
+		if(rand() % 50 == 0) { seq[i] = "ACGT"[rand() % 4]; }
+	}
 
-	/* section count */
-	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+	/* dense and compact, drop and truncate, max_occ and ppm */
+	for(int64_t j = 0; j < 8; j++) {
+		gref_params_t p = {
+			.k = 8,
+			.kmer_idx_type = (j & 0x01) ? GREF_KMER_IDX_COMPACT : GREF_KMER_IDX_DENSE,
+			.occ_mode = (j & 0x02) ? GREF_OCC_TRUNCATE : GREF_OCC_DROP,
+			.max_occ = (j & 0x04) ? 0 : 40,
+			.mask_top_ppm = (j & 0x04) ? 2000 : 0,
+			.build_mode = (j & 0x01) ? GREF_BUILD_COUNT : GREF_BUILD_SORT
+		};
+		gref_pool_t *pool[2] = { gref_init_pool(&p), NULL };
+		p.max_occ = 0; p.mask_top_ppm = 0;
+		pool[1] = gref_init_pool(&p);
+		struct gref_s *idx[2];
+		for(int64_t t = 0; t < 2; t++) {
+			gref_append_segment(pool[t], _str("seq"), seq, len);
+			idx[t] = gref_build_index(gref_freeze_pool(pool[t]));
+			assert(idx[t] != NULL);
+		}
 
-	/* total len */
-	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+		/* capped buckets are the largest ones, flagged, and keep the counts */
+		int64_t masked = 0, distinct = 0, min_masked = INT64_MAX, max_kept = 0, mismatch = 0;
+		for(uint64_t kmer = 0; kmer < 0x10000; kmer++) {
+			struct gref_match_res_s a = gref_match_2bitpacked(idx[0], kmer);
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[1], kmer);
+			distinct += (r.len != 0);
+			mismatch += gref_match_count_2bitpacked(idx[0], kmer) != r.len;
+			mismatch += r.masked != 0;
+			if(a.masked) {
+				masked++;
+				min_masked = MIN2(min_masked, r.len);
+				mismatch += (j & 0x02) ? (a.len == 0 || a.len >= r.len) : (a.len != 0);
+			} else {
+				max_kept = MAX2(max_kept, r.len);
+				mismatch += a.len != r.len;
+			}
+			mismatch += unittest_match_cmp(idx[0], &a, idx[1], &r, a.len);
+		}
+		assert(mismatch == 0, "%lld, %lld", j, mismatch);
+		assert(masked > 0, "%lld", j);
+		assert(min_masked > max_kept, "%lld, %lld, %lld", j, min_masked, max_kept);
+		if(j & 0x04) {
+			assert(masked <= distinct * 2000 / 1000000, "%lld, %lld, %lld", j, masked, distinct);
+		} else {
+			assert(max_kept <= 40 && min_masked > 40, "%lld", j);
+		}
+		assert(idx[0]->kmer_table_size < idx[1]->kmer_table_size);
+
+		/* the mask is saved in the file */
+		zf_t *fp = zfopen(path, "w");
+		assert(gref_dump_index(idx[0], fp) == 0);
+		zfclose(fp);
+		fp = zfopen(path, "r");
+		struct gref_s *ld[2] = { gref_load_index(fp), gref_load_index_mmap(path) };
+		zfclose(fp);
+		for(int64_t t = 0; t < 2; t++) {
+			assert(ld[t] != NULL);
+			mismatch = 0;
+			for(uint64_t kmer = 0; kmer < 0x10000; kmer++) {
+				struct gref_match_res_s a = gref_match_2bitpacked(idx[0], kmer);
+				struct gref_match_res_s b = gref_match_2bitpacked(ld[t], kmer);
+				mismatch += a.len != b.len || a.masked != b.masked;
+				mismatch += gref_match_count_2bitpacked(ld[t], kmer) != gref_match_count_2bitpacked(idx[0], kmer);
+			}
+			assert(mismatch == 0, "%lld, %lld", j, mismatch);
+			gref_clean(ld[t]);
+		}
 
-	/* get lim */
-	assert(gref_get_lim(acv) == lmm_kv_ptr(acv->seq) + 2 * acv->seq_len + 32, "lim(%p)", gref_get_lim(acv));
+		/* incremental update is not available */
+		assert(gref_update_index(idx[0]) == -1);
+		gref_clean(idx[0]);
+		gref_clean(idx[1]);
+	}
+	remove(path);
+}
 
-	/* check bases at the head of the sections */
-	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
-	assert(gref_get_section(acv, 1)->base[0] == 0x08, "%x", gref_get_section(acv, 1)->base[0]);
-	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
-	assert(gref_get_section(acv, 3)->base[0] == 0x0c, "%x", gref_get_section(acv, 3)->base[0]);
-	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
-	assert(gref_get_section(acv, 5)->base[0] == 0x01, "%x", gref_get_section(acv, 5)->base[0]);
+/* packed kmer table entries */
+unittest()
+{
+	char const *path = "test_gref_packed_entry.gref";
+	int64_t const cnt = 10;
+	uint8_t seq[10][3000];
+	srand(5);
+	for(int64_t i = 0; i < cnt; i++) {
+		for(int64_t j = 0; j < 3000; j++) { seq[i][j] = "ACGTACGTACGTN"[rand() % 13]; }
+	}
 
-	gref_clean(acv);
+	for(int64_t j = 0; j < 4; j++) {
+		struct gref_s *idx[2];
+		for(int64_t t = 0; t < 2; t++) {
+			gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+				.k = 8,
+				.seq_direction = (j & 0x01) ? GREF_FW_RV : GREF_FW_ONLY,
+				.kmer_idx_type = (j & 0x02) ? GREF_KMER_IDX_COMPACT : GREF_KMER_IDX_DENSE,
+				.max_occ = (j == 3) ? 20 : 0,
+				.occ_mode = GREF_OCC_TRUNCATE,
+				.table_mem = (j == 2) ? GREF_MEM_HUGEPAGE : GREF_MEM_DEFAULT,
+				.entry_format = (t == 0) ? GREF_ENTRY_PLAIN : GREF_ENTRY_PACKED));
+			for(int64_t i = 0; i < cnt; i++) {
+				char name[8];
+				sprintf(name, "s%" PRId64 "", i);
+				gref_append_segment(pool, name, strlen(name), seq[i], 1000 + 200 * i);
+				if(i > 0) { gref_append_link(pool, name, strlen(name), 0, "s0", 2, i & 0x01); }
+			}
+			idx[t] = gref_build_index(gref_freeze_pool(pool));
+			assert(idx[t] != NULL);
+		}
+
+		/* 5 bits of gid, 12 bits of pos */
+		assert(idx[0]->entry_size == 0);
+		assert(idx[1]->entry_size == 3, "%u", idx[1]->entry_size);
+		assert(idx[1]->kmer_table_size == idx[0]->kmer_table_size);
+
+		zf_t *fp = zfopen(path, "w");
+		assert(gref_dump_index(idx[1], fp) == 0);
+		zfclose(fp);
+		fp = zfopen(path, "r");
+		struct gref_s *ld[2] = { gref_load_index(fp), gref_load_index_mmap(path) };
+		zfclose(fp);
+		assert(ld[0] != NULL && ld[1] != NULL);
+
+		int64_t mismatch = 0;
+		for(uint64_t kmer = 0; kmer < 0x10000; kmer++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[0], kmer);
+			for(int64_t t = 0; t < 3; t++) {
+				struct gref_s const *g = (t == 0) ? idx[1] : ld[t - 1];
+				struct gref_match_res_s a = gref_match_2bitpacked(g, kmer);
+				struct gref_gid_pos_s buf[256];
+				mismatch += a.len != r.len || a.masked != r.masked;
+				mismatch += gref_match_decode(g, &a, buf) != r.len;
+				for(int64_t i = 0; i < r.len; i++) {
+					struct gref_gid_pos_s e = gref_match_get(g, &a, i), f = gref_match_get(idx[0], &r, i);
+					mismatch += e.gid != f.gid || e.pos != f.pos || buf[i].gid != f.gid || buf[i].pos != f.pos;
+				}
+			}
+		}
+		assert(mismatch == 0, "%lld, %lld", j, mismatch);
+
+		assert(gref_update_index(idx[1]) == -1);
+		for(int64_t t = 0; t < 2; t++) {
+			gref_clean(ld[t]);
+			gref_clean(idx[t]);
+		}
+	}
+	remove(path);
 }
 
-/* archive (fr_nocopy) */
+/* index statistics */
 unittest()
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_direction = GREF_FW_RV,
-		.seq_format = GREF_4BIT,
-		.copy_mode = GREF_NOCOPY,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
+	uint8_t seq[4][400];
+	srand(7);
+	for(int64_t i = 0; i < 4; i++) {
+		for(int64_t j = 0; j < 400; j++) { seq[i][j] = "ACGTACGTACGTR"[rand() % 13]; }
+	}
 
-	/* append */
-	#define _seqrv(x)		(uint8_t const *)(x), strlen(x)/2
+	assert(gref_get_stats(NULL, NULL) == -1);
+	for(int64_t j = 0; j < 4; j++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.kmer_idx_type = (j & 0x01) ? GREF_KMER_IDX_COMPACT : GREF_KMER_IDX_DENSE,
+			.build_mode = (j & 0x02) ? GREF_BUILD_COUNT : GREF_BUILD_SORT,
+			.seq_storage = (j == 3) ? GREF_STORAGE_2BIT : GREF_STORAGE_4BIT,
+			.entry_format = (j == 1) ? GREF_ENTRY_PACKED : GREF_ENTRY_PLAIN));
+		gref_append_segment(pool, "a", 1, seq[0], 400);
+		gref_append_segment(pool, "b", 1, seq[1], 3);
+		gref_append_segment(pool, "c", 1, seq[2], 2);
+		gref_append_segment(pool, "d", 1, seq[3], 400);
+		gref_append_link(pool, "a", 1, 0, "b", 1, 0);
+		gref_append_link(pool, "b", 1, 0, "c", 1, 0);
+		gref_append_link(pool, "c", 1, 0, "d", 1, 0);
+
+		struct gref_stats_s st;
+		assert(gref_get_stats(pool, &st) == 0);
+		assert(st.sec_cnt == 4, "%lld", st.sec_cnt);
+		assert(st.link_cnt == 3, "%lld", st.link_cnt);
+		assert(st.seq_len == 805, "%lld", st.seq_len);
+		assert(st.seq_bytes >= 805, "%llu", st.seq_bytes);
+		assert(st.kmer_cnt == 0 && st.kmer_idx_bytes == 0);
+
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL);
+		assert(gref_get_stats(idx, &st) == 0);
+		assert(st.link_cnt == 3, "%lld", st.link_cnt);
+		assert(st.kmer_cnt == ((struct gref_s *)idx)->kmer_table_size);
+		assert(st.kmer_table_bytes > 0 && st.kmer_idx_bytes > 0);
+		assert(st.total_bytes == st.seq_bytes + st.link_bytes + st.kmer_idx_bytes
+			+ st.kmer_table_bytes + st.hmap_bytes + st.aux_bytes);
+
+		/* the histogram covers all the non-empty buckets */
+		int64_t hist_sum = 0;
+		for(int64_t i = 0; i < GREF_STATS_HIST_SIZE; i++) { hist_sum += st.bucket_hist[i]; }
+		assert(hist_sum == st.bucket_cnt, "%lld, %lld", hist_sum, st.bucket_cnt);
+		assert(st.bucket_cnt > 0 && st.bucket_cnt <= st.kmer_cnt);
+		assert(st.max_bucket_size >= 1 && st.max_bucket_size <= st.kmer_cnt);
+
+		int64_t max_len = 0;
+		for(uint64_t kmer = 0; kmer < 0x10000; kmer++) {
+			max_len = MAX2(max_len, gref_match_2bitpacked(idx, kmer).len);
+		}
+		assert(max_len == st.max_bucket_size, "%lld, %lld", max_len, st.max_bucket_size);
+
+		#ifdef GREF_STATS
+		/* a kmer spans a, b, c, and d, R is expanded into two */
+		assert(st.max_stack_depth == 4, "%u", st.max_stack_depth);
+		assert(st.max_expansion >= 2, "%u", st.max_expansion);
+		assert(st.phase_sec[GREF_PHASE_ENUMERATE] > 0.0);
+		assert(((j & 0x02) != 0) == (st.phase_sec[GREF_PHASE_SORT] == 0.0));
+		#else
+		assert(st.max_stack_depth == 0 && st.max_expansion == 0);
+		for(int64_t i = 0; i < GREF_PHASE_CNT; i++) { assert(st.phase_sec[i] == 0.0); }
+		#endif
+		gref_clean(idx);
+	}
+}
 
-	gref_append_segment(pool, _str("sec0"), _seqrv("\x04\x04\x05\x01\x08\x0a\x02\x02"));
-	gref_append_segment(pool, _str("sec1"), _seqrv("\x03\x0c"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
-	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
-	gref_append_segment(pool, _str("sec2"), _seqrv("\x01\x03\x07\x07\x04\x08\x04\x08\x01\x02\x01\x02\x0e\x0e\x0c\x08"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
+/* inline bucket slots */
+unittest()
+{
+	char const *path = "test_gref_inline_slot.gref";
+	uint8_t seq[6][2000];
+	srand(11);
+	for(int64_t i = 0; i < 6; i++) {
+		for(int64_t j = 0; j < 2000; j++) { seq[i][j] = "ACGTACGTACGTN"[rand() % 13]; }
+	}
+	/* poly-A makes a large bucket */
+	memset(&seq[5][0], 'A', 1500);
+
+	assert(gref_init_pool(GREF_PARAMS(.kmer_idx_type = GREF_KMER_IDX_INLINE, .entry_format = GREF_ENTRY_PACKED)) == NULL);
+	for(int64_t j = 0; j < 4; j++) {
+		struct gref_s *idx[2];
+		for(int64_t t = 0; t < 2; t++) {
+			gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+				.k = 7,
+				.kmer_idx_type = (t == 0) ? GREF_KMER_IDX_DENSE : GREF_KMER_IDX_INLINE,
+				.build_mode = (j & 0x01) ? GREF_BUILD_COUNT : GREF_BUILD_SORT,
+				.max_occ = (j == 2) ? 30 : 0,
+				.occ_mode = GREF_OCC_TRUNCATE));
+			for(int64_t i = 0; i < 6; i++) {
+				char name[8];
+				sprintf(name, "s%" PRId64 "", i);
+				gref_append_segment(pool, name, strlen(name), seq[i], 2000 - 150 * i);
+				if(i > 0) { gref_append_link(pool, "s0", 2, 0, name, strlen(name), 0); }
+			}
+			idx[t] = gref_build_index(gref_freeze_pool(pool));
+			assert(idx[t] != NULL);
+		}
+		assert(idx[1]->kmer_slot_table != NULL && idx[1]->kmer_idx_table == NULL);
+
+		/* staged segments go to the delta, then merged into the slots */
+		if(j == 3) {
+			for(int64_t t = 0; t < 2; t++) {
+				assert(gref_idx_append_segment(idx[t], "x", 1, seq[3], 300) == 0);
+				assert(gref_update_index(idx[t]) == 0);
+				assert(gref_merge_delta(idx[t]) == 0);
+			}
+			assert(idx[1]->kmer_slot_table != NULL);
+		}
 
-	#undef _seqrv
+		zf_t *fp = zfopen(path, "w");
+		assert(gref_dump_index(idx[1], fp) == 0);
+		zfclose(fp);
+		fp = zfopen(path, "r");
+		struct gref_s *ld[2] = { gref_load_index(fp), gref_load_index_mmap(path) };
+		zfclose(fp);
+		assert(ld[0] != NULL && ld[1] != NULL);
+
+		int64_t mismatch = 0, singleton = 0;
+		for(uint64_t kmer = 0; kmer < 0x4000; kmer++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[0], kmer);
+			for(int64_t t = 0; t < 3; t++) {
+				struct gref_s const *g = (t == 0) ? idx[1] : ld[t - 1];
+				struct gref_match_res_s a = gref_match_2bitpacked(g, kmer);
+				mismatch += a.len != r.len || a.masked != r.masked;
+				mismatch += unittest_match_cmp(g, &a, idx[0], &r, r.len);
+				mismatch += gref_match_count_2bitpacked(g, kmer) != gref_match_count_2bitpacked(idx[0], kmer);
+			}
+			if(r.len == 1) {
+				singleton++;
+				mismatch += gref_match_2bitpacked(idx[1], kmer).gid_pos_arr != &idx[1]->kmer_slot_table[kmer].inl;
+			}
+		}
+		assert(mismatch == 0, "j(%lld), mismatch(%lld)", j, mismatch);
+		assert(singleton > 0);
+
+		/* batch */
+		uint64_t q[300];
+		struct gref_match_res_s res[300];
+		for(int64_t i = 0; i < 300; i++) { q[i] = (i * 2654435761u) & 0x3fff; }
+		assert(gref_match_batch(idx[1], q, 300, res) == 300);
+		for(int64_t i = 0; i < 300; i++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[0], q[i]);
+			mismatch += res[i].len != r.len;
+			mismatch += unittest_match_cmp(idx[1], &res[i], idx[0], &r, r.len);
+		}
+		assert(mismatch == 0, "j(%lld), mismatch(%lld)", j, mismatch);
 
-	/* build index */
-	gref_acv_t *acv = gref_freeze_pool(pool);
-	assert(acv != NULL, "acv(%p)", acv);
+		gref_clean(ld[0]); gref_clean(ld[1]);
+		gref_clean(idx[0]); gref_clean(idx[1]);
+	}
+	remove(path);
+}
 
-	assert(acv->type == GREF_ACV, "%d", acv->type);
-	assert(acv->link_table != NULL, "%p", acv->link_table);
+/* hash index */
+unittest()
+{
+	char const *path = "test_gref_hash.gref";
+	uint8_t seq[6][2000];
+	srand(13);
+	for(int64_t i = 0; i < 6; i++) {
+		for(int64_t j = 0; j < 2000; j++) { seq[i][j] = "ACGTACGTACGTN"[rand() % 13]; }
+	}
+	memset(&seq[5][0], 'A', 1500);
+
+	assert(gref_init_pool(GREF_PARAMS(.kmer_idx_type = GREF_KMER_IDX_HASH, .build_mode = GREF_BUILD_COUNT)) == NULL);
+	{
+		/* the count build falls back to the compact index for large k */
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 20, .build_mode = GREF_BUILD_COUNT));
+		assert(pool != NULL && ((struct gref_s *)pool)->params.kmer_idx_type == GREF_KMER_IDX_COMPACT);
+		gref_clean(pool);
+	}
+	for(int64_t j = 0; j < 5; j++) {
+		struct gref_s *idx[2];
+		for(int64_t t = 0; t < 2; t++) {
+			gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+				.k = 7,
+				.kmer_idx_type = (t == 0) ? GREF_KMER_IDX_DENSE : GREF_KMER_IDX_HASH,
+				.max_occ = (j == 1) ? 30 : 0,
+				.mask_top_ppm = (j == 2) ? 20000 : 0,
+				.occ_mode = (j == 1) ? GREF_OCC_TRUNCATE : GREF_OCC_DROP,
+				.entry_format = (j == 4) ? GREF_ENTRY_PACKED : GREF_ENTRY_PLAIN));
+			for(int64_t i = 0; i < 6; i++) {
+				char name[8];
+				sprintf(name, "s%" PRId64 "", i);
+				gref_append_segment(pool, name, strlen(name), seq[i], 2000 - 150 * i);
+				if(i > 0) { gref_append_link(pool, "s0", 2, 0, name, strlen(name), 0); }
+			}
+			idx[t] = gref_build_index(gref_freeze_pool(pool));
+			assert(idx[t] != NULL);
+		}
+		assert(idx[1]->kmer_hash_tag != NULL && idx[1]->kmer_run == NULL);
 
-	/* section count */
-	assert(gref_get_section_count(acv) == 3, "%lld", gref_get_section_count(acv));
+		if(j == 3) {
+			for(int64_t t = 0; t < 2; t++) {
+				assert(gref_idx_append_segment(idx[t], "x", 1, seq[3], 300) == 0);
+				assert(gref_update_index(idx[t]) == 0);
+				assert(gref_merge_delta(idx[t]) == 0);
+			}
+		}
 
-	/* total len */
-	assert(gref_get_total_len(acv) == 13, "len(%lld)", gref_get_total_len(acv));
+		zf_t *fp = zfopen(path, "w");
+		assert(gref_dump_index(idx[1], fp) == 0);
+		zfclose(fp);
+		fp = zfopen(path, "r");
+		struct gref_s *ld[2] = { gref_load_index(fp), gref_load_index_mmap(path) };
+		zfclose(fp);
+		assert(ld[0] != NULL && ld[1] != NULL);
+
+		uint64_t const esz = (idx[1]->entry_size == 0) ? sizeof(struct gref_gid_pos_s) : idx[1]->entry_size;
+		int64_t mismatch = 0;
+		for(uint64_t kmer = 0; kmer < 0x4000; kmer++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[0], kmer);
+			for(int64_t t = 0; t < 3; t++) {
+				struct gref_s const *g = (t == 0) ? idx[1] : ld[t - 1];
+				struct gref_match_res_s a = gref_match_2bitpacked(g, kmer);
+				mismatch += a.len != r.len || a.masked != r.masked;
+				mismatch += memcmp(a.gid_pos_arr, r.gid_pos_arr, esz * r.len) != 0;
+				mismatch += gref_match_count_2bitpacked(g, kmer) != gref_match_count_2bitpacked(idx[0], kmer);
+			}
+		}
+		assert(mismatch == 0, "j(%lld), mismatch(%lld)", j, mismatch);
+
+		/* batch */
+		uint64_t q[300];
+		struct gref_match_res_s res[300];
+		for(int64_t i = 0; i < 300; i++) { q[i] = (i * 2654435761u) & 0x3fff; }
+		assert(gref_match_batch(idx[1], q, 300, res) == 300);
+		for(int64_t i = 0; i < 300; i++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[0], q[i]);
+			mismatch += res[i].len != r.len;
+			mismatch += memcmp(res[i].gid_pos_arr, r.gid_pos_arr, esz * r.len) != 0;
+		}
+		assert(mismatch == 0, "j(%lld), mismatch(%lld)", j, mismatch);
 
-	/* get lim */
-	assert(gref_get_lim(acv) == GREF_SEQ_LIM, "lim(%p)", gref_get_lim(acv));
+		struct gref_stats_s st[2];
+		assert(gref_get_stats(idx[0], &st[0]) == 0 && gref_get_stats(idx[1], &st[1]) == 0);
+		assert(st[0].bucket_cnt == st[1].bucket_cnt && st[0].max_bucket_size == st[1].max_bucket_size);
 
-	/* check bases at the head of the sections */
-	assert(gref_get_section(acv, 0)->base[0] == 0x04, "%x", gref_get_section(acv, 0)->base[0]);
-	assert(gref_get_section(acv, 1)->base[0] == 0x08, "%x", gref_get_section(acv, 1)->base[0]);
-	assert(gref_get_section(acv, 2)->base[0] == 0x03, "%x", gref_get_section(acv, 2)->base[0]);
-	assert(gref_get_section(acv, 3)->base[0] == 0x0c, "%x", gref_get_section(acv, 3)->base[0]);
-	assert(gref_get_section(acv, 4)->base[0] == 0x01, "%x", gref_get_section(acv, 4)->base[0]);
-	assert(gref_get_section(acv, 5)->base[0] == 0x01, "%x", gref_get_section(acv, 5)->base[0]);
+		gref_clean(ld[0]); gref_clean(ld[1]);
+		gref_clean(idx[0]); gref_clean(idx[1]);
+	}
+	remove(path);
 
-	gref_clean(acv);
+	/* large k, every enumerated occurrence is found in its bucket */
+	for(int64_t i = 0; i < 4; i++) {
+		for(int64_t j = 0; j < 2000; j++) { seq[i][j] = "ACGT"[rand() % 4]; }
+	}
+	uint32_t const ks[] = { 21, 31, 32 };
+	for(int64_t c = 0; c < 3; c++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = ks[c], .kmer_strand = GREF_KMER_BOTH));
+		assert(pool != NULL && ((struct gref_s *)pool)->params.kmer_idx_type == GREF_KMER_IDX_HASH);
+		for(int64_t i = 0; i < 4; i++) {
+			char name[8];
+			sprintf(name, "s%" PRId64 "", i);
+			gref_append_segment(pool, name, strlen(name), seq[i], 2000);
+			if(i > 0) { gref_append_link(pool, "s0", 2, 0, name, strlen(name), 0); }
+		}
+		gref_acv_t *acv = gref_freeze_pool(pool);
+
+		lmm_kvec_t(struct gref_kmer_tuple_s) v;
+		lmm_kv_init(NULL, v);
+		gref_iter_t *iter = gref_iter_init(acv, NULL);
+		struct gref_kmer_tuple_s t;
+		while((t = gref_iter_next(iter)).gid_pos.gid != (uint32_t)-1) { lmm_kv_push(NULL, v, t); }
+		gref_iter_clean(iter);
+		assert(lmm_kv_size(v) > 0);
+
+		gref_idx_t *idx = gref_build_index(acv);
+		assert(idx != NULL);
+		int64_t missing = 0, found = 0;
+		for(uint64_t i = 0; i < lmm_kv_size(v); i++) {
+			struct gref_kmer_tuple_s e = lmm_kv_at(v, i);
+			struct gref_match_res_s r = gref_match_2bitpacked(idx, e.kmer);
+			int64_t hit = 0;
+			for(int64_t l = 0; l < r.len; l++) {
+				struct gref_gid_pos_s const p = gref_match_get(idx, &r, l);
+				hit += p.gid == e.gid_pos.gid && p.pos == e.gid_pos.pos;
+			}
+			missing += (hit == 0);
+		}
+		for(int64_t i = 0; i < 1000; i++) {
+			found += gref_match_2bitpacked(idx, ((uint64_t)rand()<<40 ^ (uint64_t)rand()<<20 ^ rand())
+				& ((struct gref_s *)idx)->mask).len;
+		}
+		assert(missing == 0, "k(%u), missing(%lld)", ks[c], missing);
+		assert(found == 0, "k(%u), found(%lld)", ks[c], found);
+		lmm_kv_destroy(NULL, v);
+		gref_clean(idx);
+	}
 }
 
-/* archive (fr_copy / large sequence) */
+/* duplicate occurrences */
 unittest()
 {
-	int64_t const len = 100000;
-	int64_t const cnt = 1000;
+	/* b and c are identical arms of a bubble, the kmers spanning them repeat */
+	char const *arm = "GATTACAGATTACA";
+	struct gref_s *idx[5];
+	int64_t dup_cnt[5];
+	for(int64_t j = 0; j < 5; j++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = 8,
+			.build_mode = (j == 4) ? GREF_BUILD_PARTITION : ((j & 0x01) ? GREF_BUILD_COUNT : GREF_BUILD_SORT),
+			.num_threads = (j & 0x02) ? 4 : 1));
+		gref_append_segment(pool, _str("a"), _seq("ACGTTGCAACGTTGCA"));
+		gref_append_segment(pool, _str("b"), (uint8_t const *)arm, strlen(arm));
+		gref_append_segment(pool, _str("c"), (uint8_t const *)arm, strlen(arm));
+		gref_append_segment(pool, _str("d"), _seq("CCATGGTACCATGGTA"));
+		gref_append_link(pool, _str("a"), 0, _str("b"), 0);
+		gref_append_link(pool, _str("a"), 0, _str("c"), 0);
+		gref_append_link(pool, _str("b"), 0, _str("d"), 0);
+		gref_append_link(pool, _str("c"), 0, _str("d"), 0);
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL);
+
+		struct gref_stats_s st;
+		assert(gref_get_stats(idx[j], &st) == 0);
+		assert(st.dup_cnt > 0, "%lld", st.dup_cnt);
+		dup_cnt[j] = st.dup_cnt;
+
+		/* unique and sorted */
+		int64_t unsorted = 0;
+		for(uint64_t kmer = 0; kmer < 0x10000; kmer++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[j], kmer);
+			for(int64_t i = 1; i < r.len; i++) {
+				struct gref_gid_pos_s const p = gref_match_get(idx[j], &r, i - 1), q = gref_match_get(idx[j], &r, i);
+				unsorted += gref_cmp_gid_pos(&p, &q) >= 0;
+			}
+		}
+		assert(unsorted == 0, "j(%lld), unsorted(%lld)", j, unsorted);
+	}
 
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_direction = GREF_FW_RV,
-		.seq_format = GREF_4BIT,
-		.copy_mode = GREF_COPY,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
+	/* independent of the build mode and the thread count */
+	for(int64_t j = 1; j < 5; j++) {
+		assert(dup_cnt[j] == dup_cnt[0], "j(%lld), dup_cnt(%lld, %lld)", j, dup_cnt[j], dup_cnt[0]);
+		assert(idx[j]->kmer_table_size == idx[0]->kmer_table_size);
+		assert(memcmp(idx[j]->kmer_table, idx[0]->kmer_table,
+			sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0, "j(%lld)", j);
+		assert(memcmp(idx[j]->kmer_idx_table, idx[0]->kmer_idx_table,
+			sizeof(int64_t) * (0x10000 + 1)) == 0, "j(%lld)", j);
+	}
 
-	/* dump */
-	for(int64_t i = 0; i < cnt; i++) {
+	/* another identical arm through the delta */
+	assert(gref_idx_append_segment(idx[0], _str("e"), (uint8_t const *)arm, strlen(arm)) == 0);
+	assert(gref_idx_append_link(idx[0], _str("a"), 0, _str("e"), 0) == 0);
+	assert(gref_idx_append_link(idx[0], _str("e"), 0, _str("d"), 0) == 0);
+	assert(gref_update_index(idx[0]) == 0);
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 8));
+	gref_append_segment(pool, _str("a"), _seq("ACGTTGCAACGTTGCA"));
+	gref_append_segment(pool, _str("b"), (uint8_t const *)arm, strlen(arm));
+	gref_append_segment(pool, _str("c"), (uint8_t const *)arm, strlen(arm));
+	gref_append_segment(pool, _str("d"), _seq("CCATGGTACCATGGTA"));
+	gref_append_segment(pool, _str("e"), (uint8_t const *)arm, strlen(arm));
+	gref_append_link(pool, _str("a"), 0, _str("b"), 0);
+	gref_append_link(pool, _str("a"), 0, _str("c"), 0);
+	gref_append_link(pool, _str("b"), 0, _str("d"), 0);
+	gref_append_link(pool, _str("c"), 0, _str("d"), 0);
+	gref_append_link(pool, _str("a"), 0, _str("e"), 0);
+	gref_append_link(pool, _str("e"), 0, _str("d"), 0);
+	gref_idx_t *ref = gref_build_index(gref_freeze_pool(pool));
+	assert(ref != NULL);
+
+	int64_t mismatch = 0;
+	for(int64_t m = 0; m < 2; m++) {
+		for(uint64_t kmer = 0; kmer < 0x10000; kmer++) {
+			mismatch += gref_match_count_2bitpacked(idx[0], kmer) != gref_match_count_2bitpacked(ref, kmer);
+		}
+		assert(mismatch == 0, "m(%lld), mismatch(%lld)", m, mismatch);
+		assert(gref_merge_delta(idx[0]) == 0);
+	}
+	assert(idx[0]->kmer_table_size == ((struct gref_s *)ref)->kmer_table_size);
 
-		/* name */
-		char buf[1024];
-		sprintf(buf, "seq%" PRId64 "", i);
+	gref_clean(ref);
+	for(int64_t j = 0; j < 5; j++) { gref_clean(idx[j]); }
+}
 
-		/* seq */
-		char *seq = unittest_generate_random_sequence(len);
+/* partitioned build */
+unittest()
+{
+	uint8_t seq[4][3000];
+	srand(17);
+	for(int64_t i = 0; i < 4; i++) {
+		for(int64_t j = 0; j < 3000; j++) { seq[i][j] = "ACGTACGTACGTR"[rand() % 13]; }
+	}
+	memset(&seq[3][0], 'C', 800);
+
+	for(int64_t j = 0; j < 32; j++) {
+		uint8_t const types[] = { GREF_KMER_IDX_DENSE, GREF_KMER_IDX_COMPACT, GREF_KMER_IDX_INLINE, GREF_KMER_IDX_HASH };
+		struct gref_s *idx[2];
+		for(int64_t t = 0; t < 2; t++) {
+			gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+				.k = 9,
+				.build_mode = (t == 0) ? GREF_BUILD_SORT : GREF_BUILD_PARTITION,
+				.kmer_idx_type = types[j & 0x03],
+				.num_threads = (j & 0x04) ? 4 : 1,
+				.kmer_strand = (j & 0x08) ? GREF_KMER_CANONICAL : GREF_KMER_BOTH,
+				.build_mem_kb = (j & 0x10) ? 0 : 4,
+				.max_occ = (j == 5) ? 20 : 0));
+			for(int64_t i = 0; i < 4; i++) {
+				char name[8];
+				sprintf(name, "s%" PRId64 "", i);
+				gref_append_segment(pool, name, strlen(name), seq[i], 3000);
+				if(i > 0) { gref_append_link(pool, "s0", 2, 0, name, strlen(name), 1); }
+			}
+			idx[t] = gref_build_index(gref_freeze_pool(pool));
+			assert(idx[t] != NULL, "j(%lld), t(%lld)", j, t);
+		}
+		assert(idx[1]->kmer_run == NULL);
+		assert(idx[0]->kmer_table_size == idx[1]->kmer_table_size, "j(%lld)", j);
+		assert(memcmp(idx[0]->kmer_table, idx[1]->kmer_table,
+			sizeof(struct gref_gid_pos_s) * idx[0]->kmer_table_size) == 0, "j(%lld)", j);
+
+		int64_t mismatch = 0;
+		for(uint64_t kmer = 0; kmer < 0x40000; kmer++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx[0], kmer);
+			struct gref_match_res_s a = gref_match_2bitpacked(idx[1], kmer);
+			mismatch += a.len != r.len || a.masked != r.masked;
+			mismatch += a.len == r.len && unittest_match_cmp(idx[1], &a, idx[0], &r, r.len);
+		}
+		assert(mismatch == 0, "j(%lld), mismatch(%lld)", j, mismatch);
+		gref_clean(idx[0]); gref_clean(idx[1]);
+	}
+}
 
-		/* append */
-		gref_append_segment(pool, buf, strlen(buf), (uint8_t const *)seq, strlen(seq));
-		free(seq);
+/* fixed-k kernels */
+unittest()
+{
+	uint8_t seq[3][600];
+	srand(17);
+	for(int64_t i = 0; i < 3; i++) {
+		for(int64_t j = 0; j < 600; j++) { seq[i][j] = "ACGTACGTACGTRN"[rand() % 14]; }
 	}
 
-	/* freeze */
-	gref_acv_t *acv = gref_freeze_pool(pool);
-	assert(acv != NULL, "acv(%p)", acv);
+	/* k in the kernel list and not */
+	int64_t const ks[] = { 11, 12, 14, 16, 17, 20, 21 };
+	for(int64_t t = 0; t < sizeof(ks) / sizeof(int64_t); t++) {
+		int64_t const k = ks[t];
+		assert(gref_pack_kmer(seq[0], k) == gref_select_pack_kmer(k)(seq[0], k), "k(%lld)", k);
+
+		/* the direct-address tables get too large at k > 12 */
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = k,
+			.kmer_idx_type = (k <= 12) ? GREF_KMER_IDX_DENSE : GREF_KMER_IDX_HASH));
+		gref_append_segment(pool, _str("s0"), seq[0], 600);
+		gref_append_segment(pool, _str("s1"), seq[1], 400);
+		gref_append_segment(pool, _str("s2"), seq[2], 500);
+		gref_append_link(pool, _str("s0"), 0, _str("s1"), 0);
+		gref_append_link(pool, _str("s0"), 0, _str("s2"), 0);
+		gref_acv_t *acv = gref_freeze_pool(pool);
+
+		gref_iter_t *iter = gref_iter_init(acv, GREF_ITER_PARAMS(.seq_direction = GREF_FW_RV));
+		gref_iter_t *batch = gref_iter_init(acv, GREF_ITER_PARAMS(.seq_direction = GREF_FW_RV));
+		struct gref_kmer_tuple_s buf[64];
+		int64_t total = 0, cnt, mismatch = 0;
+		while((cnt = gref_iter_next_batch(batch, buf, 64)) > 0) {
+			for(int64_t i = 0; i < cnt; i++) {
+				struct gref_kmer_tuple_s u = gref_iter_next(iter);
+				mismatch += (u.kmer != buf[i].kmer
+					|| u.gid_pos.gid != buf[i].gid_pos.gid
+					|| u.gid_pos.pos != buf[i].gid_pos.pos);
+			}
+			total += cnt;
+		}
+		assert(mismatch == 0 && total > 0, "k(%lld), mismatch(%lld), total(%lld)", k, mismatch, total);
+		gref_iter_clean(iter);
+		gref_iter_clean(batch);
+
+		/* the specialized query encoder hits the same buckets */
+		gref_idx_t *idx = gref_build_index(acv);
+		assert(idx != NULL, "k(%lld)", k);
+		int64_t miss = 0;
+		for(int64_t p = 0; p + k <= 600; p += 7) {
+			struct gref_match_res_s r = gref_match(idx, &seq[0][p]);
+			struct gref_match_res_s q = gref_match_2bitpacked(idx, gref_pack_kmer(&seq[0][p], k));
+			miss += (r.len != q.len || r.gid_pos_arr != q.gid_pos_arr
+				|| gref_match_count(idx, &seq[0][p]) != gref_match_count_2bitpacked(idx, gref_pack_kmer(&seq[0][p], k)));
+		}
+		assert(miss == 0, "k(%lld), miss(%lld)", k, miss);
+		gref_clean(idx);
+	}
+}
 
-	assert(acv->type == GREF_ACV, "%d", acv->type);
-	assert(acv->link_table != NULL, "%p", acv->link_table);
+/* shared index handle */
+struct gref_test_handle_s {
+	gref_handle_t *handle;
+	uint32_t reader;
+	uint32_t volatile *done;
+	int64_t per_sec;				/* occurrences of the query in a section */
+	int64_t acquired, broken;
+};
 
-	/* section count */
-	assert(gref_get_section_count(acv) == cnt, "%lld", gref_get_section_count(acv));
+static
+void *gref_test_handle_reader(
+	void *arg)
+{
+	struct gref_test_handle_s *t = (struct gref_test_handle_s *)arg;
+	while(*t->done == 0 || t->acquired == 0) {
+		gref_idx_t const *idx = gref_handle_acquire(t->handle, t->reader);
 
-	/* total len */
-	assert(gref_get_total_len(acv) == cnt * len, "len(%lld)", gref_get_total_len(acv));
+		/* each generation i holds (i + 1) copies of ACGTACGT... in its own section */
+		int64_t const gen = gref_get_section_count(idx) - 1;
+		struct gref_match_res_s r = gref_match(idx, (uint8_t const *)"ACGTACGT");
+		t->broken += (r.len != t->per_sec * (gen + 1));
+		t->acquired++;
 
-	gref_clean(acv);
+		gref_handle_release(t->handle, t->reader);
+	}
+	return(NULL);
 }
 
-
-/* seed iteration */
 unittest()
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32,
-		.seq_direction = GREF_FW_ONLY));
-	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
-	gref_append_segment(pool, _str("sec1"), _seq("M"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
-	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
-	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
-	
-	/* build archive */
-	gref_acv_t *acv = gref_freeze_pool(pool);
-
-	/* create iterator */
-	gref_iter_t *iter = gref_iter_init(acv, NULL);
-	assert(iter != NULL, "%p", iter);
+	#define _gen(_i) ({ \
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 8)); \
+		for(int64_t j = 0; j <= (_i); j++) { \
+			char name[8]; \
+			sprintf(name, "s%" PRId64 "", j); \
+			gref_append_segment(pool, name, strlen(name), _seq("ACGTACGTACGTACGTACGTACGTACGTAC")); \
+		} \
+		gref_build_index(gref_freeze_pool(pool)); \
+	})
+
+	assert(gref_handle_init(NULL, 4) == NULL);
+	gref_handle_t *handle = gref_handle_init(_gen(0), 4);
+	assert(handle != NULL);
+	assert(gref_handle_acquire(handle, 4) == NULL);
+	int64_t const per_sec = gref_match(gref_handle_acquire(handle, 0), (uint8_t const *)"ACGTACGT").len;
+	gref_handle_release(handle, 0);
+	assert(per_sec > 0);
+
+	uint32_t volatile done = 0;
+	pthread_t th[4];
+	struct gref_test_handle_s t[4];
+	for(int64_t i = 0; i < 4; i++) {
+		t[i] = (struct gref_test_handle_s){ .handle = handle, .reader = i, .done = &done, .per_sec = per_sec };
+		pthread_create(&th[i], NULL, gref_test_handle_reader, (void *)&t[i]);
+	}
 
-	/* enumerate */
-	#define _f(_i)					gref_iter_next(_i)
-	#define _check_kmer(_t, _k, _id, _pos) ( \
-		   (_t).kmer == _pack(_k) \
-		&& (_t).gid_pos.gid == _encode_id(_id, 0) \
-		&& (_t).gid_pos.pos == (_pos) \
-	)
-	#define _print_kmer(_t) \
-		"kmer(%llx), sec(%u), pos(%u)", \
-		(_t).kmer, _decode_id((_t).gid_pos.gid), (_t).gid_pos.pos
+	/* replace the index under the readers; the old ones are freed in publish */
+	for(int64_t i = 1; i < 12; i++) {
+		assert(gref_handle_publish(handle, _gen(i)) == 0);
+	}
+	done = 1;
 
-	struct gref_kmer_tuple_s t;
+	int64_t broken = 0;
+	for(int64_t i = 0; i < 4; i++) {
+		pthread_join(th[i], NULL);
+		broken += t[i].broken;
+	}
+	assert(broken == 0, "broken(%lld)", broken);
 
-	/* sec0 */
-	t = _f(iter); assert(_check_kmer(t, "GGAA", 0, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GGGA", 0, 0), _print_kmer(t));
+	/* readers after the last publish see the last generation */
+	gref_idx_t const *idx = gref_handle_acquire(handle, 0);
+	assert(gref_get_section_count(idx) == 12, "%lld", gref_get_section_count(idx));
+	gref_handle_release(handle, 0);
+	gref_handle_clean(handle);
 
-	/* sec0-sec1 */
-	t = _f(iter); assert(_check_kmer(t, "GAAA", 0, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GGAA", 0, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GAAC", 0, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GGAC", 0, 1), _print_kmer(t));
+	#undef _gen
+}
 
-	/* sec0-sec1-sec2 */
-	t = _f(iter); assert(_check_kmer(t, "AAAA", 0, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GAAA", 0, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "AACA", 0, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GACA", 0, 2), _print_kmer(t));
+/* snp */
+unittest()
+{
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 4));
+	gref_append_segment(pool, _str("s0"), _seq("ACGTNACCGGTTAAC"));
+	assert(gref_append_snp(pool, _str("s0"), 2, 'A') == 0);		/* ACGT -> ACRT */
+	assert(gref_append_snp(pool, _str("s0"), 4, 'A') == 0);		/* N is kept */
+	assert(gref_append_snp(pool, _str("s0"), 15, 'A') != 0);
+	assert(gref_append_snp(pool, _str("s0"), 3, 'N') != 0);
+	assert(gref_append_snp(pool, _str("s1"), 0, 'A') != 0);		/* undefined */
+	struct gref_snp_s const undef = { .name = "s2", .name_len = 2, .pos = 0, .allele = 'A' };
+	assert(gref_append_snp_batch(pool, &undef, 1) == 0);
+
+	/* the undefined names are not inserted */
+	assert(((struct gref_s *)pool)->sec_cnt == 1, "%u", ((struct gref_s *)pool)->sec_cnt);
+	assert(hmap_get_count(((struct gref_s *)pool)->hmap) == 1);
+	gref_append_segment(pool, _str("s1"), _seq("GGGG"));
+	assert(gref_append_snp(pool, _str("s2"), 0, 'A') != 0);
+
+	struct gref_snp_s const snp[] = {
+		{ .name = "s0", .name_len = 2, .pos = 5, .allele = 'G' },		/* ACCG -> RCCG */
+		{ .name = "s0", .name_len = 2, .pos = 14, .allele = 'T' },
+		{ .name = "s1", .name_len = 2, .pos = 1, .allele = 'T' },		/* GGGG -> GKGG */
+		{ .name = "s1", .name_len = 2, .pos = 4, .allele = 'T' }		/* out of the segment */
+	};
+	assert(gref_append_snp_batch(pool, snp, 4) == 3);
 
-	t = _f(iter); assert(_check_kmer(t, "AAAC", 0, 3), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACAC", 0, 3), _print_kmer(t));
+	gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+	assert(idx != NULL);
+	assert(gref_get_section_count(idx) == 2, "%lld", gref_get_section_count(idx));
+
+	/* both alleles */
+	#define _has(_r, _gid, _pos) ({ \
+		int64_t found = 0; \
+		for(int64_t i = 0; i < (_r).len; i++) { \
+			struct gref_gid_pos_s const _p = gref_match_get(idx, &(_r), i); \
+			found |= (_p.gid == (_gid) && _p.pos == (_pos)); \
+		} \
+		found; \
+	})
+	struct gref_match_res_s r = gref_match(idx, (uint8_t const *)"ACGT");
+	assert(_has(r, 0, 0), "len(%lld)", r.len);
+	r = gref_match(idx, (uint8_t const *)"ACAT");
+	assert(_has(r, 0, 0), "len(%lld)", r.len);
+	r = gref_match(idx, (uint8_t const *)"GCCG");
+	assert(_has(r, 0, 5), "len(%lld)", r.len);
+	r = gref_match(idx, (uint8_t const *)"TAAT");
+	assert(_has(r, 0, 11), "len(%lld)", r.len);
+	r = gref_match(idx, (uint8_t const *)"GTGG");
+	assert(_has(r, 2, 0), "len(%lld)", r.len);
+	assert(gref_match(idx, (uint8_t const *)"GTAC").len == 0);	/* no kmer over N */
+	#undef _has
+	gref_clean(idx);
 
-	/* sec0-sec2 */
-	t = _f(iter); assert(_check_kmer(t, "GAAA", 0, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GGAA", 0, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "AAAC", 0, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GAAC", 0, 2), _print_kmer(t));
+	/* the sequence is not owned by the pool */
+	pool = gref_init_pool(GREF_PARAMS(.k = 4, .seq_format = GREF_4BIT, .copy_mode = GREF_NOCOPY));
+	uint8_t const seq4[] = { 0x01, 0x02, 0x04, 0x08 };
+	gref_append_segment(pool, _str("s0"), seq4, 4);
+	assert(gref_append_snp(pool, _str("s0"), 0, 0x02) != 0);
+	assert(gref_append_snp_batch(pool, snp, 1) < 0);
+	gref_clean(pool);
+}
 
-	t = _f(iter); assert(_check_kmer(t, "AACA", 0, 3), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "AACC", 0, 3), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "AACG", 0, 3), _print_kmer(t));
+/* position-sorted buckets */
+unittest()
+{
+	uint8_t seq[4][1000];
+	srand(19);
+	for(int64_t i = 0; i < 4; i++) {
+		for(int64_t j = 0; j < 1000; j++) { seq[i][j] = "AACGTT"[rand() % 6]; }
+	}
 
-	/* sec1-sec2 */
-	t = _f(iter); assert(_check_kmer(t, "AACA", 1, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CACA", 1, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "AACC", 1, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CACC", 1, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "AACG", 1, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CACG", 1, 0), _print_kmer(t));
+	for(int64_t f = 0; f < 3; f++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 6,
+			.seq_direction = GREF_FW_RV,
+			.entry_format = (f == 1) ? GREF_ENTRY_PACKED : GREF_ENTRY_PLAIN));
+		for(int64_t i = 0; i < 3; i++) {
+			char name[8];
+			sprintf(name, "s%" PRId64 "", i);
+			gref_append_segment(pool, name, strlen(name), seq[i], 1000);
+			if(i > 0) { gref_append_link(pool, "s0", 2, 0, name, strlen(name), 0); }
+		}
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL);
+
+		/* the delta buckets are kept in order */
+		if(f == 2) {
+			assert(gref_idx_append_segment(idx, "s3", 2, seq[3], 1000) == 0);
+			assert(gref_idx_append_link(idx, "s3", 2, 0, "s1", 2, 0) == 0);
+			assert(gref_update_index(idx) == 0);
+		}
 
-	/* sec2 */
-	t = _f(iter); assert(_check_kmer(t, "ACAA", 2, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACCA", 2, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACGA", 2, 0), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "ACAC", 2, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACCC", 2, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACGC", 2, 0), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "ACAG", 2, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACCG", 2, 0), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "ACGG", 2, 0), _print_kmer(t));
+		int64_t unsorted = 0, mismatch = 0;
+		for(uint64_t kmer = 0; kmer < 0x1000; kmer++) {
+			struct gref_match_res_s r = gref_match_2bitpacked(idx, kmer);
+			for(int64_t i = 1; i < r.len; i++) {
+				struct gref_gid_pos_s a = gref_match_get(idx, &r, i - 1), b = gref_match_get(idx, &r, i);
+				unsorted += gref_cmp_gid_pos(&a, &b) >= 0;
+			}
 
-	t = _f(iter); assert(_check_kmer(t, "CAAG", 2, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CCAG", 2, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CGAG", 2, 1), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "CACG", 2, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CCCG", 2, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CGCG", 2, 1), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "CAGG", 2, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CCGG", 2, 1), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CGGG", 2, 1), _print_kmer(t));
+			/* range, compared to the linear scan */
+			uint32_t const gid = rand() % 8, lo = rand() % 1000, hi = lo + rand() % 400;
+			struct gref_match_res_s q = gref_match_in_range(idx, kmer, gid, lo, hi);
+			int64_t cnt = 0;
+			for(int64_t i = 0; i < r.len; i++) {
+				struct gref_gid_pos_s e = gref_match_get(idx, &r, i);
+				if(e.gid != gid || e.pos < lo || e.pos >= hi) { continue; }
+				struct gref_gid_pos_s x = (cnt < q.len) ? gref_match_get(idx, &q, cnt) : (struct gref_gid_pos_s){ 0 };
+				mismatch += x.gid != e.gid || x.pos != e.pos;
+				cnt++;
+			}
+			mismatch += cnt != q.len;
+		}
+		assert(unsorted == 0 && mismatch == 0, "f(%lld), unsorted(%lld), mismatch(%lld)", f, unsorted, mismatch);
+
+		/* diagonals of three seeds on a query taken from s1 */
+		int64_t const dist[3] = { 0, 3, -5 };
+		for(int64_t p = 5; p < 900; p += 11) {
+			struct gref_match_res_s res[3];
+			for(int64_t i = 0; i < 3; i++) {
+				res[i] = gref_match(idx, &seq[1][p + dist[i]]);
+			}
+			struct gref_gid_pos_s dst[1024];
+			int64_t const n = gref_match_intersect(idx, res, dist, 3, dst);
+
+			/* brute force */
+			int64_t cnt = 0, found = 0;
+			for(int64_t a = 0; a < res[0].len; a++) {
+				struct gref_gid_pos_s e = gref_match_get(idx, &res[0], a);
+				int64_t hit = 1;
+				for(int64_t i = 1; i < 3; i++) {
+					int64_t h = 0;
+					for(int64_t b = 0; b < res[i].len; b++) {
+						struct gref_gid_pos_s x = gref_match_get(idx, &res[i], b);
+						h |= x.gid == e.gid && (int64_t)x.pos == (int64_t)e.pos + dist[i];
+					}
+					hit &= h;
+				}
+				if(hit == 0) { continue; }
+				mismatch += cnt >= n || dst[cnt].gid != e.gid || dst[cnt].pos != e.pos;
+				found |= e.gid == 2 && e.pos == p;
+				cnt++;
+			}
+			mismatch += cnt != n || found == 0;
+		}
+		assert(mismatch == 0, "f(%lld), mismatch(%lld)", f, mismatch);
+		gref_clean(idx);
+	}
+}
 
-	t = _f(iter); assert(_check_kmer(t, "AAGT", 2, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CAGT", 2, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GAGT", 2, 2), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "ACGT", 2, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CCGT", 2, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GCGT", 2, 2), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "AGGT", 2, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CGGT", 2, 2), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GGGT", 2, 2), _print_kmer(t));
-	
-	t = _f(iter); assert(_check_kmer(t, "AGTG", 2, 3), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "CGTG", 2, 3), _print_kmer(t));
-	t = _f(iter); assert(_check_kmer(t, "GGTG", 2, 3), _print_kmer(t));
+/* seed extension */
+unittest()
+{
+	char const *acgt = "ACGT";
+	uint8_t s[3][160], q[2][160];
+	srand(23);
+	for(int64_t i = 0; i < 100; i++) { s[0][i] = acgt[rand() % 4]; }
+	for(int64_t i = 0; i < 60; i++) { s[1][i] = s[2][i] = acgt[rand() % 4]; }
+	for(int64_t i = 10; i < 60; i++) { s[2][i] = acgt[(strchr(acgt, s[1][i]) - acgt + 1) % 4]; }
+
+	/* s0[20, 100) + s1[0, 40) + mismatch + random, and its reverse complement */
+	memcpy(&q[0][0], &s[0][20], 80);
+	memcpy(&q[0][80], &s[1][0], 40);
+	q[0][120] = acgt[(strchr(acgt, s[1][40]) - acgt + 1) % 4];
+	for(int64_t i = 121; i < 130; i++) { q[0][i] = acgt[rand() % 4]; }
+	for(int64_t i = 0; i < 130; i++) { q[1][i] = "TGCA"[strchr(acgt, q[0][129 - i]) - acgt]; }
+
+	for(int64_t c = 0; c < 4; c++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 8,
+			.seq_storage = (c & 0x01) ? GREF_STORAGE_2BIT : GREF_STORAGE_4BIT,
+			.seq_direction = (c < 2) ? GREF_FW_ONLY : GREF_FW_RV,
+			.kmer_strand = (c == 3) ? GREF_KMER_CANONICAL : GREF_KMER_BOTH));
+		gref_append_segment(pool, "s0", 2, s[0], 100);
+		gref_append_segment(pool, "s1", 2, s[1], 60);
+		gref_append_segment(pool, "s2", 2, s[2], 60);
+		gref_append_link(pool, "s0", 2, 0, "s1", 2, 0);
+		gref_append_link(pool, "s0", 2, 0, "s2", 2, 0);
+		gref_idx_t *idx = gref_build_index(gref_freeze_pool(pool));
+		assert(idx != NULL, "c(%lld)", c);
+
+		/* seeds on s0 and on s1, both on the forward query */
+		struct gref_mem_s m;
+		uint32_t path[16];
+		struct { int64_t qpos; struct gref_gid_pos_s hit; } const seed[3] = {
+			{ 10, { .gid = 0, .pos = 30 } },
+			{ 76, { .gid = 0, .pos = 96 } },	/* across the branch */
+			{ 100, { .gid = 2, .pos = 20 } }
+		};
+		for(int64_t i = 0; i < 3; i++) {
+			memset(path, 0xff, sizeof(path));
+			assert(gref_match_extend(idx, q[0], 130, seed[i].qpos, seed[i].hit, &m, path, 16) == 0, "c(%lld), i(%lld)", c, i);
+			assert(m.qpos == 0 && m.len == 120, "c(%lld), i(%lld), qpos(%lld), len(%lld)", c, i, m.qpos, m.len);
+			assert(m.head.gid == 0 && m.head.pos == 20, "c(%lld), i(%lld), head(%u, %u)", c, i, m.head.gid, m.head.pos);
+			assert(m.tail.gid == 2 && m.tail.pos == 39, "c(%lld), i(%lld), tail(%u, %u)", c, i, m.tail.gid, m.tail.pos);
+			assert(m.path_len == 2 && path[0] == 0 && path[1] == 2 && path[2] == 0xffffffff, "c(%lld), i(%lld), path_len(%lld)", c, i, m.path_len);
+		}
 
-	t = _f(iter); assert(_check_kmer(t, "GTGT", 2, 4), _print_kmer(t));
+		/* the reverse strand, from the hit found by gref_match */
+		int64_t found = 0;
+		struct gref_match_res_s r = gref_match(idx, &q[1][30]);
+		for(int64_t i = 0; i < r.len; i++) {
+			struct gref_gid_pos_s h = gref_match_get(idx, &r, i);
+			if(r.rv) { h = (struct gref_gid_pos_s){ .gid = h.gid ^ 0x01, .pos = gref_get_section(idx, gref_id(h.gid))->len - h.pos - 8 }; }
+			if(gref_match_extend(idx, q[1], 130, 30, h, &m, path, 16) != 0 || m.len != 120) { continue; }
+			found++;
+			assert(m.qpos == 10, "c(%lld), qpos(%lld)", c, m.qpos);
+			assert(m.head.gid == 3 && m.head.pos == 20, "c(%lld), head(%u, %u)", c, m.head.gid, m.head.pos);
+			assert(m.tail.gid == 1 && m.tail.pos == 79, "c(%lld), tail(%u, %u)", c, m.tail.gid, m.tail.pos);
+			assert(m.path_len == 2 && path[0] == 3 && path[1] == 1, "c(%lld), path_len(%lld)", c, m.path_len);
+		}
+		assert(found == 1, "c(%lld), found(%lld)", c, found);
+
+		/* seed mismatch, out of range, and the path capacity */
+		assert(gref_match_extend(idx, q[0], 130, 10, (struct gref_gid_pos_s){ .gid = 4, .pos = 30 }, &m, path, 16) != 0);
+		assert(gref_match_extend(idx, q[0], 130, 125, seed[0].hit, &m, path, 16) != 0);
+		assert(gref_match_extend(idx, q[0], 130, 10, (struct gref_gid_pos_s){ .gid = 2, .pos = 55 }, &m, path, 16) != 0);
+		assert(gref_match_extend(idx, q[0], 130, 10, seed[0].hit, &m, path, 1) == 0);
+		assert(m.len == 80 && m.path_len == 1 && m.tail.gid == 0 && m.tail.pos == 99, "c(%lld), len(%lld)", c, m.len);
+		gref_clean(idx);
+	}
+}
 
-	t = _f(iter); assert(t.kmer == GREF_ITER_KMER_TERM, "%llx, %llx", t.kmer, GREF_ITER_KMER_TERM);
-	assert(t.gid_pos.gid == (uint32_t)-1, "gid(%u)", t.gid_pos.gid);
+/* flat graph view */
+unittest()
+{
+	uint8_t seq[200];
+	srand(29);
+	for(int64_t i = 0; i < 200; i++) { seq[i] = "ACGT"[rand() % 4]; }
+
+	for(int64_t c = 0; c < 2; c++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 4,
+			.seq_storage = (c == 0) ? GREF_STORAGE_4BIT : GREF_STORAGE_2BIT));
+		char name[8];
+		for(int64_t i = 0; i < 6; i++) {
+			sprintf(name, "sec%" PRId64 "", i);
+			gref_append_segment(pool, name, strlen(name), &seq[i * 20], 10 + i * 5);
+		}
+		for(int64_t i = 0; i < 10; i++) {
+			char src[8], dst[8];
+			sprintf(src, "sec%d", rand() % 6);
+			sprintf(dst, "sec%d", rand() % 6);
+			gref_append_link(pool, src, 4, rand() % 2, dst, 4, rand() % 2);
+		}
+		assert(gref_graph_init(pool) == NULL);
+		gref_acv_t *acv = gref_freeze_pool(pool);
+
+		for(int64_t t = 0; t < 2; t++) {
+			gref_t *gref = (t == 0) ? acv : gref_build_index(acv);
+			assert(gref != NULL);
+			gref_graph_t *graph = gref_graph_init(gref);
+			assert(graph != NULL);
+			assert(graph->gid_cnt == 2 * gref_get_section_count(gref), "%lld", graph->gid_cnt);
+			assert(graph->lim == gref_get_lim(gref));
+
+			/* arrays, compared to the hashmap accessors */
+			int64_t mismatch = 0;
+			for(uint32_t g = 0; g < graph->gid_cnt; g++) {
+				struct gref_section_s const *s = gref_get_section(gref, g);
+				struct gref_link_s l = gref_get_link(gref, g);
+				struct gref_str_s n = gref_get_name(gref, g);
+				mismatch += graph->base[g] != s->base || graph->len[g] != s->len;
+				mismatch += graph->link_idx[g + 1] - graph->link_idx[g] != l.len
+					|| &graph->link_table[graph->link_idx[g]] != l.gid_arr;
+				mismatch += graph->name[gref_id(g)] != n.str || graph->name_len[gref_id(g)] != n.len;
+			}
+			assert(mismatch == 0, "c(%lld), t(%lld), mismatch(%lld)", c, t, mismatch);
+
+			/* batch accessors */
+			uint32_t gid[32];
+			struct gref_section_s sec[32];
+			struct gref_link_s link[32];
+			struct gref_str_s str[32];
+			for(int64_t i = 0; i < 32; i++) { gid[i] = rand() % graph->gid_cnt; }
+			assert(gref_graph_get_section(graph, gid, 32, sec) == 32);
+			assert(gref_graph_get_link(graph, gid, 32, link) == 32);
+			assert(gref_graph_get_name(graph, gid, 32, str) == 32);
+			for(int64_t i = 0; i < 32; i++) {
+				struct gref_section_s const *s = gref_get_section(gref, gid[i]);
+				struct gref_link_s l = gref_get_link(gref, gid[i]);
+				struct gref_str_s n = gref_get_name(gref, gid[i]);
+				mismatch += sec[i].gid != gid[i] || sec[i].base != s->base || sec[i].len != s->len;
+				mismatch += link[i].gid_arr != l.gid_arr || link[i].len != l.len;
+				mismatch += str[i].str != n.str || str[i].len != n.len;
+			}
+			assert(mismatch == 0, "c(%lld), t(%lld), mismatch(%lld)", c, t, mismatch);
+
+			gid[31] = graph->gid_cnt;
+			assert(gref_graph_get_section(graph, gid, 32, sec) == -1);
+			assert(gref_graph_get_link(graph, gid, 32, link) == -1);
+			assert(gref_graph_get_name(graph, gid, 32, str) == -1);
+			gref_graph_clean(graph);
+			if(t == 1) { gref_clean(gref); }
+		}
+	}
+}
 
-	#undef _f
-	#undef _check_kmer
-	#undef _print_kmer
+/* bounded ambiguity expansion */
+unittest()
+{
+	char const *acgt = "ACGT", *seq = "ACRRRRRRRRGT";
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 8));
+	gref_append_segment(pool, _str("sec0"), _seq(seq));
+	gref_acv_t *acv = gref_freeze_pool(pool);
 
-	gref_iter_clean(iter);
+	uint16_t const caps[] = { 0, 16, 1 };
+	int64_t const full[] = { 256, 16, 1 };
+	for(int64_t c = 0; c < sizeof(caps) / sizeof(uint16_t); c++) {
+		gref_iter_t *iter = gref_iter_init(acv, GREF_ITER_PARAMS(.max_expansion = caps[c]));
+
+		int64_t cnt[5] = { 0 }, invalid = 0;
+		struct gref_kmer_tuple_s t;
+		while((t = gref_iter_next(iter)).gid_pos.gid != (uint32_t)-1) {
+			cnt[t.gid_pos.pos]++;
+			for(int64_t i = 0; i < 8; i++) {
+				uint64_t b = 0x03 & (t.kmer>>(2 * i));
+				invalid += (t.gid_pos.pos + i < 2 || t.gid_pos.pos + i >= 10)
+					? (b != (uint64_t)(strchr(acgt, seq[t.gid_pos.pos + i]) - acgt))
+					: (b != 0 && b != 2);
+			}
+		}
+		assert(invalid == 0, "cap(%u), invalid(%lld)", caps[c], invalid);
+		assert(cnt[2] == full[c], "cap(%u), cnt(%lld)", caps[c], cnt[2]);
+		for(int64_t p = 0; p < 5; p++) {
+			assert(cnt[p] >= 1 && cnt[p] <= full[c], "cap(%u), pos(%lld), cnt(%lld)", caps[c], p, cnt[p]);
+		}
+		gref_iter_clean(iter);
+	}
 	gref_clean(acv);
 }
 
-/* build index */
+/* fixed-stride sampling */
 unittest()
 {
-	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
-		.k = 4,
-		.seq_head_margin = 32,
-		.seq_tail_margin = 32));
-
-	/* append */
-	gref_append_segment(pool, _str("sec0"), _seq("GGRA"));
-	gref_append_segment(pool, _str("sec1"), _seq("MGGG"));
+	srand(0);
+	gref_pool_t *pool = gref_init_pool(GREF_PARAMS(.k = 8, .seq_format = GREF_4BIT));
+	char *seq = unittest_generate_random_sequence(1000);
+	gref_append_segment(pool, _str("sec0"), (uint8_t const *)seq, strlen(seq));
+	gref_append_segment(pool, _str("sec1"), (uint8_t const *)seq, 500);
 	gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
-	gref_append_link(pool, _str("sec1"), 0, _str("sec2"), 0);
-	gref_append_segment(pool, _str("sec2"), _seq("ACVVGTGT"));
-	gref_append_link(pool, _str("sec0"), 0, _str("sec2"), 0);
-
-	/* build index */	
+	free(seq);
 	gref_acv_t *acv = gref_freeze_pool(pool);
-	assert(acv != NULL, "acv(%p)", acv);
 
-	gref_idx_t *idx = gref_build_index(pool);
-	assert(idx != NULL, "idx(%p)", idx);
+	gref_iter_t *iter = gref_iter_init(acv, GREF_ITER_PARAMS(.step_size = 1, .seq_direction = GREF_FW_RV));
+	gref_iter_t *sparse = gref_iter_init(acv, GREF_ITER_PARAMS(.step_size = 3, .seq_direction = GREF_FW_RV));
 
-	/* section count */
-	assert(gref_get_section_count(idx) == 3, "%lld", gref_get_section_count(idx));
+	int64_t cnt = 0, mismatch = 0;
+	struct gref_kmer_tuple_s t, u;
+	while((t = gref_iter_next(iter)).gid_pos.gid != (uint32_t)-1) {
+		if(t.gid_pos.pos % 3 != 0) { continue; }
+		u = gref_iter_next(sparse);
+		mismatch += (t.kmer != u.kmer || t.gid_pos.gid != u.gid_pos.gid || t.gid_pos.pos != u.gid_pos.pos);
+		cnt++;
+	}
+	assert(gref_iter_next(sparse).gid_pos.gid == (uint32_t)-1);
+	assert(cnt > 2 * 1500 / 3 - 10, "cnt(%lld)", cnt);
+	assert(mismatch == 0, "mismatch(%lld)", mismatch);
 
-	/* total len */
-	assert(gref_get_total_len(idx) == 16, "len(%lld)", gref_get_total_len(idx));
+	gref_iter_clean(iter);
+	gref_iter_clean(sparse);
+	gref_clean(acv);
+}
 
-	gref_clean(idx);
+/* minimizer index */
+unittest()
+{
+	int64_t const k = 12, w = 10;
+	int64_t const len0 = 3000, len1 = 2000;
+
+	srand(1);
+	char *seq0 = unittest_generate_random_sequence(len0);
+	char *seq1 = unittest_generate_random_sequence(len1);
+
+	gref_idx_t *idx[2] = { NULL, NULL };
+	for(int64_t j = 0; j < 2; j++) {
+		gref_pool_t *pool = gref_init_pool(GREF_PARAMS(
+			.k = k,
+			.seq_format = GREF_4BIT,
+			.kmer_idx_type = GREF_KMER_IDX_DENSE,
+			.minimizer_window = (j == 0) ? 1 : w));
+		gref_append_segment(pool, _str("sec0"), (uint8_t const *)seq0, len0);
+		gref_append_segment(pool, _str("sec1"), (uint8_t const *)seq1, len1);
+		gref_append_link(pool, _str("sec0"), 0, _str("sec1"), 0);
+		idx[j] = gref_build_index(gref_freeze_pool(pool));
+		assert(idx[j] != NULL);
+	}
+
+	/* density is around 2 / (w + 1) */
+	assert(idx[1]->kmer_table_size * 4 < idx[0]->kmer_table_size,
+		"%lld, %lld", idx[1]->kmer_table_size, idx[0]->kmer_table_size);
+
+	/* query minimizers must be found in the index at the corresponding position */
+	int64_t const qlen = 150;
+	int64_t found = 0, total = 0;
+	for(int64_t a = 0; a < len0 + len1 - qlen; a += 37) {
+		char q[qlen];
+		for(int64_t i = 0; i < qlen; i++) {
+			q[i] = (a + i < len0) ? seq0[a + i] : seq1[a + i - len0];
+		}
+		gref_match_stream_t *stream = gref_match_stream_init(idx[1], (uint8_t const *)q, qlen,
+			GREF_MATCH_STREAM_PARAMS( .seq_format = GREF_4BIT, .minimizer_window = w ));
+
+		struct gref_match_stream_res_s r;
+		while((r = gref_match_stream_next(stream)).pos != -1) {
+			uint32_t gid = (a + r.pos < len0) ? gref_gid(0, GREF_FW) : gref_gid(1, GREF_FW);
+			uint32_t pos = (a + r.pos < len0) ? a + r.pos : a + r.pos - len0;
+			for(int64_t i = 0; i < r.res.len; i++) {
+				struct gref_gid_pos_s const p = gref_match_get(idx[1], &r.res, i);
+				if(p.gid == gid && p.pos == pos) {
+					found++; break;
+				}
+			}
+			total++;
+		}
+		gref_match_stream_clean(stream);
+
+		/* reverse-complemented query, matched with the reverse kmers */
+		char rq[qlen];
+		for(int64_t i = 0; i < qlen; i++) {
+			rq[i] = "\x00\x08\x04\x00\x02\x00\x00\x00\x01"[(uint8_t)q[qlen - 1 - i]];
+		}
+		stream = gref_match_stream_init(idx[1], (uint8_t const *)rq, qlen,
+			GREF_MATCH_STREAM_PARAMS( .seq_format = GREF_4BIT, .seq_direction = GREF_FW_RV, .minimizer_window = w ));
+		while((r = gref_match_stream_next(stream)).pos != -1) {
+			if(r.dir != GREF_RV) { continue; }
+			int64_t fpos = a + qlen - k - r.pos;
+			uint32_t gid = (fpos < len0) ? gref_gid(0, GREF_FW) : gref_gid(1, GREF_FW);
+			uint32_t pos = (fpos < len0) ? fpos : fpos - len0;
+			for(int64_t i = 0; i < r.res.len; i++) {
+				struct gref_gid_pos_s const p = gref_match_get(idx[1], &r.res, i);
+				if(p.gid == gid && p.pos == pos) {
+					found++; break;
+				}
+			}
+			total++;
+		}
+		gref_match_stream_clean(stream);
+	}
+	assert(total > 0 && found == total, "found(%lld), total(%lld)", found, total);
+
+	gref_clean(idx[0]);
+	gref_clean(idx[1]);
+	free(seq0);
+	free(seq1);
 }
 
 /* build iterator from gref_idx_t */
@@ -2483,18 +11014,18 @@ unittest()
 	assert(r.len == 2, "%lld", r.len);
 
 	/* check pos */
-	assert(r.gid_pos_arr[0].pos == 4, "%u", r.gid_pos_arr[0].pos);
+	assert(gref_match_get(idx, &r, 0).pos == 4, "%u", gref_match_get(idx, &r, 0).pos);
 
 	/* check section */
-	struct gref_section_s const *sec = gref_get_section(idx, r.gid_pos_arr[0].gid);
+	struct gref_section_s const *sec = gref_get_section(idx, gref_match_get(idx, &r, 0).gid);
 	assert(sec->gid == 4, "gid(%u)", sec->gid);
 	assert(sec->len == 8, "len(%u)", sec->len);
 
 	/* check pos */
-	assert(r.gid_pos_arr[1].pos == 4, "%u", r.gid_pos_arr[1].pos);
+	assert(gref_match_get(idx, &r, 1).pos == 4, "%u", gref_match_get(idx, &r, 1).pos);
 
 	/* check section */
-	sec = gref_get_section(idx, r.gid_pos_arr[1].gid);
+	sec = gref_get_section(idx, gref_match_get(idx, &r, 1).gid);
 	assert(sec->gid == 5, "gid(%u)", sec->gid);
 	assert(sec->len == 8, "len(%u)", sec->len);
 
@@ -2505,26 +11036,26 @@ unittest()
 	assert(r.len == 3, "%lld", r.len);
 
 	/* check pos */
-	assert(r.gid_pos_arr[0].pos == 0, "%u", r.gid_pos_arr[0].pos);
+	assert(gref_match_get(idx, &r, 0).pos == 0, "%u", gref_match_get(idx, &r, 0).pos);
 
 	/* check section */
-	sec = gref_get_section(idx, r.gid_pos_arr[0].gid);
+	sec = gref_get_section(idx, gref_match_get(idx, &r, 0).gid);
 	assert(sec->gid == 2, "gid(%u)", sec->gid);
 	assert(sec->len == 4, "len(%u)", sec->len);
 
 	/* check pos */
-	assert(r.gid_pos_arr[1].pos == 1, "%u", r.gid_pos_arr[1].pos);
+	assert(gref_match_get(idx, &r, 1).pos == 1, "%u", gref_match_get(idx, &r, 1).pos);
 
 	/* check section */
-	sec = gref_get_section(idx, r.gid_pos_arr[1].gid);
+	sec = gref_get_section(idx, gref_match_get(idx, &r, 1).gid);
 	assert(sec->gid == 4, "gid(%u)", sec->gid);
 	assert(sec->len == 8, "len(%u)", sec->len);
 
 	/* check pos */
-	assert(r.gid_pos_arr[2].pos == 3, "%u", r.gid_pos_arr[2].pos);
+	assert(gref_match_get(idx, &r, 2).pos == 3, "%u", gref_match_get(idx, &r, 2).pos);
 
 	/* check section */
-	sec = gref_get_section(idx, r.gid_pos_arr[2].gid);
+	sec = gref_get_section(idx, gref_match_get(idx, &r, 2).gid);
 	assert(sec->gid == 5, "gid(%u)", sec->gid);
 	assert(sec->len == 8, "len(%u)", sec->len);
 
@@ -16,6 +16,7 @@
 #define _GREF_H_INCLUDED
 
 #include <stdint.h>
+#include "zf/zf.h"
 
 /**
  * @enum gref_error
@@ -52,6 +53,124 @@ enum gref_format_flags {
 	GREF_4BIT					= 2,
 };
 
+/**
+ * @enum gref_build_mode
+ *
+ * @brief GREF_BUILD_SORT collects all the (kmer, gid, pos) tuples and sorts them.
+ * GREF_BUILD_COUNT enumerates kmers twice (count, then scatter) without the
+ * tuple buffer, which reduces the peak memory of gref_build_index.
+ * GREF_BUILD_PARTITION spills the tuples to a temporary file (in TMPDIR) in
+ * partitions of the kmer prefix, and sorts them one at a time within
+ * build_mem_kb, so that only the kmer table and the bucket table are held in
+ * memory.
+ */
+enum gref_build_mode {
+	GREF_BUILD_SORT				= 1,
+	GREF_BUILD_COUNT			= 2,
+	GREF_BUILD_PARTITION		= 3
+};
+
+/**
+ * @enum gref_kmer_idx_type
+ *
+ * @brief bucket table representation. GREF_KMER_IDX_DENSE is a direct-address
+ * table of 64-bit offsets (8 * 4^k bytes). GREF_KMER_IDX_COMPACT holds a 64-bit
+ * base per 64 buckets and 16-bit relative offsets (about 2.1 * 4^k bytes), at
+ * the cost of one more (mostly cached) memory access on lookup. GREF_KMER_IDX_INLINE
+ * packs the offset and the count of a bucket in a 16-byte slot with a copy of
+ * its first entry (16 * 4^k bytes), so that a lookup on a singleton bucket
+ * costs a single cache miss. it is not available with GREF_ENTRY_PACKED.
+ * GREF_KMER_IDX_HASH is an open-addressing table on the kmers present (about
+ * 21 bytes per distinct kmer), probed 16 slots at a time with 8-bit tags, which
+ * allows k up to 32. it cannot be built with GREF_BUILD_COUNT. defaults to dense
+ * for k <= 12, compact for k <= 16 (or any k with GREF_BUILD_COUNT), and hash
+ * otherwise.
+ */
+enum gref_kmer_idx_type {
+	GREF_KMER_IDX_DENSE			= 1,
+	GREF_KMER_IDX_COMPACT		= 2,
+	GREF_KMER_IDX_INLINE		= 3,
+	GREF_KMER_IDX_HASH			= 4
+};
+
+/**
+ * @enum gref_kmer_strand
+ *
+ * @brief GREF_KMER_BOTH stores the kmers on the forward and reverse strands
+ * separately. GREF_KMER_CANONICAL stores each occurrence once, under the smaller
+ * of the kmer and its reverse complement (palindromic kmers are stored on both
+ * strands). the gid of an entry tells the strand the stored kmer was read from,
+ * and the query is canonicalized on matching (see gref_match_res_s). sampling
+ * (step_size, minimizer_window) is not available in the canonical mode.
+ */
+enum gref_kmer_strand {
+	GREF_KMER_BOTH				= 1,
+	GREF_KMER_CANONICAL			= 2
+};
+
+/**
+ * @enum gref_occ_mode
+ *
+ * @brief what gref_build_index does on buckets larger than the occurrence cap,
+ * the smaller of max_occ and the size that masks the mask_top_ppm most frequent
+ * kmers (in parts per million of the distinct kmers). GREF_OCC_DROP empties the
+ * bucket, GREF_OCC_TRUNCATE keeps as many entries as the cap. either way the kmer
+ * is flagged (masked in gref_match_res_s) and the original count is kept for
+ * gref_match_count. incremental updates are not available on capped indices.
+ */
+enum gref_occ_mode {
+	GREF_OCC_DROP				= 1,
+	GREF_OCC_TRUNCATE			= 2
+};
+
+/**
+ * @enum gref_entry_format
+ *
+ * @brief layout of the kmer table. GREF_ENTRY_PLAIN stores gref_gid_pos_s (8
+ * bytes per entry). GREF_ENTRY_PACKED stores (gid, pos) in the fewest bytes
+ * that hold the largest gid and the longest section, chosen on gref_build_index.
+ * gid_pos_arr of the match result is opaque; entries are read with
+ * gref_match_get or gref_match_decode, which work on both formats.
+ * incremental updates are not available on packed indices.
+ */
+enum gref_entry_format {
+	GREF_ENTRY_PLAIN			= 1,
+	GREF_ENTRY_PACKED			= 2
+};
+
+/**
+ * @enum gref_seq_storage
+ *
+ * @brief GREF_STORAGE_4BIT keeps one 4bit code per byte. GREF_STORAGE_2BIT packs
+ * the sequence into 2bit codes (32 bases per word) with a sorted run-length list
+ * of the non-ACGT bases, converted on gref_freeze_pool. the reverse strand is not
+ * materialized in the 2bit storage regardless of seq_direction, and the base of
+ * sections returned by gref_get_section is the offset in the packed array (see
+ * gref_get_packed_seq and gref_decode_section). requires GREF_COPY.
+ */
+enum gref_seq_storage {
+	GREF_STORAGE_4BIT			= 1,
+	GREF_STORAGE_2BIT			= 2
+};
+
+/**
+ * @enum gref_table_mem
+ *
+ * @brief backing memory of the kmer tables, bitwise or of the flags. tables
+ * are moved to anonymous mappings after they are built (and loaded with
+ * gref_load_index, not with gref_load_index_mmap). GREF_MEM_HUGETLB_* fall back
+ * to transparent huge pages if no huge page is reserved. GREF_MEM_INTERLEAVE
+ * spreads pages over the numa nodes the process is allowed to use. the flags
+ * are hints; tables stay on the heap if the mapping fails. linux only.
+ */
+enum gref_table_mem {
+	GREF_MEM_DEFAULT			= 0,
+	GREF_MEM_HUGEPAGE			= 0x01,		/* madvise(MADV_HUGEPAGE) */
+	GREF_MEM_HUGETLB_2M			= 0x02,		/* MAP_HUGETLB with 2MiB pages */
+	GREF_MEM_HUGETLB_1G			= 0x04,		/* MAP_HUGETLB with 1GiB pages */
+	GREF_MEM_INTERLEAVE			= 0x08		/* mbind(MPOL_INTERLEAVE) */
+};
+
 /**
  * @enum gref_copy_mode
  *
@@ -82,7 +201,13 @@ typedef struct gref_s gref_acv_t;
 
 /**
  * @type gref_idx_t
- * @brief immutable sequence pool with kmer index, converted from gref_acv_t
+ * @brief immutable sequence pool with kmer index, converted from gref_acv_t.
+ * the query functions (gref_match*, gref_get_*, gref_iter_init and
+ * gref_match_stream_init with their iterators) do not modify the index and can
+ * be called from multiple threads at once, provided that the lmm in the params
+ * is NULL (iterators and streams are allocated from it). gref_idx_append_*,
+ * gref_update_index, gref_merge_delta and gref_clean need exclusive access; use
+ * gref_handle_t to replace an index under load.
  */
 typedef struct gref_s gref_idx_t;
 
@@ -91,6 +216,17 @@ typedef struct gref_s gref_idx_t;
  */
 typedef struct gref_iter_s gref_iter_t;
 
+/**
+ * @type gref_match_stream_t
+ */
+typedef struct gref_match_stream_s gref_match_stream_t;
+
+/**
+ * @type gref_handle_t
+ * @brief shared reference to an index, replaced with gref_handle_publish
+ */
+typedef struct gref_handle_s gref_handle_t;
+
 /**
  * @struct gref_params_s
  */
@@ -100,10 +236,26 @@ struct gref_params_s {
 	uint8_t seq_format;
 	uint8_t copy_mode;
 	uint16_t num_threads;
-	uint16_t reserved;
+	uint8_t build_mode;
+	uint8_t kmer_idx_type;
 	uint32_t hash_size;
 	uint16_t seq_head_margin;
 	uint16_t seq_tail_margin;
+
+	/* sparse index, see gref_iter_params_s */
+	uint16_t step_size;
+	uint8_t minimizer_window;
+	uint8_t kmer_strand;
+	uint16_t max_expansion;			/* see gref_iter_params_s */
+	uint8_t seq_storage;
+	uint8_t table_mem;				/* see gref_table_mem */
+
+	/* occurrence cap, see gref_occ_mode */
+	uint32_t max_occ;				/* 0: unlimited */
+	uint16_t mask_top_ppm;			/* 0: disabled */
+	uint8_t occ_mode;
+	uint8_t entry_format;			/* see gref_entry_format */
+	uint32_t build_mem_kb;			/* sort and spill buffers of GREF_BUILD_PARTITION, 0: 1 GiB */
 	void *lmm;
 };
 typedef struct gref_params_s gref_params_t;
@@ -112,14 +264,30 @@ typedef struct gref_params_s gref_params_t;
 /**
  * @struct gref_iter_params_s
  */
+#define GREF_ITER_MM_MAX_WINDOW		( 64 )
+#define GREF_ITER_MAX_EXPANSION		( 1024 )	/* default */
 struct gref_iter_params_s {
-	uint32_t step_size;
+	uint32_t step_size;				/* kmers at pos % step_size == 0 are enumerated */
 	uint8_t seq_direction;
-	uint8_t pad[3];
+	uint8_t minimizer_window;		/* (w, k)-minimizers if > 1 (step_size is ignored) */
+	uint16_t max_expansion;			/* ambiguous bases are truncated to the first variant beyond this */
 };
 typedef struct gref_iter_params_s gref_iter_params_t;
 #define GREF_ITER_PARAMS(...)		( &((struct gref_iter_params_s const) { __VA_ARGS__ }) )
 
+/**
+ * @struct gref_match_stream_params_s
+ */
+struct gref_match_stream_params_s {
+	uint32_t step_size;				/* query positions are sampled at pos % step_size == 0 */
+	uint8_t seq_direction;			/* GREF_FW_RV also looks up the reverse complement */
+	uint8_t seq_format;				/* GREF_ASCII or GREF_4BIT */
+	uint8_t minimizer_window;		/* report (w, k)-minimizers only if > 1 (step_size is ignored) */
+	uint8_t pad[1];
+};
+typedef struct gref_match_stream_params_s gref_match_stream_params_t;
+#define GREF_MATCH_STREAM_PARAMS(...)	( &((struct gref_match_stream_params_s const) { __VA_ARGS__ }) )
+
 /**
  * @struct gref_section_s
  * @brief has equivalent fields to struct sea_section_s
@@ -131,6 +299,31 @@ struct gref_section_s {
 };
 typedef struct gref_section_s gref_section_t;
 
+/**
+ * @struct gref_seq_exc_s
+ * @brief run of a non-ACGT code in the 2bit storage, pos is the offset in the
+ * packed array. the 2bit field under the run is zero.
+ */
+struct gref_seq_exc_s {
+	uint64_t pos;
+	uint32_t len;
+	uint8_t base;					/* 4bit code */
+	uint8_t reserved[3];
+};
+typedef struct gref_seq_exc_s gref_seq_exc_t;
+
+/**
+ * @struct gref_packed_seq_s
+ * @brief base at pos is (seq[pos / 32]>>(2 * (pos % 32))) & 0x03 unless overridden by exc
+ */
+struct gref_packed_seq_s {
+	uint64_t const *seq;
+	struct gref_seq_exc_s const *exc;	/* sorted by pos */
+	int64_t exc_cnt;
+	int64_t len;
+};
+typedef struct gref_packed_seq_s gref_packed_seq_t;
+
 /**
  * @struct gref_link_s
  */
@@ -140,6 +333,39 @@ struct gref_link_s {
 };
 typedef struct gref_link_s gref_link_t;
 
+/**
+ * @struct gref_graph_s
+ * @brief flat view of the sections and links, built with gref_graph_init.
+ * base and len are indexed by gid (as gref_get_section), the links of gid are
+ * link_table[link_idx[gid], link_idx[gid + 1]), and the names are indexed by
+ * id (gid>>1). the view refers to the link table and the names of the object,
+ * and is invalidated by gref_update_index, gref_merge_delta and gref_clean.
+ */
+struct gref_graph_s {
+	int64_t gid_cnt;				/* twice the section count */
+	uint8_t const *lim;
+	uint8_t const *const *base;		/* offsets in the 2bit storage */
+	uint32_t const *len;
+	uint32_t const *link_idx;		/* gid_cnt + 1 entries */
+	uint32_t const *link_table;
+	char const *const *name;
+	int32_t const *name_len;
+};
+typedef struct gref_graph_s gref_graph_t;
+
+/**
+ * @struct gref_snp_s
+ * @brief a record of gref_append_snp_batch
+ */
+struct gref_snp_s {
+	char const *name;
+	int32_t name_len;
+	uint8_t allele;			/* in the seq_format of the pool */
+	uint8_t reserved[3];
+	int64_t pos;
+};
+typedef struct gref_snp_s gref_snp_t;
+
 /**
  * @struct gref_str_s
  */
@@ -179,11 +405,38 @@ typedef struct gref_kmer_tuple_s gref_kmer_tuple_t;
  * @struct gref_match_res_s
  */
 struct gref_match_res_s {
-	struct gref_gid_pos_s *gid_pos_arr;
+	void const *gid_pos_arr;		/* opaque, read with gref_match_get or gref_match_decode */
 	int64_t len;
+	uint32_t rv;					/* canonical index: the entries are occurrences of the revcomp of the query */
+	uint32_t masked;				/* the bucket was dropped or truncated by the occurrence cap */
 };
 typedef struct gref_match_res_s gref_match_res_t;
 
+/**
+ * @struct gref_mem_s
+ * @brief maximal exact match, returned by gref_match_extend
+ */
+struct gref_mem_s {
+	int64_t qpos;					/* head on the query */
+	int64_t len;
+	struct gref_gid_pos_s head;		/* first base on the graph */
+	struct gref_gid_pos_s tail;		/* last base on the graph */
+	int64_t path_len;				/* number of sections from head to tail */
+};
+typedef struct gref_mem_s gref_mem_t;
+
+/**
+ * @struct gref_match_stream_res_s
+ * @brief pos is the head of the kmer on the (forward) query, -1 at the end.
+ */
+struct gref_match_stream_res_s {
+	int64_t pos;
+	uint32_t dir;					/* GREF_FW or GREF_RV (res.rv is folded in for canonical indices) */
+	uint32_t reserved;
+	struct gref_match_res_s res;
+};
+typedef struct gref_match_stream_res_s gref_match_stream_res_t;
+
 /**
  * @fn gref_init_pool
  * @brief initialize mutable reference object (reference index precursor)
@@ -212,10 +465,55 @@ gref_idx_t *gref_build_index(
 
 /**
  * @fn gref_disable_index
+ * @brief staged updates (gref_idx_append_*) are kept in the archive.
  */
 gref_acv_t *gref_disable_index(
 	gref_idx_t *idx);
 
+/**
+ * @fn gref_idx_append_segment, gref_idx_append_link
+ *
+ * @brief stage a segment or a link to be added to a live index, visible after
+ * gref_update_index. sections already in the index cannot be redefined.
+ * iterators on the index must be cleaned beforehand.
+ */
+int gref_idx_append_segment(
+	gref_idx_t *idx,
+	char const *name,
+	int32_t name_len,
+	uint8_t const *seq,
+	int64_t seq_len);
+int gref_idx_append_link(
+	gref_idx_t *idx,
+	char const *src,
+	int32_t src_len,
+	int32_t src_ori,
+	char const *dst,
+	int32_t dst_len,
+	int32_t dst_ori);
+
+/**
+ * @fn gref_update_index
+ *
+ * @brief apply the staged segments and links without rebuilding the index. only
+ * the kmers on the new sections and those around the new junctions are
+ * enumerated; the changed buckets are kept in a delta looked up before the main
+ * table. match results obtained before the call are invalidated. fails on
+ * indices built with the occurrence cap (see gref_occ_mode) or the packed
+ * entries (see gref_entry_format).
+ */
+int gref_update_index(
+	gref_idx_t *idx);
+
+/**
+ * @fn gref_merge_delta
+ *
+ * @brief compact the delta into the main kmer table. not thread-safe with lookups.
+ * the delta must be merged before gref_dump_index.
+ */
+int gref_merge_delta(
+	gref_idx_t *idx);
+
 /**
  * @fn gref_clean
  * @brief cleanup object. gref can be pool, acv, or idx.
@@ -249,8 +547,14 @@ int gref_append_link(
 	int32_t dst_ori);
 
 /**
- * @fn gref_append_snp
- * @brief not implemented yet (;_;)
+ * @fn gref_append_snp, gref_append_snp_batch
+ *
+ * @brief add an alternate allele (snp, in the seq_format of the pool) at pos on
+ * the segment. the allele is or-ed into the 4bit base, so that both alleles are
+ * enumerated as an ambiguous base without adding sections or links. requires
+ * GREF_COPY. gref_append_snp returns 0 on success; gref_append_snp_batch returns
+ * the number of records applied, which is less than cnt if a record is invalid.
+ * an undefined segment name is rejected without being added to the pool.
  */
 int gref_append_snp(
 	gref_pool_t *_pool,
@@ -258,10 +562,49 @@ int gref_append_snp(
 	int32_t name_len,
 	int64_t pos,
 	uint8_t snp);
+int64_t gref_append_snp_batch(
+	gref_pool_t *pool,
+	struct gref_snp_s const *snp,
+	int64_t cnt);
+
+/**
+ * @fn gref_merge_pools
+ *
+ * @brief append the segments and links of pool2 to pool1, used to merge pools
+ * filled in parallel (a pool is not thread-safe). both pools are consumed and
+ * the merged one is returned. fails (returns NULL) if the params differ (except
+ * for num_threads, hash_size, and lmm), or a segment is defined in both.
+ */
+gref_pool_t *gref_merge_pools(
+	gref_pool_t *pool1,
+	gref_pool_t *pool2);
+
+/**
+ * @fn gref_load_fasta
+ *
+ * @brief append all the records in a fasta file (plain or gzipped) as segments.
+ * the name is the header up to the first space; lines starting with ';' are
+ * skipped as comments. requires GREF_ASCII and GREF_COPY.
+ */
+int gref_load_fasta(
+	gref_pool_t *pool,
+	char const *path);
+
+/**
+ * @fn gref_load_gfa
+ *
+ * @brief append the S and L lines in a gfa file (plain or gzipped) as segments
+ * and links, the other lines are ignored. lines are parsed in num_threads threads.
+ * requires GREF_ASCII and GREF_COPY.
+ */
+int gref_load_gfa(
+	gref_pool_t *pool,
+	char const *path);
 
 /**
  * @fn gref_split_segment
- * @brief not implemented yet (;_;)
+ * @brief not implemented yet (;_;). meant for structural variants; use
+ * gref_append_snp for snvs.
  */
 int gref_split_segment(
 	gref_pool_t *_pool,
@@ -271,20 +614,28 @@ int gref_split_segment(
 	char const *splitted,
 	int32_t splitted_len);
 
-#if 0
 /**
- * @fn gref_load_index
+ * @fn gref_dump_index
+ * @brief dump acv or idx object to fp. returns 0 on success.
  */
-gref_idx_t *gref_load_index(
+int gref_dump_index(
+	gref_acv_t const *gref,
 	zf_t *fp);
 
 /**
- * @fn gref_dump_index
+ * @fn gref_load_index
+ * @brief load acv or idx object from fp (compressed files are also accepted).
  */
-int gref_dump_index(
-	gref_idx_t const *gref,
+gref_acv_t *gref_load_index(
 	zf_t *fp);
-#endif
+
+/**
+ * @fn gref_load_index_mmap
+ * @brief map uncompressed file dumped by gref_dump_index read-only and use
+ * the arrays in place. the mapping is released in gref_clean.
+ */
+gref_acv_t *gref_load_index_mmap(
+	char const *path);
 
 /**
  * @fn gref_iter_init, gref_iter_next, gref_iter_clean
@@ -302,6 +653,16 @@ gref_iter_t *gref_iter_init(
 gref_kmer_tuple_t gref_iter_next(
 	gref_iter_t *iter);
 
+/**
+ * @fn gref_iter_next_batch
+ * @brief fill buf with at most cap tuples, in the same order as gref_iter_next.
+ * returns the number of tuples stored, 0 at the end of the enumeration.
+ */
+int64_t gref_iter_next_batch(
+	gref_iter_t *iter,
+	gref_kmer_tuple_t *buf,
+	int64_t cap);
+
 /**
  * @fn gref_iter_clean
  */
@@ -320,6 +681,137 @@ struct gref_match_res_s gref_match_2bitpacked(
 	gref_idx_t const *gref,
 	uint64_t seq);
 
+/**
+ * @fn gref_match_get, gref_match_decode
+ *
+ * @brief gref_match_get returns the i-th entry of the match result,
+ * gref_match_decode copies all of them (res->len entries) to dst and returns
+ * the count. both work on either entry format.
+ */
+struct gref_gid_pos_s gref_match_get(
+	gref_idx_t const *gref,
+	struct gref_match_res_s const *res,
+	int64_t i);
+int64_t gref_match_decode(
+	gref_idx_t const *gref,
+	struct gref_match_res_s const *res,
+	struct gref_gid_pos_s *dst);
+
+/**
+ * @fn gref_match_in_range, gref_match_intersect
+ *
+ * @brief the entries in a bucket are in the (gid, pos) order. gref_match_in_range
+ * returns the entries of a 2bit-packed kmer on gid in [pos_lo, pos_hi), found
+ * with binary search. gref_match_intersect keeps the entries e of res[0] such
+ * that (e.gid, e.pos + dist[i]) is in res[i] for all i in [1, cnt), i.e. the
+ * hits on the same diagonal for kmers dist[i] bases apart on the query. the
+ * entries are stored in dst (res[0].len at most) and the count is returned.
+ */
+struct gref_match_res_s gref_match_in_range(
+	gref_idx_t const *gref,
+	uint64_t kmer,
+	uint32_t gid,
+	uint32_t pos_lo,
+	uint32_t pos_hi);
+int64_t gref_match_intersect(
+	gref_idx_t const *gref,
+	struct gref_match_res_s const *res,
+	int64_t const *dist,
+	int64_t cnt,
+	struct gref_gid_pos_s *dst);
+
+/**
+ * @fn gref_match_extend
+ *
+ * @brief extend a seed, the kmer at qpos on the (ascii) query hit at (gid, pos),
+ * to both sides along the graph, and store the maximal exact match in mem and
+ * the gids of the sections it runs through in path (path_cap at most). the
+ * longest extension is taken at the branches. graph bases match the query
+ * base they contain (e.g. those added by gref_append_snp). for a hit with .rv
+ * on a canonical index, pass (gid ^ 1, section length - pos - k). returns 0 on
+ * success, -1 if the seed does not match.
+ */
+int gref_match_extend(
+	gref_idx_t const *gref,
+	uint8_t const *query,
+	int64_t qlen,
+	int64_t qpos,
+	struct gref_gid_pos_s hit,
+	struct gref_mem_s *mem,
+	uint32_t *path,
+	int64_t path_cap);
+
+/**
+ * @fn gref_match_count, gref_match_count_2bitpacked
+ *
+ * @brief number of occurrences of the kmer, including those removed by the
+ * occurrence cap. the kmer table is not touched.
+ */
+int64_t gref_match_count(
+	gref_idx_t const *gref,
+	uint8_t const *seq);
+int64_t gref_match_count_2bitpacked(
+	gref_idx_t const *gref,
+	uint64_t seq);
+
+/**
+ * @fn gref_match_batch
+ *
+ * @brief lookup cnt 2bit-packed kmers at once, results are stored in res.
+ * bucket tables are prefetched in windows of GREF_MATCH_BATCH_SIZE kmers.
+ * returns cnt on success, -1 otherwise.
+ */
+#ifndef GREF_MATCH_BATCH_SIZE
+#define GREF_MATCH_BATCH_SIZE		( 32 )
+#endif
+int64_t gref_match_batch(
+	gref_idx_t const *gref,
+	uint64_t const *seq,
+	int64_t cnt,
+	struct gref_match_res_s *res);
+
+/**
+ * @fn gref_match_stream_init, gref_match_stream_next, gref_match_stream_clean
+ *
+ * @brief rolling matcher over a query. kmers containing ambiguous bases are
+ * skipped (the window restarts after them). lookups are done in batches with
+ * gref_match_batch.
+ */
+gref_match_stream_t *gref_match_stream_init(
+	gref_idx_t const *idx,
+	uint8_t const *seq,
+	int64_t len,
+	gref_match_stream_params_t const *params);
+gref_match_stream_res_t gref_match_stream_next(
+	gref_match_stream_t *stream);
+void gref_match_stream_clean(
+	gref_match_stream_t *stream);
+
+/**
+ * @fn gref_handle_init, gref_handle_acquire, gref_handle_release, gref_handle_publish, gref_handle_clean
+ *
+ * @brief epoch-based index swap. the handle owns the index. reader (in
+ * [0, reader_cnt)) is a slot private to the calling thread; the index returned
+ * by gref_handle_acquire stays valid until gref_handle_release on the same slot
+ * (acquires do not nest). gref_handle_publish swaps in idx, waits until the
+ * readers that may hold the previous one release it, and then cleans it;
+ * readers never block. returns 0 on success.
+ */
+gref_handle_t *gref_handle_init(
+	gref_idx_t *idx,
+	uint32_t reader_cnt);
+gref_idx_t const *gref_handle_acquire(
+	gref_handle_t *handle,
+	uint32_t reader);
+void gref_handle_release(
+	gref_handle_t *handle,
+	uint32_t reader);
+int gref_handle_publish(
+	gref_handle_t *handle,
+	gref_idx_t *idx);
+void gref_handle_clean(
+	gref_handle_t *handle);
+
 /**
  * @fn gref_get_section_count
  */
@@ -333,6 +825,23 @@ struct gref_section_s const *gref_get_section(
 	gref_acv_t const *gref,
 	uint32_t gid);
 
+/**
+ * @fn gref_get_packed_seq
+ * @brief seq is NULL unless the object is in the 2bit storage
+ */
+struct gref_packed_seq_s gref_get_packed_seq(
+	gref_acv_t const *gref);
+
+/**
+ * @fn gref_decode_section
+ * @brief copy 4bit codes of the section to dst (sec.len bytes), in any storage
+ * and direction. returns sec.len.
+ */
+int64_t gref_decode_section(
+	gref_acv_t const *gref,
+	uint32_t gid,
+	uint8_t *dst);
+
 /**
  * @fn gref_get_link
  */
@@ -347,6 +856,33 @@ struct gref_str_s gref_get_name(
 	gref_t const *gref,
 	uint32_t gid);
 
+/**
+ * @fn gref_graph_init, gref_graph_clean, gref_graph_get_section, gref_graph_get_link, gref_graph_get_name
+ * @brief read-only flat view of an archive or an index (see gref_graph_s),
+ * without the hashmap lookups of gref_get_*. the batch accessors fill dst[i]
+ * for gid[i], and return cnt or -1 if a gid is out of range. the view can be
+ * shared among threads.
+ */
+gref_graph_t *gref_graph_init(
+	gref_acv_t const *gref);
+void gref_graph_clean(
+	gref_graph_t *graph);
+int64_t gref_graph_get_section(
+	gref_graph_t const *graph,
+	uint32_t const *gid,
+	int64_t cnt,
+	struct gref_section_s *dst);
+int64_t gref_graph_get_link(
+	gref_graph_t const *graph,
+	uint32_t const *gid,
+	int64_t cnt,
+	struct gref_link_s *dst);
+int64_t gref_graph_get_name(
+	gref_graph_t const *graph,
+	uint32_t const *gid,
+	int64_t cnt,
+	struct gref_str_s *dst);
+
 #if 0
 /* deprecated */
 /**
@@ -369,6 +905,67 @@ uint8_t const *gref_get_lim(
 	gref_t const *gref);
 #define gref_rev_ptr(ptr, lim)		( (uint8_t const *)(lim) + (uint64_t)(lim) - (uint64_t)(ptr) - 1 )
 
+/**
+ * @enum gref_phase
+ * @brief index of gref_stats_s.phase_sec. the first two are recorded in
+ * gref_freeze_pool, the others in gref_build_index.
+ */
+enum gref_phase {
+	GREF_PHASE_SEQ				= 0,	/* sequence rearrangement and 2bit packing */
+	GREF_PHASE_LINK				= 1,	/* link table */
+	GREF_PHASE_ENUMERATE		= 2,	/* kmer enumeration (both passes in GREF_BUILD_COUNT) */
+	GREF_PHASE_SORT				= 3,	/* GREF_BUILD_SORT only */
+	GREF_PHASE_KMER_TABLE		= 4,	/* kmer index and kmer table */
+	GREF_PHASE_CAP				= 5,	/* duplicate removal and occurrence cap */
+	GREF_PHASE_PACK				= 6,	/* entry packing */
+	GREF_PHASE_PLACE			= 7,	/* move to params.table_mem */
+	GREF_PHASE_CNT				= 8
+};
+
+/**
+ * @struct gref_stats_s
+ * @brief memory usage and build profile. the phase times and the iterator
+ * maxima are recorded only if gref.c is compiled with GREF_STATS defined,
+ * otherwise they are left zero.
+ */
+#define GREF_STATS_HIST_SIZE		( 32 )
+struct gref_stats_s {
+	/* bytes held by each structure, zero if absent */
+	uint64_t seq_bytes;				/* byte sequence, or 2bit array and exceptions */
+	uint64_t link_bytes;			/* link vector (pool) or link_table */
+	uint64_t kmer_idx_bytes;		/* kmer_idx_table, or sb, rel, and esc tables */
+	uint64_t kmer_table_bytes;
+	uint64_t hmap_bytes;			/* section objects and names (estimated) */
+	uint64_t aux_bytes;				/* incremental delta and occurrence mask */
+	uint64_t total_bytes;
+
+	/* counts */
+	int64_t sec_cnt;
+	int64_t link_cnt;
+	int64_t seq_len;
+	int64_t kmer_cnt;				/* entries in the kmer table */
+	int64_t dup_cnt;				/* repeated occurrences removed at the build */
+	int64_t bucket_cnt;				/* non-empty buckets */
+	int64_t max_bucket_size;
+	int64_t bucket_hist[GREF_STATS_HIST_SIZE];	/* buckets with [2^i, 2^(i+1)) entries */
+
+	/* iterator maxima over the kmer enumerations of gref_build_index */
+	uint32_t max_stack_depth;		/* sections on the stack */
+	uint32_t max_expansion;			/* variants of a kmer by ambiguous bases */
+
+	/* wall time in seconds */
+	double phase_sec[GREF_PHASE_CNT];
+};
+
+/**
+ * @fn gref_get_stats
+ * @brief fill stats. the bucket distribution is computed on the kmer index,
+ * scanning all the 4^k buckets. returns 0 on success.
+ */
+int gref_get_stats(
+	gref_t const *gref,
+	struct gref_stats_s *stats);
+
 #if 0
 /**
  * @fn gref_is_amb